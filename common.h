@@ -15,6 +15,15 @@
 #include "backlight_control.h"
 #include "speaker_control.h"
 #include "lrf_serial_comm.h"
+#include "sample_queue.h"
+#include "sample_logger.h"
+#include "sample_store.h"
+#include "order_stat_tree.h"
+#include "dist_graph.h"
+#include "dist_histogram.h"
+#include "sample_timing.h"
+#include "track_filter.h"
+#include "track_assoc.h"
 
 
 
@@ -32,6 +41,10 @@
 #define NO_DISTANCE_DISPLAY -2	/* This distance will be displayed as a blank */
 
 #define AUTO_RESTART 0x80
+#define ADAPTIVE_COOLOFF 0x40
+#define LRF_COMMAND_MASK 0x3f	/* Sampling mode bits of the LRF command */
+
+#define BUF_TRACKING INT16_MIN	/* Buffering setting of the tracking mode */
 
 #define NB_HEX_VALS_IN_PASSTHRU_SCREEN 90	/* 7 lines of 13 hex values,
 						   minus 1 for the left arrow */
@@ -44,6 +57,7 @@
 extern const char *config_file;
 extern const char *smm_pfx_config_definition_file;
 extern const char *dsp_files_dir;
+extern const char *sample_log_files_dir;
 
 /** Submenu item names **/
 extern const char *submenu_item_names[];
@@ -60,6 +74,19 @@ extern const int16_t config_buf_values[];
 extern const char *config_buf_names[];
 extern const uint8_t nb_config_buf_values;
 
+/** Statistic setting parameters **/
+extern const char *config_stat_label;
+extern const uint8_t config_stat_values[];
+extern const char *config_stat_names[];
+extern const char *config_stat_symbols[];
+extern const uint8_t nb_config_stat_values;
+
+/** Targets setting parameters **/
+extern const char *config_targets_label;
+extern const uint8_t config_targets_values[];
+extern const char *config_targets_names[];
+extern const uint8_t nb_config_targets_values;
+
 /** Beep setting parameters **/
 extern const char *config_beep_label;
 extern const uint8_t config_beep_values[];
@@ -85,6 +112,14 @@ extern const uint8_t nb_config_smm_pfx_values;
 /** UART receive timeout **/
 extern const uint16_t uart_rx_timeout;
 
+/** UART receive thread wakeup conditions **/
+extern const uint16_t uart_rx_wakeup_threshold;
+extern const uint16_t uart_rx_wakeup_timeout;
+
+/** LRF command response timeout and retries **/
+extern const uint16_t lrf_cmd_resp_timeout;
+extern const uint8_t lrf_cmd_max_retries;
+
 /** Speaker parameters **/
 extern const uint16_t beep_frequency;
 extern const uint16_t sample_received_beep_duration;
@@ -92,9 +127,40 @@ extern const uint16_t sample_received_beep_duration;
 /** LED parameters **/
 extern const uint16_t min_led_flash_duration;
 
+/** Automatic SMM scheduler timings **/
+extern const uint16_t smm_cooloff;
+extern const uint16_t smm_error_cooloff;
+extern const uint16_t smm_min_cooloff;
+extern const uint16_t smm_cooloff_step;
+extern const uint16_t smm_resp_timeout;
+
+/** Burst SMM parameters **/
+extern const uint16_t burst_smm_nb_shots;
+extern const uint8_t burst_smm_pipeline_depth;
+
 /** Sample view timings **/
 extern const uint16_t sample_view_update_every;
 extern const uint8_t sample_view_smm_prefix_enabled_blink_every;
+extern const uint16_t sample_view_avg_recompute_every;
+
+/** Tracking filter parameters **/
+extern const float track_filter_accel_noise;
+extern const float track_filter_meas_noise;
+extern const float track_filter_gate;
+extern const uint8_t track_filter_max_misses;
+
+/** Target association parameters **/
+extern const float track_assoc_gate;
+extern const uint8_t track_assoc_max_misses;
+
+/** Serial link load parameters **/
+extern const uint8_t lrf_cmm_frame_len;
+extern const uint8_t uart_bits_per_byte;
+
+/** Histogram view parameters **/
+extern const uint16_t histogram_view_update_every;
+extern const uint32_t histogram_bin_widths_cm[];
+extern const uint8_t nb_histogram_bin_widths;
 
 /** Test laser view timings **/
 extern const uint16_t test_laser_view_update_every;
@@ -147,13 +213,71 @@ typedef enum {
   /* About view */
   submenu_about = 9,
 
+  /* Link statistics view - items added after the About view are numbered
+     after it, as the last selected item is saved in the configuration file */
+  submenu_linkstats = 10,
+
+  /* Histogram view */
+  submenu_histogram = 11,
+
   /* Total number of items */
-  total_submenu_items = 10,
+  total_submenu_items = 12,
 
 } SubmenuIndex;
 
 
 
+/** Statistics calculated from the buffered distances **/
+typedef enum {
+
+  /* Mean */
+  stat_mean = 0,
+
+  /* Median */
+  stat_median = 1,
+
+  /* 10% trimmed mean */
+  stat_trimmed_mean = 2,
+
+  /* Mean and standard deviation */
+  stat_mean_sd = 3,
+
+} SampleStatistic;
+
+
+
+/** Assignments of the distances returned by the LRF to the targets **/
+typedef enum {
+
+  /* In the order the LRF returns them */
+  targets_slots = 0,
+
+  /* Associated with persistent target tracks */
+  targets_tracked = 1,
+
+} TargetAssignment;
+
+
+
+/** Sample view screens **/
+typedef enum {
+
+  /* Distances, amplitudes and spreads */
+  sample_screen_dists = 0,
+
+  /* Graph of the distances over time */
+  sample_screen_graph = 1,
+
+  /* Sample timing statistics */
+  sample_screen_timing = 2,
+
+  /* Total number of screens */
+  total_sample_screens = 3,
+
+} SampleScreen;
+
+
+
 /** Saved configuration values **/
 typedef struct {
 
@@ -178,6 +302,12 @@ typedef struct {
   /* Last selected submenu item */
   uint8_t sitem;
 
+  /* Statistic setting */
+  uint8_t stat;
+
+  /* Targets setting */
+  uint8_t targets;
+
 } Config;
 
 
@@ -198,13 +328,57 @@ typedef struct {
 
 
 
+/** Sample view display snapshot: the values computed by the sample
+    processing thread that the sample view displays **/
+typedef struct {
+
+  /* Displayed distances and amplitudes */
+  LRFSample sample;
+
+  /* Displayed spreads of the distances */
+  float spread1;
+  float spread2;
+  float spread3;
+
+  /* Displayed radial velocities of the targets in tracking mode */
+  float vel1;
+  float vel2;
+  float vel3;
+
+  /* Displayed effective sampling frequency */
+  double eff_freq;
+
+  /* Displayed return rate */
+  double return_rate;
+
+  /* Time span of and number of samples in the ring buffer */
+  double samples_time_span;
+  uint16_t nb_samples;
+
+  /* Statistics of the intervals between the arrival times of the samples */
+  SampleTiming sample_timing;
+
+  /* Distance graph */
+  DistGraphDisp graph;
+
+} SampleDisp;
+
+
+
 /** Sample view model **/
 typedef struct {
 
   Config *config;
 
+  /* Queue of LRF samples waiting to be processed */
+  SampleQueue sample_queue;
+
+  /* Sample processing thread and its ID */
+  FuriThread *sample_thread;
+  FuriThreadId sample_thread_id;
+
   /* LRF sample ring buffer */
-  LRFSample *samples;
+  SampleStore sample_store;
   uint16_t max_samples;
   uint16_t samples_start_i;
   uint16_t samples_end_i;
@@ -212,26 +386,125 @@ typedef struct {
   /* Number of samples in the ring buffer */
   uint16_t nb_samples;
 
+  /* Timestamps of the oldest and newest samples in the ring buffer in
+     microseconds. The packed samples only hold the time elapsed since the
+     previous sample */
+  uint64_t oldest_tstamp_us;
+  uint64_t newest_tstamp_us;
+
   /* Time difference between the oldest and newest samples in the ring buffer */
   double samples_time_span;
 
+  /* Averaging window: the newest samples in the ring buffer corresponding
+     strictly to the configured buffering setting */
+  uint16_t avg_start_i;
+  uint16_t nb_avg_samples;
+
+  /* Timestamp of the oldest sample in the averaging window */
+  uint64_t avg_start_tstamp_us;
+
+  /* Running sums of the valid distances and amplitudes in the averaging
+     window, and number of valid distances */
+  float sum_dist1;
+  float sum_dist2;
+  float sum_dist3;
+  uint32_t sum_ampl1;
+  uint32_t sum_ampl2;
+  uint32_t sum_ampl3;
+  uint16_t nb_valid_dist1;
+  uint16_t nb_valid_dist2;
+  uint16_t nb_valid_dist3;
+  uint16_t nb_valid_any_dist;
+
+  /* Running sums of the deviations of the valid distances in the averaging
+     window from reference distances, and of their squares */
+  float ref_dist1;
+  float ref_dist2;
+  float ref_dist3;
+  float sum_dev1;
+  float sum_dev2;
+  float sum_dev3;
+  float sum_sq_dev1;
+  float sum_sq_dev2;
+  float sum_sq_dev3;
+
+  /* Number of samples since the running sums were last recomputed */
+  uint16_t nb_samples_since_avg_recompute;
+
+  /* Whether the valid distances in the averaging window are kept in
+     order-statistic trees, and the trees */
+  bool use_dist_trees;
+  OrderStatTree dist1_tree;
+  OrderStatTree dist2_tree;
+  OrderStatTree dist3_tree;
+
   /* Flag to indicate the ring buffer should be reset */
   bool flush_samples;
 
-  /* Displayed distances and amplitudes */
+  /* Distances and amplitudes to display */
   LRFSample disp_sample;
 
-  /* Displayed effective sampling frequency */
+  /* Spreads of the distances to display */
+  float disp_spread1;
+  float disp_spread2;
+  float disp_spread3;
+
+  /* Target associator */
+  TrackAssoc track_assoc;
+
+  /* Tracking filter and radial velocities of the targets to display in
+     tracking mode */
+  TrackFilter track_filter;
+  float disp_vel1;
+  float disp_vel2;
+  float disp_vel3;
+
+  /* Effective sampling frequency to display */
   double eff_freq;
 
-  /* Displayed return rate */
+  /* Return rate to display */
   double return_rate;
 
+  /* Display snapshots published by the sample processing thread, and
+     generation counter of the latest one, which is in disp_snapshots[disp_gen
+     & 1]. The other one is the next one being written */
+  SampleDisp disp_snapshots[2];
+  uint32_t disp_gen;
+
+  /* Generation of the display snapshot last drawn by the update timer */
+  uint32_t drawn_disp_gen;
+
+  /* Copy of the latest display snapshot being drawn */
+  SampleDisp disp;
+
   /* Whether continuous measurement is started */
   bool continuous_meas_started;
 
-  /* Flag to indicate whether the sample data was updated */
-  bool samples_updated;
+  /* Automatic SMM scheduler: timer triggering the next SMM command or
+     expiring the response to the last one, whether a measurement is
+     outstanding, and current cool-off time between measurements */
+  FuriTimer *smm_timer;
+  bool smm_outstanding;
+  uint16_t smm_cooloff_ms;
+
+  /* Number of measurements since automatic single measurement started and
+     timestamp of the first one, to work out the achieved measurement
+     rate */
+  uint32_t nb_smm_meas;
+  uint64_t first_smm_tstamp_us;
+
+  /* Number of quick SMM shots of the current burst queued, done and
+     failed */
+  uint16_t nb_burst_shots_queued;
+  uint16_t nb_burst_shots_done;
+  uint16_t nb_burst_shots_failed;
+
+  /* Smallest, largest and sum of the latencies of the quick SMM shots of the
+     current burst the LRF responded to - from the end of the command to the
+     response - in microseconds */
+  uint32_t burst_min_latency_us;
+  uint32_t burst_max_latency_us;
+  uint64_t burst_sum_latency_us;
 
   /* Whether the OK button symbol should be displayed in reverse video */
   bool symbol_reversed;
@@ -242,6 +515,28 @@ typedef struct {
   /* Whether the pointer is on or off */
   bool pointer_is_on;
 
+  /* LRF identification, used to name the log files */
+  LRFIdent ident;
+
+  /* Whether we have a valid identification */
+  bool has_ident;
+
+  /* Logger to record the raw samples to the SD card, and its displayed
+     statistics */
+  SampleLogger sample_logger;
+  SampleLoggerStats log_stats;
+
+  /* Displayed screen */
+  uint8_t screen;
+
+  /* Graph of the distances over time, and number of targets the user wants
+     displayed in it */
+  DistGraph dist_graph;
+  uint8_t graph_nb_targets;
+
+  /* Statistics of the intervals between the arrival times of the samples */
+  SampleTiming sample_timing;
+
   /* Scratchpad string */
   char spstr[32];
 
@@ -249,6 +544,42 @@ typedef struct {
 
 
 
+/** Histogram view model **/
+typedef struct {
+
+  /* Queue of LRF samples waiting to be added to the histogram, allocated
+     while the view is active */
+  SampleQueue *sample_queue;
+
+  /* Histogram processing thread and its ID */
+  FuriThread *histogram_thread;
+  FuriThreadId histogram_thread_id;
+
+  /* Histogram of the distances of the samples received */
+  DistHistogram histogram;
+
+  /* Mutex to access the histogram above */
+  FuriMutex *histogram_mutex;
+
+  /* Copy of the histogram above to draw */
+  DistHistogram disp_histogram;
+
+  /* Target associator */
+  TrackAssoc track_assoc;
+
+  /* Width of the bins, as an index in the histogram bin widths */
+  uint8_t bin_width_i;
+
+  /* Flag to indicate whether the histogram was updated */
+  bool histogram_updated;
+
+  /* Scratchpad string */
+  char spstr[24];
+
+} HistogramModel;
+
+
+
 /** LRF info view model **/
 typedef struct {
 
@@ -274,8 +605,8 @@ typedef struct {
 /** Test boot time view model **/
 typedef struct {
 
-  /* Time at which the LRF was powered on */
-  uint32_t power_on_tstamp;
+  /* Time at which the LRF was powered on in microseconds */
+  uint64_t power_on_tstamp_us;
 
   /* Whether we're waiting for a boot string */
   bool await_boot_info;
@@ -455,6 +786,25 @@ typedef struct {
 
 
 
+/** Link statistics view model **/
+typedef struct {
+
+  /* Serial link statistics */
+  LRFLinkStats stats;
+
+  /* Sample queue statistics */
+  SampleQueueStats sample_queue_stats;
+
+  /* Displayed screen number */
+  uint8_t screen;
+
+  /* Scratchpad string */
+  char spstr[16];
+
+} LinkStatsModel;
+
+
+
 /** About view model **/
 typedef struct {
 
@@ -470,9 +820,9 @@ typedef struct {
 
   /* Large storage space shared between various parts of the app, because
      the Flipper Zero doesn't have enough memory for separate storage areas.
-     Should be large enough to hold 2000 LRFSample samples (and then some)
+     Should be large enough to hold 2000 packed LRF samples (and then some)
      or a full LRF diagnostic frame */
-  uint8_t shared_storage[60000];	/* Holds 2500 samples */
+  uint8_t shared_storage[60000];	/* Holds 3529 packed samples */
 
   /* Saved configuration values */
   Config config;
@@ -490,6 +840,8 @@ typedef struct {
   VariableItemList *config_list;
   VariableItem *item_mode;
   VariableItem *item_buf;
+  VariableItem *item_stat;
+  VariableItem *item_targets;
   VariableItem *item_beep;
   VariableItem *item_baudrate;
   VariableItem *item_passthru_chan;
@@ -498,6 +850,9 @@ typedef struct {
   /* Sample view */
   View *sample_view;
 
+  /* Histogram view */
+  View *histogram_view;
+
   /* LRF info view */
   View *lrfinfo_view;
 
@@ -516,12 +871,18 @@ typedef struct {
   /* USB serial passthrough pointer view */
   View *passthru_view;
 
+  /* Link statistics view */
+  View *linkstats_view;
+
   /* About view  */
   View *about_view;
 
   /* Timer to update the sample view */
   FuriTimer *sample_view_timer;
 
+  /* Timer to update the histogram view */
+  FuriTimer *histogram_view_timer;
+
   /* Timer to update the test laser view */
   FuriTimer *test_laser_view_timer;
 
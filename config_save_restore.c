@@ -6,6 +6,7 @@
 ***/
 
 /*** Includes ***/
+#include <stddef.h>
 #include <storage/storage.h>
 #include <gui/view.h>
 
@@ -26,8 +27,8 @@ void load_configuration(App *app) {
   SMMPfxConfig read_smm_pfx_config;
   bool file_read;
   uint16_t bytes_read = 0;
-  uint8_t mode_idx, buf_idx, beep_idx, baudrate_idx, passthru_chan_idx,
-		smm_pfx_idx;
+  uint8_t mode_idx, buf_idx, stat_idx, targets_idx, beep_idx, baudrate_idx,
+		passthru_chan_idx, smm_pfx_idx;
   uint8_t i;
 
   /* Open storage */
@@ -152,12 +153,22 @@ void load_configuration(App *app) {
     return;
 
   /* If we didn't read enough bytes, give up */
-  if(bytes_read < sizeof(Config)) {
+  if(bytes_read < offsetof(Config, stat)) {
     FURI_LOG_I(TAG, "Read %d bytes from config file %s but %d expected",
 			bytes_read, config_file, sizeof(Config));
     return;
   }
 
+  /* Configuration files saved before the statistic setting existed end with
+     an undefined padding byte where the statistic setting is now, and don't
+     have the targets setting: use the default settings. Files saved with
+     the statistic setting but before the targets setting existed are the
+     same size, so they get the default statistic setting too */
+  if(bytes_read <= offsetof(Config, targets)) {
+    read_config.stat = config_stat_values[0];
+    read_config.targets = config_targets_values[0];
+  }
+
   /* Check that the sampling mode setting exists */
   for(mode_idx = 0; mode_idx < nb_config_mode_values &&
 			read_config.mode != config_mode_values[mode_idx];
@@ -180,6 +191,28 @@ void load_configuration(App *app) {
     return;
   }
 
+  /* Check that the statistic setting exists */
+  for(stat_idx = 0; stat_idx < nb_config_stat_values &&
+			read_config.stat != config_stat_values[stat_idx];
+	stat_idx++);
+
+  if(stat_idx >= nb_config_stat_values) {
+    FURI_LOG_I(TAG, "Invalid statistic value %d in config file %s",
+			read_config.stat, config_file);
+    return;
+  }
+
+  /* Check that the targets setting exists */
+  for(targets_idx = 0; targets_idx < nb_config_targets_values &&
+			read_config.targets != config_targets_values[targets_idx];
+	targets_idx++);
+
+  if(targets_idx >= nb_config_targets_values) {
+    FURI_LOG_I(TAG, "Invalid targets value %d in config file %s",
+			read_config.targets, config_file);
+    return;
+  }
+
   /* Check that the beep option exists */
   for(beep_idx = 0; beep_idx < nb_config_beep_values &&
 			read_config.beep != config_beep_values[beep_idx];
@@ -250,6 +283,21 @@ void load_configuration(App *app) {
 					config_buf_names[buf_idx]);
   FURI_LOG_I(TAG, "  %s: %s", config_buf_label, config_buf_names[buf_idx]);
 
+  /* Configure the statistic setting from the read value */
+  app->config.stat = read_config.stat;
+  variable_item_set_current_value_index(app->item_stat, stat_idx);
+  variable_item_set_current_value_text(app->item_stat,
+					config_stat_names[stat_idx]);
+  FURI_LOG_I(TAG, "  %s: %s", config_stat_label, config_stat_names[stat_idx]);
+
+  /* Configure the targets setting from the read value */
+  app->config.targets = read_config.targets;
+  variable_item_set_current_value_index(app->item_targets, targets_idx);
+  variable_item_set_current_value_text(app->item_targets,
+					config_targets_names[targets_idx]);
+  FURI_LOG_I(TAG, "  %s: %s", config_targets_label,
+		config_targets_names[targets_idx]);
+
   /* Configure the beep option from the read value */
   app->config.beep = read_config.beep;
   variable_item_set_current_value_index(app->item_beep, beep_idx);
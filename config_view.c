@@ -49,6 +49,42 @@ void config_buf_change(VariableItem *item) {
 
 
 
+/** Statistic setting change function **/
+void config_stat_change(VariableItem *item) {
+
+  App *app = variable_item_get_context(item);
+  uint8_t idx;
+
+  /* Get the new statistic setting item index */
+  idx = variable_item_get_current_value_index(item);
+
+  /* Set the new statistic setting */
+  app->config.stat = config_stat_values[idx];
+  variable_item_set_current_value_text(item, config_stat_names[idx]);
+
+  FURI_LOG_D(TAG, "Statistic setting change: %s", config_stat_names[idx]);
+}
+
+
+
+/** Targets setting change function **/
+void config_targets_change(VariableItem *item) {
+
+  App *app = variable_item_get_context(item);
+  uint8_t idx;
+
+  /* Get the new targets setting item index */
+  idx = variable_item_get_current_value_index(item);
+
+  /* Set the new targets setting */
+  app->config.targets = config_targets_values[idx];
+  variable_item_set_current_value_text(item, config_targets_names[idx]);
+
+  FURI_LOG_D(TAG, "Targets setting change: %s", config_targets_names[idx]);
+}
+
+
+
 /** Beep option change function **/
 void config_beep_change(VariableItem *item) {
 
@@ -18,6 +18,12 @@ void config_mode_change(VariableItem *);
 /** Buffering setting change function **/
 void config_buf_change(VariableItem *);
 
+/** Statistic setting change function **/
+void config_stat_change(VariableItem *);
+
+/** Targets setting change function **/
+void config_targets_change(VariableItem *);
+
 /** Beep option change function **/
 void config_beep_change(VariableItem *);
 
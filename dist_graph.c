@@ -0,0 +1,318 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Distance graph
+***/
+
+/*** Includes ***/
+#include "dist_graph.h"
+
+
+
+/*** Routines ***/
+
+/** Convert a valid distance in meters into centimeters. Invalid distances
+    are returned as 0 **/
+static uint32_t dist_to_cm(float dist) {
+
+  if(dist <= 0.5f)
+    return 0;
+
+  return (uint32_t)(dist * 100 + 0.5f);
+}
+
+
+
+/** Empty a column **/
+static void clear_column(DistGraph *graph, uint8_t i) {
+
+  uint8_t t;
+
+  for(t = 0; t < 3; t++) {
+    graph->columns[i].min_cm[t] = UINT32_MAX;
+    graph->columns[i].max_cm[t] = 0;
+    graph->spans[i][t].top = 0xff;
+    graph->spans[i][t].bottom = 0;
+  }
+}
+
+
+
+/** Find the smallest and largest distances of the displayed targets in all
+    the columns **/
+static void rescan_min_max(DistGraph *graph) {
+
+  uint8_t i, n, t;
+
+  graph->min_cm = UINT32_MAX;
+  graph->max_cm = 0;
+
+  for(i = graph->newest_i, n = 0; n < graph->nb_columns;
+	i = (i - 1) & (DIST_GRAPH_WIDTH - 1), n++)
+    for(t = 0; t < graph->nb_targets; t++) {
+      if(graph->columns[i].min_cm[t] < graph->min_cm)
+        graph->min_cm = graph->columns[i].min_cm[t];
+      if(graph->columns[i].max_cm[t] > graph->max_cm)
+        graph->max_cm = graph->columns[i].max_cm[t];
+    }
+}
+
+
+
+/** Adjust the displayed range to the smallest and largest distances in the
+    graph if they don't fit in it, or if they only fill a small part of it.
+    The range has margins above and below the distances, so it doesn't change
+    with every new sample
+    Returns true if the displayed range has changed **/
+static bool update_range(DistGraph *graph, bool force) {
+
+  uint32_t dist_range, range, margin;
+
+  if(graph->min_cm > graph->max_cm)
+    return false;
+
+  dist_range = graph->max_cm - graph->min_cm;
+  range = dist_range + dist_range / 4;
+  if(range < DIST_GRAPH_MIN_RANGE_CM)
+    range = DIST_GRAPH_MIN_RANGE_CM;
+
+  if(!force && graph->min_cm >= graph->range_min_cm &&
+	graph->max_cm <= graph->range_max_cm &&
+	graph->range_max_cm - graph->range_min_cm <= 2 * range)
+    return false;
+
+  margin = (range - dist_range) / 2;
+  graph->range_min_cm = graph->min_cm >= margin? graph->min_cm - margin : 0;
+  graph->range_max_cm = graph->range_min_cm + range;
+
+  return true;
+}
+
+
+
+/** Convert a distance within the displayed range into a y coordinate **/
+static uint8_t dist_to_y(DistGraph *graph, uint32_t dist_cm) {
+
+  return DIST_GRAPH_HEIGHT - 1 - (uint64_t)(dist_cm - graph->range_min_cm) *
+				(DIST_GRAPH_HEIGHT - 1) /
+				(graph->range_max_cm - graph->range_min_cm);
+}
+
+
+
+/** Work out the spans of pixels of a column in the displayed range **/
+static void render_column(DistGraph *graph, uint8_t i) {
+
+  uint8_t t;
+
+  for(t = 0; t < 3; t++)
+    if(graph->columns[i].min_cm[t] <= graph->columns[i].max_cm[t]) {
+      graph->spans[i][t].top = dist_to_y(graph, graph->columns[i].max_cm[t]);
+      graph->spans[i][t].bottom = dist_to_y(graph,
+						graph->columns[i].min_cm[t]);
+    }
+}
+
+
+
+/** Work out the spans of pixels of all the columns in the displayed range **/
+static void render_all_columns(DistGraph *graph) {
+
+  uint8_t i, n;
+
+  for(i = graph->newest_i, n = 0; n < graph->nb_columns;
+	i = (i - 1) & (DIST_GRAPH_WIDTH - 1), n++)
+    render_column(graph, i);
+}
+
+
+
+/** Start new columns, scrolling the oldest columns out of the graph **/
+static void advance_columns(DistGraph *graph, uint32_t nb) {
+
+  bool rescan = false;
+  uint8_t i, t;
+
+  graph->newest_column_nb += nb;
+  graph->nb_samples_in_column = 0;
+
+  if(nb > DIST_GRAPH_WIDTH)
+    nb = DIST_GRAPH_WIDTH;
+
+  for(; nb; nb--) {
+
+    i = (graph->newest_i + 1) & (DIST_GRAPH_WIDTH - 1);
+    graph->newest_i = i;
+
+    /* If the column scrolling out of the graph holds the smallest or largest
+       distance, the other columns need rescanning */
+    if(graph->nb_columns == DIST_GRAPH_WIDTH) {
+      for(t = 0; t < graph->nb_targets; t++)
+        if(graph->columns[i].min_cm[t] == graph->min_cm ||
+		graph->columns[i].max_cm[t] == graph->max_cm)
+          rescan = true;
+    }
+
+    else
+      graph->nb_columns++;
+
+    clear_column(graph, i);
+  }
+
+  if(rescan)
+    rescan_min_max(graph);
+}
+
+
+
+/** Setup a distance graph for the buffering setting, covering the buffering
+    time, or at least the buffered number of samples with one sample per
+    column, and empty it **/
+void dist_graph_init(DistGraph *graph, int16_t buf, uint8_t nb_targets) {
+
+  graph->span_ms = buf > 0? buf * 1000 : 0;
+  graph->samples_per_column = buf < 0? (-buf + DIST_GRAPH_WIDTH - 1) /
+						DIST_GRAPH_WIDTH : 1;
+  graph->nb_targets = nb_targets;
+
+  dist_graph_reset(graph);
+}
+
+
+
+/** Empty a distance graph **/
+void dist_graph_reset(DistGraph *graph) {
+
+  graph->newest_i = 0;
+  graph->nb_columns = 0;
+  graph->nb_samples_in_column = 0;
+  graph->newest_column_nb = 0;
+  graph->min_cm = UINT32_MAX;
+  graph->max_cm = 0;
+  graph->range_min_cm = 0;
+  graph->range_max_cm = DIST_GRAPH_MIN_RANGE_CM;
+}
+
+
+
+/** Set the number of targets displayed in a distance graph - 1 or 3 **/
+void dist_graph_set_targets(DistGraph *graph, uint8_t nb_targets) {
+
+  graph->nb_targets = nb_targets;
+
+  rescan_min_max(graph);
+  if(update_range(graph, true))
+    render_all_columns(graph);
+}
+
+
+
+/** Add a LRF sample to a distance graph **/
+void dist_graph_add_sample(DistGraph *graph, LRFSample *sample) {
+
+  DistGraphColumn *column;
+  uint32_t dists_cm[3];
+  uint32_t column_nb;
+  uint8_t t;
+
+  /* The first sample starts the first column */
+  if(!graph->nb_columns) {
+    graph->start_tstamp_us = sample->tstamp_us;
+    graph->newest_i = DIST_GRAPH_WIDTH - 1;
+    advance_columns(graph, 1);
+    graph->newest_column_nb = 0;
+  }
+
+  /* Do the columns cover a set amount of time? If so, start as many new
+     columns as needed to reach the sample's column. Columns without samples
+     show as gaps */
+  else if(graph->span_ms) {
+    column_nb = (sample->tstamp_us - graph->start_tstamp_us) *
+			DIST_GRAPH_WIDTH / (graph->span_ms * 1000ULL);
+    if(column_nb > graph->newest_column_nb)
+      advance_columns(graph, column_nb - graph->newest_column_nb);
+  }
+
+  /* The columns cover a set number of samples: start a new column if the
+     newest column is full */
+  else if(graph->nb_samples_in_column >= graph->samples_per_column)
+    advance_columns(graph, 1);
+
+  graph->nb_samples_in_column++;
+
+  /* Add the sample's valid distances to the newest column, and keep track
+     of the smallest and largest distances of the displayed targets */
+  column = &graph->columns[graph->newest_i];
+
+  dists_cm[0] = dist_to_cm(sample->dist1);
+  dists_cm[1] = dist_to_cm(sample->dist2);
+  dists_cm[2] = dist_to_cm(sample->dist3);
+
+  for(t = 0; t < 3; t++) {
+
+    if(!dists_cm[t])
+      continue;
+
+    if(dists_cm[t] < column->min_cm[t])
+      column->min_cm[t] = dists_cm[t];
+    if(dists_cm[t] > column->max_cm[t])
+      column->max_cm[t] = dists_cm[t];
+
+    if(t < graph->nb_targets) {
+      if(dists_cm[t] < graph->min_cm)
+        graph->min_cm = dists_cm[t];
+      if(dists_cm[t] > graph->max_cm)
+        graph->max_cm = dists_cm[t];
+    }
+  }
+
+  /* If the displayed range has changed, all the columns need redrawing.
+     Otherwise only the newest column does */
+  if(update_range(graph, false))
+    render_all_columns(graph);
+  else
+    render_column(graph, graph->newest_i);
+}
+
+
+
+/** Get the ring buffer index of the column drawn at a given x coordinate,
+    the newest column being drawn at the right-hand side
+    Returns -1 if there is no column at that position **/
+int16_t dist_graph_column_at(DistGraph *graph, uint8_t x) {
+
+  uint8_t age = DIST_GRAPH_WIDTH - 1 - x;
+
+  if(age >= graph->nb_columns)
+    return -1;
+
+  return (graph->newest_i - age) & (DIST_GRAPH_WIDTH - 1);
+}
+
+
+
+/** Copy what's drawn of a distance graph **/
+void dist_graph_get_disp(DistGraph *graph, DistGraphDisp *disp) {
+
+  int16_t i;
+  uint8_t x, t;
+
+  for(x = 0; x < DIST_GRAPH_WIDTH; x++) {
+
+    i = dist_graph_column_at(graph, x);
+
+    for(t = 0; t < graph->nb_targets; t++)
+      if(i < 0) {
+        disp->spans[x][t].top = 1;
+        disp->spans[x][t].bottom = 0;
+      }
+      else
+        disp->spans[x][t] = graph->spans[i][t];
+  }
+
+  disp->nb_targets = graph->nb_targets;
+  disp->has_dists = graph->min_cm <= graph->max_cm;
+  disp->range_min_cm = graph->range_min_cm;
+  disp->range_max_cm = graph->range_max_cm;
+}
@@ -0,0 +1,141 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Distance graph
+ *
+ * Scrolling strip chart of the distances over the last samples or seconds,
+ * with no dependency on the Flipper Zero firmware. Each column of the graph
+ * holds the smallest and largest distances of the samples that fell into it,
+ * and the vertical spans of pixels to draw for them are worked out as the
+ * samples come in, so drawing the graph is only a matter of drawing one line
+ * per column and per target
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lrf_frame_decoder.h"
+
+
+
+/*** Defines ***/
+#define DIST_GRAPH_WIDTH 128		/* columns - must be a power of 2 */
+#define DIST_GRAPH_HEIGHT 47		/* pixels */
+#define DIST_GRAPH_MIN_RANGE_CM 20	/* Smallest displayed range */
+
+
+
+/*** Types ***/
+
+/** Graph column
+    min_cm > max_cm for the targets without any valid distance **/
+typedef struct {
+
+  /* Smallest and largest valid distances of each target in centimeters */
+  uint32_t min_cm[3];
+  uint32_t max_cm[3];
+
+} DistGraphColumn;
+
+
+
+/** Vertical span of pixels to draw in a column for one target
+    top > bottom if there is nothing to draw **/
+typedef struct {
+
+  uint8_t top;
+  uint8_t bottom;
+
+} DistGraphSpan;
+
+
+
+/** Distance graph **/
+typedef struct {
+
+  /* Ring buffer of columns, and their spans of pixels */
+  DistGraphColumn columns[DIST_GRAPH_WIDTH];
+  DistGraphSpan spans[DIST_GRAPH_WIDTH][3];
+
+  /* Newest column in the ring buffer, and number of columns with data */
+  uint8_t newest_i;
+  uint8_t nb_columns;
+
+  /* Time span of the whole graph in milliseconds if the columns cover a set
+     amount of time, 0 if they cover a set number of samples */
+  uint32_t span_ms;
+
+  /* Number of samples per column if the columns cover a set number of
+     samples, and number of samples in the newest column */
+  uint16_t samples_per_column;
+  uint16_t nb_samples_in_column;
+
+  /* Timestamp of the first sample in the graph, and number of the newest
+     column counted from the first column */
+  uint64_t start_tstamp_us;
+  uint32_t newest_column_nb;
+
+  /* Number of targets displayed - 1 or 3 */
+  uint8_t nb_targets;
+
+  /* Smallest and largest distances of the displayed targets in the graph,
+     min_cm > max_cm if there are none */
+  uint32_t min_cm;
+  uint32_t max_cm;
+
+  /* Displayed range of distances */
+  uint32_t range_min_cm;
+  uint32_t range_max_cm;
+
+} DistGraph;
+
+
+
+/** Copy of what's drawn of a distance graph, taken by the thread that adds
+    the samples for the draw callback, with the columns in drawing order **/
+typedef struct {
+
+  /* Spans of pixels of the displayed targets at each x coordinate. No
+     spans at the x coordinates without a column */
+  DistGraphSpan spans[DIST_GRAPH_WIDTH][3];
+
+  /* Number of targets displayed - 1 or 3 */
+  uint8_t nb_targets;
+
+  /* Whether the graph has any distance to show, and displayed range of
+     distances */
+  bool has_dists;
+  uint32_t range_min_cm;
+  uint32_t range_max_cm;
+
+} DistGraphDisp;
+
+
+
+/*** Routines ***/
+
+/** Setup a distance graph for the buffering setting, covering the buffering
+    time, or at least the buffered number of samples with one sample per
+    column, and empty it **/
+void dist_graph_init(DistGraph *, int16_t, uint8_t);
+
+/** Empty a distance graph **/
+void dist_graph_reset(DistGraph *);
+
+/** Set the number of targets displayed in a distance graph - 1 or 3 **/
+void dist_graph_set_targets(DistGraph *, uint8_t);
+
+/** Add a LRF sample to a distance graph **/
+void dist_graph_add_sample(DistGraph *, LRFSample *);
+
+/** Get the ring buffer index of the column drawn at a given x coordinate,
+    the newest column being drawn at the right-hand side
+    Returns -1 if there is no column at that position **/
+int16_t dist_graph_column_at(DistGraph *, uint8_t);
+
+/** Copy what's drawn of a distance graph **/
+void dist_graph_get_disp(DistGraph *, DistGraphDisp *);
@@ -0,0 +1,302 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Distance histogram
+***/
+
+/*** Includes ***/
+#include <string.h>
+
+#include "dist_histogram.h"
+
+
+
+/*** Routines ***/
+
+/** Get the bin a distance falls into
+    Returns -1 if the distance falls outside the bins, or the bins aren't
+    centred yet **/
+static int16_t bin_of(DistHistogram *hist, uint32_t dist_cm) {
+
+  uint32_t i;
+
+  if(!hist->centred || dist_cm < hist->low_cm)
+    return -1;
+
+  i = (dist_cm - hist->low_cm) / hist->bin_width_cm;
+
+  return i < DIST_HISTOGRAM_NB_BINS? (int16_t)i : -1;
+}
+
+
+
+/** Find the bin with the most distances **/
+static void find_mode(DistHistogram *hist) {
+
+  uint8_t i;
+
+  hist->mode_i = 0;
+  for(i = 1; i < DIST_HISTOGRAM_NB_BINS; i++)
+    if(hist->bins[i] > hist->bins[hist->mode_i])
+      hist->mode_i = i;
+}
+
+
+
+/** Add a distance to the bins **/
+static void add_to_bins(DistHistogram *hist, uint32_t dist_cm) {
+
+  int16_t b;
+
+  if(!dist_cm)
+    return;
+
+  hist->nb_valid++;
+
+  if((b = bin_of(hist, dist_cm)) < 0) {
+    hist->nb_out++;
+    return;
+  }
+
+  hist->bins[b]++;
+  if(hist->bins[b] > hist->bins[hist->mode_i])
+    hist->mode_i = b;
+}
+
+
+
+/** Remove a distance from the bins. If it was in the mode's bin, the mode
+    may have moved, which only takes a scan of the bins to find **/
+static void remove_from_bins(DistHistogram *hist, uint32_t dist_cm) {
+
+  int16_t b;
+
+  if(!dist_cm)
+    return;
+
+  hist->nb_valid--;
+
+  if((b = bin_of(hist, dist_cm)) < 0) {
+    hist->nb_out--;
+    return;
+  }
+
+  hist->bins[b]--;
+  if(b == hist->mode_i)
+    find_mode(hist);
+}
+
+
+
+/** Remove the oldest sample from the window **/
+static void evict_oldest_sample(DistHistogram *hist) {
+
+  remove_from_bins(hist, hist->dists_cm[hist->start_i]);
+
+  hist->start_i++;
+  if(hist->start_i >= hist->max_samples)
+    hist->start_i = 0;
+
+  hist->nb_samples--;
+}
+
+
+
+/** Centre the bins on the densest part of the valid distances in the
+    window, and redistribute the distances into the bins
+    The densest part is found by binning the distances coarsely over their
+    whole range and zooming into the fullest coarse bin until it's no wider
+    than a bin, so outliers don't pull the bins away from the bulk of the
+    distances **/
+static void centre_bins(DistHistogram *hist) {
+
+  uint16_t counts[DIST_HISTOGRAM_NB_BINS];
+  uint32_t low_cm = UINT32_MAX, high_cm = 0;
+  uint32_t width_cm, dist_cm, centre_bin;
+  uint16_t i, n;
+  uint8_t m;
+
+  hist->nb_added_since_centring = 0;
+  hist->centred = hist->nb_valid > 0;
+  if(!hist->centred)
+    return;
+
+  /* Find the range of the valid distances */
+  for(i = hist->start_i, n = 0; n < hist->nb_samples; n++) {
+    dist_cm = hist->dists_cm[i];
+    if(dist_cm && dist_cm < low_cm)
+      low_cm = dist_cm;
+    if(dist_cm > high_cm)
+      high_cm = dist_cm;
+    if(++i >= hist->max_samples)
+      i = 0;
+  }
+
+  /* Zoom into the fullest coarse bin until it's no wider than a bin */
+  while((width_cm = (high_cm - low_cm) / DIST_HISTOGRAM_NB_BINS + 1) >
+		hist->bin_width_cm) {
+
+    memset(counts, 0, sizeof(counts));
+
+    for(i = hist->start_i, n = 0; n < hist->nb_samples; n++) {
+      dist_cm = hist->dists_cm[i];
+      if(dist_cm >= low_cm && dist_cm <= high_cm)
+        counts[(dist_cm - low_cm) / width_cm]++;
+      if(++i >= hist->max_samples)
+        i = 0;
+    }
+
+    for(m = 0, i = 1; i < DIST_HISTOGRAM_NB_BINS; i++)
+      if(counts[i] > counts[m])
+        m = i;
+
+    low_cm += m * width_cm;
+    high_cm = low_cm + width_cm - 1;
+  }
+
+  /* Put the middle of the densest part in the middle bin, with the bins
+     lined up on multiples of their width */
+  centre_bin = (low_cm + (high_cm - low_cm) / 2) / hist->bin_width_cm;
+  hist->low_cm = centre_bin >= DIST_HISTOGRAM_NB_BINS / 2?
+			(centre_bin - DIST_HISTOGRAM_NB_BINS / 2) *
+			hist->bin_width_cm : 0;
+
+  /* Redistribute the distances into the bins */
+  memset(hist->bins, 0, sizeof(hist->bins));
+  hist->nb_valid = 0;
+  hist->nb_out = 0;
+  hist->mode_i = 0;
+
+  for(i = hist->start_i, n = 0; n < hist->nb_samples; n++) {
+    add_to_bins(hist, hist->dists_cm[i]);
+    if(++i >= hist->max_samples)
+      i = 0;
+  }
+}
+
+
+
+/** Setup a distance histogram with its window of samples in a storage area
+    aligned on 4 bytes, covering the buffering time or number of samples - or
+    as many samples as the storage area can hold if there is no buffering -
+    with bins of a given width, and empty it **/
+void dist_histogram_init(DistHistogram *hist, uint8_t *storage,
+				size_t storage_size, int16_t buf,
+				uint32_t bin_width_cm) {
+
+  storage_size /= DIST_HISTOGRAM_BYTES_PER_SAMPLE;
+  hist->max_samples = storage_size < UINT16_MAX? storage_size : UINT16_MAX;
+  hist->dists_cm = (uint32_t *)storage;
+  hist->tstamps_ms = hist->dists_cm + hist->max_samples;
+
+  hist->window_ms = buf > 0? buf * 1000 : 0;
+  hist->window_samples = buf < 0 && -buf < hist->max_samples?
+						-buf : hist->max_samples;
+  hist->bin_width_cm = bin_width_cm;
+
+  dist_histogram_reset(hist);
+}
+
+
+
+/** Empty a distance histogram **/
+void dist_histogram_reset(DistHistogram *hist) {
+
+  hist->start_i = 0;
+  hist->nb_samples = 0;
+  memset(hist->bins, 0, sizeof(hist->bins));
+  hist->centred = false;
+  hist->nb_valid = 0;
+  hist->nb_out = 0;
+  hist->mode_i = 0;
+  hist->nb_added_since_centring = 0;
+}
+
+
+
+/** Change the width of the bins of a distance histogram and re-centre it **/
+void dist_histogram_set_bin_width(DistHistogram *hist, uint32_t bin_width_cm) {
+
+  hist->bin_width_cm = bin_width_cm;
+  centre_bins(hist);
+}
+
+
+
+/** Add a LRF sample to a distance histogram, removing the samples that fall
+    out of its window **/
+void dist_histogram_add_sample(DistHistogram *hist, LRFSample *sample) {
+
+  uint32_t dist_cm, tstamp_ms;
+  uint16_t i;
+
+  /* Make room for the new sample if the window is full */
+  while(hist->nb_samples >= hist->window_samples)
+    evict_oldest_sample(hist);
+
+  /* Add the new sample's first distance to the window, with its timestamp in
+     milliseconds which is enough to keep track of the window's age */
+  dist_cm = sample->dist1 > 0.5f? (uint32_t)(sample->dist1 * 100 + 0.5f) :
+					0;
+  tstamp_ms = sample->tstamp_us / 1000;
+
+  i = hist->start_i + hist->nb_samples;
+  if(i >= hist->max_samples)
+    i -= hist->max_samples;
+
+  hist->dists_cm[i] = dist_cm;
+  hist->tstamps_ms[i] = tstamp_ms;
+  hist->nb_samples++;
+
+  /* If the window covers a set amount of time, remove the samples that are
+     too old */
+  if(hist->window_ms)
+    while(hist->nb_samples > 1 &&
+		tstamp_ms - hist->tstamps_ms[hist->start_i] >
+		hist->window_ms)
+      evict_oldest_sample(hist);
+
+  add_to_bins(hist, dist_cm);
+
+  if(!dist_cm)
+    return;
+
+  if(hist->nb_added_since_centring < UINT16_MAX)
+    hist->nb_added_since_centring++;
+
+  /* Re-centre the bins if more than a quarter of the distances fall outside
+     them, but only if enough distances were added since they were last
+     centred, so the bins don't keep moving if the distances are spread
+     wider than the bins */
+  if(hist->nb_out * 4 > hist->nb_valid &&
+	hist->nb_added_since_centring * 4 >= hist->nb_valid)
+    centre_bins(hist);
+}
+
+
+
+/** Find the contiguous bins around the mode that hold at least half as many
+    distances as the mode
+    Returns the full width at half maximum in centimeters, or 0 if the
+    histogram is empty **/
+uint32_t dist_histogram_fwhm(DistHistogram *hist, uint8_t *first,
+				uint8_t *last) {
+
+  uint16_t max_count = hist->bins[hist->mode_i];
+
+  *first = hist->mode_i;
+  *last = hist->mode_i;
+
+  if(!max_count)
+    return 0;
+
+  while(*first > 0 && hist->bins[*first - 1] * 2 >= max_count)
+    (*first)--;
+
+  while(*last < DIST_HISTOGRAM_NB_BINS - 1 &&
+	hist->bins[*last + 1] * 2 >= max_count)
+    (*last)++;
+
+  return (*last - *first + 1) * hist->bin_width_cm;
+}
@@ -0,0 +1,98 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Distance histogram
+ *
+ * Histogram of the first target's distances over a sliding window of
+ * samples, with no dependency on the Flipper Zero firmware. The histogram has
+ * a fixed number of bins around a centre distance: the bins are updated
+ * as samples enter and leave the window, and the histogram is only
+ * re-centred when too many distances fall outside the bins
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lrf_frame_decoder.h"
+
+
+
+/*** Defines ***/
+#define DIST_HISTOGRAM_NB_BINS 64
+#define DIST_HISTOGRAM_BYTES_PER_SAMPLE 8
+
+
+
+/*** Types ***/
+
+/** Distance histogram **/
+typedef struct {
+
+  /* Window of samples: ring buffer of the first target's distances in
+     centimeters - 0 if invalid - and of the timestamps of the samples */
+  uint32_t *dists_cm;
+  uint32_t *tstamps_ms;
+  uint16_t max_samples;
+  uint16_t start_i;
+  uint16_t nb_samples;
+
+  /* Time span of the window in milliseconds if it covers a set amount of
+     time, 0 if it covers a set number of samples */
+  uint32_t window_ms;
+
+  /* Number of samples in the window if it covers a set number of samples */
+  uint16_t window_samples;
+
+  /* Bins, distance of the lower edge of the first bin and width of the bins
+     in centimeters */
+  uint16_t bins[DIST_HISTOGRAM_NB_BINS];
+  uint32_t low_cm;
+  uint32_t bin_width_cm;
+
+  /* Whether the bins are centred yet */
+  bool centred;
+
+  /* Number of valid distances in the window, and how many of them fall
+     outside the bins */
+  uint16_t nb_valid;
+  uint16_t nb_out;
+
+  /* Bin with the most distances */
+  uint8_t mode_i;
+
+  /* Number of valid distances added since the bins were last centred */
+  uint16_t nb_added_since_centring;
+
+} DistHistogram;
+
+
+
+/*** Routines ***/
+
+/** Setup a distance histogram with its window of samples in a storage area
+    aligned on 4 bytes, covering the buffering time or number of samples - or
+    as many samples as the storage area can hold if there is no buffering -
+    with bins of a given width, and empty it **/
+void dist_histogram_init(DistHistogram *, uint8_t *, size_t, int16_t,
+				uint32_t);
+
+/** Empty a distance histogram **/
+void dist_histogram_reset(DistHistogram *);
+
+/** Change the width of the bins of a distance histogram and re-centre it **/
+void dist_histogram_set_bin_width(DistHistogram *, uint32_t);
+
+/** Add a LRF sample to a distance histogram, removing the samples that fall
+    out of its window **/
+void dist_histogram_add_sample(DistHistogram *, LRFSample *);
+
+/** Find the contiguous bins around the mode that hold at least half as many
+    distances as the mode
+    Returns the full width at half maximum in centimeters, or 0 if the
+    histogram is empty **/
+uint32_t dist_histogram_fwhm(DistHistogram *, uint8_t *, uint8_t *);
@@ -0,0 +1,128 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Little-endian value loaders and storers
+ *
+ * The LRF sends multi-byte values in little-endian order. On a little-endian
+ * target - such as the Flipper Zero - values are loaded directly. The
+ * byte-swapping path is only compiled on big-endian hosts, or when
+ * ENDIAN_LOADERS_PORTABLE is defined to exercise it on a little-endian host
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <string.h>
+
+
+
+/*** Defines ***/
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && \
+	!defined(ENDIAN_LOADERS_PORTABLE)
+#define ENDIAN_LOADERS_NATIVE_LE
+#endif
+
+
+
+/*** Routines ***/
+
+/** Load a little-endian unsigned 16-bit value **/
+static inline uint16_t load_le_u16(const uint8_t *p) {
+
+#ifdef ENDIAN_LOADERS_NATIVE_LE
+  uint16_t v;
+
+  memcpy(&v, p, sizeof(v));	/* Compiles to a single unaligned load */
+  return v;
+#else
+  return (uint16_t)(p[0] | p[1] << 8);
+#endif
+}
+
+
+
+/** Load a little-endian signed 16-bit value **/
+static inline int16_t load_le_i16(const uint8_t *p) {
+
+  return (int16_t)load_le_u16(p);
+}
+
+
+
+/** Load a little-endian unsigned 24-bit value **/
+static inline uint32_t load_le_u24(const uint8_t *p) {
+
+  return load_le_u16(p) | (uint32_t)p[2] << 16;
+}
+
+
+
+/** Load a little-endian unsigned 32-bit value **/
+static inline uint32_t load_le_u32(const uint8_t *p) {
+
+#ifdef ENDIAN_LOADERS_NATIVE_LE
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+#else
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+#endif
+}
+
+
+
+/** Load a little-endian 32-bit float **/
+static inline float load_le_float(const uint8_t *p) {
+
+  float v;
+
+#ifdef ENDIAN_LOADERS_NATIVE_LE
+  memcpy(&v, p, sizeof(v));
+#else
+  uint32_t u = (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+
+  memcpy(&v, &u, sizeof(v));
+#endif
+
+  return v;
+}
+
+
+
+/** Store an unsigned 16-bit value in little-endian order **/
+static inline void store_le_u16(uint8_t *p, uint16_t v) {
+
+#ifdef ENDIAN_LOADERS_NATIVE_LE
+  memcpy(p, &v, sizeof(v));
+#else
+  p[0] = v;
+  p[1] = v >> 8;
+#endif
+}
+
+
+
+/** Store an unsigned 24-bit value in little-endian order **/
+static inline void store_le_u24(uint8_t *p, uint32_t v) {
+
+  store_le_u16(p, v);
+  p[2] = v >> 16;
+}
+
+
+
+/** Store an unsigned 32-bit value in little-endian order **/
+static inline void store_le_u32(uint8_t *p, uint32_t v) {
+
+#ifdef ENDIAN_LOADERS_NATIVE_LE
+  memcpy(p, &v, sizeof(v));
+#else
+  store_le_u16(p, v);
+  store_le_u16(p + 2, v >> 16);
+#endif
+}
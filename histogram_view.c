@@ -0,0 +1,393 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Histogram view
+***/
+
+/*** Includes ***/
+#include "common.h"
+
+
+
+/*** Defines ***/
+#define HISTOGRAM_TOP 13	/* Top of the tallest bar */
+#define HISTOGRAM_BOTTOM 47	/* Bottom of the bars */
+
+
+
+/*** Histogram processing thread events ***/
+typedef enum {
+  stop = 1,
+  sample_avail = 2
+} histogram_thread_evts;
+
+
+
+/*** Routines ***/
+
+/** Add one LRF sample to the histogram
+    Called by the histogram processing thread for each LRF sample pulled out
+    of the sample queue **/
+static void add_lrf_sample(App *app, HistogramModel *histogram_model,
+				LRFSample *lrf_sample) {
+
+  /* If we track the targets, move the sample's distances to the slots of
+     the targets they belong to, so the histogram follows the first target
+     tracked */
+  if(app->config.targets == targets_tracked)
+    track_assoc_assign(&histogram_model->track_assoc, lrf_sample);
+
+  /* Acquire the mutex to get exclusive access to the histogram */
+  furi_check(furi_mutex_acquire(histogram_model->histogram_mutex,
+				FuriWaitForever) == FuriStatusOk);
+
+  /* Add the sample to the histogram */
+  dist_histogram_add_sample(&histogram_model->histogram, lrf_sample);
+  histogram_model->histogram_updated = true;
+
+  /* Release access to the histogram */
+  furi_check(furi_mutex_release(histogram_model->histogram_mutex) ==
+		FuriStatusOk);
+}
+
+
+
+/** Histogram processing thread
+    Add the LRF samples queued by the LRF sample handler to the histogram,
+    so the UART receive thread doesn't have to **/
+static int32_t histogram_thread(void *ctx) {
+
+  App *app = (App *)ctx;
+  HistogramModel *histogram_model = view_get_model(app->histogram_view);
+  LRFSample lrf_sample;
+  uint32_t evts;
+
+  FURI_LOG_I(TAG, "Histogram processing thread started");
+
+  while(true) {
+
+    /* Wait for events */
+    evts = furi_thread_flags_wait(stop | sample_avail, FuriFlagWaitAny,
+					FuriWaitForever);
+
+    /* Check for errors */
+    furi_check((evts & FuriFlagError) == 0);
+
+    /* Should we stop the thread? */
+    if(evts & stop)
+      break;
+
+    /* Add all the samples in the queue to the histogram */
+    while(sample_queue_pop(histogram_model->sample_queue, &lrf_sample))
+      add_lrf_sample(app, histogram_model, &lrf_sample);
+  }
+
+  FURI_LOG_I(TAG, "Histogram processing thread stopped");
+
+  return 0;
+}
+
+
+
+/** LRF sample handler
+    Called in the UART receive thread when a LRF sample is available from the
+    LRF serial communication app: queue the sample and wake up the histogram
+    processing thread **/
+static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
+
+  App *app = (App *)ctx;
+  HistogramModel *histogram_model = view_get_model(app->histogram_view);
+
+  /* Queue the sample. If the queue is full, the sample is dropped and
+     counted as an overflow */
+  if(!sample_queue_push(histogram_model->sample_queue, lrf_sample))
+    FURI_LOG_W(TAG, "Sample queue overflow: LRF sample dropped");
+
+  /* Wake up the histogram processing thread */
+  furi_thread_flags_set(histogram_model->histogram_thread_id, sample_avail);
+}
+
+
+
+/** Histogram view update timer callback **/
+static void histogram_view_timer_callback(void *ctx) {
+
+  App *app = (App *)ctx;
+  HistogramModel *histogram_model = view_get_model(app->histogram_view);
+
+  /* Was the histogram updated? */
+  if(histogram_model->histogram_updated) {
+
+    histogram_model->histogram_updated = false;
+
+    /* Trigger a histogram view redraw */
+    with_view_model(app->histogram_view, HistogramModel *_model,
+			{UNUSED(_model);}, true);
+  }
+}
+
+
+
+/** Histogram view enter callback
+    Setup the histogram and start continuous measurement **/
+void histogram_view_enter_callback(void *ctx) {
+
+  App *app = (App *)ctx;
+  HistogramModel *histogram_model = view_get_model(app->histogram_view);
+  uint32_t period = furi_ms_to_ticks(histogram_view_update_every);
+
+  /* Create the mutex to access the histogram */
+  histogram_model->histogram_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+
+  /* Setup the histogram to cover the buffering setting - or as many samples
+     as the shared storage can hold in tracking mode - with the window of
+     samples in the shared storage and the narrowest bins */
+  histogram_model->bin_width_i = 0;
+  dist_histogram_init(&histogram_model->histogram, app->shared_storage,
+			sizeof(app->shared_storage),
+			app->config.buf == BUF_TRACKING? 0 : app->config.buf,
+			histogram_bin_widths_cm[histogram_model->bin_width_i]);
+  histogram_model->histogram_updated = true;
+
+  /* Setup the target associator */
+  track_assoc_init(&histogram_model->track_assoc, track_assoc_gate,
+			track_assoc_max_misses);
+
+  /* Allocate and empty the sample queue */
+  histogram_model->sample_queue = malloc(sizeof(SampleQueue));
+  sample_queue_reset(histogram_model->sample_queue);
+  sample_queue_reset_stats(histogram_model->sample_queue);
+
+  /* Allocate space for the histogram processing thread */
+  histogram_model->histogram_thread = furi_thread_alloc();
+
+  /* Initialize the histogram processing thread */
+  furi_thread_set_name(histogram_model->histogram_thread, "histogram_proc");
+  furi_thread_set_stack_size(histogram_model->histogram_thread, 1024);
+  furi_thread_set_context(histogram_model->histogram_thread, app);
+  furi_thread_set_callback(histogram_model->histogram_thread,
+				histogram_thread);
+
+  /* Start the histogram processing thread */
+  furi_thread_start(histogram_model->histogram_thread);
+
+  /* Get the histogram processing thread ID */
+  histogram_model->histogram_thread_id =
+			furi_thread_get_id(histogram_model->histogram_thread);
+
+  /* Start the UART at the correct baudrate */
+  start_uart(app->lrf_serial_comm_app, app->config.baudrate);
+
+  /* Setup the callback to receive decoded LRF samples */
+  add_lrf_sample_handler(app->lrf_serial_comm_app, lrf_sample_handler, app);
+
+  /* Start continuous measurement at the configured frequency, or at 10 Hz
+     if the sampling mode is single measurement or burst SMM */
+  send_lrf_command(app->lrf_serial_comm_app,
+			(app->config.mode & LRF_COMMAND_MASK) == smm ||
+			app->config.mode == quick_smm?
+				cmm_10hz : app->config.mode);
+
+  /* Set the backlight on all the time */
+  set_backlight(&app->backlight_control, BL_ON);
+
+  /* Setup and start the view update timer */
+  app->histogram_view_timer = furi_timer_alloc(histogram_view_timer_callback,
+						FuriTimerTypePeriodic, ctx);
+  furi_timer_start(app->histogram_view_timer, period);
+}
+
+
+
+/** Histogram view exit callback
+    Stop continuous measurement **/
+void histogram_view_exit_callback(void *ctx) {
+
+  App *app = (App *)ctx;
+  HistogramModel *histogram_model = view_get_model(app->histogram_view);
+
+  /* Send a CMM-break command unconditionally. It is resent if the LRF doesn't
+     acknowledge it */
+  send_lrf_command(app->lrf_serial_comm_app, cmm_break);
+  app->pointer_is_on = false;	/* A CMM break turns the pointer off */
+
+  /* Set the backlight back to automatic */
+  set_backlight(&app->backlight_control, BL_AUTO);
+
+  /* Remove the callback to receive decoded LRF samples */
+  remove_lrf_sample_handler(app->lrf_serial_comm_app, lrf_sample_handler, app);
+
+  /* Stop and free the view update timer */
+  furi_timer_stop(app->histogram_view_timer);
+  furi_timer_free(app->histogram_view_timer);
+
+  /* Stop the UART */
+  stop_uart(app->lrf_serial_comm_app);
+
+  /* Stop and free the histogram processing thread */
+  furi_thread_flags_set(histogram_model->histogram_thread_id, stop);
+  furi_thread_join(histogram_model->histogram_thread);
+  furi_thread_free(histogram_model->histogram_thread);
+
+  /* Free the sample queue */
+  free(histogram_model->sample_queue);
+
+  /* Free the mutex to access the histogram */
+  furi_mutex_free(histogram_model->histogram_mutex);
+}
+
+
+
+/** Draw callback for the histogram view **/
+void histogram_view_draw_callback(Canvas *canvas, void *model) {
+
+  HistogramModel *histogram_model = (HistogramModel *)model;
+  DistHistogram *hist = &histogram_model->disp_histogram;
+  uint32_t fwhm_cm;
+  uint16_t max_count;
+  uint8_t first, last;
+  uint8_t i, x, y;
+
+  /* Acquire the mutex to get exclusive access to the histogram */
+  furi_check(furi_mutex_acquire(histogram_model->histogram_mutex,
+				FuriWaitForever) == FuriStatusOk);
+
+  /* Make a copy of the histogram to draw, so we can release the mutex asap
+     and avoid holding up the histogram processing thread */
+  memcpy(hist, &histogram_model->histogram, sizeof(DistHistogram));
+
+  /* Release access to the histogram */
+  furi_check(furi_mutex_release(histogram_model->histogram_mutex) ==
+		FuriStatusOk);
+
+  canvas_set_font(canvas, FontKeyboard);
+
+  max_count = hist->bins[hist->mode_i];
+
+  /* If no distance falls into the bins, say why in the middle of the
+     screen */
+  if(!max_count)
+    canvas_draw_str_aligned(canvas, 64, 30, AlignCenter, AlignBottom,
+				hist->nb_valid? "OUT OF RANGE" : "NO SAMPLE");
+
+  else {
+
+    /* Draw the bins as 2 pixel-wide bars, the tallest bar being the mode */
+    for(i = 0; i < DIST_HISTOGRAM_NB_BINS; i++)
+      if(hist->bins[i]) {
+        y = HISTOGRAM_BOTTOM - (uint32_t)hist->bins[i] *
+				(HISTOGRAM_BOTTOM - HISTOGRAM_TOP) / max_count;
+        canvas_draw_box(canvas, i * 2, y, 2, HISTOGRAM_BOTTOM - y + 1);
+      }
+
+    /* Draw a marker above the mode */
+    x = hist->mode_i * 2;
+    canvas_draw_line(canvas, x - 1, HISTOGRAM_TOP - 4, x + 2,
+			HISTOGRAM_TOP - 4);
+    canvas_draw_line(canvas, x, HISTOGRAM_TOP - 3, x + 1, HISTOGRAM_TOP - 3);
+
+    /* Draw the full width at half maximum across the bars in reverse
+       video */
+    fwhm_cm = dist_histogram_fwhm(hist, &first, &last);
+    y = (HISTOGRAM_BOTTOM + HISTOGRAM_TOP) / 2;
+    canvas_set_color(canvas, ColorXOR);
+    canvas_draw_line(canvas, first * 2, y, last * 2 + 1, y);
+    canvas_set_color(canvas, ColorBlack);
+
+    /* Print the mode's distance and the full width at half maximum at the
+       top */
+    snprintf(histogram_model->spstr, sizeof(histogram_model->spstr),
+		"M %.2f", (hist->low_cm + hist->mode_i * hist->bin_width_cm +
+				hist->bin_width_cm / 2.0) / 100);
+    canvas_draw_str(canvas, 0, 7, histogram_model->spstr);
+
+    snprintf(histogram_model->spstr, sizeof(histogram_model->spstr),
+		"FWHM %.2f", fwhm_cm / 100.0);
+    canvas_draw_str_aligned(canvas, 128, 7, AlignRight, AlignBottom,
+				histogram_model->spstr);
+  }
+
+  /* Print the distances of the edges of the bins */
+  if(hist->centred) {
+    snprintf(histogram_model->spstr, sizeof(histogram_model->spstr),
+		"%.2f", hist->low_cm / 100.0);
+    canvas_draw_str(canvas, 0, 56, histogram_model->spstr);
+
+    snprintf(histogram_model->spstr, sizeof(histogram_model->spstr),
+		"%.2f", (hist->low_cm + DIST_HISTOGRAM_NB_BINS *
+				hist->bin_width_cm) / 100.0);
+    canvas_draw_str_aligned(canvas, 128, 56, AlignRight, AlignBottom,
+				histogram_model->spstr);
+  }
+
+  /* Print the number of valid distances in the window, how many of them
+     fall outside the bins, and the width of the bins */
+  if(hist->nb_out)
+    snprintf(histogram_model->spstr, sizeof(histogram_model->spstr),
+		"N %d out %d", hist->nb_valid, hist->nb_out);
+  else
+    snprintf(histogram_model->spstr, sizeof(histogram_model->spstr),
+		"N %d", hist->nb_valid);
+  canvas_draw_str(canvas, 0, 64, histogram_model->spstr);
+
+  snprintf(histogram_model->spstr, sizeof(histogram_model->spstr),
+		"%ldcm/bin", hist->bin_width_cm);
+  canvas_draw_str_aligned(canvas, 128, 64, AlignRight, AlignBottom,
+				histogram_model->spstr);
+
+  /* Draw a dividing line between the histogram and the bottom lines */
+  canvas_draw_line(canvas, 0, 48, 128, 48);
+}
+
+
+
+/** Input callback for the histogram view **/
+bool histogram_view_input_callback(InputEvent *evt, void *ctx) {
+
+  App *app = (App *)ctx;
+  HistogramModel *histogram_model = view_get_model(app->histogram_view);
+  uint8_t prev_bin_width_i = histogram_model->bin_width_i;
+
+  if(evt->type != InputTypePress)
+    return false;
+
+  /* If the user pressed the up button, widen the bins */
+  if(evt->key == InputKeyUp) {
+    FURI_LOG_D(TAG, "Up button pressed");
+    if(histogram_model->bin_width_i < nb_histogram_bin_widths - 1)
+      histogram_model->bin_width_i++;
+  }
+
+  /* If the user pressed the down button, narrow the bins */
+  else if(evt->key == InputKeyDown) {
+    FURI_LOG_D(TAG, "Down button pressed");
+    if(histogram_model->bin_width_i > 0)
+      histogram_model->bin_width_i--;
+  }
+
+  /* If the user pressed the OK button, empty the histogram */
+  else if(evt->key != InputKeyOk)
+    return false;
+
+  /* Acquire the mutex to get exclusive access to the histogram */
+  furi_check(furi_mutex_acquire(histogram_model->histogram_mutex,
+				FuriWaitForever) == FuriStatusOk);
+
+  if(evt->key == InputKeyOk) {
+    FURI_LOG_D(TAG, "OK button pressed");
+    dist_histogram_reset(&histogram_model->histogram);
+  }
+
+  else if(histogram_model->bin_width_i != prev_bin_width_i)
+    dist_histogram_set_bin_width(&histogram_model->histogram,
+			histogram_bin_widths_cm[histogram_model->bin_width_i]);
+
+  histogram_model->histogram_updated = true;
+
+  /* Release access to the histogram */
+  furi_check(furi_mutex_release(histogram_model->histogram_mutex) ==
+		FuriStatusOk);
+
+  return true;
+}
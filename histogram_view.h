@@ -0,0 +1,22 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Histogram view
+***/
+
+/*** Routines ***/
+
+/** Histogram view enter callback
+    Setup the histogram and start continuous measurement **/
+void histogram_view_enter_callback(void *);
+
+/** Histogram view exit callback
+    Stop continuous measurement **/
+void histogram_view_exit_callback(void *);
+
+/** Draw callback for the histogram view **/
+void histogram_view_draw_callback(Canvas *, void *);
+
+/** Input callback for the histogram view **/
+bool histogram_view_input_callback(InputEvent *, void *);
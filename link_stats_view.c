@@ -0,0 +1,221 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Link statistics view
+***/
+
+/*** Includes ***/
+#include <stdarg.h>
+
+#include "common.h"
+#include "noptel_lrf_sampler_icons.h"	/* Generated from images in assets */
+
+
+
+/*** Defines ***/
+#define NB_LINK_STATS_SCREENS 4
+
+
+
+/*** Routines ***/
+
+/** Draw a statistic's name and value on one line **/
+static void draw_stat(Canvas *canvas, LinkStatsModel *linkstats_model,
+			uint8_t y, char *name, char *fmt, ...) {
+
+  va_list args;
+
+  /* Draw the statistic's name */
+  canvas_set_font(canvas, FontSecondary);
+  canvas_draw_str(canvas, 2, y, name);
+
+  /* Format the statistic's value */
+  va_start(args, fmt);
+  vsnprintf(linkstats_model->spstr, sizeof(linkstats_model->spstr), fmt,
+		args);
+  va_end(args);
+
+  /* Draw the statistic's value right-aligned */
+  canvas_set_font(canvas, FontKeyboard);
+  canvas_draw_str_aligned(canvas, 126, y, AlignRight, AlignBottom,
+				linkstats_model->spstr);
+}
+
+
+
+/** Link statistics view enter callback **/
+void linkstats_view_enter_callback(void *ctx) {
+
+  App *app = (App *)ctx;
+  SampleModel *sample_model = view_get_model(app->sample_view);
+
+  with_view_model(app->linkstats_view, LinkStatsModel *linkstats_model,
+	{
+	  /* Start at the first screen */
+	  linkstats_model->screen = 0;
+
+	  /* Get the serial link statistics */
+	  get_lrf_link_stats(app->lrf_serial_comm_app,
+				&linkstats_model->stats);
+
+	  /* Get the sample queue statistics */
+	  sample_queue_get_stats(&sample_model->sample_queue,
+				&linkstats_model->sample_queue_stats);
+	},
+	false);
+}
+
+
+
+/** Draw callback for the link statistics view **/
+void linkstats_view_draw_callback(Canvas *canvas, void *model) {
+
+  LinkStatsModel *linkstats_model = (LinkStatsModel *)model;
+  LRFLinkStats *stats = &linkstats_model->stats;
+
+  /* Draw the title of the screen */
+  canvas_set_font(canvas, FontPrimary);
+  canvas_draw_str_aligned(canvas, 64, 8, AlignCenter, AlignBottom,
+				linkstats_model->screen == 0? "Serial link" :
+				linkstats_model->screen == 1? "Frames" :
+				linkstats_model->screen == 2? "Errors" :
+								"Sample queue");
+
+  /* Which screen should we draw? */
+  switch(linkstats_model->screen) {
+
+    /* Draw the serial link screen */
+    case 0:
+
+      draw_stat(canvas, linkstats_model, 19, "RX bytes", "%ld",
+			stats->nb_rx_bytes);
+      draw_stat(canvas, linkstats_model, 28, "Dropped bytes", "%ld",
+			stats->nb_dropped_bytes);
+      draw_stat(canvas, linkstats_model, 37, "Peak RX buf fill", "%d/%d",
+			stats->peak_rx_ring_buf_fill, stats->rx_ring_buf_size);
+      draw_stat(canvas, linkstats_model, 46, "RX timeouts", "%ld",
+			stats->dec.nb_rx_timeouts);
+      break;
+
+    /* Draw the decoded frames screen */
+    case 1:
+
+      draw_stat(canvas, linkstats_model, 19, "Samples", "%ld",
+			stats->dec.nb_frames[lrf_evt_sample]);
+      draw_stat(canvas, linkstats_model, 28, "Ident/info", "%ld/%ld",
+			stats->dec.nb_frames[lrf_evt_ident],
+			stats->dec.nb_frames[lrf_evt_info]);
+      draw_stat(canvas, linkstats_model, 37, "Diag/boot", "%ld/%ld",
+			stats->dec.nb_frames[lrf_evt_diag],
+			stats->dec.nb_frames[lrf_evt_boot_info]);
+      draw_stat(canvas, linkstats_model, 46, "Status/win/ack", "%ld/%ld/%ld",
+			stats->dec.nb_frames[lrf_evt_status],
+			stats->dec.nb_frames[lrf_evt_range_win],
+			stats->dec.nb_frames[lrf_evt_ack]);
+      break;
+
+    /* Draw the errors screen */
+    case 2:
+
+      draw_stat(canvas, linkstats_model, 19, "Checksum errors", "%ld",
+			stats->dec.nb_checksum_errors);
+      draw_stat(canvas, linkstats_model, 28, "Unknown cmds", "%ld",
+			stats->dec.nb_unknown_cmds);
+      draw_stat(canvas, linkstats_model, 37, "Invalid lengths", "%ld",
+			stats->dec.nb_invalid_lens);
+      draw_stat(canvas, linkstats_model, 46, "Resyncs/recov", "%ld/%ld",
+			stats->dec.nb_resyncs,
+			stats->dec.nb_frames_recovered);
+      break;
+
+    /* Draw the sample queue screen */
+    case 3:
+
+      draw_stat(canvas, linkstats_model, 19, "Queued samples", "%ld",
+			linkstats_model->sample_queue_stats.nb_pushed);
+      draw_stat(canvas, linkstats_model, 28, "Overflows", "%ld",
+			linkstats_model->sample_queue_stats.nb_overflows);
+      draw_stat(canvas, linkstats_model, 37, "Peak queue fill", "%d/%d",
+			linkstats_model->sample_queue_stats.high_water_mark,
+			linkstats_model->sample_queue_stats.size);
+      break;
+  }
+
+  /* Draw a left arrow at the top left if we're not on the first screen */
+  if(linkstats_model->screen > 0)
+    canvas_draw_icon(canvas, 0, 0, &I_arrow_left);
+
+  /* Draw a right arrow at the top right if we're not on the last screen */
+  if(linkstats_model->screen < NB_LINK_STATS_SCREENS - 1)
+    canvas_draw_icon(canvas, 124, 0, &I_arrow_right);
+
+  /* Print the OK button symbol followed by "Reset" in a frame at the
+     right-hand side */
+  canvas_set_font(canvas, FontPrimary);
+  canvas_draw_frame(canvas, 77, 52, 51, 12);
+  canvas_draw_icon(canvas, 79, 54, &I_ok_button);
+  canvas_draw_str(canvas, 97, 62, "Reset");
+}
+
+
+
+/** Input callback for the link statistics view **/
+bool linkstats_view_input_callback(InputEvent *evt, void *ctx) {
+
+  App *app = (App *)ctx;
+  LinkStatsModel *linkstats_model = view_get_model(app->linkstats_view);
+  SampleModel *sample_model = view_get_model(app->sample_view);
+  bool evt_handled = false;
+
+  /* Was the event a button press? */
+  if(evt->type == InputTypePress)
+
+    /* Which button was pressed? */
+    switch(evt->key) {
+
+      /* OK button: reset the serial link and sample queue statistics */
+      case InputKeyOk:
+        FURI_LOG_D(TAG, "OK button pressed");
+        reset_lrf_link_stats(app->lrf_serial_comm_app);
+        get_lrf_link_stats(app->lrf_serial_comm_app, &linkstats_model->stats);
+        sample_queue_reset_stats(&sample_model->sample_queue);
+        sample_queue_get_stats(&sample_model->sample_queue,
+				&linkstats_model->sample_queue_stats);
+        evt_handled = true;
+        break;
+
+      /* Right button: go to the next screen */
+      case InputKeyRight:
+        FURI_LOG_D(TAG, "Right button pressed");
+        linkstats_model->screen =
+			linkstats_model->screen < NB_LINK_STATS_SCREENS - 1?
+				linkstats_model->screen + 1 :
+				linkstats_model->screen;
+        evt_handled = true;
+        break;
+
+      /* Left button: go to the previous screen */
+      case InputKeyLeft:
+        FURI_LOG_D(TAG, "Left button pressed");
+        linkstats_model->screen = linkstats_model->screen > 0?
+					linkstats_model->screen - 1 :
+					linkstats_model->screen;
+        evt_handled = true;
+        break;
+
+      default:
+        evt_handled = false;
+    }
+
+  /* If we haven't handled this event, return now */
+  if(!evt_handled)
+    return false;
+
+  /* Trigger a link statistics view redraw */
+  with_view_model(app->linkstats_view, LinkStatsModel *_model,
+			{UNUSED(_model);}, true);
+
+  /* We handled the event */
+  return true;
+}
@@ -0,0 +1,17 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Link statistics view
+***/
+
+/*** Routines ***/
+
+/** Link statistics view enter callback **/
+void linkstats_view_enter_callback(void *);
+
+/** Draw callback for the link statistics view **/
+void linkstats_view_draw_callback(Canvas *, void *);
+
+/** Input callback for the link statistics view **/
+bool linkstats_view_input_callback(InputEvent *, void *);
@@ -0,0 +1,952 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF frame decoder
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <string.h>
+
+#include "lrf_frame_decoder.h"
+#include "endian_loaders.h"
+
+
+
+/*** Defines ***/
+#define LF 10
+#define CR 13
+#define SPACE 32
+#define SLASH 47
+
+#ifndef UNUSED
+#define UNUSED(x) (void)(x)
+#endif
+
+
+
+/*** Routines ***/
+
+/** Copy bytes to a string and stop as soon as a non-printable character or
+    space is encountered */
+static void strcpy_rstrip(char *dst, uint8_t *src) {
+
+  uint8_t i;
+
+  for(i = 0; src[i] > 32 && src[i] < 127; i++)
+    dst[i] = src[i];
+  dst[i] = 0;
+}
+
+
+
+/** LRF frame check byte calculator **/
+static uint8_t checkbyte(uint8_t *data, uint16_t len) {
+
+  uint8_t checksum = 0;
+  uint16_t i;
+
+  for(i = 0; i < len; i++)
+    checksum += data[i];
+
+  checksum ^= 0x50;
+
+  return checksum;
+}
+
+
+
+/** Send an event to the event handler if we have one **/
+static inline void send_event(LRFFrameDecoder *dec, LRFFrameEvent evt) {
+
+  if(dec->evt_handler)
+    dec->evt_handler(dec, evt, dec->evt_handler_ctx);
+}
+
+
+
+/** Decode one byte of a LRF boot string **/
+static void decode_boot_string_byte(LRFFrameDecoder *dec, uint8_t b,
+					uint64_t now_us) {
+
+  /* Handle receiving the boot string entirely separately, as the boot process
+     can send a lot of confusing garbage that may be misconstrued as valid LRF
+     communication frames */
+  switch(dec->nb_dec_buf) {
+
+    /* We're waiting for a LF byte */
+    case 0:
+      if(b == LF)
+        dec->dec_buf[dec->nb_dec_buf++] = b;
+      break;
+
+    /* We're waiting for a CR byte */
+    case 1:
+      if(b == CR) {
+        dec->boot_info.id[0] = 0;
+        dec->boot_info.fwversion[0] = 0;
+        dec->dec_buf[dec->nb_dec_buf++] = b;
+      }
+      break;
+
+    /* We're waiting for the end of the ID string marked by a space, of the end
+       of the firmware string marked by a CR */
+    default:
+
+      /* What character did we get? */
+      switch(b) {
+
+        /* Did we get a space? */
+        case SPACE:
+
+          /* If we already have a firmware version strings, the boot string is
+             invalid: reset the decode buffer */
+          if(dec->boot_info.fwversion[0]) {
+            dec->nb_dec_buf = 0;
+            break;
+          }
+
+          /* If we already have an ID, ignore the space */
+          if(dec->boot_info.id[0])
+            break;
+
+          /* IF the ID is too short, the boot string is invalid: reset the
+             decode buffer */
+          if(dec->nb_dec_buf == 2) {
+            dec->nb_dec_buf = 0;
+            break;
+          }
+
+          /* Store the ID */
+          dec->dec_buf[dec->nb_dec_buf] = 0;
+          strcpy_rstrip(dec->boot_info.id, dec->dec_buf + 2);
+
+          /* "Rewind" the decode buffer */
+          dec->nb_dec_buf = 2;
+          break;
+
+        /* Did we get a CR? */
+        case CR:
+
+          /* If we don't have an ID string, we already have a fiwmare version
+             string or the firmware version is too short, the boot string is
+             invalid: reset the decode buffer */
+          if(!dec->boot_info.id[0] || dec->boot_info.fwversion[0] ||
+		dec->nb_dec_buf == 2) {
+            dec->nb_dec_buf = 0;
+            break;
+          }
+
+          /* Store the firmware version */
+          dec->dec_buf[dec->nb_dec_buf] = 0;
+          strcpy_rstrip(dec->boot_info.fwversion, dec->dec_buf + 2);
+
+          /* "Rewind" the decode buffer */
+          dec->nb_dec_buf = 2;
+          break;
+
+        /* Did we get a LF? */
+        case LF:
+
+          /* If we don't have ID or a firmware version strings, the boot string
+             is invalid: reset the decode buffer */
+          if(!dec->boot_info.id[0] || !dec->boot_info.fwversion[0]) {
+            dec->nb_dec_buf = 0;
+            break;
+          }
+
+          /* Mark the time we received the valid boot string */
+          dec->boot_info.boot_string_rx_tstamp_us = now_us;
+
+          dec->stats.nb_frames[lrf_evt_boot_info]++;
+
+          /* Send the decoded LRF boot information */
+          send_event(dec, lrf_evt_boot_info);
+          break;
+
+        /* We got another character */
+        default:
+
+          /* If the character isn't printable or the decode buffer is too full
+             already - leaving room for the string terminator - the boot string
+             is invalid: reset the decode buffer */
+          if(b < 32 || b >= 127 || dec->nb_dec_buf >= 17 ||
+		dec->nb_dec_buf + 1u >= dec->dec_buf_size) {
+            dec->nb_dec_buf = 0;
+            break;
+          }
+
+          /* Store the character in the decode buffer */
+          dec->dec_buf[dec->nb_dec_buf++] = b;
+          break;
+      }
+
+      break;
+  }
+}
+
+
+
+/** Decode a range measurement response **/
+static bool decode_range_meas(LRFFrameDecoder *dec, uint64_t now_us) {
+
+  UNUSED(now_us);
+
+  /* Decode the 1st distance and amplitude */
+  dec->sample.dist1 = load_le_float(dec->dec_buf + 2);
+  dec->sample.ampl1 = load_le_u16(dec->dec_buf + 6);
+
+  /* Decode the 2nd distance and amplitude */
+  dec->sample.dist2 = load_le_float(dec->dec_buf + 8);
+  dec->sample.ampl2 = load_le_u16(dec->dec_buf + 12);
+
+  /* Decode the 3rd distance and amplitude */
+  dec->sample.dist3 = load_le_float(dec->dec_buf + 14);
+  dec->sample.ampl3 = load_le_u16(dec->dec_buf + 18);
+
+  /* Timestamp the sample with the arrival time of its sync byte */
+  dec->sample.tstamp_us = dec->frame_tstamp_us;
+
+  return true;
+}
+
+
+
+/** Decode a single-target measurement response (SMM, quick SMM, low
+    visibility SMM, CMM or SMM with status) **/
+static bool decode_single_target_meas(LRFFrameDecoder *dec,
+					uint64_t now_us) {
+
+  UNUSED(now_us);
+
+  /* Decode the distance and amplitude */
+  dec->sample.dist1 = load_le_float(dec->dec_buf + 2);
+  dec->sample.ampl1 = load_le_u16(dec->dec_buf + 6);
+
+  /* Only one target is reported */
+  dec->sample.dist2 = 0;
+  dec->sample.ampl2 = 0;
+  dec->sample.dist3 = 0;
+  dec->sample.ampl3 = 0;
+
+  /* If the response carries a status byte, keep it as the first status byte
+     of the LRF status */
+  if(dec->dec_buf[1] == 0x12) {
+    dec->status.statusbyte1 = dec->dec_buf[8];
+    dec->status.statusbyte2 = 0;
+    dec->status.statusbyte3 = 0;
+  }
+
+  /* Timestamp the sample with the arrival time of its sync byte */
+  dec->sample.tstamp_us = dec->frame_tstamp_us;
+
+  return true;
+}
+
+
+
+/** Decode an identification frame response **/
+static bool decode_ident(LRFFrameDecoder *dec, uint64_t now_us) {
+
+  uint8_t electronics;
+  uint8_t fw_major, fw_minor, fw_micro, fw_build;
+  uint16_t fw_version;
+
+  UNUSED(now_us);
+
+  /* Make sure the LRF ID is terminated by CRLF and discard the frame if it
+     isn't */
+  if(dec->dec_buf[17] != CR || dec->dec_buf[18] != LF)
+    return false;
+
+  /* Copy the printable left-hand part of the LRF ID */
+  strcpy_rstrip(dec->ident.id, dec->dec_buf + 2);
+
+  /* Make sure the additional information is terminated by CRLF and discard
+     the frame if it isn't */
+  if(dec->dec_buf[34] != CR || dec->dec_buf[35] != LF)
+    return false;
+
+  /* Copy the printable left-hand part of the additional information */
+  strcpy_rstrip(dec->ident.addinfo, dec->dec_buf + 19);
+
+  /* Make sure the serial number is terminated by CRLF and discard the frame
+     if it isn't */
+  if(dec->dec_buf[46] != CR || dec->dec_buf[47] != LF)
+    return false;
+
+  /* Copy the printable left-hand part of the serial number */
+  strcpy_rstrip(dec->ident.serial, dec->dec_buf + 36);
+
+  /* Decode the firmware version number */
+  fw_version = load_le_u16(dec->dec_buf + 48);
+
+  /* Get the electronics type */
+  electronics = dec->dec_buf[50];
+
+  /* Get the optics type in readable format */
+  snprintf(dec->ident.optics, 4, "%d", dec->dec_buf[51]);
+
+  /* Interpret the firmware version information */
+  fw_major = fw_version >> 12;
+  fw_minor = (fw_version & 0xf00) >> 8;
+  fw_micro = fw_version & 0xff;
+  dec->ident.is_fw_newer_than_x4 = fw_minor > 4 ||
+					(fw_minor == 4 && fw_micro > 0);
+
+  /* Extract the firmware's build number from the electronics type if the
+     firmware is a newer version */
+  if (dec->ident.is_fw_newer_than_x4) {
+    fw_build = electronics;
+    electronics = 0;
+  }
+  else {
+    fw_build = electronics & 0x0f;
+    electronics >>= 4;
+  }
+
+  /* Store the eletronics type in readable format */
+  snprintf(dec->ident.electronics, 4, "%d", electronics);
+
+  /* Store the firmware version in readable format */
+  snprintf(dec->ident.fwversion, 16, "%d.%d.%d.%d",
+		fw_major, fw_minor, fw_micro, fw_build);
+
+  /* Make sure the year, month and day of the build date are ASCII digits and
+     discard the frame if they aren't */
+  if(dec->dec_buf[52] < 0x30 || dec->dec_buf[52] > 0x39 ||
+	dec->dec_buf[53] < 0x30 || dec->dec_buf[53] > 0x39 ||
+	dec->dec_buf[55] < 0x30 || dec->dec_buf[55] > 0x39 ||
+	dec->dec_buf[56] < 0x30 || dec->dec_buf[56] > 0x39 ||
+	dec->dec_buf[58] < 0x30 || dec->dec_buf[58] > 0x39 ||
+	dec->dec_buf[59] < 0x30 || dec->dec_buf[59] > 0x39)
+    return false;
+
+  /* Make sure the date is terminated by CRLF and discard the if it isn't */
+  if(dec->dec_buf[60] != CR || dec->dec_buf[61] != LF)
+    return false;
+
+  /* Make sure the hour, minute and second of the build date are ASCII digits
+     and discard the frame if they aren't */
+  if(dec->dec_buf[62] < 0x30 || dec->dec_buf[62] > 0x39 ||
+	dec->dec_buf[63] < 0x30 || dec->dec_buf[63] > 0x39 ||
+	dec->dec_buf[65] < 0x30 || dec->dec_buf[65] > 0x39 ||
+	dec->dec_buf[66] < 0x30 || dec->dec_buf[66] > 0x39 ||
+	dec->dec_buf[68] < 0x30 || dec->dec_buf[68] > 0x39 ||
+	dec->dec_buf[69] < 0x30 || dec->dec_buf[69] > 0x39)
+    return false;
+
+  /* Get the build date. If the month separator is "/", swap the day and the
+     year */
+  if(dec->dec_buf[57] == SLASH)
+    snprintf(dec->ident.builddate, 20,
+		"20%c%c-%c%c-%c%c %c%c:%c%c:%c%c",
+		dec->dec_buf[58], dec->dec_buf[59],
+		dec->dec_buf[55], dec->dec_buf[56],
+		dec->dec_buf[52], dec->dec_buf[53],
+		dec->dec_buf[62], dec->dec_buf[63],
+		dec->dec_buf[65], dec->dec_buf[66],
+		dec->dec_buf[68], dec->dec_buf[69]);
+  else
+    snprintf(dec->ident.builddate, 20,
+		"20%c%c-%c%c-%c%c %c%c:%c%c:%c%c",
+		dec->dec_buf[52], dec->dec_buf[53],
+		dec->dec_buf[55], dec->dec_buf[56],
+		dec->dec_buf[58], dec->dec_buf[59],
+		dec->dec_buf[62], dec->dec_buf[63],
+		dec->dec_buf[65], dec->dec_buf[66],
+		dec->dec_buf[68], dec->dec_buf[69]);
+
+  return true;
+}
+
+
+
+/** Decode an information frame response **/
+static bool decode_info(LRFFrameDecoder *dec, uint64_t now_us) {
+
+  UNUSED(now_us);
+
+  /* Get the number of transmission retries */
+  dec->info.txretries = dec->dec_buf[2];
+
+  /* Decode the laser pump time */
+  dec->info.txpumptime = load_le_u16(dec->dec_buf + 3);
+
+  /* Decode the number of pulses used in the last measurement */
+  dec->info.pulsesused = load_le_u16(dec->dec_buf + 5);
+
+  /* Decode the transmitter temperature */
+  dec->info.txtemp = dec->dec_buf[7];
+
+  /* Get the APD at first burst */
+  dec->info.apdatfirstburst = dec->dec_buf[8];
+
+  /* Get the 1st target distance */
+  dec->info.targetdist1 = load_le_u16(dec->dec_buf + 10);
+
+  /* Get the 2nd target distance */
+  dec->info.targetdist2 = load_le_u16(dec->dec_buf + 12);
+
+  /* Get the 3rd target distance */
+  dec->info.targetdist3 = load_le_u16(dec->dec_buf + 14);
+
+  /* Get the 1st target magnitude */
+  dec->info.targetmagnitude1 = dec->dec_buf[16];
+
+  /* Get the 2nd target magnitude */
+  dec->info.targetmagnitude2 = dec->dec_buf[17];
+
+  /* Get the 3rd target magnitude */
+  dec->info.targetmagnitude3 = dec->dec_buf[18];
+
+  /* Decode the battery voltage */
+  dec->info.battvoltage = (float)load_le_u16(dec->dec_buf + 20) * 0.001;
+
+  /* Decode the I/O voltage */
+  dec->info.iovoltage = (float)(load_le_u16(dec->dec_buf + 24) - 3300) *
+			0.001;
+
+  /* Decode the receiver voltage */
+  dec->info.rxvoltage = (float)load_le_u16(dec->dec_buf + 26) * 0.01;
+
+  /* Decode the transmitter voltage */
+  dec->info.txvoltage = (float)load_le_u16(dec->dec_buf + 28) * 0.001;
+
+  /* Decode the receiver temperature */
+  dec->info.rxtemp = (float)load_le_i16(dec->dec_buf + 30) * 0.01;
+
+  /* Get status bytes */
+  dec->info.statusbyte1 = dec->dec_buf[32];
+  dec->info.statusbyte2 = dec->dec_buf[33];
+  dec->info.statusbyte3 = dec->dec_buf[34];
+
+  /* Decode the pulse counter */
+  dec->info.pulsectr = load_le_u24(dec->dec_buf + 35) * 1e6;
+
+  /* Get the serial error counter */
+  dec->info.rserrorctr = dec->dec_buf[38];
+
+  return true;
+}
+
+
+
+/** Work out the total length of a read diagnostic data response from the
+    start of the frame. Returns 0 if the lengths in the frame are invalid **/
+static uint32_t get_diag_len(LRFFrameDecoder *dec) {
+
+  uint32_t data_count, histogram_len;
+  uint32_t len = 6;
+
+  /* Decode the data count before the histogram, which includes the data
+     count itself so it can't be 0 */
+  data_count = load_le_u16(dec->dec_buf + 2);
+  if(!data_count)
+    return 0;
+
+  /* Decode the histogram length */
+  histogram_len = load_le_u16(dec->dec_buf + 4);
+
+  /* Neither value can exceed 0xffff, so the total length can't overflow */
+  len += (data_count - 1) * 2;
+  len += histogram_len * 2;
+
+  len++;		/* One last byte for the checkbyte */
+
+  return len;
+}
+
+
+
+/** Report the progress of a diagnostic data download **/
+static void diag_progress(LRFFrameDecoder *dec, uint64_t now_us, bool first) {
+
+  /* Is this the first progress report? */
+  if(first) {
+
+    /* Initialize the LRF diagnostic data: for now set vals to NULL since the
+       download isn't complete */
+    dec->diag.vals = NULL;
+    dec->diag.nb_vals = (dec->nb_dec_buf - 2) / 2;
+    dec->diag.total_vals = (dec->wait_nb_dec_buf - 2 - 1) / 2;
+  }
+
+  /* If this isn't the first report, only report the progress if we have an
+     even number of bytes and we're due to send an update */
+  else if((dec->nb_dec_buf & 1) ||
+		now_us <= dec->last_diag_update_tstamp_us +
+				DIAG_PROGRESS_UPDATE_EVERY * 1000ULL)
+    return;
+
+  else
+    dec->diag.nb_vals = (dec->nb_dec_buf - 2) / 2;
+
+  /* Inform the event handler of the progress of the download */
+  send_event(dec, lrf_evt_diag);
+  dec->last_diag_update_tstamp_us = now_us;
+}
+
+
+
+/** Decode a read diagnostic data response **/
+static bool decode_diag(LRFFrameDecoder *dec, uint64_t now_us) {
+
+#ifndef ENDIAN_LOADERS_NATIVE_LE
+  uint16_t j;
+#endif
+
+  UNUSED(now_us);
+
+  /* Point the diagnostic values to the decode buffer */
+  dec->diag.vals = (uint16_t *)(dec->dec_buf + 2) ;
+
+  /* Update the number of values received */
+  dec->diag.nb_vals = dec->diag.total_vals;
+
+#ifndef ENDIAN_LOADERS_NATIVE_LE
+  /* Fix up the diagnostic values' endianness */
+  for(j = 0; j < dec->diag.nb_vals; j++)
+    dec->diag.vals[j] = load_le_u16((uint8_t *)&dec->diag.vals[j]);
+#endif
+
+  return true;
+}
+
+
+
+/** Decode a status query response **/
+static bool decode_status(LRFFrameDecoder *dec, uint64_t now_us) {
+
+  UNUSED(now_us);
+
+  /* Get the status bytes */
+  dec->status.statusbyte1 = dec->dec_buf[2];
+  dec->status.statusbyte2 = dec->dec_buf[3];
+  dec->status.statusbyte3 = dec->dec_buf[4];
+
+  return true;
+}
+
+
+
+/** Decode an ask range window response **/
+static bool decode_range_win(LRFFrameDecoder *dec, uint64_t now_us) {
+
+  UNUSED(now_us);
+
+  /* Decode the minimum and maximum ranges */
+  dec->range_win.min_range = load_le_u16(dec->dec_buf + 2);
+  dec->range_win.max_range = load_le_u16(dec->dec_buf + 4);
+
+  return true;
+}
+
+
+
+/** Decode a command acknowledgment **/
+static bool decode_ack(LRFFrameDecoder *dec, uint64_t now_us) {
+
+  UNUSED(now_us);
+
+  /* Make sure the frame contains the acknowledgment byte and discard it if it
+     doesn't */
+  if(dec->dec_buf[2] != 0x3c)
+    return false;
+
+  /* Get the acknowledged command */
+  dec->ack.cmd = dec->dec_buf[1];
+
+  return true;
+}
+
+
+
+/** LRF response frame descriptors **/
+static const LRFFrameDescriptor lrf_frame_descs[] = {
+
+	  /* Range measurement */
+	  {0xcc, 22, NULL, NULL, decode_range_meas, lrf_evt_sample},
+
+	  /* SMM */
+	  {0xc3, 9, NULL, NULL, decode_single_target_meas, lrf_evt_sample},
+
+	  /* SMM with status */
+	  {0x12, 10, NULL, NULL, decode_single_target_meas, lrf_evt_sample},
+
+	  /* Low visibility SMM */
+	  {0xd3, 9, NULL, NULL, decode_single_target_meas, lrf_evt_sample},
+
+	  /* Quick SMM */
+	  {0xdd, 9, NULL, NULL, decode_single_target_meas, lrf_evt_sample},
+
+	  /* CMM */
+	  {0xda, 9, NULL, NULL, decode_single_target_meas, lrf_evt_sample},
+
+	  /* Identification frame */
+	  {0xc0, 73, NULL, NULL, decode_ident, lrf_evt_ident},
+
+	  /* Information frame */
+	  {0xc2, 40, NULL, NULL, decode_info, lrf_evt_info},
+
+	  /* Read diagnostic data: 6 bytes needed to know the total length */
+	  {0xdc, 6, get_diag_len, diag_progress, decode_diag, lrf_evt_diag},
+
+	  /* Status query */
+	  {0xc7, 6, NULL, NULL, decode_status, lrf_evt_status},
+
+	  /* Ask range window */
+	  {0x30, 7, NULL, NULL, decode_range_win, lrf_evt_range_win},
+
+	  /* CMM break */
+	  {0xc6, 4, NULL, NULL, decode_ack, lrf_evt_ack},
+
+	  /* Set pointer mode */
+	  {0xc5, 4, NULL, NULL, decode_ack, lrf_evt_ack},
+
+	  /* Set minimum range */
+	  {0x31, 4, NULL, NULL, decode_ack, lrf_evt_ack},
+
+	  /* Set maximum range */
+	  {0x32, 4, NULL, NULL, decode_ack, lrf_evt_ack},
+
+	  /* Set baudrate */
+	  {0xc8, 4, NULL, NULL, decode_ack, lrf_evt_ack},
+
+	  /* Reset RS error counter */
+	  {0xcb, 4, NULL, NULL, decode_ack, lrf_evt_ack},
+	};
+
+/** Command byte to frame descriptor lookup table, built from the frame
+    descriptors the first time a decoder is initialized. Entries hold the
+    descriptor's index + 1, or 0 for unknown command bytes **/
+static uint8_t lrf_frame_desc_idx[256];
+static bool is_lrf_frame_desc_idx_built = false;
+
+
+
+/** Build the command byte to frame descriptor lookup table **/
+static void build_lrf_frame_desc_idx(void) {
+
+  uint8_t i;
+
+  if(is_lrf_frame_desc_idx_built)
+    return;
+
+  for(i = 0; i < sizeof(lrf_frame_descs) / sizeof(LRFFrameDescriptor);
+		i++)
+    lrf_frame_desc_idx[lrf_frame_descs[i].cmd] = i + 1;
+
+  is_lrf_frame_desc_idx_built = true;
+}
+
+
+
+/** Decode one byte of a normal LRF communication frame. Returns true if the
+    frame being decoded turned out to be invalid, in which case the decode
+    buffer still contains the bytes of the invalid frame, including the byte
+    that invalidated it **/
+static bool decode_frame_byte(LRFFrameDecoder *dec, uint8_t b,
+				uint64_t now_us) {
+
+  uint8_t idx;
+
+  switch(dec->nb_dec_buf) {
+
+    /* We're waiting for a sync byte */
+    case 0:
+      if(b == 0x59) {
+        dec->dec_buf[dec->nb_dec_buf++] = b;
+        dec->frame_tstamp_us = now_us;
+      }
+      break;
+
+    /* We're waiting for a command byte */
+    case 1:
+
+      /* Look up the frame descriptor for this command byte */
+      idx = lrf_frame_desc_idx[b];
+
+      /* If we got an unknown command byte, the frame is invalid */
+      if(!idx) {
+        dec->stats.nb_unknown_cmds++;
+        dec->dec_buf[dec->nb_dec_buf++] = b;
+        return true;
+      }
+
+      /* Start decoding the frame, and wait until we get either the entire
+         frame if it has a fixed length, or enough bytes to work out its
+         total length */
+      dec->frame_desc = &lrf_frame_descs[idx - 1];
+      dec->dec_buf[dec->nb_dec_buf++] = b;
+      dec->wait_nb_dec_buf = dec->frame_desc->len;
+
+      /* If the frame - or the start of it we need to work out its length -
+         doesn't fit in the decode buffer, the frame is invalid */
+      if(dec->wait_nb_dec_buf > dec->dec_buf_size) {
+        dec->stats.nb_invalid_lens++;
+        return true;
+      }
+
+      /* Remember whether the frame was found by resynchronizing */
+      dec->is_frame_recovered = dec->is_resyncing;
+      break;
+
+    /* We're decoding a command */
+    default:
+
+      /* Add the byte to the decode buffer. It can't overflow: we never wait
+         for more bytes than the decode buffer can hold, and we stop adding
+         bytes as soon as we have as many as we wait for */
+      dec->dec_buf[dec->nb_dec_buf++] = b;
+
+      /* Do we still not have all the expected data? */
+      if(dec->nb_dec_buf < dec->wait_nb_dec_buf) {
+
+        /* If we're receiving the bulk of a variable-length frame, report the
+           progress if needed */
+        if(dec->frame_desc->progress &&
+		dec->wait_nb_dec_buf > dec->frame_desc->len)
+          dec->frame_desc->progress(dec, now_us, false);
+
+        /* Continue getting data into the decode buffer */
+        break;
+      }
+
+      /* If we're receiving a variable-length frame and we only have the start
+         of the frame, work out the total number of bytes we need to get */
+      if(dec->frame_desc->get_len &&
+		dec->wait_nb_dec_buf == dec->frame_desc->len) {
+
+        dec->wait_nb_dec_buf = dec->frame_desc->get_len(dec);
+
+        /* If the new number of bytes to get is too low or exceeds the size of
+           the decode buffer, the frame is invalid */
+        if(dec->wait_nb_dec_buf <= dec->frame_desc->len ||
+		dec->wait_nb_dec_buf > dec->dec_buf_size) {
+          dec->stats.nb_invalid_lens++;
+          return true;
+        }
+
+        /* Report the progress for the first time if needed */
+        if(dec->frame_desc->progress)
+          dec->frame_desc->progress(dec, now_us, true);
+
+        break;
+      }
+
+      /* We have enough bytes: if the frame's checksum doesn't match, the
+         frame is invalid */
+      if(dec->dec_buf[dec->nb_dec_buf - 1] !=
+			checkbyte(dec->dec_buf, dec->nb_dec_buf - 1)) {
+        dec->stats.nb_checksum_errors++;
+        return true;
+      }
+
+      /* Decode the frame and send the corresponding event if it's valid */
+      if(dec->frame_desc->decode(dec, now_us)) {
+
+        /* Count the frame, and count it as recovered if we found it while
+           resynchronizing */
+        dec->stats.nb_frames[dec->frame_desc->evt]++;
+        if(dec->is_frame_recovered)
+          dec->stats.nb_frames_recovered++;
+
+        send_event(dec, dec->frame_desc->evt);
+      }
+
+      /* Clear the decode buffer */
+      dec->nb_dec_buf = 0;
+
+      break;
+  }
+
+  return false;
+}
+
+
+
+#ifndef LRF_FRAME_DECODER_NO_RESYNC
+/** Resynchronize the decoder after an invalid frame: instead of discarding
+    all the bytes of the invalid frame, look for the next sync byte in them
+    and decode the bytes again from there, in case a valid frame started
+    within the invalid frame. The arrival time of a sync byte found that way
+    is unknown, so a recovered frame is timestamped with the time of the data
+    being fed in **/
+static void resync_frame_decoder(LRFFrameDecoder *dec, uint64_t now_us) {
+
+  uint8_t *buf = dec->dec_buf;
+  uint32_t nb_bytes, start, pos;
+
+  /* Number of bytes of the invalid frame in the decode buffer */
+  nb_bytes = dec->nb_dec_buf;
+
+  dec->is_resyncing = true;
+  dec->nb_dec_buf = 0;
+  start = 0;
+
+  while(1) {
+
+    /* Look for the next sync byte past the start of the invalid frame */
+    for(pos = start + 1; pos < nb_bytes && buf[pos] != 0x59; pos++);
+
+    /* Stop if there's no other sync byte */
+    if(pos >= nb_bytes)
+      break;
+
+    dec->stats.nb_resyncs++;
+
+    /* Decode the bytes again from the sync byte, in place: the decoder
+       writes each frame from the position of its first byte, so it only
+       ever writes a byte back where it reads it from and the bytes are
+       never moved */
+    for(; pos < nb_bytes; pos++) {
+      if(!dec->nb_dec_buf)
+        dec->dec_buf = buf + pos;
+      if(decode_frame_byte(dec, buf[pos], now_us))
+        break;
+    }
+
+    /* Stop if all the bytes were decoded without running into another invalid
+       frame */
+    if(pos >= nb_bytes)
+      break;
+
+    /* Start over from the start of the new invalid frame */
+    start = dec->dec_buf - buf;
+    dec->dec_buf = buf;
+    dec->nb_dec_buf = 0;
+  }
+
+  /* Move the start of the frame being decoded, if any, to the start of the
+     decode buffer */
+  if(dec->dec_buf != buf) {
+    memmove(buf, dec->dec_buf, dec->nb_dec_buf);
+    dec->dec_buf = buf;
+  }
+
+  dec->is_resyncing = false;
+}
+#endif
+
+
+
+/** Initialize a LRF frame decoder **/
+void lrf_frame_decoder_init(LRFFrameDecoder *dec, uint8_t *dec_buf,
+				uint16_t dec_buf_size, uint16_t rx_timeout,
+				void (*evt_handler)(LRFFrameDecoder *,
+							LRFFrameEvent, void *),
+				void *evt_handler_ctx) {
+
+  /* Set the receive timeout */
+  dec->rx_timeout = rx_timeout;
+  dec->last_rx_tstamp_us = 0;
+  dec->last_diag_update_tstamp_us = 0;
+  dec->frame_tstamp_us = 0;
+
+  /* Build the command byte to frame descriptor lookup table if needed */
+  build_lrf_frame_desc_idx();
+
+  /* Not resynchronizing yet */
+  dec->is_resyncing = false;
+  dec->is_frame_recovered = false;
+
+  /* Clear the statistics */
+  lrf_frame_decoder_reset_stats(dec);
+
+  /* Decode normal LRF communication frames by default */
+  dec->boot_string_mode = false;
+
+  /* No diagnostic data yet */
+  dec->diag.vals = NULL;
+  dec->diag.nb_vals = 0;
+  dec->diag.total_vals = 0;
+
+  /* Set the event handler */
+  dec->evt_handler = evt_handler;
+  dec->evt_handler_ctx = evt_handler_ctx;
+
+  /* Set the decode buffer and reset the decoder */
+  lrf_frame_decoder_set_buf(dec, dec_buf, dec_buf_size);
+}
+
+
+
+/** Change the decode buffer and reset the decoder **/
+void lrf_frame_decoder_set_buf(LRFFrameDecoder *dec, uint8_t *dec_buf,
+				uint16_t dec_buf_size) {
+
+  dec->dec_buf = dec_buf;
+  dec->dec_buf_size = dec_buf_size;
+
+  lrf_frame_decoder_reset(dec);
+}
+
+
+
+/** Enable or disable decoding LRF boot strings only **/
+void lrf_frame_decoder_set_boot_string_mode(LRFFrameDecoder *dec,
+						bool enabled) {
+
+  /* If the mode changes, discard whatever we were decoding in the old mode */
+  if(dec->boot_string_mode != enabled) {
+    dec->boot_string_mode = enabled;
+    lrf_frame_decoder_reset(dec);
+  }
+}
+
+
+
+/** Reset the decoder **/
+void lrf_frame_decoder_reset(LRFFrameDecoder *dec) {
+
+  dec->nb_dec_buf = 0;
+  dec->wait_nb_dec_buf = 0;
+}
+
+
+
+/** Reset the decoder statistics **/
+void lrf_frame_decoder_reset_stats(LRFFrameDecoder *dec) {
+
+  memset(&dec->stats, 0, sizeof(LRFFrameDecoderStats));
+}
+
+
+
+/** Feed bytes received at a given time into the decoder and send events to
+    the event handler as frames are decoded
+    Times are in microseconds. first_tstamp_us is the arrival time of the
+    first byte if it's known more precisely than the time the bytes were
+    received, or the same time otherwise. Frames are timestamped with the
+    arrival time of their sync byte, so the caller should feed sync bytes
+    first whenever it knows when they arrived **/
+void lrf_frame_decoder_feed(LRFFrameDecoder *dec, uint8_t *data, uint16_t len,
+				uint64_t now_us, uint64_t first_tstamp_us) {
+
+  uint16_t i;
+
+  /* If too much time has passed since the previous data was received, reset
+     the decode buffer */
+  if(dec->nb_dec_buf && now_us >= dec->last_rx_tstamp_us +
+					dec->rx_timeout * 1000ULL) {
+    dec->stats.nb_rx_timeouts++;
+    dec->nb_dec_buf = 0;
+  }
+
+  dec->last_rx_tstamp_us = now_us;
+
+  /* Process the data we're received */
+  for(i = 0; i < len; i++)
+    if(dec->boot_string_mode)
+      decode_boot_string_byte(dec, data[i], now_us);
+    else if(decode_frame_byte(dec, data[i], i? now_us : first_tstamp_us))
+#ifndef LRF_FRAME_DECODER_NO_RESYNC
+      resync_frame_decoder(dec, now_us);
+#else
+      /* Discard the invalid frame without resynchronizing - only to compare
+         with resynchronizing in the host tests */
+      dec->nb_dec_buf = 0;
+#endif
+}
@@ -0,0 +1,378 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF frame decoder
+ *
+ * Pure byte-stream state machine with no dependency on the Flipper Zero
+ * firmware, so it may also be built and exercised on a host computer
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+/*** Defines ***/
+#define DIAG_PROGRESS_UPDATE_EVERY 250 /*ms*/
+
+
+
+/*** Types ***/
+
+/** LRF sample **/
+typedef struct {
+
+  /* Distances */
+  float dist1;
+  float dist2;
+  float dist3;
+
+  /* Amplitudes */
+  uint16_t ampl1;
+  uint16_t ampl2;
+  uint16_t ampl3;
+
+  /* Reception timestamp: arrival time of the frame's sync byte in
+     microseconds */
+  uint64_t tstamp_us;
+
+} LRFSample;
+
+
+
+/** LRF identification **/
+typedef struct {
+
+  /* Device ID */
+  char id[16];
+
+  /* Additional information */
+  char addinfo[16];
+
+  /* Serial number */
+  char serial[16];
+
+  /* Firmware version */
+  char fwversion[16];
+
+  /* Whether the firmware is newer than x.4.x */
+  bool is_fw_newer_than_x4;
+
+  /* Electronics type */
+  char electronics[4];
+
+  /* Optics type */
+  char optics[4];
+
+  /* Build date */
+  char builddate[32];
+
+} LRFIdent;
+
+
+
+/** LRF information **/
+typedef struct {
+
+  /* Transmission retries */
+  uint8_t txretries;
+
+  /* Laser pump time */
+  uint16_t txpumptime;
+
+  /* Number of pulses used for the last measurement */
+  uint16_t pulsesused;
+
+  /* Transmitter temperature */
+  uint8_t txtemp;
+
+  /* APD at first burst */
+  uint8_t apdatfirstburst;
+
+  /* Target distances */
+  uint16_t targetdist1;
+  uint16_t targetdist2;
+  uint16_t targetdist3;
+
+  /* Target magnitudes */
+  uint8_t targetmagnitude1;
+  uint8_t targetmagnitude2;
+  uint8_t targetmagnitude3;
+
+  /* Battery voltage */
+  float battvoltage;
+
+  /* I/O voltage */
+  float iovoltage;
+
+  /* Receiver voltage */
+  float rxvoltage;
+
+  /* Transmitter voltage */
+  float txvoltage;
+
+  /* Receiver temperature */
+  float rxtemp;
+
+  /* Status bytes */
+  uint8_t statusbyte1;
+  uint8_t statusbyte2;
+  uint8_t statusbyte3;
+
+  /* Pulse counter */
+  uint64_t pulsectr;
+
+  /* Serial error counter */
+  uint8_t rserrorctr;
+
+} LRFInfo;
+
+
+
+/** LRF boot information **/
+typedef struct {
+
+  /* Device ID */
+  char id[16];
+
+  /* Firmware version */
+  char fwversion[16];
+
+  /* Rx timestamp in microseconds */
+  uint64_t boot_string_rx_tstamp_us;
+
+} LRFBootInfo;
+
+
+
+/** LRF diagnostic data **/
+typedef struct {
+
+  /* Diagnostic data values */
+  uint16_t *vals;
+
+  /* Number of values currently read */
+  uint16_t nb_vals;
+
+  /* Total number of values */
+  uint16_t total_vals;
+
+} LRFDiag;
+
+
+
+/** LRF status **/
+typedef struct {
+
+  /* Status bytes */
+  uint8_t statusbyte1;
+  uint8_t statusbyte2;
+  uint8_t statusbyte3;
+
+} LRFStatus;
+
+
+
+/** LRF range window **/
+typedef struct {
+
+  /* Minimum and maximum ranges */
+  uint16_t min_range;
+  uint16_t max_range;
+
+} LRFRangeWindow;
+
+
+
+/** LRF command acknowledgment **/
+typedef struct {
+
+  /* Acknowledged command byte */
+  uint8_t cmd;
+
+} LRFAck;
+
+
+
+/** Events generated by the LRF frame decoder **/
+typedef enum {
+
+  /* A LRF sample was decoded */
+  lrf_evt_sample = 0,
+
+  /* A LRF identification frame was decoded */
+  lrf_evt_ident = 1,
+
+  /* A LRF information frame was decoded */
+  lrf_evt_info = 2,
+
+  /* A LRF boot string was decoded */
+  lrf_evt_boot_info = 3,
+
+  /* Part or all of the diagnostic data was received */
+  lrf_evt_diag = 4,
+
+  /* A LRF status frame was decoded */
+  lrf_evt_status = 5,
+
+  /* A LRF range window frame was decoded */
+  lrf_evt_range_win = 6,
+
+  /* A LRF command acknowledgment was decoded */
+  lrf_evt_ack = 7,
+
+  /* Total number of events */
+  total_lrf_frame_evts = 8,
+
+} LRFFrameEvent;
+
+
+
+/** LRF frame decoder statistics **/
+typedef struct {
+
+  /* Number of frames decoded for each type of event */
+  uint32_t nb_frames[total_lrf_frame_evts];
+
+  /* Number of frames discarded because of a checksum mismatch */
+  uint32_t nb_checksum_errors;
+
+  /* Number of unknown command bytes following a sync byte */
+  uint32_t nb_unknown_cmds;
+
+  /* Number of variable-length frames discarded because of an invalid
+     length */
+  uint32_t nb_invalid_lens;
+
+  /* Number of frames discarded because of a receive timeout */
+  uint32_t nb_rx_timeouts;
+
+  /* Number of resynchronizations, and number of frames recovered by
+     resynchronizing */
+  uint32_t nb_resyncs;
+  uint32_t nb_frames_recovered;
+
+} LRFFrameDecoderStats;
+
+
+
+/** LRF frame decoder **/
+typedef struct _LRFFrameDecoder LRFFrameDecoder;
+
+
+
+/** LRF response frame descriptor **/
+typedef struct {
+
+  /* Command byte */
+  uint8_t cmd;
+
+  /* Total length of the frame if it has a fixed length, or number of bytes
+     needed to work out the total length if it doesn't */
+  uint16_t len;
+
+  /* Function to work out the total length of a variable-length frame from
+     the start of the frame - NULL for fixed-length frames */
+  uint32_t (*get_len)(LRFFrameDecoder *);
+
+  /* Function to report the progress of the reception of a variable-length
+     frame - NULL if not needed */
+  void (*progress)(LRFFrameDecoder *, uint64_t, bool);
+
+  /* Function to decode a complete frame with a valid checkbyte. Returns
+     false if the frame should be discarded */
+  bool (*decode)(LRFFrameDecoder *, uint64_t);
+
+  /* Event to send when the frame is decoded */
+  LRFFrameEvent evt;
+
+} LRFFrameDescriptor;
+
+
+
+struct _LRFFrameDecoder {
+
+  /* Decode buffer */
+  uint8_t *dec_buf;
+  uint16_t nb_dec_buf;
+  uint16_t dec_buf_size;
+
+  /* Descriptor of the frame being decoded */
+  const LRFFrameDescriptor *frame_desc;
+
+  /* Number of bytes needed to complete the frame being decoded */
+  uint32_t wait_nb_dec_buf;
+
+  /* Whether we decode LRF boot strings only */
+  bool boot_string_mode;
+
+  /* Receive timeout in milliseconds, and time at which the last data was fed
+     in */
+  uint16_t rx_timeout;
+  uint64_t last_rx_tstamp_us;
+
+  /* Time at which the last diagnostic data progress event was sent */
+  uint64_t last_diag_update_tstamp_us;
+
+  /* Time at which the sync byte of the frame being decoded was received */
+  uint64_t frame_tstamp_us;
+
+  /* Whether we're resynchronizing after an invalid frame, and whether the
+     frame being decoded was found by resynchronizing */
+  bool is_resyncing;
+  bool is_frame_recovered;
+
+  /* Decoder statistics */
+  LRFFrameDecoderStats stats;
+
+  /* Last decoded sample, identification, information, boot information,
+     diagnostic data, status, range window and command acknowledgment */
+  LRFSample sample;
+  LRFIdent ident;
+  LRFInfo info;
+  LRFBootInfo boot_info;
+  LRFDiag diag;
+  LRFStatus status;
+  LRFRangeWindow range_win;
+  LRFAck ack;
+
+  /* Callback to send decoder events to and the context we should pass it */
+  void (*evt_handler)(LRFFrameDecoder *, LRFFrameEvent, void *);
+  void *evt_handler_ctx;
+
+};
+
+
+
+/*** Routines ***/
+
+/** Initialize a LRF frame decoder **/
+void lrf_frame_decoder_init(LRFFrameDecoder *, uint8_t *, uint16_t, uint16_t,
+				void (*)(LRFFrameDecoder *, LRFFrameEvent,
+						void *), void *);
+
+/** Change the decode buffer and reset the decoder **/
+void lrf_frame_decoder_set_buf(LRFFrameDecoder *, uint8_t *, uint16_t);
+
+/** Enable or disable decoding LRF boot strings only **/
+void lrf_frame_decoder_set_boot_string_mode(LRFFrameDecoder *, bool);
+
+/** Reset the decoder **/
+void lrf_frame_decoder_reset(LRFFrameDecoder *);
+
+/** Reset the decoder statistics **/
+void lrf_frame_decoder_reset_stats(LRFFrameDecoder *);
+
+/** Feed bytes received at a given time into the decoder and send events to
+    the event handler as frames are decoded
+    Times are in microseconds. first_tstamp_us is the arrival time of the
+    first byte if it's known more precisely than the time the bytes were
+    received, or the same time otherwise. Frames are timestamped with the
+    arrival time of their sync byte, so the caller should feed sync bytes
+    first whenever it knows when they arrived **/
+void lrf_frame_decoder_feed(LRFFrameDecoder *, uint8_t *, uint16_t, uint64_t,
+				uint64_t);
@@ -65,14 +65,14 @@ void lrfinfo_view_enter_callback(void *ctx) {
 	  lrfinfo_model->has_ident = false;
 
 	  /* Setup the callback to receive decoded LRF identification frames */
-	  set_lrf_ident_handler(app->lrf_serial_comm_app, lrf_ident_handler,
+	  add_lrf_ident_handler(app->lrf_serial_comm_app, lrf_ident_handler,
 				app);
 
 	  /* Invalidate the current information - if any */
 	  lrfinfo_model->has_info = false;
 
 	  /* Setup the callback to receive decoded LRF information frames */
-	  set_lrf_info_handler(app->lrf_serial_comm_app, lrf_info_handler, app);
+	  add_lrf_info_handler(app->lrf_serial_comm_app, lrf_info_handler, app);
 
 	  /* Send a send-identification-frame command */
 	  send_lrf_command(app->lrf_serial_comm_app, send_ident);
@@ -90,11 +90,11 @@ void lrfinfo_view_exit_callback(void *ctx) {
 
   App *app = (App *)ctx;
 
-  /* Unset the callback to receive decoded LRF information frames */
-  set_lrf_info_handler(app->lrf_serial_comm_app, NULL, app);
+  /* Remove the callback to receive decoded LRF information frames */
+  remove_lrf_info_handler(app->lrf_serial_comm_app, lrf_info_handler, app);
 
-  /* Unset the callback to receive decoded LRF identification frames */
-  set_lrf_ident_handler(app->lrf_serial_comm_app, NULL, app);
+  /* Remove the callback to receive decoded LRF identification frames */
+  remove_lrf_ident_handler(app->lrf_serial_comm_app, lrf_ident_handler, app);
 
   /* Stop the UART */
   stop_uart(app->lrf_serial_comm_app);
@@ -0,0 +1,414 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Test of the LRF sample log format used by the sample view and the log
+ * tool. Runs on Linux - not part of the Flipper Zero app
+ *
+ * Build:
+ *
+ * gcc -O2 -o lrf_log_test lrf_log_test.c lrf_sample_log.c
+ *
+ * or make -C test, which also runs it with make -C test check
+ *
+ * Usage:
+ *
+ * lrf_log_test
+ *
+ * Encodes a long 200 Hz stream of samples into blocks, seals them, checks
+ * them and decodes them back, and fails if the decoded samples differ from
+ * the original samples by more than the 1 mm resolution of the format, if a
+ * corrupted block or index passes its CRC check, if the header doesn't
+ * decode to what was encoded, or if the index doesn't thin itself as
+ * documented or doesn't find the right block to seek to. Reports the
+ * encoding and decoding throughputs
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "lrf_sample_log.h"
+
+
+
+/*** Defines ***/
+#define RATE_HZ 200
+#define NB_SAMPLES (RATE_HZ * 3600)
+#define MAX_BLOCKS (NB_SAMPLES / 100)
+#define NB_INDEX_BLOCKS 100000
+#define NB_FIND_CHECKS 10000
+
+
+
+/*** Routines ***/
+
+/** Monotonic time in nanoseconds **/
+static uint64_t now_ns(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+/** xorshift32 pseudo-random number generator, so the test is the same on
+    every run **/
+static uint32_t test_rand(uint32_t *state) {
+
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return *state = x;
+}
+
+
+
+/** Check that a decoded distance is the original distance to the nearest
+    millimeter **/
+static bool same_dist(float orig, float decoded) {
+
+  if(orig <= 0)
+    return decoded == 0;
+
+  return fabs(decoded - orig) <= 0.0005 + orig * 1e-6;
+}
+
+
+
+/** Check that the header decodes to what was encoded, and that a corrupted
+    header is rejected **/
+static bool test_header(void) {
+
+  uint8_t buf[LRF_LOG_HEADER_SIZE];
+  LRFLogHeader hdr, dec_hdr;
+
+  memset(&hdr, 0, sizeof(hdr));
+  strcpy(hdr.ident.id, "LRF1234");
+  strcpy(hdr.ident.addinfo, "Test");
+  strcpy(hdr.ident.serial, "00123456");
+  strcpy(hdr.ident.fwversion, "1.5.1");
+  hdr.ident.is_fw_newer_than_x4 = true;
+  strcpy(hdr.ident.electronics, "E2");
+  strcpy(hdr.ident.optics, "O3");
+  strcpy(hdr.ident.builddate, "2024-01-02 03:04:05");
+  hdr.mode = 2;
+  hdr.buf = -1000;
+  hdr.stat = 1;
+  hdr.baudrate = 115200;
+  hdr.year = 2024;
+  hdr.month = 12;
+  hdr.day = 31;
+  hdr.hour = 23;
+  hdr.minute = 59;
+  hdr.second = 58;
+
+  lrf_log_encode_header(buf, &hdr);
+
+  memset(&dec_hdr, 0xff, sizeof(dec_hdr));
+  if(!lrf_log_decode_header(buf, &dec_hdr)) {
+    printf("FAILED: the header doesn't decode\n");
+    return false;
+  }
+
+  if(strcmp(dec_hdr.ident.id, hdr.ident.id) ||
+	strcmp(dec_hdr.ident.addinfo, hdr.ident.addinfo) ||
+	strcmp(dec_hdr.ident.serial, hdr.ident.serial) ||
+	strcmp(dec_hdr.ident.fwversion, hdr.ident.fwversion) ||
+	dec_hdr.ident.is_fw_newer_than_x4 != hdr.ident.is_fw_newer_than_x4 ||
+	strcmp(dec_hdr.ident.electronics, hdr.ident.electronics) ||
+	strcmp(dec_hdr.ident.optics, hdr.ident.optics) ||
+	strcmp(dec_hdr.ident.builddate, hdr.ident.builddate) ||
+	dec_hdr.mode != hdr.mode || dec_hdr.buf != hdr.buf ||
+	dec_hdr.stat != hdr.stat || dec_hdr.baudrate != hdr.baudrate ||
+	dec_hdr.year != hdr.year || dec_hdr.month != hdr.month ||
+	dec_hdr.day != hdr.day || dec_hdr.hour != hdr.hour ||
+	dec_hdr.minute != hdr.minute || dec_hdr.second != hdr.second) {
+    printf("FAILED: the header decodes to something else\n");
+    return false;
+  }
+
+  buf[40] ^= 0x10;
+  if(lrf_log_decode_header(buf, &dec_hdr)) {
+    printf("FAILED: a corrupted header passes its check\n");
+    return false;
+  }
+
+  return true;
+}
+
+
+
+/** Encode the samples into blocks and seal them
+    Returns the number of blocks, or 0 if the blocks are too few **/
+static uint32_t encode_blocks(LRFSample *samples, uint32_t nb_samples,
+				uint8_t *blocks, uint32_t max_blocks) {
+
+  LRFLogBlockEncoder enc;
+  uint32_t nb_blocks = 0;
+  uint32_t i;
+
+  lrf_log_start_block(&enc, blocks, 0);
+
+  for(i = 0; i < nb_samples; i++) {
+
+    /* Seal the block when it's full and start the next one */
+    if(!lrf_log_add_sample(&enc, &samples[i])) {
+
+      lrf_log_seal_block(blocks + nb_blocks * LRF_LOG_BLOCK_SIZE);
+      if(++nb_blocks >= max_blocks)
+        return 0;
+
+      lrf_log_start_block(&enc, blocks + nb_blocks * LRF_LOG_BLOCK_SIZE,
+				nb_blocks);
+      lrf_log_add_sample(&enc, &samples[i]);
+    }
+  }
+
+  lrf_log_seal_block(blocks + nb_blocks * LRF_LOG_BLOCK_SIZE);
+
+  return nb_blocks + 1;
+}
+
+
+
+/** Check and decode the blocks, and compare the decoded samples with the
+    original samples
+    Returns the number of samples that decoded correctly, or -1 if a block is
+    rejected or malformed **/
+static int32_t decode_blocks(LRFSample *samples, uint8_t *blocks,
+				uint32_t nb_blocks) {
+
+  LRFLogBlockDecoder dec;
+  LRFLogBlockInfo info;
+  LRFSample sample;
+  int32_t nb_ok = 0;
+  uint32_t i, b;
+
+  for(b = i = 0; b < nb_blocks; b++) {
+
+    if(!lrf_log_check_block(blocks + b * LRF_LOG_BLOCK_SIZE, &info) ||
+	info.seq != b)
+      return -1;
+
+    lrf_log_start_block_decoding(&dec, blocks + b * LRF_LOG_BLOCK_SIZE);
+
+    while(lrf_log_decode_sample(&dec, &sample)) {
+      if(sample.tstamp_us == samples[i].tstamp_us / 1000 * 1000 &&
+		same_dist(samples[i].dist1, sample.dist1) &&
+		same_dist(samples[i].dist2, sample.dist2) &&
+		same_dist(samples[i].dist3, sample.dist3) &&
+		sample.ampl1 == samples[i].ampl1 &&
+		sample.ampl2 == samples[i].ampl2 &&
+		sample.ampl3 == samples[i].ampl3)
+        nb_ok++;
+      i++;
+    }
+
+    if(dec.nb_left)
+      return -1;
+  }
+
+  return nb_ok;
+}
+
+
+
+/** Check that the index thins itself as documented when more blocks are
+    added than it can hold, that it survives being encoded and decoded, and
+    that it finds the last indexed block not newer than a timestamp **/
+static bool test_index(void) {
+
+  static uint8_t buf[LRF_LOG_MAX_INDEX_ENTRIES * LRF_LOG_INDEX_ENTRY_SIZE +
+			LRF_LOG_FOOTER_SIZE];
+  static LRFLogIndex idx, dec_idx;
+  static uint32_t tstamps_ms[NB_INDEX_BLOCKS];
+  uint32_t expected_stride, block_pos, tstamp_ms;
+  uint32_t nb_blocks, seed = 1;
+  int32_t nb_entries;
+  size_t len;
+  uint16_t i;
+  uint32_t j;
+
+  /* Blocks of about 20 seconds of samples */
+  tstamps_ms[0] = 1000;
+  for(j = 1; j < NB_INDEX_BLOCKS; j++)
+    tstamps_ms[j] = tstamps_ms[j - 1] + 15000 + test_rand(&seed) % 10000;
+
+  lrf_log_index_init(&idx);
+
+  for(nb_blocks = 1; nb_blocks <= NB_INDEX_BLOCKS; nb_blocks++) {
+
+    lrf_log_index_add(&idx, nb_blocks - 1, tstamps_ms[nb_blocks - 1]);
+
+    /* The index should hold every stride-th block, with the smallest
+       power-of-two stride that fits all the blocks seen so far */
+    for(expected_stride = 1; (nb_blocks + expected_stride - 1) /
+		expected_stride > LRF_LOG_MAX_INDEX_ENTRIES;
+		expected_stride *= 2);
+
+    if(idx.stride != expected_stride || idx.nb_entries !=
+		(nb_blocks + expected_stride - 1) / expected_stride) {
+      printf("FAILED: index of %d blocks with a stride of %d and %d "
+		"entries instead of %d and %d\n", nb_blocks, idx.stride,
+		idx.nb_entries, expected_stride,
+		(nb_blocks + expected_stride - 1) / expected_stride);
+      return false;
+    }
+
+    for(i = 0; i < idx.nb_entries; i++)
+      if(idx.entries[i].block_pos != i * idx.stride ||
+		idx.entries[i].tstamp_ms != tstamps_ms[i * idx.stride]) {
+        printf("FAILED: wrong entry %d in the index of %d blocks\n", i,
+		nb_blocks);
+        return false;
+      }
+  }
+
+  /* Encode the index and its footer, and decode them back */
+  len = lrf_log_encode_index(buf, &idx);
+
+  if(len != (size_t)idx.nb_entries * LRF_LOG_INDEX_ENTRY_SIZE +
+		LRF_LOG_FOOTER_SIZE ||
+	(nb_entries = lrf_log_decode_footer(buf + len -
+						LRF_LOG_FOOTER_SIZE)) !=
+		idx.nb_entries ||
+	!lrf_log_decode_index(buf, nb_entries, &dec_idx) ||
+	dec_idx.nb_entries != idx.nb_entries ||
+	dec_idx.stride != idx.stride ||
+	memcmp(dec_idx.entries, idx.entries,
+		idx.nb_entries * sizeof(LRFLogIndexEntry))) {
+    printf("FAILED: the index doesn't decode to what was encoded\n");
+    return false;
+  }
+
+  buf[LRF_LOG_INDEX_ENTRY_SIZE * 3 + 1] ^= 0x01;
+  if(lrf_log_decode_index(buf, nb_entries, &dec_idx)) {
+    printf("FAILED: a corrupted index passes its check\n");
+    return false;
+  }
+
+  /* Seek to random timestamps, before the first block too */
+  for(j = 0; j < NB_FIND_CHECKS; j++) {
+
+    tstamp_ms = test_rand(&seed) % (tstamps_ms[NB_INDEX_BLOCKS - 1] + 50000);
+
+    block_pos = 0;
+    for(i = 0; i < idx.nb_entries; i++)
+      if(idx.entries[i].tstamp_ms <= tstamp_ms)
+        block_pos = idx.entries[i].block_pos;
+
+    /* The block found must not be newer than the timestamp, and the next
+       indexed block must be */
+    if(lrf_log_index_find(&idx, tstamp_ms) != block_pos ||
+	(tstamp_ms >= tstamps_ms[0] && tstamps_ms[block_pos] > tstamp_ms) ||
+	(block_pos + idx.stride < NB_INDEX_BLOCKS &&
+		tstamps_ms[block_pos + idx.stride] <= tstamp_ms)) {
+      printf("FAILED: seeking to %d ms finds block %d instead of %d\n",
+		tstamp_ms, lrf_log_index_find(&idx, tstamp_ms), block_pos);
+      return false;
+    }
+  }
+
+  printf("Index of %d blocks: stride %d, %d entries\n", NB_INDEX_BLOCKS,
+		idx.stride, idx.nb_entries);
+
+  return true;
+}
+
+
+
+/** Main routine **/
+int main(void) {
+
+  static LRFSample samples[NB_SAMPLES];
+  uint8_t *blocks, corrupted_block[LRF_LOG_BLOCK_SIZE];
+  LRFLogBlockInfo info;
+  uint64_t start_ns, encode_ns, decode_ns;
+  uint32_t nb_blocks, i;
+  int32_t nb_ok;
+  float dist = 100;
+  uint64_t tstamp_us = 1234567;
+  uint32_t seed = 1;
+  bool failed = false;
+
+  /* Build an hour-long 200 Hz stream with a first target drifting around
+     100 m, a second target 20 m further away returning 70% of the time, a
+     third target returning 10% of the time, and jittery timestamps */
+  for(i = 0; i < NB_SAMPLES; i++) {
+    dist += ((int32_t)(test_rand(&seed) % 201) - 100) / 1000.0f;
+    if(dist < 1)
+      dist = 1;
+    samples[i].dist1 = dist + (test_rand(&seed) % 1000) / 1e6f;
+    samples[i].ampl1 = 1000 + test_rand(&seed) % 100;
+    samples[i].dist2 = test_rand(&seed) % 10 < 7? dist + 20 : 0;
+    samples[i].ampl2 = samples[i].dist2 > 0? 500 : 0;
+    samples[i].dist3 = test_rand(&seed) % 10 < 1? dist + 50 : 0;
+    samples[i].ampl3 = samples[i].dist3 > 0? 100 + test_rand(&seed) % 50 : 0;
+    samples[i].tstamp_us = tstamp_us;
+    tstamp_us += 1000000 / RATE_HZ - 500 + test_rand(&seed) % 1000;
+  }
+
+  if(!(blocks = malloc(MAX_BLOCKS * LRF_LOG_BLOCK_SIZE))) {
+    printf("FAILED: out of memory\n");
+    return 1;
+  }
+
+  failed |= !test_header();
+
+  /* Round trip: encode, seal, check and decode */
+  start_ns = now_ns();
+  nb_blocks = encode_blocks(samples, NB_SAMPLES, blocks, MAX_BLOCKS);
+  encode_ns = now_ns() - start_ns;
+
+  start_ns = now_ns();
+  nb_ok = decode_blocks(samples, blocks, nb_blocks);
+  decode_ns = now_ns() - start_ns;
+
+  if(!nb_blocks) {
+    printf("FAILED: the samples need more than %d blocks\n", MAX_BLOCKS);
+    failed = true;
+  }
+  else if(nb_ok < 0) {
+    printf("FAILED: a sealed block is rejected or malformed\n");
+    failed = true;
+  }
+  else if(nb_ok != NB_SAMPLES) {
+    printf("FAILED: %d of %d samples decode to something else\n",
+		NB_SAMPLES - nb_ok, NB_SAMPLES);
+    failed = true;
+  }
+
+  /* A single bit error in a sealed block must be caught */
+  for(i = 0; nb_blocks && i < LRF_LOG_BLOCK_SIZE * 8; i += 37) {
+    memcpy(corrupted_block, blocks, LRF_LOG_BLOCK_SIZE);
+    corrupted_block[i / 8] ^= 1 << i % 8;
+    if(lrf_log_check_block(corrupted_block, &info)) {
+      printf("FAILED: a block with bit %d flipped passes its check\n", i);
+      failed = true;
+      break;
+    }
+  }
+
+  failed |= !test_index();
+
+  if(nb_blocks)
+    printf("%d samples in %d blocks: %.1f bytes/sample, "
+		"encoding %.1f Msamples/s, decoding %.1f Msamples/s\n",
+		NB_SAMPLES, nb_blocks,
+		(double)nb_blocks * LRF_LOG_BLOCK_SIZE / NB_SAMPLES,
+		NB_SAMPLES * 1e3 / encode_ns, NB_SAMPLES * 1e3 / decode_ns);
+
+  free(blocks);
+
+  return failed? 1 : 0;
+}
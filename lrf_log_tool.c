@@ -0,0 +1,300 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Companion utility to convert LRF sample log files recorded by the sample
+ * view into CSV and print summary statistics. Runs on Linux - not part of
+ * the Flipper Zero app
+ *
+ * Build:
+ *
+ * gcc -O2 -o lrf_log_tool lrf_log_tool.c lrf_sample_log.c
+ *
+ * Usage:
+ *
+ * lrf_log_tool [-n] [-s <start timestamp>] <log file>
+ *
+ * The samples are written to the standard output as CSV and the summary
+ * statistics to the standard error
+ *
+ * -n only prints the summary statistics
+ * -s skips the samples older than the start timestamp in milliseconds,
+ *    seeking with the index of the log file if it has one
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lrf_sample_log.h"
+
+
+
+/*** Types ***/
+
+/** Summary statistics of one target **/
+typedef struct {
+
+  /* Number of valid distances */
+  uint32_t nb_valid;
+
+  /* Smallest, largest and sum of the valid distances */
+  double min_dist;
+  double max_dist;
+  double sum_dist;
+
+  /* Sum of the amplitudes of the valid distances */
+  double sum_ampl;
+
+} TargetStats;
+
+
+
+/*** Routines ***/
+
+/** Add a distance and its amplitude to a target's statistics **/
+static void add_to_target_stats(TargetStats *ts, float dist, uint16_t ampl) {
+
+  if(dist <= 0.5)
+    return;
+
+  if(!ts->nb_valid || dist < ts->min_dist)
+    ts->min_dist = dist;
+
+  if(!ts->nb_valid || dist > ts->max_dist)
+    ts->max_dist = dist;
+
+  ts->sum_dist += dist;
+  ts->sum_ampl += ampl;
+  ts->nb_valid++;
+}
+
+
+
+/** Print a target's statistics **/
+static void print_target_stats(TargetStats *ts, int target) {
+
+  if(!ts->nb_valid)
+    fprintf(stderr, "Target %d:           no valid distance\n", target);
+  else
+    fprintf(stderr, "Target %d:           %u valid distances - "
+			"min %.3f m, mean %.3f m, max %.3f m, "
+			"mean amplitude %.0f\n",
+			target, ts->nb_valid, ts->min_dist,
+			ts->sum_dist / ts->nb_valid, ts->max_dist,
+			ts->sum_ampl / ts->nb_valid);
+}
+
+
+
+/** Main routine **/
+int main(int argc, char **argv) {
+
+  uint8_t header_buf[LRF_LOG_HEADER_SIZE];
+  uint8_t footer[LRF_LOG_FOOTER_SIZE];
+  uint8_t *index_buf;
+  static uint8_t block[LRF_LOG_BLOCK_SIZE];
+  LRFLogHeader header;
+  LRFLogIndex idx;
+  LRFLogBlockInfo info;
+  LRFLogBlockDecoder dec;
+  LRFSample sample;
+  TargetStats ts[3];
+  FILE *f;
+  long file_size, data_end;
+  size_t index_size;
+  int32_t nb_entries;
+  bool has_index = false;
+  bool csv = true;
+  bool has_start = false;
+  uint32_t start_tstamp_ms = 0;
+  uint32_t nb_blocks, block_pos;
+  uint32_t nb_bad_blocks = 0, nb_dropped_blocks = 0;
+  uint32_t nb_bad_blocks_since_prev = 0;
+  uint32_t nb_samples = 0, nb_errors = 0;
+  uint32_t first_tstamp_ms = 0, last_tstamp_ms = 0;
+  uint32_t tstamp_ms;
+  uint32_t prev_seq = 0;
+  bool has_prev_seq = false;
+  double duration;
+  int opt;
+
+  /* Parse the command line */
+  while((opt = getopt(argc, argv, "ns:")) != -1)
+    switch(opt) {
+
+      case 'n':
+        csv = false;
+        break;
+
+      case 's':
+        start_tstamp_ms = strtoul(optarg, NULL, 0);
+        has_start = true;
+        break;
+
+      default:
+        fprintf(stderr, "Usage: %s [-n] [-s <start timestamp>] <log file>\n",
+			argv[0]);
+        return 1;
+    }
+
+  if(optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-n] [-s <start timestamp>] <log file>\n",
+			argv[0]);
+    return 1;
+  }
+
+  /* Open the log file and get its size */
+  if(!(f = fopen(argv[optind], "rb"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  fseek(f, 0, SEEK_END);
+  file_size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  /* Read the header */
+  if(fread(header_buf, 1, sizeof(header_buf), f) != sizeof(header_buf) ||
+	!lrf_log_decode_header(header_buf, &header)) {
+    fprintf(stderr, "%s: not a LRF sample log file\n", argv[optind]);
+    fclose(f);
+    return 1;
+  }
+
+  /* Read the index at the end of the file if there is one. If there isn't,
+     the recording was interrupted: all the complete blocks are read */
+  data_end = file_size;
+  lrf_log_index_init(&idx);
+
+  if(file_size >= LRF_LOG_HEADER_SIZE + LRF_LOG_FOOTER_SIZE) {
+
+    fseek(f, file_size - LRF_LOG_FOOTER_SIZE, SEEK_SET);
+
+    if(fread(footer, 1, sizeof(footer), f) == sizeof(footer) &&
+		(nb_entries = lrf_log_decode_footer(footer)) >= 0) {
+
+      index_size = nb_entries * LRF_LOG_INDEX_ENTRY_SIZE +
+			LRF_LOG_FOOTER_SIZE;
+
+      if(file_size - LRF_LOG_HEADER_SIZE >= (long)index_size &&
+		(index_buf = malloc(index_size))) {
+
+        fseek(f, file_size - index_size, SEEK_SET);
+
+        if(fread(index_buf, 1, index_size, f) == index_size &&
+		lrf_log_decode_index(index_buf, nb_entries, &idx)) {
+          has_index = true;
+          data_end = file_size - index_size;
+        }
+
+        free(index_buf);
+      }
+    }
+  }
+
+  nb_blocks = (data_end - LRF_LOG_HEADER_SIZE) / LRF_LOG_BLOCK_SIZE;
+
+  /* Seek to the first block to read */
+  block_pos = has_start? lrf_log_index_find(&idx, start_tstamp_ms) : 0;
+  fseek(f, LRF_LOG_HEADER_SIZE + (long)block_pos * LRF_LOG_BLOCK_SIZE,
+		SEEK_SET);
+
+  memset(ts, 0, sizeof(ts));
+
+  if(csv)
+    printf("tstamp_ms,dist1,dist2,dist3,ampl1,ampl2,ampl3\n");
+
+  /* Read the blocks */
+  for(; block_pos < nb_blocks; block_pos++) {
+
+    if(fread(block, 1, sizeof(block), f) != sizeof(block))
+      break;
+
+    /* Skip corrupted blocks */
+    if(!lrf_log_check_block(block, &info)) {
+      nb_bad_blocks++;
+      nb_bad_blocks_since_prev++;
+      continue;
+    }
+
+    /* Count the blocks dropped while recording: the gaps in the sequence
+       numbers that aren't explained by corrupted blocks */
+    if(has_prev_seq &&
+		info.seq > prev_seq + 1 + nb_bad_blocks_since_prev)
+      nb_dropped_blocks += info.seq - prev_seq - 1 -
+				nb_bad_blocks_since_prev;
+    prev_seq = info.seq;
+    has_prev_seq = true;
+    nb_bad_blocks_since_prev = 0;
+
+    /* Decode the samples */
+    lrf_log_start_block_decoding(&dec, block);
+
+    while(lrf_log_decode_sample(&dec, &sample)) {
+
+      tstamp_ms = sample.tstamp_us / 1000;
+
+      if(has_start && tstamp_ms < start_tstamp_ms)
+        continue;
+
+      if(csv)
+        printf("%u,%.3f,%.3f,%.3f,%u,%u,%u\n", tstamp_ms,
+			(double)sample.dist1, (double)sample.dist2,
+			(double)sample.dist3,
+			sample.ampl1, sample.ampl2, sample.ampl3);
+
+      if(!nb_samples)
+        first_tstamp_ms = tstamp_ms;
+      last_tstamp_ms = tstamp_ms;
+      nb_samples++;
+
+      /* Count the samples where the LRF encountered an error or hit the eye
+         safety limit */
+      if(sample.dist1 == 0.5 || sample.dist2 == 0.5 || sample.dist3 == 0.5)
+        nb_errors++;
+
+      add_to_target_stats(&ts[0], sample.dist1, sample.ampl1);
+      add_to_target_stats(&ts[1], sample.dist2, sample.ampl2);
+      add_to_target_stats(&ts[2], sample.dist3, sample.ampl3);
+    }
+
+    /* Malformed sample data passed the CRC check */
+    if(dec.nb_left)
+      nb_bad_blocks++;
+  }
+
+  fclose(f);
+
+  /* Print the summary statistics */
+  duration = (last_tstamp_ms - first_tstamp_ms) / 1000.0;
+
+  fprintf(stderr, "LRF serial number:  %s\n",
+		header.ident.serial[0]? header.ident.serial : "unknown");
+  fprintf(stderr, "LRF firmware:       %s\n",
+		header.ident.fwversion[0]? header.ident.fwversion : "unknown");
+  fprintf(stderr, "Recorded on:        %04d-%02d-%02d %02d:%02d:%02d\n",
+		header.year, header.month, header.day,
+		header.hour, header.minute, header.second);
+  fprintf(stderr, "Sampling config:    mode 0x%02x, buffering %d, "
+			"statistic %d, %u bps\n",
+		header.mode, header.buf, header.stat, header.baudrate);
+  fprintf(stderr, "Blocks:             %u (%u corrupted, %u dropped "
+			"while recording)%s\n",
+		nb_blocks, nb_bad_blocks, nb_dropped_blocks,
+		has_index? "" : " - no index, recording interrupted");
+  fprintf(stderr, "Samples:            %u (%u errors)\n",
+		nb_samples, nb_errors);
+
+  if(nb_samples > 1)
+    fprintf(stderr, "Duration:           %.3f s - %.1f Hz\n",
+		duration, duration > 0? (nb_samples - 1) / duration : 0);
+
+  print_target_stats(&ts[0], 1);
+  print_target_stats(&ts[1], 2);
+  print_target_stats(&ts[2], 3);
+
+  return 0;
+}
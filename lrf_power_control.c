@@ -9,6 +9,7 @@
 #include <furi_hal.h>
 #include <furi_hal_gpio.h>
 #include "common.h"
+#include "tstamp.h"
 
 
 
@@ -16,9 +17,9 @@
 
 /** Turn the LRF on or off
     Control the LRF using the C1 pin, and the +5V pin if compiled in
-    If a pointer to a uint32_t variable is passed, store the power change
-    timestamp in that variable **/
-void power_lrf(bool on, uint32_t *power_change_tstamp) {
+    If a pointer to a uint64_t variable is passed, store the power change
+    timestamp in microseconds in that variable **/
+void power_lrf(bool on, uint64_t *power_change_tstamp_us) {
 
 #ifdef USE_5V_PIN
   uint8_t otg_on_attempt = 0;
@@ -38,21 +39,21 @@ void power_lrf(bool on, uint32_t *power_change_tstamp) {
     while(otg_on_attempt < 5) {
 
       if(furi_hal_power_is_otg_enabled()) {
-        if(!otg_on_attempt && power_change_tstamp != NULL)
-          *power_change_tstamp = furi_get_tick();
+        if(!otg_on_attempt && power_change_tstamp_us != NULL)
+          *power_change_tstamp_us = tstamp_us();
         break;
       }
 
       furi_hal_power_enable_otg();
-      if(power_change_tstamp != NULL)
-        *power_change_tstamp = furi_get_tick();
+      if(power_change_tstamp_us != NULL)
+        *power_change_tstamp_us = tstamp_us();
 
       furi_delay_ms(10);
       otg_on_attempt++;
     }
 #else
-    if(power_change_tstamp != NULL)
-      *power_change_tstamp = furi_get_tick();
+    if(power_change_tstamp_us != NULL)
+      *power_change_tstamp_us = tstamp_us();
 #endif
   }
 
@@ -68,7 +69,7 @@ void power_lrf(bool on, uint32_t *power_change_tstamp) {
     /* Set the +5V pin low */
     furi_hal_power_disable_otg();
 #endif
-    if(power_change_tstamp != NULL)
-      *power_change_tstamp = furi_get_tick();
+    if(power_change_tstamp_us != NULL)
+      *power_change_tstamp_us = tstamp_us();
   }
 }
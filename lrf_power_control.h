@@ -9,6 +9,6 @@
 
 /** Turn the LRF on or off
     Control the LRF using the C1 pin, and the +5V pin if compiled in
-    If a pointer to a uint32_t variable is passed, store the power change
-    timestamp in that variable **/
-void power_lrf(bool, uint32_t *);
+    If a pointer to a uint64_t variable is passed, store the power change
+    timestamp in microseconds in that variable **/
+void power_lrf(bool, uint64_t *);
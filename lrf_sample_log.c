@@ -0,0 +1,543 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF sample log format
+***/
+
+/*** Includes ***/
+#include <string.h>
+
+#include "lrf_sample_log.h"
+#include "endian_loaders.h"
+
+
+
+/*** Defines ***/
+#define LRF_LOG_MAGIC "NLRFLOG"		/* 8 bytes with the terminating 0 */
+#define LRF_LOG_INDEX_MAGIC "LIDX"	/* 4 bytes without the terminating 0 */
+
+#define MAX_DIST_MM 2000000000
+
+
+
+/*** Routines ***/
+
+/** Calculate the CRC32 (IEEE 802.3) of a buffer
+    Uses a 16-entry table, processing 4 bits at a time **/
+uint32_t lrf_log_crc32(const uint8_t *buf, size_t len) {
+
+  static const uint32_t crc_table[16] = {
+	0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+	0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+	0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+  uint32_t crc = 0xffffffff;
+
+  while(len--) {
+    crc ^= *buf++;
+    crc = (crc >> 4) ^ crc_table[crc & 0x0f];
+    crc = (crc >> 4) ^ crc_table[crc & 0x0f];
+  }
+
+  return ~crc;
+}
+
+
+
+/** Copy a string into a fixed-size field, padded with zeros **/
+static void encode_str(uint8_t *p, const char *str, size_t len) {
+
+  size_t l;
+
+  for(l = 0; l < len && str[l]; l++);
+
+  memcpy(p, str, l);
+  memset(p + l, 0, len - l);
+}
+
+
+
+/** Copy a fixed-size field into a zero-terminated string **/
+static void decode_str(char *str, const uint8_t *p, size_t len) {
+
+  memcpy(str, p, len);
+  str[len - 1] = 0;
+}
+
+
+
+/** Encode a log file header into a LRF_LOG_HEADER_SIZE-byte buffer **/
+void lrf_log_encode_header(uint8_t *buf, LRFLogHeader *hdr) {
+
+  memset(buf, 0, LRF_LOG_HEADER_SIZE);
+
+  memcpy(buf, LRF_LOG_MAGIC, 8);
+  store_le_u16(buf + 8, LRF_LOG_VERSION);
+  store_le_u16(buf + 10, LRF_LOG_HEADER_SIZE);
+  store_le_u16(buf + 12, LRF_LOG_BLOCK_SIZE);
+
+  /* Sampling configuration */
+  buf[14] = hdr->mode;
+  buf[15] = hdr->stat;
+  store_le_u16(buf + 16, hdr->buf);
+  store_le_u32(buf + 20, hdr->baudrate);
+
+  /* Date and time the recording started */
+  store_le_u16(buf + 18, hdr->year);
+  buf[24] = hdr->month;
+  buf[25] = hdr->day;
+  buf[26] = hdr->hour;
+  buf[27] = hdr->minute;
+  buf[28] = hdr->second;
+
+  /* LRF identification */
+  buf[29] = hdr->ident.is_fw_newer_than_x4;
+  encode_str(buf + 32, hdr->ident.id, sizeof(hdr->ident.id));
+  encode_str(buf + 48, hdr->ident.addinfo, sizeof(hdr->ident.addinfo));
+  encode_str(buf + 64, hdr->ident.serial, sizeof(hdr->ident.serial));
+  encode_str(buf + 80, hdr->ident.fwversion, sizeof(hdr->ident.fwversion));
+  encode_str(buf + 96, hdr->ident.electronics,
+		sizeof(hdr->ident.electronics));
+  encode_str(buf + 100, hdr->ident.optics, sizeof(hdr->ident.optics));
+  encode_str(buf + 104, hdr->ident.builddate, sizeof(hdr->ident.builddate));
+
+  store_le_u32(buf + LRF_LOG_HEADER_SIZE - 4,
+		lrf_log_crc32(buf, LRF_LOG_HEADER_SIZE - 4));
+}
+
+
+
+/** Decode a LRF_LOG_HEADER_SIZE-byte log file header
+    Returns false if the header is invalid **/
+bool lrf_log_decode_header(const uint8_t *buf, LRFLogHeader *hdr) {
+
+  /* Check the header */
+  if(memcmp(buf, LRF_LOG_MAGIC, 8) ||
+	load_le_u16(buf + 8) != LRF_LOG_VERSION ||
+	load_le_u16(buf + 10) != LRF_LOG_HEADER_SIZE ||
+	load_le_u16(buf + 12) != LRF_LOG_BLOCK_SIZE ||
+	load_le_u32(buf + LRF_LOG_HEADER_SIZE - 4) !=
+		lrf_log_crc32(buf, LRF_LOG_HEADER_SIZE - 4))
+    return false;
+
+  /* Sampling configuration */
+  hdr->mode = buf[14];
+  hdr->stat = buf[15];
+  hdr->buf = load_le_i16(buf + 16);
+  hdr->baudrate = load_le_u32(buf + 20);
+
+  /* Date and time the recording started */
+  hdr->year = load_le_u16(buf + 18);
+  hdr->month = buf[24];
+  hdr->day = buf[25];
+  hdr->hour = buf[26];
+  hdr->minute = buf[27];
+  hdr->second = buf[28];
+
+  /* LRF identification */
+  hdr->ident.is_fw_newer_than_x4 = buf[29];
+  decode_str(hdr->ident.id, buf + 32, sizeof(hdr->ident.id));
+  decode_str(hdr->ident.addinfo, buf + 48, sizeof(hdr->ident.addinfo));
+  decode_str(hdr->ident.serial, buf + 64, sizeof(hdr->ident.serial));
+  decode_str(hdr->ident.fwversion, buf + 80, sizeof(hdr->ident.fwversion));
+  decode_str(hdr->ident.electronics, buf + 96,
+		sizeof(hdr->ident.electronics));
+  decode_str(hdr->ident.optics, buf + 100, sizeof(hdr->ident.optics));
+  decode_str(hdr->ident.builddate, buf + 104, sizeof(hdr->ident.builddate));
+
+  return true;
+}
+
+
+
+/** Encode an unsigned value as a variable-length integer: 7 bits per byte,
+    least significant bits first, with the MSB set in all but the last byte
+    Returns the number of bytes encoded **/
+static uint8_t encode_varint(uint8_t *p, uint32_t v) {
+
+  uint8_t n = 0;
+
+  while(v >= 0x80) {
+    p[n++] = v | 0x80;
+    v >>= 7;
+  }
+  p[n++] = v;
+
+  return n;
+}
+
+
+
+/** Encode a signed value as a variable-length integer, zigzag-encoded so
+    small negative values stay short **/
+static uint8_t encode_svarint(uint8_t *p, int32_t v) {
+
+  return encode_varint(p, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+
+
+/** Decode a variable-length integer
+    Returns false if the integer runs past the end of the buffer or is too
+    long **/
+static bool decode_varint(LRFLogBlockDecoder *dec, uint32_t *v) {
+
+  uint8_t shift = 0;
+  uint8_t b;
+
+  *v = 0;
+
+  do {
+    if(dec->p >= dec->end || shift > 28)
+      return false;
+
+    b = *dec->p++;
+    *v |= (uint32_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while(b & 0x80);
+
+  return true;
+}
+
+
+
+/** Decode a zigzag-encoded signed variable-length integer **/
+static bool decode_svarint(LRFLogBlockDecoder *dec, int32_t *v) {
+
+  uint32_t u;
+
+  if(!decode_varint(dec, &u))
+    return false;
+
+  *v = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+
+  return true;
+}
+
+
+
+/** Convert a distance in meters into a distance in millimeters **/
+static int32_t dist_to_mm(float dist) {
+
+  if(dist <= 0)
+    return 0;
+
+  if(dist >= MAX_DIST_MM / 1000.0f)
+    return MAX_DIST_MM;
+
+  return (int32_t)(dist * 1000 + 0.5f);
+}
+
+
+
+/** Start encoding a LRF_LOG_BLOCK_SIZE-byte block of samples **/
+void lrf_log_start_block(LRFLogBlockEncoder *enc, uint8_t *block,
+				uint32_t seq) {
+
+  enc->block = block;
+  enc->len = LRF_LOG_BLOCK_HEADER_SIZE;
+  enc->nb_samples = 0;
+
+  store_le_u32(block, seq);
+  store_le_u32(block + 4, 0);
+  store_le_u16(block + 8, 0);
+  store_le_u16(block + 10, enc->len);
+}
+
+
+
+/** Add a sample to the block being encoded
+    Returns false if the sample doesn't fit in the block **/
+bool lrf_log_add_sample(LRFLogBlockEncoder *enc, LRFSample *sample) {
+
+  uint8_t buf[LRF_LOG_MAX_SAMPLE_SIZE];
+  uint32_t tstamp_ms;
+  int32_t dist_mm[3];
+  uint16_t ampl[3];
+  uint8_t n = 0;
+  uint8_t t;
+
+  /* Samples are logged with millisecond timestamps */
+  tstamp_ms = sample->tstamp_us / 1000;
+
+  /* The first sample in the block is encoded against its own timestamp and
+     null distances and amplitudes, so each block can be decoded on its own */
+  if(!enc->nb_samples) {
+    enc->prev_tstamp_ms = tstamp_ms;
+    for(t = 0; t < 3; t++) {
+      enc->prev_dist_mm[t] = 0;
+      enc->prev_ampl[t] = 0;
+    }
+  }
+
+  dist_mm[0] = dist_to_mm(sample->dist1);
+  dist_mm[1] = dist_to_mm(sample->dist2);
+  dist_mm[2] = dist_to_mm(sample->dist3);
+  ampl[0] = sample->ampl1;
+  ampl[1] = sample->ampl2;
+  ampl[2] = sample->ampl3;
+
+  /* Encode the differences with the previous sample */
+  n += encode_varint(buf + n, tstamp_ms - enc->prev_tstamp_ms);
+
+  for(t = 0; t < 3; t++)
+    n += encode_svarint(buf + n, dist_mm[t] - enc->prev_dist_mm[t]);
+
+  for(t = 0; t < 3; t++)
+    n += encode_svarint(buf + n, (int32_t)ampl[t] - enc->prev_ampl[t]);
+
+  /* Does the sample fit before the block's CRC? */
+  if(enc->len + n > LRF_LOG_BLOCK_SIZE - 4)
+    return false;
+
+  memcpy(enc->block + enc->len, buf, n);
+  enc->len += n;
+
+  /* The first sample's timestamp is the block's timestamp */
+  if(!enc->nb_samples)
+    store_le_u32(enc->block + 4, tstamp_ms);
+
+  enc->nb_samples++;
+  store_le_u16(enc->block + 8, enc->nb_samples);
+  store_le_u16(enc->block + 10, enc->len);
+
+  enc->prev_tstamp_ms = tstamp_ms;
+  for(t = 0; t < 3; t++) {
+    enc->prev_dist_mm[t] = dist_mm[t];
+    enc->prev_ampl[t] = ampl[t];
+  }
+
+  return true;
+}
+
+
+
+/** Clear the unused end of an encoded block and add its CRC, so it's ready to
+    be written to the log file **/
+void lrf_log_seal_block(uint8_t *block) {
+
+  uint16_t len = load_le_u16(block + 10);
+
+  memset(block + len, 0, LRF_LOG_BLOCK_SIZE - 4 - len);
+  store_le_u32(block + LRF_LOG_BLOCK_SIZE - 4,
+		lrf_log_crc32(block, LRF_LOG_BLOCK_SIZE - 4));
+}
+
+
+
+/** Get the information of a block of samples without checking it **/
+void lrf_log_get_block_info(const uint8_t *block, LRFLogBlockInfo *info) {
+
+  info->seq = load_le_u32(block);
+  info->first_tstamp_ms = load_le_u32(block + 4);
+  info->nb_samples = load_le_u16(block + 8);
+  info->len = load_le_u16(block + 10);
+}
+
+
+
+/** Check a sealed block of samples and get its information
+    Returns false if the block is corrupted **/
+bool lrf_log_check_block(const uint8_t *block, LRFLogBlockInfo *info) {
+
+  if(load_le_u32(block + LRF_LOG_BLOCK_SIZE - 4) !=
+	lrf_log_crc32(block, LRF_LOG_BLOCK_SIZE - 4))
+    return false;
+
+  lrf_log_get_block_info(block, info);
+
+  return info->len >= LRF_LOG_BLOCK_HEADER_SIZE &&
+		info->len <= LRF_LOG_BLOCK_SIZE - 4;
+}
+
+
+
+/** Start decoding a checked block of samples **/
+void lrf_log_start_block_decoding(LRFLogBlockDecoder *dec,
+					const uint8_t *block) {
+
+  LRFLogBlockInfo info;
+  uint8_t t;
+
+  lrf_log_get_block_info(block, &info);
+
+  dec->p = block + LRF_LOG_BLOCK_HEADER_SIZE;
+  dec->end = block + info.len;
+  dec->nb_left = info.nb_samples;
+
+  dec->prev_tstamp_ms = info.first_tstamp_ms;
+  for(t = 0; t < 3; t++) {
+    dec->prev_dist_mm[t] = 0;
+    dec->prev_ampl[t] = 0;
+  }
+}
+
+
+
+/** Decode the next sample in a block
+    Returns false if there are no more samples or the block is malformed **/
+bool lrf_log_decode_sample(LRFLogBlockDecoder *dec, LRFSample *sample) {
+
+  uint32_t tstamp_delta_ms;
+  int32_t delta;
+  uint8_t t;
+
+  if(!dec->nb_left)
+    return false;
+
+  /* Decode the differences with the previous sample */
+  if(!decode_varint(dec, &tstamp_delta_ms))
+    return false;
+  dec->prev_tstamp_ms += tstamp_delta_ms;
+
+  for(t = 0; t < 3; t++) {
+    if(!decode_svarint(dec, &delta))
+      return false;
+    dec->prev_dist_mm[t] += delta;
+  }
+
+  for(t = 0; t < 3; t++) {
+    if(!decode_svarint(dec, &delta))
+      return false;
+    dec->prev_ampl[t] += delta;
+  }
+
+  dec->nb_left--;
+
+  sample->tstamp_us = (uint64_t)dec->prev_tstamp_ms * 1000;
+  sample->dist1 = dec->prev_dist_mm[0] / 1000.0f;
+  sample->dist2 = dec->prev_dist_mm[1] / 1000.0f;
+  sample->dist3 = dec->prev_dist_mm[2] / 1000.0f;
+  sample->ampl1 = dec->prev_ampl[0];
+  sample->ampl2 = dec->prev_ampl[1];
+  sample->ampl3 = dec->prev_ampl[2];
+
+  return true;
+}
+
+
+
+/** Empty an index **/
+void lrf_log_index_init(LRFLogIndex *idx) {
+
+  idx->nb_entries = 0;
+  idx->stride = 1;
+}
+
+
+
+/** Add a block written at a given position in the file to the index **/
+void lrf_log_index_add(LRFLogIndex *idx, uint32_t block_pos,
+			uint32_t tstamp_ms) {
+
+  uint16_t i, j;
+
+  if(block_pos % idx->stride)
+    return;
+
+  /* If the index is full, keep every other entry and double the stride */
+  if(idx->nb_entries >= LRF_LOG_MAX_INDEX_ENTRIES) {
+
+    for(i = j = 0; i < idx->nb_entries; i++)
+      if(!(idx->entries[i].block_pos % (idx->stride * 2)))
+        idx->entries[j++] = idx->entries[i];
+
+    idx->nb_entries = j;
+    idx->stride *= 2;
+
+    if(block_pos % idx->stride)
+      return;
+  }
+
+  idx->entries[idx->nb_entries].block_pos = block_pos;
+  idx->entries[idx->nb_entries].tstamp_ms = tstamp_ms;
+  idx->nb_entries++;
+}
+
+
+
+/** Encode an index followed by the log file footer
+    Returns the number of bytes encoded **/
+size_t lrf_log_encode_index(uint8_t *buf, LRFLogIndex *idx) {
+
+  uint8_t *p = buf;
+  uint16_t i;
+
+  for(i = 0; i < idx->nb_entries; i++, p += LRF_LOG_INDEX_ENTRY_SIZE) {
+    store_le_u32(p, idx->entries[i].block_pos);
+    store_le_u32(p + 4, idx->entries[i].tstamp_ms);
+  }
+
+  /* Footer: number of entries, stride, CRC of the entries and of the
+     footer up to the CRC, and magic at the very end of the file */
+  store_le_u32(p, idx->nb_entries);
+  store_le_u32(p + 4, idx->stride);
+  store_le_u32(p + 8, lrf_log_crc32(buf, p + 8 - buf));
+  memcpy(p + 12, LRF_LOG_INDEX_MAGIC, 4);
+
+  return p + LRF_LOG_FOOTER_SIZE - buf;
+}
+
+
+
+/** Decode a LRF_LOG_FOOTER_SIZE-byte log file footer
+    Returns the number of index entries before the footer, or -1 if there is
+    no valid footer **/
+int32_t lrf_log_decode_footer(const uint8_t *footer) {
+
+  uint32_t nb_entries;
+
+  if(memcmp(footer + 12, LRF_LOG_INDEX_MAGIC, 4))
+    return -1;
+
+  nb_entries = load_le_u32(footer);
+
+  return nb_entries <= LRF_LOG_MAX_INDEX_ENTRIES? (int32_t)nb_entries : -1;
+}
+
+
+
+/** Decode an index followed by the log file footer
+    Returns false if the index is invalid **/
+bool lrf_log_decode_index(const uint8_t *buf, uint16_t nb_entries,
+				LRFLogIndex *idx) {
+
+  const uint8_t *p = buf;
+  const uint8_t *footer = buf + nb_entries * LRF_LOG_INDEX_ENTRY_SIZE;
+  uint16_t i;
+
+  if(load_le_u32(footer) != nb_entries ||
+	load_le_u32(footer + 8) != lrf_log_crc32(buf, footer + 8 - buf))
+    return false;
+
+  for(i = 0; i < nb_entries; i++, p += LRF_LOG_INDEX_ENTRY_SIZE) {
+    idx->entries[i].block_pos = load_le_u32(p);
+    idx->entries[i].tstamp_ms = load_le_u32(p + 4);
+  }
+
+  idx->nb_entries = nb_entries;
+  idx->stride = load_le_u32(footer + 4);
+
+  return true;
+}
+
+
+
+/** Find the position of the last indexed block whose first sample isn't
+    newer than a timestamp, to start reading from **/
+uint32_t lrf_log_index_find(LRFLogIndex *idx, uint32_t tstamp_ms) {
+
+  uint16_t lo = 0, hi = idx->nb_entries, mid;
+
+  /* Binary search for the first entry newer than the timestamp */
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(idx->entries[mid].tstamp_ms <= tstamp_ms)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo? idx->entries[lo - 1].block_pos : 0;
+}
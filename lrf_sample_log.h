@@ -0,0 +1,214 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF sample log format
+ *
+ * Encoder and reader of the binary files the raw LRF samples are recorded
+ * into, with no dependency on the Flipper Zero firmware. A log file is made
+ * of:
+ *
+ *  - A header holding the LRF identification and the sampling configuration
+ *  - Fixed-size blocks of delta-encoded samples, each with a CRC. Each block
+ *    can be decoded on its own
+ *  - A trailing sparse index of the timestamps of the blocks, for seeking.
+ *    The index is missing if the recording was interrupted
+ *
+ * All the multi-byte values are little-endian. Distances are stored with a
+ * 1 mm resolution
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lrf_frame_decoder.h"
+
+
+
+/*** Defines ***/
+#define LRF_LOG_VERSION 1
+
+#define LRF_LOG_HEADER_SIZE 256		/* bytes */
+#define LRF_LOG_BLOCK_SIZE 4096		/* bytes */
+#define LRF_LOG_BLOCK_HEADER_SIZE 12	/* bytes */
+#define LRF_LOG_FOOTER_SIZE 16		/* bytes */
+#define LRF_LOG_INDEX_ENTRY_SIZE 8	/* bytes */
+
+#define LRF_LOG_MAX_INDEX_ENTRIES 256
+#define LRF_LOG_MAX_SAMPLE_SIZE 35	/* bytes: 7 varints of up to 5 bytes */
+
+
+
+/*** Types ***/
+
+/** Log file header **/
+typedef struct {
+
+  /* LRF identification - blank if unknown */
+  LRFIdent ident;
+
+  /* Sampling configuration */
+  uint8_t mode;
+  int16_t buf;
+  uint8_t stat;
+  uint32_t baudrate;
+
+  /* Date and time the recording started */
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+
+} LRFLogHeader;
+
+
+
+/** Block of samples information **/
+typedef struct {
+
+  /* Block sequence number. Gaps in the sequence numbers of consecutive
+     blocks indicate dropped blocks */
+  uint32_t seq;
+
+  /* Timestamp of the first sample in the block */
+  uint32_t first_tstamp_ms;
+
+  /* Number of samples in the block */
+  uint16_t nb_samples;
+
+  /* Number of bytes used in the block, including the block header */
+  uint16_t len;
+
+} LRFLogBlockInfo;
+
+
+
+/** Block of samples encoder **/
+typedef struct {
+
+  /* Block being encoded, and number of bytes used in it */
+  uint8_t *block;
+  uint16_t len;
+
+  /* Number of samples in the block */
+  uint16_t nb_samples;
+
+  /* Previous sample in the block, that the next sample is encoded against */
+  uint32_t prev_tstamp_ms;
+  int32_t prev_dist_mm[3];
+  uint16_t prev_ampl[3];
+
+} LRFLogBlockEncoder;
+
+
+
+/** Block of samples decoder **/
+typedef struct {
+
+  /* Next byte to decode and end of the encoded samples */
+  const uint8_t *p;
+  const uint8_t *end;
+
+  /* Number of samples left to decode */
+  uint16_t nb_left;
+
+  /* Previous decoded sample */
+  uint32_t prev_tstamp_ms;
+  int32_t prev_dist_mm[3];
+  uint16_t prev_ampl[3];
+
+} LRFLogBlockDecoder;
+
+
+
+/** Index entry **/
+typedef struct {
+
+  /* Position of the block in the file - 0 for the first block after the
+     header - and timestamp of its first sample */
+  uint32_t block_pos;
+  uint32_t tstamp_ms;
+
+} LRFLogIndexEntry;
+
+
+
+/** Sparse index of the blocks
+    Holds one entry every stride blocks. When the index is full, every other
+    entry is discarded and the stride doubles, so the index stays the same
+    size however long the recording **/
+typedef struct {
+
+  LRFLogIndexEntry entries[LRF_LOG_MAX_INDEX_ENTRIES];
+  uint16_t nb_entries;
+  uint32_t stride;
+
+} LRFLogIndex;
+
+
+
+/*** Routines ***/
+
+/** Calculate the CRC32 (IEEE 802.3) of a buffer **/
+uint32_t lrf_log_crc32(const uint8_t *, size_t);
+
+/** Encode a log file header into a LRF_LOG_HEADER_SIZE-byte buffer **/
+void lrf_log_encode_header(uint8_t *, LRFLogHeader *);
+
+/** Decode a LRF_LOG_HEADER_SIZE-byte log file header
+    Returns false if the header is invalid **/
+bool lrf_log_decode_header(const uint8_t *, LRFLogHeader *);
+
+/** Start encoding a LRF_LOG_BLOCK_SIZE-byte block of samples **/
+void lrf_log_start_block(LRFLogBlockEncoder *, uint8_t *, uint32_t);
+
+/** Add a sample to the block being encoded
+    Returns false if the sample doesn't fit in the block **/
+bool lrf_log_add_sample(LRFLogBlockEncoder *, LRFSample *);
+
+/** Clear the unused end of an encoded block and add its CRC, so it's ready to
+    be written to the log file **/
+void lrf_log_seal_block(uint8_t *);
+
+/** Get the information of a block of samples without checking it **/
+void lrf_log_get_block_info(const uint8_t *, LRFLogBlockInfo *);
+
+/** Check a sealed block of samples and get its information
+    Returns false if the block is corrupted **/
+bool lrf_log_check_block(const uint8_t *, LRFLogBlockInfo *);
+
+/** Start decoding a checked block of samples **/
+void lrf_log_start_block_decoding(LRFLogBlockDecoder *, const uint8_t *);
+
+/** Decode the next sample in a block
+    Returns false if there are no more samples or the block is malformed **/
+bool lrf_log_decode_sample(LRFLogBlockDecoder *, LRFSample *);
+
+/** Empty an index **/
+void lrf_log_index_init(LRFLogIndex *);
+
+/** Add a block written at a given position in the file to the index **/
+void lrf_log_index_add(LRFLogIndex *, uint32_t, uint32_t);
+
+/** Encode an index followed by the log file footer
+    Returns the number of bytes encoded **/
+size_t lrf_log_encode_index(uint8_t *, LRFLogIndex *);
+
+/** Decode a LRF_LOG_FOOTER_SIZE-byte log file footer
+    Returns the number of index entries before the footer, or -1 if there is
+    no valid footer **/
+int32_t lrf_log_decode_footer(const uint8_t *);
+
+/** Decode an index followed by the log file footer
+    Returns false if the index is invalid **/
+bool lrf_log_decode_index(const uint8_t *, uint16_t, LRFLogIndex *);
+
+/** Find the position of the last indexed block whose first sample isn't
+    newer than a timestamp, to start reading from **/
+uint32_t lrf_log_index_find(LRFLogIndex *, uint32_t);
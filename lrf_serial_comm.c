@@ -11,18 +11,15 @@
 
 #include "lrf_serial_comm.h"
 #include "led_control.h"
+#include "tstamp.h"
 
 
 
 /*** Defines ***/
 #define TAG "lrf_serial_comm"
 
-#define UART_RX_STREAM_BUF_SIZE 1024
-
-#define LF 10
-#define CR 13
-#define SPACE 32
-#define SLASH 47
+#define UART_RX_RING_BUF_SIZE 1024	/* Must be a power of 2 */
+#define UART_RX_SYNC_TSTAMPS_SIZE 128	/* Must be a power of 2 */
 
 
 
@@ -42,6 +39,7 @@ static uint8_t cmd_pointer_off[] = "\xc5\x00\x95";
 static uint8_t cmd_send_ident[] = "\xc0\x90";
 static uint8_t cmd_send_info[] = "\xc2\x92";
 static uint8_t cmd_read_diag[] = "\xdc\x8c";
+static uint8_t cmd_quick_smm[] = "\xdd\x00\x8d";
 
 static uint8_t *lrf_cmds[] = {
 	  cmd_smm,		/* smm */
@@ -57,6 +55,7 @@ static uint8_t *lrf_cmds[] = {
 	  cmd_send_ident,	/* send_ident */
 	  cmd_send_info,	/* send_info */
 	  cmd_read_diag,	/* read_diag */
+	  cmd_quick_smm,	/* quick_smm */
 	};
 
 static const uint8_t lrf_cmds_len[] = {
@@ -73,6 +72,7 @@ static const uint8_t lrf_cmds_len[] = {
 	  sizeof(cmd_send_ident),	/* send_ident */
 	  sizeof(cmd_send_info),	/* send_info */
 	  sizeof(cmd_read_diag),	/* read_diag */
+	  sizeof(cmd_quick_smm),	/* quick_smm */
 	};
 
 static const char *lrf_cmds_desc[] = {
@@ -89,12 +89,135 @@ static const char *lrf_cmds_desc[] = {
 	  "Send identification frame",	/* send_ident */
 	  "Send infornation frame",	/* send_info */
 	  "Read diagnostic data",	/* read_diag */
+	  "Quick SMM command",		/* quick_smm */
+	};
+
+/** Command byte of the response each LRF command should get, or 0 if the
+    command isn't acknowledged in a way we can wait for **/
+static const uint8_t lrf_cmds_resp[] = {
+	  0,		/* smm: a measurement may take a long time or fail */
+	  0,		/* cmm_1hz: samples are streamed without acknowledgment */
+	  0,		/* cmm_4hz */
+	  0,		/* cmm_10hz */
+	  0,		/* cmm_20hz */
+	  0,		/* cmm_100hz */
+	  0,		/* cmm_200hz */
+	  0xc6,		/* cmm_break */
+	  0xc5,		/* pointer_on */
+	  0xc5,		/* pointer_off */
+	  0xc0,		/* send_ident */
+	  0xc2,		/* send_info */
+	  0,		/* read_diag: the download may take a long time */
+	  0xdd,		/* quick_smm: wait for the measurement so quick SMM
+			   commands can be sent back to back */
+	};
+
+/** Whether each LRF command is resent if its response doesn't come in time.
+    Only the commands we wait for a response to are ever resent **/
+static const bool lrf_cmds_resent[] = {
+	  true,		/* smm */
+	  true,		/* cmm_1hz */
+	  true,		/* cmm_4hz */
+	  true,		/* cmm_10hz */
+	  true,		/* cmm_20hz */
+	  true,		/* cmm_100hz */
+	  true,		/* cmm_200hz */
+	  true,		/* cmm_break */
+	  true,		/* pointer_on */
+	  true,		/* pointer_off */
+	  true,		/* send_ident */
+	  true,		/* send_info */
+	  true,		/* read_diag */
+	  false,	/* quick_smm: a resent shot would fire the laser again,
+			   and the late response to the first shot would be
+			   taken for the response to the resent one */
 	};
 
 
 
 /*** Types ***/
 
+/** UART transmit request type **/
+typedef enum {
+
+  /* Send data to the LRF */
+  lrf_tx_data = 0,
+
+  /* Call the completion callback when all the previous requests are done */
+  lrf_tx_sync = 1,
+
+  /* Stop the UART transmit thread */
+  lrf_tx_stop = 2,
+
+} LRFTxRequestType;
+
+
+
+/** UART transmit request **/
+typedef struct {
+
+  /* Request type */
+  LRFTxRequestType type;
+
+  /* Data to send */
+  uint8_t data[LRF_TX_BUF_SIZE];
+  uint8_t len;
+
+  /* Command being sent - no_cmd if the data isn't a command or if the
+     request doesn't send data - and command byte of the response we should
+     wait for, or 0 if we shouldn't wait for a response. Only commands wait
+     for responses */
+  LRFCommand cmd;
+  uint8_t expected_resp;
+
+  /* How many times to resend the data if the response doesn't come */
+  uint8_t max_retries;
+
+  /* Completion callback and the context we should pass it */
+  void (*done_cb)(LRFCommand, bool, void *);
+  void *done_cb_ctx;
+
+} LRFTxRequest;
+
+
+
+/** LRF handler callback **/
+typedef union {
+  void (*raw_data)(uint8_t *, uint16_t, void *);
+  void (*sample)(LRFSample *, void *);
+  void (*ident)(LRFIdent *, void *);
+  void (*info)(LRFInfo *, void *);
+  void (*boot_info)(LRFBootInfo *, void *);
+  void (*diag)(LRFDiag *, void *);
+  void (*status)(LRFStatus *, void *);
+  void (*range_win)(LRFRangeWindow *, void *);
+  void (*ack)(LRFAck *, void *);
+  void (*any)(void);
+} LRFHandlerCb;
+
+
+
+/** LRF handler **/
+typedef struct {
+
+  /* Callback and the context we should pass it */
+  LRFHandlerCb cb;
+  void *ctx;
+
+} LRFHandler;
+
+
+
+/** List of LRF handlers for one type of data **/
+typedef struct {
+
+  LRFHandler handlers[MAX_LRF_HANDLERS];
+  uint8_t nb_handlers;
+
+} LRFHandlerList;
+
+
+
 /** App structure **/
 struct _LRFSerialCommApp {
 
@@ -108,11 +231,70 @@ struct _LRFSerialCommApp {
   /* UART receive thread */
   FuriThread *rx_thread;
 
-  /* UART receive stream buffer */
-  FuriStreamBuffer *rx_stream;
-
-  /* UART receive timeout */
-  uint16_t uart_rx_timeout;
+  /* UART transmit thread and queue of requests it services */
+  FuriThread *tx_thread;
+  FuriMessageQueue *tx_queue;
+
+  /* Command byte of the response the UART transmit thread is waiting for, or
+     0 if it isn't waiting for a response */
+  uint8_t tx_expected_resp;
+
+  /* Arrival time of the sync byte of the last response the UART transmit
+     thread was waiting for - lower 32 bits of the microsecond timestamp -
+     and time between the end of the transmission of the last command and
+     the arrival of its response */
+  uint32_t tx_resp_tstamp_us;
+  uint32_t tx_resp_time_us;
+
+  /* How long to wait for the response to a command and how many times to
+     resend the command if no response comes */
+  uint16_t lrf_cmd_resp_timeout;
+  uint8_t lrf_cmd_max_retries;
+
+  /* Semaphore signalled when all the queued requests are done */
+  FuriSemaphore *tx_sync_sem;
+
+  /* Whether the UART transmit thread should drop the queued requests
+     instead of sending them */
+  bool tx_purge;
+
+  /* UART receive ring buffer, filled by the IRQ callback and emptied by the
+     UART receive thread */
+  uint8_t rx_ring_buf[UART_RX_RING_BUF_SIZE];
+  uint16_t rx_ring_buf_head;
+  uint16_t rx_ring_buf_tail;
+
+  /* Positions in the received byte stream of the next byte the IRQ callback
+     stores in the receive ring buffer, and of the next byte the UART receive
+     thread gets out of it */
+  uint16_t rx_irq_pos;
+  uint16_t rx_thread_pos;
+
+  /* Ring buffer of the positions in the received byte stream and arrival
+     times - lower 32 bits of the microsecond timestamps - of the sync bytes,
+     filled by the IRQ callback and emptied by the UART receive thread */
+  uint16_t rx_sync_pos[UART_RX_SYNC_TSTAMPS_SIZE];
+  uint32_t rx_sync_tstamps_us[UART_RX_SYNC_TSTAMPS_SIZE];
+  uint16_t rx_sync_head;
+  uint16_t rx_sync_tail;
+
+  /* Number of bytes received by the IRQ callback since the UART receive
+     thread was last woken up */
+  uint16_t nb_rx_since_wakeup;
+
+  /* Number of received bytes after which the UART receive thread is woken up
+     without waiting for the line to go idle */
+  uint16_t uart_rx_wakeup_threshold;
+
+  /* Maximum time the UART receive thread waits before checking the receive
+     ring buffer */
+  uint16_t uart_rx_wakeup_timeout;
+
+  /* Number of bytes received, number of bytes dropped because the receive
+     ring buffer was full, and peak receive ring buffer fill */
+  uint32_t nb_rx_bytes;
+  uint32_t nb_dropped_bytes;
+  uint16_t peak_rx_ring_buf_fill;
 
   /* Receive buffer */
   uint8_t rx_buf[UART_RX_BUF_SIZE];
@@ -120,38 +302,18 @@ struct _LRFSerialCommApp {
   /* Default LRF frame decode buffer */
   uint8_t default_dec_buf[128];
 
-  /* Actual LRF frame decode buffer */
-  uint8_t *dec_buf;
-  uint16_t nb_dec_buf;
-  uint16_t dec_buf_size;
+  /* LRF frame decoder */
+  LRFFrameDecoder lrf_frame_decoder;
 
-  /* Callback to send raw received data to and the context we should pass it */
-  void (*lrf_raw_data_handler)(uint8_t *, uint16_t, void *);
-  void *lrf_raw_data_handler_ctx;
+  /* Handlers to send raw received data to */
+  LRFHandlerList raw_data_handlers;
 
-  /* Callback to send a decoded LRF sample to and the context we should
-     pass it */
-  void (*lrf_sample_handler)(LRFSample *, void *);
-  void *lrf_sample_handler_ctx;
+  /* Handlers to send each type of decoded LRF frame to */
+  LRFHandlerList evt_handlers[total_lrf_frame_evts];
 
-  /* Callback to send a decoded LRF identification frame to and the context
-     we should pass it */
-  void (*lrf_ident_handler)(LRFIdent *, void *);
-  void *lrf_ident_handler_ctx;
-
-  /* Callback to send a decoded LRF information frame to and the context
-     we should pass it */
-  void (*lrf_info_handler)(LRFInfo *, void *);
-  void *lrf_info_handler_ctx;
-
-  /* Callback to send a decoded LRF boot string and the context we should
-     pass it */
-  void (*lrf_boot_info_handler)(LRFBootInfo *, void *);
-  void *lrf_boot_info_handler_ctx;
-
-  /* Callback to send diagnostic data to and the context we should pass it */
-  void (*diag_data_handler)(LRFDiag *, void *);
-  void *diag_data_handler_ctx;
+  /* Mutex to add or remove handlers while the UART receive thread isn't
+     calling them */
+  FuriMutex *handlers_mutex;
 
   /* UART channel and handle */
   FuriHalSerialId serial_channel;
@@ -172,59 +334,299 @@ typedef enum {
 
 
 
+/** Transmit thread events **/
+typedef enum {
+  resp_received = 1,
+} tx_thread_evts;
+
+
+
 /*** Routines ***/
 
-/** Set the callback to handle raw data received from the LRF **/
-void set_lrf_raw_data_handler(LRFSerialCommApp *app,
-				void (*cb)(uint8_t *, uint16_t, void *),
-				void *ctx) {
-  app->lrf_raw_data_handler = cb;
-  app->lrf_raw_data_handler_ctx = ctx;
+/** Check whether we're running in one of the UART threads **/
+static bool in_uart_thread(LRFSerialCommApp *app) {
+
+  FuriThreadId thread_id = furi_thread_get_current_id();
+
+  return thread_id == furi_thread_get_id(app->rx_thread) ||
+		thread_id == furi_thread_get_id(app->tx_thread);
+}
+
+
+
+/** Add a handler to a list of handlers **/
+static bool add_handler(LRFSerialCommApp *app, LRFHandlerList *list,
+			LRFHandlerCb cb, void *ctx) {
+
+  bool added = false;
+
+  /* Handlers may not be added by a handler: the list is locked while the
+     handlers are called */
+  furi_check(!in_uart_thread(app));
+
+  furi_check(furi_mutex_acquire(app->handlers_mutex, FuriWaitForever) ==
+		FuriStatusOk);
+
+  /* Add the handler at the end of the list if there's room left */
+  if(list->nb_handlers < MAX_LRF_HANDLERS) {
+    list->handlers[list->nb_handlers].cb = cb;
+    list->handlers[list->nb_handlers].ctx = ctx;
+    list->nb_handlers++;
+    added = true;
+  }
+
+  furi_check(furi_mutex_release(app->handlers_mutex) == FuriStatusOk);
+
+  if(!added)
+    FURI_LOG_E(TAG, "Too many handlers: handler not added");
+
+  return added;
+}
+
+
+
+/** Remove a handler from a list of handlers **/
+static void remove_handler(LRFSerialCommApp *app, LRFHandlerList *list,
+				LRFHandlerCb cb, void *ctx) {
+
+  uint8_t i;
+
+  /* Handlers may not be removed by a handler: the list is locked while the
+     handlers are called */
+  furi_check(!in_uart_thread(app));
+
+  furi_check(furi_mutex_acquire(app->handlers_mutex, FuriWaitForever) ==
+		FuriStatusOk);
+
+  /* Find the handler with the same callback and context */
+  for(i = 0; i < list->nb_handlers &&
+		(list->handlers[i].cb.any != cb.any ||
+		list->handlers[i].ctx != ctx); i++);
+
+  /* If we found it, remove it and close the gap */
+  if(i < list->nb_handlers) {
+    list->nb_handlers--;
+    memmove(&list->handlers[i], &list->handlers[i + 1],
+		(list->nb_handlers - i) * sizeof(LRFHandler));
+  }
+
+  furi_check(furi_mutex_release(app->handlers_mutex) == FuriStatusOk);
 }
 
 
 
-/** Set the callback to handle one received LRF sample **/
-void set_lrf_sample_handler(LRFSerialCommApp *app,
+/** Add a callback to handle raw data received from the LRF **/
+bool add_lrf_raw_data_handler(LRFSerialCommApp *app,
+				void (*cb)(uint8_t *, uint16_t, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.raw_data = cb};
+
+  return add_handler(app, &app->raw_data_handlers,
+			handler_cb, ctx);
+}
+
+
+
+/** Remove a callback that handles raw data received from the LRF **/
+void remove_lrf_raw_data_handler(LRFSerialCommApp *app,
+				void (*cb)(uint8_t *, uint16_t, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.raw_data = cb};
+
+  remove_handler(app, &app->raw_data_handlers,
+			handler_cb, ctx);
+}
+
+
+
+/** Add a callback to handle received LRF samples **/
+bool add_lrf_sample_handler(LRFSerialCommApp *app,
 				void (*cb)(LRFSample *, void *), void *ctx) {
-  app->lrf_sample_handler = cb;
-  app->lrf_sample_handler_ctx = ctx;
+
+  LRFHandlerCb handler_cb = {.sample = cb};
+
+  return add_handler(app, &app->evt_handlers[lrf_evt_sample],
+			handler_cb, ctx);
 }
 
 
 
-/** Set the callback to handle one received LRF identification frame **/
-void set_lrf_ident_handler(LRFSerialCommApp *app,
+/** Remove a callback that handles received LRF samples **/
+void remove_lrf_sample_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFSample *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.sample = cb};
+
+  remove_handler(app, &app->evt_handlers[lrf_evt_sample],
+			handler_cb, ctx);
+}
+
+
+
+/** Add a callback to handle received LRF identification frames **/
+bool add_lrf_ident_handler(LRFSerialCommApp *app,
 				void (*cb)(LRFIdent *, void *), void *ctx) {
-  app->lrf_ident_handler = cb;
-  app->lrf_ident_handler_ctx = ctx;
+
+  LRFHandlerCb handler_cb = {.ident = cb};
+
+  return add_handler(app, &app->evt_handlers[lrf_evt_ident],
+			handler_cb, ctx);
 }
 
 
 
-/** Set the callback to handle one received LRF information frame **/
-void set_lrf_info_handler(LRFSerialCommApp *app,
+/** Remove a callback that handles received LRF identification frames **/
+void remove_lrf_ident_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFIdent *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.ident = cb};
+
+  remove_handler(app, &app->evt_handlers[lrf_evt_ident],
+			handler_cb, ctx);
+}
+
+
+
+/** Add a callback to handle received LRF information frames **/
+bool add_lrf_info_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFInfo *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.info = cb};
+
+  return add_handler(app, &app->evt_handlers[lrf_evt_info],
+			handler_cb, ctx);
+}
+
+
+
+/** Remove a callback that handles received LRF information frames **/
+void remove_lrf_info_handler(LRFSerialCommApp *app,
 				void (*cb)(LRFInfo *, void *), void *ctx) {
-  app->lrf_info_handler = cb;
-  app->lrf_info_handler_ctx = ctx;
+
+  LRFHandlerCb handler_cb = {.info = cb};
+
+  remove_handler(app, &app->evt_handlers[lrf_evt_info],
+			handler_cb, ctx);
+}
+
+
+
+/** Add a callback to handle LRF boot information **/
+bool add_lrf_boot_info_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFBootInfo *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.boot_info = cb};
+
+  return add_handler(app, &app->evt_handlers[lrf_evt_boot_info],
+			handler_cb, ctx);
 }
 
 
 
-/** Set the callback to handle LRF boot information **/
-void set_lrf_boot_info_handler(LRFSerialCommApp *app,
+/** Remove a callback that handles LRF boot information **/
+void remove_lrf_boot_info_handler(LRFSerialCommApp *app,
 				void (*cb)(LRFBootInfo *, void *), void *ctx) {
-  app->lrf_boot_info_handler = cb;
-  app->lrf_boot_info_handler_ctx = ctx;
+
+  LRFHandlerCb handler_cb = {.boot_info = cb};
+
+  remove_handler(app, &app->evt_handlers[lrf_evt_boot_info],
+			handler_cb, ctx);
 }
 
 
 
-/** Set the callback to handle received diagnostic data **/
-void set_diag_data_handler(LRFSerialCommApp *app,
+/** Add a callback to handle received diagnostic data **/
+bool add_diag_data_handler(LRFSerialCommApp *app,
 				void (*cb)(LRFDiag *, void *), void *ctx) {
-  app->diag_data_handler = cb;
-  app->diag_data_handler_ctx = ctx;
+
+  LRFHandlerCb handler_cb = {.diag = cb};
+
+  return add_handler(app, &app->evt_handlers[lrf_evt_diag],
+			handler_cb, ctx);
+}
+
+
+
+/** Remove a callback that handles received diagnostic data **/
+void remove_diag_data_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFDiag *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.diag = cb};
+
+  remove_handler(app, &app->evt_handlers[lrf_evt_diag],
+			handler_cb, ctx);
+}
+
+
+
+/** Add a callback to handle received LRF statuses **/
+bool add_lrf_status_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFStatus *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.status = cb};
+
+  return add_handler(app, &app->evt_handlers[lrf_evt_status],
+			handler_cb, ctx);
+}
+
+
+
+/** Remove a callback that handles received LRF statuses **/
+void remove_lrf_status_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFStatus *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.status = cb};
+
+  remove_handler(app, &app->evt_handlers[lrf_evt_status],
+			handler_cb, ctx);
+}
+
+
+
+/** Add a callback to handle received LRF range windows **/
+bool add_lrf_range_win_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFRangeWindow *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.range_win = cb};
+
+  return add_handler(app, &app->evt_handlers[lrf_evt_range_win],
+			handler_cb, ctx);
+}
+
+
+
+/** Remove a callback that handles received LRF range windows **/
+void remove_lrf_range_win_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFRangeWindow *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.range_win = cb};
+
+  remove_handler(app, &app->evt_handlers[lrf_evt_range_win],
+			handler_cb, ctx);
+}
+
+
+
+/** Add a callback to handle received LRF command acknowledgments **/
+bool add_lrf_ack_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFAck *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.ack = cb};
+
+  return add_handler(app, &app->evt_handlers[lrf_evt_ack],
+			handler_cb, ctx);
+}
+
+
+
+/** Remove a callback that handles received LRF command acknowledgments **/
+void remove_lrf_ack_handler(LRFSerialCommApp *app,
+				void (*cb)(LRFAck *, void *), void *ctx) {
+
+  LRFHandlerCb handler_cb = {.ack = cb};
+
+  remove_handler(app, &app->evt_handlers[lrf_evt_ack],
+			handler_cb, ctx);
 }
 
 
@@ -233,18 +635,39 @@ void set_diag_data_handler(LRFSerialCommApp *app,
     buffer **/
 void enable_shared_storage_dec_buf(LRFSerialCommApp *app, bool enabled) {
 
-  /* Switch the decode buffer pointer and size as needed */
-  if(enabled) {
-    app->dec_buf = app->shared_storage;
-    app->dec_buf_size = app->shared_storage_size;
-  }
-  else {
-    app->dec_buf = app->default_dec_buf;
-    app->dec_buf_size = sizeof(app->default_dec_buf);
-  }
+  /* Switch the decode buffer pointer and size as needed. This also resets
+     the decoder */
+  if(enabled)
+    lrf_frame_decoder_set_buf(&app->lrf_frame_decoder,
+				app->shared_storage, app->shared_storage_size);
+  else
+    lrf_frame_decoder_set_buf(&app->lrf_frame_decoder,
+				app->default_dec_buf,
+				sizeof(app->default_dec_buf));
+}
+
+
+
+/** Get the serial link statistics **/
+void get_lrf_link_stats(LRFSerialCommApp *app, LRFLinkStats *stats) {
 
-  /* Reset the decode buffer */
-  app->nb_dec_buf = 0;
+  stats->nb_rx_bytes = app->nb_rx_bytes;
+  stats->nb_dropped_bytes = app->nb_dropped_bytes;
+  stats->peak_rx_ring_buf_fill = app->peak_rx_ring_buf_fill;
+  stats->rx_ring_buf_size = UART_RX_RING_BUF_SIZE;
+  memcpy(&stats->dec, &app->lrf_frame_decoder.stats,
+		sizeof(LRFFrameDecoderStats));
+}
+
+
+
+/** Reset the serial link statistics **/
+void reset_lrf_link_stats(LRFSerialCommApp *app) {
+
+  app->nb_rx_bytes = 0;
+  app->nb_dropped_bytes = 0;
+  app->peak_rx_ring_buf_fill = 0;
+  lrf_frame_decoder_reset_stats(&app->lrf_frame_decoder);
 }
 
 
@@ -254,54 +677,339 @@ static void on_uart_irq_callback(FuriHalSerialHandle *hndl,
 					FuriHalSerialRxEvent evt, void *ctx) {
 
   LRFSerialCommApp *app = (LRFSerialCommApp *)ctx;
+  uint16_t head, next_head;
+  uint16_t sync_head, next_sync_head;
+  uint16_t fill;
+  bool wakeup;
+
+  /* Wake up the receive thread if the line has gone idle - i.e. the LRF
+     probably finished sending a frame */
+  wakeup = evt & FuriHalSerialRxEventIdle;
+
+  if(evt & FuriHalSerialRxEventData) {
+
+    /* Only the IRQ callback modifies the heads of the ring buffers */
+    head = app->rx_ring_buf_head;
+    sync_head = app->rx_sync_head;
+
+    /* Get all the available bytes */
+    while(furi_hal_serial_async_rx_available(hndl)) {
+
+      uint8_t data = furi_hal_serial_async_rx(hndl);
+
+      /* Store the byte in the ring buffer if it isn't full. Otherwise drop
+         it */
+      next_head = (head + 1) & (UART_RX_RING_BUF_SIZE - 1);
+      if(next_head != __atomic_load_n(&app->rx_ring_buf_tail,
+					__ATOMIC_ACQUIRE)) {
+        app->rx_ring_buf[head] = data;
+        head = next_head;
+        app->nb_rx_since_wakeup++;
+
+        /* If the byte may be the sync byte of a frame, record when it
+           arrived if there's room left to do so */
+        next_sync_head = (sync_head + 1) & (UART_RX_SYNC_TSTAMPS_SIZE - 1);
+        if(data == 0x59 && next_sync_head !=
+		__atomic_load_n(&app->rx_sync_tail, __ATOMIC_ACQUIRE)) {
+          app->rx_sync_pos[sync_head] = app->rx_irq_pos;
+          app->rx_sync_tstamps_us[sync_head] = tstamp_us();
+          sync_head = next_sync_head;
+        }
 
-  if(evt == FuriHalSerialRxEventData) {
-    uint8_t data = furi_hal_serial_async_rx(hndl);
-    furi_stream_buffer_send(app->rx_stream, &data, 1, 0);
+        app->rx_irq_pos++;
+      }
+      else
+        app->nb_dropped_bytes++;
+    }
+
+    /* Update the peak receive ring buffer fill */
+    fill = (head - app->rx_ring_buf_tail) & (UART_RX_RING_BUF_SIZE - 1);
+    if(fill > app->peak_rx_ring_buf_fill)
+      app->peak_rx_ring_buf_fill = fill;
+
+    /* Publish the new sync byte arrival times and the new bytes to the
+       receive thread */
+    __atomic_store_n(&app->rx_sync_head, sync_head, __ATOMIC_RELEASE);
+    __atomic_store_n(&app->rx_ring_buf_head, head, __ATOMIC_RELEASE);
+
+    /* Wake up the receive thread if enough bytes have accumulated */
+    if(app->nb_rx_since_wakeup >= app->uart_rx_wakeup_threshold)
+      wakeup = true;
+  }
+
+  /* Wake up the receive thread if needed and there's something for it */
+  if(wakeup && app->nb_rx_since_wakeup) {
+    app->nb_rx_since_wakeup = 0;
     furi_thread_flags_set(furi_thread_get_id(app->rx_thread), rx_done);
   }
 }
 
 
 
-/** Copy bytes to a string and stop as soon as a non-printable character or
-    space is encountered */
-void strcpy_rstrip(char *dst, uint8_t *src) {
+/** Get data from the UART receive ring buffer **/
+static uint16_t get_rx_ring_buf_data(LRFSerialCommApp *app, uint8_t *buf,
+					uint16_t size) {
 
-  uint8_t i;
+  uint16_t head, tail;
+  uint16_t len = 0;
+
+  /* Only the UART receive thread modifies the tail of the ring buffer */
+  head = __atomic_load_n(&app->rx_ring_buf_head, __ATOMIC_ACQUIRE);
+  tail = app->rx_ring_buf_tail;
+
+  /* Copy as many bytes as we can */
+  while(tail != head && len < size) {
+    buf[len++] = app->rx_ring_buf[tail];
+    tail = (tail + 1) & (UART_RX_RING_BUF_SIZE - 1);
+  }
 
-  for(i = 0; src[i] > 32 && src[i] < 127; i++)
-    dst[i] = src[i];
-  dst[i] = 0;
+  /* Release the space in the ring buffer */
+  __atomic_store_n(&app->rx_ring_buf_tail, tail, __ATOMIC_RELEASE);
+
+  return len;
 }
 
 
 
-/** LRF frame check byte calculator **/
-static uint8_t checkbyte(uint8_t *data, uint16_t len) {
+/** Feed the data in the receive buffer, pulled out of the receive ring
+    buffer at a given time, into the LRF frame decoder
+    The data is fed in pieces starting at each sync byte whose arrival time
+    the IRQ callback recorded, along with that arrival time, so the decoder
+    timestamps the frames with the time their sync byte arrived rather than
+    the time the UART receive thread got round to processing them. Sync bytes
+    whose arrival time couldn't be recorded get the time the data was pulled
+    out of the receive ring buffer **/
+static void feed_lrf_frame_decoder(LRFSerialCommApp *app, uint16_t len,
+					uint64_t pull_tstamp_us) {
+
+  uint64_t first_tstamp_us;
+  uint16_t tail, start = 0, end;
+  int16_t offset;
+
+  while(start < len) {
+
+    first_tstamp_us = pull_tstamp_us;
+    end = len;
+
+    /* Go through the recorded sync bytes until we find one past the start of
+       the data to feed in: only feed in the data up to that one */
+    while((tail = app->rx_sync_tail) !=
+		__atomic_load_n(&app->rx_sync_head, __ATOMIC_ACQUIRE)) {
+
+      offset = app->rx_sync_pos[tail] - app->rx_thread_pos;
 
-  uint8_t checksum = 0;
-  uint16_t i;
+      if(offset > start) {
+        if(offset < len)
+          end = offset;
+        break;
+      }
 
-  for(i = 0; i < len; i++)
-    checksum += data[i];
+      /* If the data to feed in starts with this sync byte, feed it in with
+         the sync byte's arrival time, worked out from the lower 32 bits of
+         its timestamp since it's more recent than 71 minutes */
+      if(offset == start)
+        first_tstamp_us = pull_tstamp_us -
+				(uint32_t)((uint32_t)pull_tstamp_us -
+					app->rx_sync_tstamps_us[tail]);
+
+      /* Release the recorded sync byte */
+      __atomic_store_n(&app->rx_sync_tail,
+			(tail + 1) & (UART_RX_SYNC_TSTAMPS_SIZE - 1),
+			__ATOMIC_RELEASE);
+    }
 
-  checksum ^= 0x50;
+    lrf_frame_decoder_feed(&app->lrf_frame_decoder, app->rx_buf + start,
+				end - start, pull_tstamp_us, first_tstamp_us);
+    start = end;
+  }
 
-  return checksum;
+  app->rx_thread_pos += len;
 }
 
 
 
-/** Time difference in milliseconds between system ticks in milliseconds,
-    taking the timestamp overflow into account **/
-static uint32_t ms_tick_time_diff_ms(uint32_t tstamp1, uint32_t tstamp2) {
+/** LRF frame decoder event handler **/
+static void lrf_frame_decoder_evt_handler(LRFFrameDecoder *dec,
+						LRFFrameEvent evt, void *ctx) {
 
-  if(tstamp1 >= tstamp2)
-    return tstamp1 - tstamp2;
+  LRFSerialCommApp *app = (LRFSerialCommApp *)ctx;
+  LRFHandler *handler;
+  uint8_t i;
 
-  else
-    return 0xffffffff - tstamp2 + 1 + tstamp1;
+  /* If the UART transmit thread is waiting for this response, tell it it has
+     arrived */
+  if(evt != lrf_evt_boot_info && dec->dec_buf[1] ==
+		__atomic_load_n(&app->tx_expected_resp, __ATOMIC_ACQUIRE)) {
+    __atomic_store_n(&app->tx_resp_tstamp_us, (uint32_t)dec->frame_tstamp_us,
+			__ATOMIC_RELEASE);
+    furi_thread_flags_set(furi_thread_get_id(app->tx_thread), resp_received);
+  }
+
+  /* What did the decoder give us? */
+  switch(evt) {
+
+    /* We got a LRF sample */
+    case lrf_evt_sample:
+
+      FURI_LOG_T(TAG, "LRF sample received: "
+			"dist1=%f, dist2=%f, dist3=%f, "
+			"ampl1=%d, ampl2=%d, ampl3=%d",
+		(double)dec->sample.dist1,
+		(double)dec->sample.dist2,
+		(double)dec->sample.dist3,
+		dec->sample.ampl1,
+		dec->sample.ampl2,
+		dec->sample.ampl3);
+
+      /* Pass the LRF sample to all the handlers */
+      for(i = 0; i < app->evt_handlers[lrf_evt_sample].nb_handlers; i++) {
+        handler = &app->evt_handlers[lrf_evt_sample].handlers[i];
+        handler->cb.sample(&dec->sample, handler->ctx);
+      }
+
+      break;
+
+    /* We got a LRF identification frame */
+    case lrf_evt_ident:
+
+      FURI_LOG_T(TAG, "LRF identification frame received: "
+			"lrfid=%s, addinfo=%s, serial=%s, "
+			"fwversion=%s, electronics=%s, "
+			"optics=%s, builddate=%s",
+		dec->ident.id, dec->ident.addinfo,
+		dec->ident.serial, dec->ident.fwversion,
+		dec->ident.electronics, dec->ident.optics,
+		dec->ident.builddate);
+
+      /* Pass the LRF identification to all the handlers */
+      for(i = 0; i < app->evt_handlers[lrf_evt_ident].nb_handlers; i++) {
+        handler = &app->evt_handlers[lrf_evt_ident].handlers[i];
+        handler->cb.ident(&dec->ident, handler->ctx);
+      }
+
+      break;
+
+    /* We got a LRF information frame */
+    case lrf_evt_info:
+
+      FURI_LOG_T(TAG, "LRF information frame received: "
+			"txretries=%d, txpumptime=%d, "
+			"pulsesused=%d, txtemp=%d, "
+			"apdatfirstburst=%d, targetdist1=%d, "
+			"targetdist2=%d, targetdist3=%d, "
+			"targetmagnitude1=%d, "
+			"targetmagnitude2=%d, "
+			"targetmagnitude3=%d, "
+			"battvoltage=%0.3f, iovoltage=%0.3f, "
+			"rxvoltage=%0.2f, txvoltage=%0.3f, "
+			"rxtemp=%0.2f, statusbyte1=%02x, "
+			"statusbyte2=%02x, statusbyte3=%02x, "
+			"pulsectr=%lld, rserrorctr=%d",
+			dec->info.txretries, dec->info.txpumptime,
+			dec->info.pulsesused, dec->info.txtemp,
+			dec->info.apdatfirstburst,
+			dec->info.targetdist1,
+			dec->info.targetdist2,
+			dec->info.targetdist3,
+			dec->info.targetmagnitude1,
+			dec->info.targetmagnitude2,
+			dec->info.targetmagnitude3,
+			(double)dec->info.battvoltage,
+			(double)dec->info.iovoltage,
+			(double)dec->info.rxvoltage,
+			(double)dec->info.txvoltage,
+			(double)dec->info.rxtemp,
+			dec->info.statusbyte1,
+			dec->info.statusbyte2,
+			dec->info.statusbyte3,
+			dec->info.pulsectr, dec->info.rserrorctr);
+
+      /* Pass the LRF information to all the handlers */
+      for(i = 0; i < app->evt_handlers[lrf_evt_info].nb_handlers; i++) {
+        handler = &app->evt_handlers[lrf_evt_info].handlers[i];
+        handler->cb.info(&dec->info, handler->ctx);
+      }
+
+      break;
+
+    /* We got a LRF boot string */
+    case lrf_evt_boot_info:
+
+      FURI_LOG_T(TAG, "LRF boot string received: lrfid=%s, fwversion=%s",
+		dec->boot_info.id, dec->boot_info.fwversion);
+
+      /* Pass the LRF boot information to all the handlers */
+      for(i = 0; i < app->evt_handlers[lrf_evt_boot_info].nb_handlers; i++) {
+        handler = &app->evt_handlers[lrf_evt_boot_info].handlers[i];
+        handler->cb.boot_info(&dec->boot_info, handler->ctx);
+      }
+
+      break;
+
+    /* We got diagnostic data or a diagnostic data download progress update */
+    case lrf_evt_diag:
+
+      if(dec->diag.vals)
+        FURI_LOG_T(TAG, "LRF diagnostic data received: %d bytes / "
+			"%d diagnostic values",
+		dec->nb_dec_buf, dec->diag.total_vals);
+
+      /* Pass the diagnostic data to all the handlers */
+      for(i = 0; i < app->evt_handlers[lrf_evt_diag].nb_handlers; i++) {
+        handler = &app->evt_handlers[lrf_evt_diag].handlers[i];
+        handler->cb.diag(&dec->diag, handler->ctx);
+      }
+
+      break;
+
+    /* We got a LRF status */
+    case lrf_evt_status:
+
+      FURI_LOG_T(TAG, "LRF status received: statusbyte1=%02x, "
+			"statusbyte2=%02x, statusbyte3=%02x",
+		dec->status.statusbyte1, dec->status.statusbyte2,
+		dec->status.statusbyte3);
+
+      /* Pass the LRF status to all the handlers */
+      for(i = 0; i < app->evt_handlers[lrf_evt_status].nb_handlers; i++) {
+        handler = &app->evt_handlers[lrf_evt_status].handlers[i];
+        handler->cb.status(&dec->status, handler->ctx);
+      }
+
+      break;
+
+    /* We got a LRF range window */
+    case lrf_evt_range_win:
+
+      FURI_LOG_T(TAG, "LRF range window received: min_range=%d, "
+			"max_range=%d",
+		dec->range_win.min_range, dec->range_win.max_range);
+
+      /* Pass the LRF range window to all the handlers */
+      for(i = 0; i < app->evt_handlers[lrf_evt_range_win].nb_handlers; i++) {
+        handler = &app->evt_handlers[lrf_evt_range_win].handlers[i];
+        handler->cb.range_win(&dec->range_win, handler->ctx);
+      }
+
+      break;
+
+    /* We got a LRF command acknowledgment */
+    case lrf_evt_ack:
+
+      FURI_LOG_T(TAG, "LRF acknowledgment received for command %02x",
+		dec->ack.cmd);
+
+      /* Pass the LRF command acknowledgment to all the handlers */
+      for(i = 0; i < app->evt_handlers[lrf_evt_ack].nb_handlers; i++) {
+        handler = &app->evt_handlers[lrf_evt_ack].handlers[i];
+        handler->cb.ack(&dec->ack, handler->ctx);
+      }
+
+      break;
+
+    default:
+      break;
+  }
 }
 
 
@@ -310,787 +1018,62 @@ static uint32_t ms_tick_time_diff_ms(uint32_t tstamp1, uint32_t tstamp2) {
 static int32_t uart_rx_thread(void *ctx) {
 
   LRFSerialCommApp *app = (LRFSerialCommApp *)ctx;
+  LRFHandler *handler;
   uint32_t evts;
-  uint32_t last_rx_tstamp_ms = 0, now_ms;
   uint16_t rx_buf_len;
-  uint32_t wait_nb_dec_buf = 0;
-  bool is_little_endian;
-  LRFSample lrf_sample;
-  LRFIdent lrf_ident;
-  LRFInfo lrf_info;
-  LRFBootInfo lrf_boot_info;
-  uint8_t electronics;
-  uint8_t fw_major, fw_minor, fw_micro, fw_build;
-  LRFDiag lrf_diag = {NULL, 0, 0};
-  uint32_t last_update_diag_handler = 0;
-  uint16_t i, j;
-
-  /* Union to convert bytes to float, initialized with the endianness test value
-     of 1234.0 */
-  union {
-    uint8_t bytes[4];
-    float val;
-  } float_union = {.bytes = {0x00, 0x40, 0x9a, 0x44}};
-
-  /* Union to convert bytes to uint16_t or int16_t */
-  union {
-    uint8_t bytes[2];
-    uint16_t unsigned_val;
-    int16_t signed_val;
-  } int16_union;
-
-  /* Test endianness */
-  is_little_endian = float_union.val == 1234.0;
-
-  /* Endian-independent value decoding macros */
-  #define LE2LE_FLOAT_AT_OFFSET(offset) \
-	float_union.bytes[0] = app->dec_buf[offset]; \
-	float_union.bytes[1] = app->dec_buf[offset + 1]; \
-	float_union.bytes[2] = app->dec_buf[offset + 2]; \
-	float_union.bytes[3] = app->dec_buf[offset + 3];
-
-  #define LE2BE_FLOAT_AT_OFFSET(offset) \
-	float_union.bytes[3] = app->dec_buf[offset]; \
-	float_union.bytes[2] = app->dec_buf[offset + 1]; \
-	float_union.bytes[1] = app->dec_buf[offset + 2]; \
-	float_union.bytes[0] = app->dec_buf[offset + 3];
-
-  #define LE2LE_INT16_AT_OFFSET(offset) \
-	int16_union.bytes[0] = app->dec_buf[offset]; \
-	int16_union.bytes[1] = app->dec_buf[offset + 1];
-
-  #define LE2BE_INT16_AT_OFFSET(offset) \
-	int16_union.bytes[1] = app->dec_buf[offset]; \
-	int16_union.bytes[0] = app->dec_buf[offset + 1];
+  uint64_t pull_tstamp_us;
+  uint8_t i;
 
   while(1) {
 
-    /* Get events */
-    evts = furi_thread_flags_wait(stop | rx_done,
-					FuriFlagWaitAny, FuriWaitForever);
+    /* Get events, or time out to pick up bytes that didn't trigger a wakeup
+       yet */
+    evts = furi_thread_flags_wait(stop | rx_done, FuriFlagWaitAny,
+					app->uart_rx_wakeup_timeout);
 
     /* Check for errors */
-    furi_check((evts & FuriFlagError) == 0);
+    furi_check(((evts & FuriFlagError) == 0) ||
+		(evts == FuriFlagErrorTimeout));
 
     /* Should we stop the thread? */
-    if(evts & stop)
+    if(evts != FuriFlagErrorTimeout && (evts & stop))
       break;
 
-    /* Have we received data? */
-    if(evts & rx_done) {
+    /* Have we received data, or did we time out and should we check the
+       receive ring buffer anyway? */
+    if(evts == FuriFlagErrorTimeout || (evts & rx_done)) {
 
-      /* Get the data */
-      rx_buf_len = furi_stream_buffer_receive(app->rx_stream,
-						app->rx_buf,
-						UART_RX_BUF_SIZE, 0);
+      /* Get the data chunk by chunk until the receive ring buffer is empty */
+      while((rx_buf_len = get_rx_ring_buf_data(app, app->rx_buf,
+						UART_RX_BUF_SIZE)) > 0) {
 
-      /* Did we actually get something? */
-      if(rx_buf_len > 0) {
+        pull_tstamp_us = tstamp_us();
+
+        /* Count the received bytes */
+        app->nb_rx_bytes += rx_buf_len;
 
         /* Start a green LED flash */
         start_led_flash(&app->led_control, GREEN);
 
-        /* Get the current timestamp */
-        now_ms = furi_get_tick();
+        /* Don't let the handlers be added or removed while we call them.
+           The handlers must not block nor touch the lists of handlers */
+        furi_check(furi_mutex_acquire(app->handlers_mutex, FuriWaitForever)
+			== FuriStatusOk);
 
-        /* If too much time has passed since the previous data was received,
-           reset the decode buffer */
-        if(app->nb_dec_buf && ms_tick_time_diff_ms(now_ms, last_rx_tstamp_ms) >=
-				app->uart_rx_timeout) {
-          FURI_LOG_T(TAG, "RX timeout");
-          app->nb_dec_buf = 0;
+        /* Pass the raw data to all the raw data handlers */
+        for(i = 0; i < app->raw_data_handlers.nb_handlers; i++) {
+          handler = &app->raw_data_handlers.handlers[i];
+          handler->cb.raw_data(app->rx_buf, rx_buf_len, handler->ctx);
         }
 
-        last_rx_tstamp_ms = now_ms;
+        /* Are we waiting for a LRF boot string only? */
+        lrf_frame_decoder_set_boot_string_mode(&app->lrf_frame_decoder,
+		app->evt_handlers[lrf_evt_boot_info].nb_handlers > 0);
 
-        /* If we have a callback to handle raw LRF data, call it, pass it the
-           data, and don't do any further processing */
-        if(app->lrf_raw_data_handler) {
-          app->lrf_raw_data_handler(app->rx_buf, rx_buf_len,
-					app->lrf_raw_data_handler_ctx);
-          continue;
-        }
+        /* Decode the data we've received */
+        feed_lrf_frame_decoder(app, rx_buf_len, pull_tstamp_us);
 
-        /* Process the data we're received */
-        for(i = 0; i < rx_buf_len; i++) {
-
-          /* Are we waiting for a LRF boot string only? */
-          if(app->lrf_boot_info_handler) {
-
-            /* Handle receiving the boot string entirely separately, as the
-               boot process can send a lot of confusing garbage that may be
-               misconstrued as valid LRF communication frames */
-            switch(app->nb_dec_buf) {
-
-              /* We're waiting for a LF byte */
-              case 0:
-                if(app->rx_buf[i] == LF)
-                  app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-                break;
-
-              /* We're waiting for a CR byte */
-              case 1:
-                if(app->rx_buf[i] == CR) {
-                  lrf_boot_info.id[0] = 0;
-                  lrf_boot_info.fwversion[0] = 0;
-                  app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-                }
-                break;
-
-              /* We're waiting for the end of the ID string marked by a space,
-                 of the end of the firmware string marked by a CR */
-              default:
-
-                /* What character did we get? */
-                switch(app->rx_buf[i]) {
-
-                  /* Did we get a space? */
-                  case SPACE:
-
-                    /* If we already have a firmware version strings, the boot
-                       string is invalid: reset the decode buffer */
-                    if(lrf_boot_info.fwversion[0]) {
-                      app->nb_dec_buf = 0;
-                      break;
-                    }
-
-                    /* If we already have an ID, ignore the space */
-                    if(lrf_boot_info.id[0])
-                      break;
-
-                    /* IF the ID is too short, the boot string is invalid:
-                       reset the decode buffer */
-                    if(app->nb_dec_buf == 2) {
-                      app->nb_dec_buf = 0;
-                      break;
-                    }
-
-                    /* Store the ID */
-                    app->dec_buf[app->nb_dec_buf] = 0;
-                    strcpy_rstrip(lrf_boot_info.id, app->dec_buf + 2);
-
-                    /* "Rewind" the decode buffer */
-                    app->nb_dec_buf = 2;
-                    break;
-
-                  /* Did we get a CR? */
-                  case CR:
-
-                    /* If we don't have an ID string, we already have a fiwmare
-                       version string or the firmware version is too short,
-                       the boot string is invalid: reset the decode buffer */
-                    if(!lrf_boot_info.id[0] || lrf_boot_info.fwversion[0] ||
-			app->nb_dec_buf == 2) {
-                      app->nb_dec_buf = 0;
-                      break;
-                    }
-
-                    /* Store the firmware version */
-                    app->dec_buf[app->nb_dec_buf] = 0;
-                    strcpy_rstrip(lrf_boot_info.fwversion, app->dec_buf + 2);
-
-                    /* "Rewind" the decode buffer */
-                    app->nb_dec_buf = 2;
-                    break;
-
-                  /* Did we get a LF? */
-                  case LF:
-
-                    /* If we don't have ID or a firmware version strings,
-                       the boot string is invalid: reset the decode buffer */
-                    if(!lrf_boot_info.id[0] || !lrf_boot_info.fwversion[0]) {
-                      app->nb_dec_buf = 0;
-                      break;
-                    }
-
-                    /* Mark the time we received the valid boot string */
-                    lrf_boot_info.boot_string_rx_tstamp = now_ms;
-
-                    /* Pass the decoded LRF boot information to the handler */
-                    app->lrf_boot_info_handler(&lrf_boot_info,
-						app->lrf_boot_info_handler_ctx);
-
-                    FURI_LOG_T(TAG, "LRF boot string received: "
-					"lrfid=%s, fwversion=%s",
-				lrf_boot_info.id, lrf_boot_info.fwversion);
-                    break;
-
-                  /* We got another character */
-                  default:
-
-                    /* If the character isn't printable or the decode buffer is
-                       too full already, the boot string is invalid: reset the
-                       decode buffer */
-                    if(app->rx_buf[i] < 32 || app->rx_buf[i] >= 127 ||
-			app->nb_dec_buf >= 17) {
-                      app->nb_dec_buf = 0;
-                      break;
-                    }
-
-                    /* Store the character in the decode buffer */
-                    app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-                    break;
-                }
-
-                break;
-            }
-
-            continue;
-          }
-
-          /* We're waiting for normal LRF communication frames */
-          switch(app->nb_dec_buf) {
-
-            /* We're waiting for a sync byte */
-            case 0:
-              if(app->rx_buf[i] == 0x59)
-                app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-              break;
-
-            /* We're waiting for a command byte */
-            case 1:
-
-              /* What command byte did we get? */
-              switch(app->rx_buf[i]) {
-
-                /* We got a range measurement response */
-                case 0xcc:
-                  app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-                  wait_nb_dec_buf = 22;	/* We need to get 22 bytes total
-					   for this frame */
-                  break;
-
-                /* We got an identification frame response */
-                case 0xc0:
-                  app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-                  wait_nb_dec_buf = 73;	/* We need to get 73 bytes total
-					   for this frame */
-                  break;
-
-                /* We got an information frame response */
-                case 0xc2:
-                  app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-                  wait_nb_dec_buf = 40;	/* We need to get 40 bytes total
-					   for this frame */
-                  break;
-
-                /* We got a read diagnostic data response */
-                case 0xdc:
-                  app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-                  wait_nb_dec_buf = 6;	/* We need to get 4 more bytes to know
-					   how many we need to get in total */
-                  break;
-
-                /* We got an unknown command byte: reset the decode buffer */
-                default:
-                  app->nb_dec_buf = 0;
-              }
-              break;
-
-            /* We're decoding a command */
-            default:
-
-              /* Add the byte to the decode buffer, making sure the it doesn't
-                 overflow */
-              app->dec_buf[app->nb_dec_buf++] = app->rx_buf[i];
-              if(app->nb_dec_buf >= app->dec_buf_size)
-                app->nb_dec_buf--;
-
-              /* Do we still not have all the expected data? */
-              if(app->nb_dec_buf < wait_nb_dec_buf) {
-
-                /* If we have a diagnostic data handler, we're receiving the
-                   bulk of a diagnostic data frame, we have an even number of
-                   bytes and we're due to send an update update on the progress
-                   of the download to the diagnostic data handler, do so */
-                if(app->diag_data_handler && app->dec_buf[1] == 0xdc &&
-			wait_nb_dec_buf > 6 && !(app->nb_dec_buf & 1) &&
-			ms_tick_time_diff_ms(now_ms, last_update_diag_handler) >
-				DIAG_PROGRESS_UPDATE_EVERY) {
-                  lrf_diag.nb_vals = (app->nb_dec_buf - 2) / 2;
-                  app->diag_data_handler(&lrf_diag, app->diag_data_handler_ctx);
-                  last_update_diag_handler = now_ms;
-                }
-
-                /* Continue getting data into the decode buffer */
-                break;
-              }
-
-              /* If we're receiving diagnostic data and we only have the start
-                 of the frame, recalculate the total number of bytes we need
-                 to get */
-              if(wait_nb_dec_buf == 6) {
-
-                /* Decode the data count before the histogram */
-                if(is_little_endian) {
-                  LE2LE_INT16_AT_OFFSET(2);
-                }
-                else {
-                  LE2BE_INT16_AT_OFFSET(2);
-                }
-                wait_nb_dec_buf += (int16_union.unsigned_val - 1) * 2;
-
-                /* Decode the histogram length */
-                if(is_little_endian) {
-                  LE2LE_INT16_AT_OFFSET(4);
-                }
-                else {
-                  LE2BE_INT16_AT_OFFSET(4);
-                }
-                wait_nb_dec_buf += int16_union.unsigned_val * 2;
-
-                wait_nb_dec_buf++;	/* One last byte for the checkbyte */
-
-                /* If the new number of bytes to get is too low or exceeds the
-                   size of the decode buffer, reset the decode buffer */
-                if(wait_nb_dec_buf <= 6 ||
-			wait_nb_dec_buf > app->dec_buf_size) {
-                  app->nb_dec_buf = 0;
-                  break;
-                }
-
-                /* Initialize the LRF diagnostic data: for now set vals to NULL
-                   since the download isn't complete */
-                lrf_diag.vals = NULL;
-                lrf_diag.nb_vals = (app->nb_dec_buf - 2) / 2;
-                lrf_diag.total_vals = (wait_nb_dec_buf - 2 - 1) / 2;
-
-                /* If we have a diagnostic data handler, inform it of the
-                   progress of the download for the first time */
-                if(app->diag_data_handler) {
-                  app->diag_data_handler(&lrf_diag, app->diag_data_handler_ctx);
-                  last_update_diag_handler = now_ms;
-                }
-
-                break;
-              }
-
-              /* We have enough bytes: if the frame's checksum doesn't match,
-                 discard the frame */
-              if(app->dec_buf[app->nb_dec_buf - 1] !=
-				checkbyte(app->dec_buf, app->nb_dec_buf - 1)) {
-                app->nb_dec_buf = 0;
-                break;
-              }
-
-              /* Decode the frame */
-              switch(app->dec_buf[1]) {
-
-                /* We got a range measurement response */
-                case 0xcc:
-
-                  if(is_little_endian) {
-
-                    /* Decode the 1st distance */
-                    LE2LE_FLOAT_AT_OFFSET(2)
-                    lrf_sample.dist1 = float_union.val;
-
-                    /* Decode the 1st amplitude */
-                    LE2LE_INT16_AT_OFFSET(6);
-                    lrf_sample.ampl1 = int16_union.unsigned_val;
-
-                    /* Decode the 2nd distance */
-                    LE2LE_FLOAT_AT_OFFSET(8)
-                    lrf_sample.dist2 = float_union.val;
-
-                    /* Decode the 2nd amplitude */
-                    LE2LE_INT16_AT_OFFSET(12);
-                    lrf_sample.ampl2 = int16_union.unsigned_val;
-
-                    /* Decode the 3rd distance */
-                    LE2LE_FLOAT_AT_OFFSET(14)
-                    lrf_sample.dist3 = float_union.val;
-
-                    /* Decode the 3rd amplitude */
-                    LE2LE_INT16_AT_OFFSET(18);
-                    lrf_sample.ampl3 = int16_union.unsigned_val;
-                  }
-
-                  else {
-
-                    /* Decode the 1st distance */
-                    LE2BE_FLOAT_AT_OFFSET(2)
-                    lrf_sample.dist1 = float_union.val;
-
-                    /* Decode the 1st amplitude */
-                    LE2BE_INT16_AT_OFFSET(6);
-                    lrf_sample.ampl1 = int16_union.unsigned_val;
-
-                    /* Decode the 2nd distance */
-                    LE2BE_FLOAT_AT_OFFSET(8)
-                    lrf_sample.dist2 = float_union.val;
-
-                    /* Decode the 2nd amplitude */
-                    LE2BE_INT16_AT_OFFSET(12);
-                    lrf_sample.ampl2 = int16_union.unsigned_val;
-
-                    /* Decode the 3rd distance */
-                    LE2BE_FLOAT_AT_OFFSET(14)
-                    lrf_sample.dist3 = float_union.val;
-
-                    /* Decode the 3rd amplitude */
-                    LE2BE_INT16_AT_OFFSET(18);
-                    lrf_sample.ampl3 = int16_union.unsigned_val;
-                  }
-
-                  /* Timestamp the sample */
-                  lrf_sample.tstamp_ms = now_ms;
-
-                  FURI_LOG_T(TAG, "LRF sample received: "
-					"dist1=%f, dist2=%f, dist3=%f, "
-					"ampl1=%d, ampl2=%d, ampl3=%d",
-				(double)lrf_sample.dist1,
-				(double)lrf_sample.dist2,
-				(double)lrf_sample.dist3,
-				lrf_sample.ampl1,
-				lrf_sample.ampl2,
-				lrf_sample.ampl3);
-
-                  /* If we have a callback to handle the decoded LRF sample,
-                     call it and pass it the sample */
-                  if(app->lrf_sample_handler)
-                    app->lrf_sample_handler(&lrf_sample,
-						app->lrf_sample_handler_ctx);
-
-                  break;
-
-                /* We got an identification frame response */
-                case 0xc0:
-
-                  /* Make sure the LRF ID is terminated by CRLF and discard the
-                     frame if it isn't */
-                  if(app->dec_buf[17] != CR || app->dec_buf[18] != LF)
-                    break;
-
-                  /* Copy the printable left-hand part of the LRF ID */
-                  strcpy_rstrip(lrf_ident.id, app->dec_buf + 2);
-
-                  /* Make sure the additional information is terminated by CRLF
-                     and discard the frame if it isn't */
-                  if(app->dec_buf[34] != CR || app->dec_buf[35] != LF)
-                    break;
-
-                  /* Copy the printable left-hand part of the additional
-                     information */
-                  strcpy_rstrip(lrf_ident.addinfo, app->dec_buf + 19);
-
-                  /* Make sure the serial number is terminated by CRLF
-                     and discard the frame if it isn't */
-                  if(app->dec_buf[46] != CR || app->dec_buf[47] != LF)
-                    break;
-
-                  /* Copy the printable left-hand part of the serial number */
-                  strcpy_rstrip(lrf_ident.serial, app->dec_buf + 36);
-
-                  /* Decode the firmware version number */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(48);
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(48);
-                  }
-
-                  /* Get the electronics type */
-                  electronics = app->dec_buf[50];
-
-                  /* Get the optics type in readable format */
-                  snprintf(lrf_ident.optics, 4, "%d", app->dec_buf[51]);
-
-                  /* Interpret the firmware version information */
-                  fw_major = int16_union.unsigned_val >> 12;
-                  fw_minor = (int16_union.unsigned_val & 0xf00) >> 8;
-                  fw_micro = int16_union.unsigned_val & 0xff;
-                  lrf_ident.is_fw_newer_than_x4 = fw_minor > 4 ||
-					(fw_minor == 4 && fw_micro > 0);
-
-                  /* Extract the firmware's build number from the electronics
-                     type if the firmware is a newer version */
-                  if (lrf_ident.is_fw_newer_than_x4) {
-                    fw_build = electronics;
-                    electronics = 0;
-                  }
-                  else {
-                    fw_build = electronics & 0x0f;
-                    electronics >>= 4;
-                  }
-
-                  /* Store the eletronics type in readable format */
-                  snprintf(lrf_ident.electronics, 4, "%d", electronics);
-
-                  /* Store the firmware version in readable format */
-                  snprintf(lrf_ident.fwversion, 16, "%d.%d.%d.%d",
-				fw_major, fw_minor, fw_micro, fw_build);
-
-                  /* Make sure the year, month and day of the build date are
-                     ASCII digits and discard the frame if they aren't */
-                  if(app->dec_buf[52] < 0x30 || app->dec_buf[52] > 0x39 ||
-			app->dec_buf[53] < 0x30 || app->dec_buf[53] > 0x39 ||
-			app->dec_buf[55] < 0x30 || app->dec_buf[55] > 0x39 ||
-			app->dec_buf[56] < 0x30 || app->dec_buf[56] > 0x39 ||
-			app->dec_buf[58] < 0x30 || app->dec_buf[58] > 0x39 ||
-			app->dec_buf[59] < 0x30 || app->dec_buf[59] > 0x39)
-                    break;
-
-                  /* Make sure the date is terminated by CRLF and discard the
-                     if it isn't */
-                  if(app->dec_buf[60] != CR || app->dec_buf[61] != LF)
-                    break;
-
-                  /* Make sure the hour, minute and second of the build date are
-                     ASCII digits and discard the frame if they aren't */
-                  if(app->dec_buf[62] < 0x30 || app->dec_buf[62] > 0x39 ||
-			app->dec_buf[63] < 0x30 || app->dec_buf[63] > 0x39 ||
-			app->dec_buf[65] < 0x30 || app->dec_buf[65] > 0x39 ||
-			app->dec_buf[66] < 0x30 || app->dec_buf[66] > 0x39 ||
-			app->dec_buf[68] < 0x30 || app->dec_buf[68] > 0x39 ||
-			app->dec_buf[69] < 0x30 || app->dec_buf[69] > 0x39)
-                    break;
-
-                  /* Get the build date. If the month separator is "/", swap
-                     the day and the year */
-                  if(app->dec_buf[57] == SLASH)
-                    snprintf(lrf_ident.builddate, 20,
-				"20%c%c-%c%c-%c%c %c%c:%c%c:%c%c",
-				app->dec_buf[58], app->dec_buf[59],
-				app->dec_buf[55], app->dec_buf[56],
-				app->dec_buf[52], app->dec_buf[53],
-				app->dec_buf[62], app->dec_buf[63],
-				app->dec_buf[65], app->dec_buf[66],
-				app->dec_buf[68], app->dec_buf[69]);
-                  else
-                    snprintf(lrf_ident.builddate, 20,
-				"20%c%c-%c%c-%c%c %c%c:%c%c:%c%c",
-				app->dec_buf[52], app->dec_buf[53],
-				app->dec_buf[55], app->dec_buf[56],
-				app->dec_buf[58], app->dec_buf[59],
-				app->dec_buf[62], app->dec_buf[63],
-				app->dec_buf[65], app->dec_buf[66],
-				app->dec_buf[68], app->dec_buf[69]);
-
-                  FURI_LOG_T(TAG, "LRF identification frame received: "
-					"lrfid=%s, addinfo=%s, serial=%s, "
-					"fwversion=%s, electronics=%s, "
-					"optics=%s, builddate=%s",
-				lrf_ident.id, lrf_ident.addinfo,
-				lrf_ident.serial, lrf_ident.fwversion,
-				lrf_ident.electronics, lrf_ident.optics,
-				lrf_ident.builddate);
-
-                  /* If we have a callback to handle the decoded LRF
-                     identification frame, call it and pass it the
-                     identification */
-                  if(app->lrf_ident_handler)
-                    app->lrf_ident_handler(&lrf_ident,
-						app->lrf_ident_handler_ctx);
-
-                  break;
-
-                /* We got an information frame response */
-                case 0xc2:
-
-                  /* Get the number of transmission retries */
-                  lrf_info.txretries = app->dec_buf[2];
-
-                  /* Decode the laser pump time */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(3)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(3)
-                  }
-                  lrf_info.txpumptime = int16_union.unsigned_val;
-
-                  /* Decode the number of pulses used in the last measurement */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(5)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(5)
-                  }
-                  lrf_info.pulsesused = int16_union.unsigned_val;
-
-                  /* Decode the transmitter temperature */
-                  lrf_info.txtemp = app->dec_buf[7];
-
-                  /* Get the APD at first burst */
-                  lrf_info.apdatfirstburst = app->dec_buf[8];
-
-                  /* Get the 1st target distance */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(10)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(10)
-                  }
-                  lrf_info.targetdist1 = int16_union.unsigned_val;
-
-                    /* Get the 2nd target distance */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(12)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(12)
-                  }
-                  lrf_info.targetdist2 = int16_union.unsigned_val;
-
-                  /* Get the 3rd target distance */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(14)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(14)
-                  }
-                  lrf_info.targetdist3 = int16_union.unsigned_val;
-
-                  /* Get the 1st target magnitude */
-                  lrf_info.targetmagnitude1 = app->dec_buf[16];
-
-                  /* Get the 2nd target magnitude */
-                  lrf_info.targetmagnitude2 = app->dec_buf[17];
-
-                  /* Get the 3rd target magnitude */
-                  lrf_info.targetmagnitude3 = app->dec_buf[18];
-
-                  /* Decode the battery voltage */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(20)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(20)
-                  }
-                  lrf_info.battvoltage = (float)int16_union.unsigned_val
-						* 0.001;
-
-                  /* Decode the I/O voltage */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(24)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(24)
-                  }
-                  lrf_info.iovoltage = (float)(int16_union.unsigned_val - 3300)
-						* 0.001;
-
-                  /* Decode the receiver voltage */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(26)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(26)
-                  }
-                  lrf_info.rxvoltage = (float)int16_union.unsigned_val * 0.01;
-
-                  /* Decode the transmitter voltage */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(28)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(28)
-                  }
-                  lrf_info.txvoltage = (float)int16_union.unsigned_val * 0.001;
-
-                  /* Decode the receiver temperature */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(30)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(30)
-                  }
-                  lrf_info.rxtemp = (float)int16_union.signed_val * 0.01;
-
-                  /* Get status bytes */
-                  lrf_info.statusbyte1 = app->dec_buf[32];
-                  lrf_info.statusbyte2 = app->dec_buf[33];
-                  lrf_info.statusbyte3 = app->dec_buf[34];
-
-                  /* Decode the pulse counter */
-                  if(is_little_endian) {
-                    LE2LE_INT16_AT_OFFSET(35)
-                  }
-                  else {
-                    LE2BE_INT16_AT_OFFSET(35)
-                  }
-                  lrf_info.pulsectr = (int16_union.unsigned_val +
-					(app->dec_buf[37] << 16)) * 1e6;
-
-                  /* Get the serial error counter */
-                  lrf_info.rserrorctr = app->dec_buf[38];
-
-                  FURI_LOG_T(TAG, "LRF information frame received: "
-					"txretries=%d, txpumptime=%d, "
-					"pulsesused=%d, txtemp=%d, "
-					"apdatfirstburst=%d, targetdist1=%d, "
-					"targetdist2=%d, targetdist3=%d, "
-					"targetmagnitude1=%d, "
-					"targetmagnitude2=%d, "
-					"targetmagnitude3=%d, "
-					"battvoltage=%0.3f, iovoltage=%0.3f, "
-					"rxvoltage=%0.2f, txvoltage=%0.3f, "
-					"rxtemp=%0.2f, statusbyte1=%02x, "
-					"statusbyte2=%02x, statusbyte3=%02x, "
-					"pulsectr=%lld, rserrorctr=%d",
-					lrf_info.txretries, lrf_info.txpumptime,
-					lrf_info.pulsesused, lrf_info.txtemp,
-					lrf_info.apdatfirstburst,
-					lrf_info.targetdist1,
-					lrf_info.targetdist2,
-					lrf_info.targetdist3,
-					lrf_info.targetmagnitude1,
-					lrf_info.targetmagnitude2,
-					lrf_info.targetmagnitude3,
-					(double)lrf_info.battvoltage,
-					(double)lrf_info.iovoltage,
-					(double)lrf_info.rxvoltage,
-					(double)lrf_info.txvoltage,
-					(double)lrf_info.rxtemp,
-					lrf_info.statusbyte1,
-					lrf_info.statusbyte2,
-					lrf_info.statusbyte3,
-					lrf_info.pulsectr, lrf_info.rserrorctr);
-
-                  /* If we have a callback to handle the decoded LRF information
-                     frame, call it and pass it the information */
-                  if(app->lrf_info_handler)
-                    app->lrf_info_handler(&lrf_info, app->lrf_info_handler_ctx);
-
-                  break;
-
-                /* We got a read diagnostic data response */
-                case 0xdc:
-
-                  /* Point the diagnostic values to the decode buffer */
-                  lrf_diag.vals = (uint16_t *)(app->dec_buf + 2) ;
-
-                  /* Update the number of values received */
-                  lrf_diag.nb_vals = lrf_diag.total_vals;
-
-                  /* Fix up the diagnostic values' endianness if needed */
-                  if(!is_little_endian) {
-                    for(j = 0; j < lrf_diag.nb_vals; j++)
-                      lrf_diag.vals[j] = (lrf_diag.vals[j] & 0xff00) >> 8 |
-						(lrf_diag.vals[j] & 0xff) << 8;
-                  }
-
-                  FURI_LOG_T(TAG, "LRF diagnostic data received: %d bytes / "
-					"%d diagnostic values",
-				app->nb_dec_buf, lrf_diag.total_vals);
-
-                  /* If we have a diagnostic data handler, update the it one
-                     last time, this time passing it the actual diagnostic
-                     values to save */
-                  if(app->diag_data_handler)
-                    app->diag_data_handler(&lrf_diag,
-						app->diag_data_handler_ctx);
-
-                  break;
-              }
-
-              /* Clear the decode buffer */
-              app->nb_dec_buf = 0;
-
-              break;
-          }
-        }
+        furi_check(furi_mutex_release(app->handlers_mutex) == FuriStatusOk);
       }
     }
   }
@@ -1100,7 +1083,134 @@ static int32_t uart_rx_thread(void *ctx) {
 
 
 
-/** UART send function **/
+/** Send data to the LRF and wait for the expected response if needed,
+    resending the data if the response doesn't come. Returns true if the
+    response came or if no response was expected, false if the response
+    didn't come or if the queued requests are being dropped **/
+static bool send_and_wait_resp(LRFSerialCommApp *app, LRFTxRequest *req) {
+
+  uint32_t evts, sent_tstamp_us = 0;
+  uint8_t try;
+
+  for(try = 0;; try++) {
+
+    /* Don't send anything - or resend the data - if the queued requests are
+       being dropped */
+    if(__atomic_load_n(&app->tx_purge, __ATOMIC_ACQUIRE)) {
+      __atomic_store_n(&app->tx_expected_resp, 0, __ATOMIC_RELEASE);
+      return false;
+    }
+
+    /* Clear any stale response notification and tell the UART receive thread
+       which response we're waiting for */
+    furi_thread_flags_clear(resp_received);
+    __atomic_store_n(&app->tx_expected_resp, req->expected_resp,
+			__ATOMIC_RELEASE);
+
+    /* Start a red LED flash */
+    start_led_flash(&app->led_control, RED);
+
+    /* Send the data */
+    uart_tx(app, req->data, req->len);
+    sent_tstamp_us = (uint32_t)tstamp_us();
+
+    /* If we don't expect a response, we're done */
+    if(!req->expected_resp)
+      return true;
+
+    /* Wait for the response */
+    evts = furi_thread_flags_wait(resp_received, FuriFlagWaitAny,
+					app->lrf_cmd_resp_timeout);
+
+    /* Check for errors */
+    furi_check(((evts & FuriFlagError) == 0) ||
+		(evts == FuriFlagErrorTimeout));
+
+    /* Did we get the response? */
+    if(evts != FuriFlagErrorTimeout)
+      break;
+
+    /* Give up if we've used up all the retries */
+    if(try >= req->max_retries) {
+      __atomic_store_n(&app->tx_expected_resp, 0, __ATOMIC_RELEASE);
+      return false;
+    }
+
+    FURI_LOG_W(TAG, "No response to %s: resending", lrf_cmds_desc[req->cmd]);
+  }
+
+  /* We're not waiting for a response anymore */
+  __atomic_store_n(&app->tx_expected_resp, 0, __ATOMIC_RELEASE);
+
+  /* Work out how long the response took to come */
+  app->tx_resp_time_us = __atomic_load_n(&app->tx_resp_tstamp_us,
+						__ATOMIC_ACQUIRE) -
+				sent_tstamp_us;
+  if((int32_t)app->tx_resp_time_us < 0)
+    app->tx_resp_time_us = 0;
+
+  return true;
+}
+
+
+
+/** UART transmit thread **/
+static int32_t uart_tx_thread(void *ctx) {
+
+  LRFSerialCommApp *app = (LRFSerialCommApp *)ctx;
+  LRFTxRequest req;
+  bool responded;
+
+  while(1) {
+
+    /* Get the next request */
+    furi_check(furi_message_queue_get(app->tx_queue, &req,
+					FuriWaitForever) == FuriStatusOk);
+
+    /* Should we stop the thread? */
+    if(req.type == lrf_tx_stop)
+      break;
+
+    /* Should we send data? */
+    if(req.type == lrf_tx_data) {
+
+      responded = send_and_wait_resp(app, &req);
+
+      if(req.expected_resp)
+        FURI_LOG_T(TAG, "%s %s", lrf_cmds_desc[req.cmd],
+			responded? "acknowledged" : "not acknowledged");
+    }
+
+    else
+      responded = true;
+
+    /* If we have a completion callback, call it */
+    if(req.done_cb)
+      req.done_cb(req.cmd, responded, req.done_cb_ctx);
+  }
+
+  return 0;
+}
+
+
+
+/** Put a request in the UART transmit queue, waiting for room in the queue
+    for up to a timeout in ticks. Returns false if there was no room **/
+static bool queue_tx_request(LRFSerialCommApp *app, LRFTxRequest *req,
+				uint32_t timeout) {
+
+  /* The UART threads may only queue requests without waiting: the transmit
+     thread would wait on its own queue, and the receive thread would stall
+     the handling of the responses the transmit thread waits for */
+  furi_check(!timeout || !in_uart_thread(app));
+
+  return furi_message_queue_put(app->tx_queue, req, timeout) == FuriStatusOk;
+}
+
+
+
+/** UART send function
+    Sends the data right away and waits for the transmission to complete **/
 void uart_tx(LRFSerialCommApp *app, uint8_t *data, uint16_t len) {
   furi_hal_serial_tx(app->serial_handle, data, len);
   furi_hal_serial_tx_wait_complete(app->serial_handle);
@@ -1108,15 +1218,172 @@ void uart_tx(LRFSerialCommApp *app, uint8_t *data, uint16_t len) {
 
 
 
-/** Send a command to the LRF **/
+/** Queue raw data to send to the LRF after the commands already queued,
+    waiting for room in the queue for up to a timeout in ticks. Returns false
+    if there was no room **/
+static bool queue_raw_data(LRFSerialCommApp *app, uint8_t *data,
+				uint16_t len, uint32_t timeout) {
+
+  LRFTxRequest req;
+
+  furi_check(len <= LRF_TX_BUF_SIZE);
+
+  req.type = lrf_tx_data;
+  memcpy(req.data, data, len);
+  req.len = len;
+  req.cmd = no_cmd;
+  req.expected_resp = 0;
+  req.max_retries = 0;
+  req.done_cb = NULL;
+  req.done_cb_ctx = NULL;
+
+  return queue_tx_request(app, &req, timeout);
+}
+
+
+
+/** Queue a command to send to the LRF with a completion callback, preceded
+    by a prefix in the same request if there is one, waiting for room in the
+    queue for up to a timeout in ticks. Returns false if there was no room **/
+static bool queue_command(LRFSerialCommApp *app, uint8_t *pfx,
+				uint16_t pfx_len, LRFCommand cmd,
+				void (*done_cb)(LRFCommand, bool, void *),
+				void *done_cb_ctx, uint32_t timeout) {
+
+  LRFTxRequest req;
+
+  furi_check(pfx_len + lrf_cmds_len[cmd] <= LRF_TX_BUF_SIZE);
+
+  /* Queue the prefix and the correct sequence of bytes to send to the LRF
+     depending on the command, so the prefix is resent with the command if
+     the command is resent */
+  req.type = lrf_tx_data;
+  if(pfx_len)
+    memcpy(req.data, pfx, pfx_len);
+  memcpy(req.data + pfx_len, lrf_cmds[cmd], lrf_cmds_len[cmd]);
+  req.len = pfx_len + lrf_cmds_len[cmd];
+  req.cmd = cmd;
+  req.expected_resp = lrf_cmds_resp[cmd];
+  req.max_retries = lrf_cmds_resent[cmd]? app->lrf_cmd_max_retries : 0;
+  req.done_cb = done_cb;
+  req.done_cb_ctx = done_cb_ctx;
+
+  if(!queue_tx_request(app, &req, timeout))
+    return false;
+
+  FURI_LOG_T(TAG, "%s command queued", lrf_cmds_desc[cmd]);
+  return true;
+}
+
+
+
+/** Queue raw data to send to the LRF after the commands already queued **/
+void send_lrf_raw_data(LRFSerialCommApp *app, uint8_t *data, uint16_t len) {
+
+  furi_check(queue_raw_data(app, data, len, FuriWaitForever));
+}
+
+
+
+/** Queue a command to send to the LRF, and call a callback when the LRF has
+    responded to it or when the LRF didn't respond after all the retries.
+    The callback is called in the UART transmit thread **/
+void send_lrf_command_cb(LRFSerialCommApp *app, LRFCommand cmd,
+				void (*done_cb)(LRFCommand, bool, void *),
+				void *done_cb_ctx) {
+
+  furi_check(queue_command(app, NULL, 0, cmd, done_cb, done_cb_ctx,
+				FuriWaitForever));
+}
+
+
+
+/** Queue a command to send to the LRF with a completion callback without
+    waiting for room in the queue, so it can be called from a completion
+    callback. Returns false if the queue is full **/
+bool try_send_lrf_command_cb(LRFSerialCommApp *app, LRFCommand cmd,
+				void (*done_cb)(LRFCommand, bool, void *),
+				void *done_cb_ctx) {
+
+  return queue_command(app, NULL, 0, cmd, done_cb, done_cb_ctx, 0);
+}
+
+
+
+/** Queue a prefix and a command to send to the LRF right after it as a
+    single request with a completion callback, without waiting for room in
+    the queue, so it can be called from a completion callback. The prefix
+    can't be left alone in the queue, and it's resent with the command if
+    the command is resent. Returns false if the queue is full **/
+bool try_send_lrf_prefixed_command_cb(LRFSerialCommApp *app, uint8_t *pfx,
+				uint16_t pfx_len, LRFCommand cmd,
+				void (*done_cb)(LRFCommand, bool, void *),
+				void *done_cb_ctx) {
+
+  return queue_command(app, pfx, pfx_len, cmd, done_cb, done_cb_ctx, 0);
+}
+
+
+
+/** Get the time between the end of the transmission of the last command
+    and the arrival of its response in microseconds. Only valid in the
+    completion callback of a command that was responded to **/
+uint32_t get_lrf_command_resp_time_us(LRFSerialCommApp *app) {
+
+  return app->tx_resp_time_us;
+}
+
+
+
+/** Queue a command to send to the LRF **/
 void send_lrf_command(LRFSerialCommApp *app, LRFCommand cmd) {
 
-  /* Start a red LED flash */
-  start_led_flash(&app->led_control, RED);
+  send_lrf_command_cb(app, cmd, NULL, NULL);
+}
+
+
+
+/** Semaphore release callback for wait_lrf_commands_sent() **/
+static void tx_sync_done(LRFCommand cmd, bool responded, void *ctx) {
+
+  UNUSED(cmd);
+  UNUSED(responded);
+
+  furi_check(furi_semaphore_release((FuriSemaphore *)ctx) == FuriStatusOk);
+}
+
+
 
-  /* Send the correct sequence of bytes to the LRF depending on the command */
-  uart_tx(app, lrf_cmds[cmd], lrf_cmds_len[cmd]);
-  FURI_LOG_T(TAG, "%s command sent", lrf_cmds_desc[cmd]);
+/** Wait until all the queued commands have been sent and responded to, or
+    have timed out, or until a timeout in ticks. Returns false if the wait
+    timed out: the semaphore is then still released when the sync request
+    is reached **/
+static bool sync_tx_queue(LRFSerialCommApp *app, uint32_t timeout) {
+
+  LRFTxRequest req;
+
+  /* Queue a sync request that releases the semaphore when it's reached */
+  req.type = lrf_tx_sync;
+  req.len = 0;
+  req.cmd = no_cmd;
+  req.expected_resp = 0;
+  req.max_retries = 0;
+  req.done_cb = tx_sync_done;
+  req.done_cb_ctx = app->tx_sync_sem;
+
+  furi_check(queue_tx_request(app, &req, FuriWaitForever));
+
+  /* Wait for the sync request to be reached */
+  return furi_semaphore_acquire(app->tx_sync_sem, timeout) == FuriStatusOk;
+}
+
+
+
+/** Wait until all the queued commands have been sent and responded to, or
+    have timed out **/
+void wait_lrf_commands_sent(LRFSerialCommApp *app) {
+
+  furi_check(sync_tx_queue(app, FuriWaitForever));
 }
 
 
@@ -1124,6 +1391,10 @@ void send_lrf_command(LRFSerialCommApp *app, LRFCommand cmd) {
 /** Initialize the LRF serial communication app **/
 LRFSerialCommApp *lrf_serial_comm_app_init(uint16_t min_led_flash_duration,
 						uint16_t uart_rx_timeout,
+						uint16_t uart_rx_wakeup_threshold,
+						uint16_t uart_rx_wakeup_timeout,
+						uint16_t lrf_cmd_resp_timeout,
+						uint8_t lrf_cmd_max_retries,
 						uint8_t *shared_storage,
 						uint16_t shared_storage_size) {
 
@@ -1139,23 +1410,36 @@ LRFSerialCommApp *lrf_serial_comm_app_init(uint16_t min_led_flash_duration,
   app->shared_storage = shared_storage;
   app->shared_storage_size = shared_storage_size;
 
-  /* No raw LRF data handler callback setup yet */
-  app->lrf_raw_data_handler = NULL;
+  /* No handlers set up yet */
+  memset(&app->raw_data_handlers, 0, sizeof(app->raw_data_handlers));
+  memset(app->evt_handlers, 0, sizeof(app->evt_handlers));
 
-  /* No received LRF data handler callback setup yet */
-  app->lrf_sample_handler = NULL;
+  /* Create the mutex to add or remove handlers */
+  app->handlers_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
 
-  /* No received LRF data identification frame handler callback setup yet */
-  app->lrf_ident_handler = NULL;
+  /* Initialize the LRF frame decoder with the default decode buffer to start
+     with */
+  lrf_frame_decoder_init(&app->lrf_frame_decoder, app->default_dec_buf,
+			sizeof(app->default_dec_buf), uart_rx_timeout,
+			lrf_frame_decoder_evt_handler, app);
 
-  /* No received diagnostic data handler callback setup yet */
-  app->diag_data_handler = NULL;
+  /* Initialize the UART receive ring buffer */
+  app->rx_ring_buf_head = 0;
+  app->rx_ring_buf_tail = 0;
+  app->nb_rx_since_wakeup = 0;
 
-  /* Use the default decode buffer to start with */
-  enable_shared_storage_dec_buf(app, false);
+  /* Initialize the sync byte arrival time ring buffer */
+  app->rx_irq_pos = 0;
+  app->rx_thread_pos = 0;
+  app->rx_sync_head = 0;
+  app->rx_sync_tail = 0;
 
-  /* Allocate space for the UART receive stream buffer */
-  app->rx_stream = furi_stream_buffer_alloc(UART_RX_STREAM_BUF_SIZE, 1);
+  /* Clear the serial link statistics */
+  reset_lrf_link_stats(app);
+
+  /* Set the UART receive thread's wakeup conditions */
+  app->uart_rx_wakeup_threshold = uart_rx_wakeup_threshold;
+  app->uart_rx_wakeup_timeout = uart_rx_wakeup_timeout;
 
   /* Allocate space for the UART receive thread */
   app->rx_thread = furi_thread_alloc();
@@ -1173,12 +1457,33 @@ LRFSerialCommApp *lrf_serial_comm_app_init(uint16_t min_led_flash_duration,
   furi_thread_set_context(app->rx_thread, app);
   furi_thread_set_callback(app->rx_thread, uart_rx_thread);
 
-  /* Set the UART receive timeout */
-  app->uart_rx_timeout = uart_rx_timeout;
-
   /* Start the UART receive thread */
   furi_thread_start(app->rx_thread);
 
+  /* Set the command response timeout and retries */
+  app->lrf_cmd_resp_timeout = lrf_cmd_resp_timeout;
+  app->lrf_cmd_max_retries = lrf_cmd_max_retries;
+  app->tx_expected_resp = 0;
+  app->tx_resp_time_us = 0;
+
+  /* Allocate the UART transmit queue and the sync semaphore */
+  app->tx_queue = furi_message_queue_alloc(LRF_TX_QUEUE_SIZE,
+						sizeof(LRFTxRequest));
+  app->tx_sync_sem = furi_semaphore_alloc(1, 0);
+  app->tx_purge = false;
+
+  /* Allocate space for the UART transmit thread */
+  app->tx_thread = furi_thread_alloc();
+
+  /* Initialize the UART transmit thread */
+  furi_thread_set_name(app->tx_thread, "uart_tx");
+  furi_thread_set_stack_size(app->tx_thread, 1024);
+  furi_thread_set_context(app->tx_thread, app);
+  furi_thread_set_callback(app->tx_thread, uart_tx_thread);
+
+  /* Start the UART transmit thread */
+  furi_thread_start(app->tx_thread);
+
   /* Acquire the UART */
   app->serial_handle = furi_hal_serial_control_acquire(app->serial_channel);
   furi_check(app->serial_handle);
@@ -1207,9 +1512,24 @@ void start_uart(LRFSerialCommApp *app, uint32_t baudrate) {
 
 
 
-/** Stop the UART **/
+/** Stop the UART
+    The queued commands are given as long as one unanswered command takes to
+    go out and get their responses. Those still queued after that are
+    dropped, so an unresponsive LRF doesn't hold up the caller **/
 void stop_uart(LRFSerialCommApp *app) {
 
+  /* Let the queued commands go out and get their responses first, or drop
+     them if they take too long, then wait for the command being sent - if
+     any - to give up */
+  if(!sync_tx_queue(app, furi_ms_to_ticks(app->lrf_cmd_resp_timeout *
+					(app->lrf_cmd_max_retries + 1)))) {
+    FURI_LOG_W(TAG, "LRF commands not sent in time: dropped");
+    __atomic_store_n(&app->tx_purge, true, __ATOMIC_RELEASE);
+    furi_check(furi_semaphore_acquire(app->tx_sync_sem, FuriWaitForever) ==
+		FuriStatusOk);
+    __atomic_store_n(&app->tx_purge, false, __ATOMIC_RELEASE);
+  }
+
   /* Stop receiving */
   furi_hal_serial_async_rx_stop(app->serial_handle);
 }
@@ -1228,8 +1548,20 @@ void set_uart_baudrate(LRFSerialCommApp *app, uint32_t baudrate) {
     communication app **/
 void lrf_serial_comm_app_free(LRFSerialCommApp *app) {
 
+  LRFTxRequest req = {.type = lrf_tx_stop};
+
   FURI_LOG_I(TAG, "App free");
 
+  /* Stop and free the UART transmit thread once it's sent everything that's
+     queued */
+  furi_check(queue_tx_request(app, &req, FuriWaitForever));
+  furi_thread_join(app->tx_thread);
+  furi_thread_free(app->tx_thread);
+
+  /* Free the UART transmit queue and the sync semaphore */
+  furi_message_queue_free(app->tx_queue);
+  furi_semaphore_free(app->tx_sync_sem);
+
   /* Deinitialize the UART if it's been initialized */
   if(app->is_uart_initialized)
     furi_hal_serial_deinit(app->serial_handle);
@@ -1242,9 +1574,6 @@ void lrf_serial_comm_app_free(LRFSerialCommApp *app) {
   furi_thread_join(app->rx_thread);
   furi_thread_free(app->rx_thread);
 
-  /* Free the UART receive stream buffer */
-  furi_stream_buffer_free(app->rx_stream);
-
   /* Re-enable support for expansion modules */
   expansion_enable(furi_record_open(RECORD_EXPANSION));
   furi_record_close(RECORD_EXPANSION);
@@ -1252,6 +1581,9 @@ void lrf_serial_comm_app_free(LRFSerialCommApp *app) {
   /* Release the LED control */
   release_led_control(&app->led_control);
 
+  /* Free the mutex to add or remove handlers */
+  furi_mutex_free(app->handlers_mutex);
+
   /* Free the LRF serial communication app's structure */
   free(app);
 }
@@ -7,9 +7,21 @@
 
 #pragma once
 
+/*** Includes ***/
+#include "lrf_frame_decoder.h"
+
+
+
 /*** Defines ***/
 #define UART_RX_BUF_SIZE 256
-#define DIAG_PROGRESS_UPDATE_EVERY 250 /*ms*/
+
+#define LRF_TX_BUF_SIZE 16	/* Largest data sent through the transmit
+				   queue - i.e. the SMM prefix followed by a
+				   command */
+#define LRF_TX_QUEUE_SIZE 16
+
+#define MAX_LRF_HANDLERS 4	/* Maximum number of handlers for raw data and
+				   for each type of decoded LRF frame */
 
 
 
@@ -57,195 +69,172 @@ typedef enum {
   /* Read diagnostic data */
   read_diag = 12,
 
-} LRFCommand;
-
-
-
-/** LRF sample **/
-typedef struct {
-
-  /* Distances */
-  float dist1;
-  float dist2;
-  float dist3;
-
-  /* Amplitudes */
-  uint16_t ampl1;
-  uint16_t ampl2;
-  uint16_t ampl3;
-
-  /* Reception timestamp */
-  uint32_t tstamp_ms;
-
-} LRFSample;
-
-
-
-/** LRF identification **/
-typedef struct {
-
-  /* Device ID */
-  char id[16];
-
-  /* Additional information */
-  char addinfo[16];
-
-  /* Serial number */
-  char serial[16];
-
-  /* Firmware version */
-  char fwversion[16];
-
-  /* Whether the firmware is newer than x.4.x */
-  bool is_fw_newer_than_x4;
-
-  /* Electronics type */
-  char electronics[4];
-
-  /* Optics type */
-  char optics[4];
+  /* Trigger one quick SMM measurement */
+  quick_smm = 13,
 
-  /* Build date */
-  char builddate[32];
+  /* Not a command: raw data or synchronization request */
+  no_cmd = 0xff,
 
-} LRFIdent;
+} LRFCommand;
 
 
 
-/** LRF information **/
+/** Serial link statistics **/
 typedef struct {
 
-  /* Transmission retries */
-  uint8_t txretries;
-
-  /* Laser pump time */
-  uint16_t txpumptime;
-
-  /* Number of pulses used for the last measurement */
-  uint16_t pulsesused;
-
-  /* Transmitter temperature */
-  uint8_t txtemp;
-
-  /* APD at first burst */
-  uint8_t apdatfirstburst;
-
-  /* Target distances */
-  uint16_t targetdist1;
-  uint16_t targetdist2;
-  uint16_t targetdist3;
-
-  /* Target magnitudes */
-  uint8_t targetmagnitude1;
-  uint8_t targetmagnitude2;
-  uint8_t targetmagnitude3;
+  /* Number of bytes received */
+  uint32_t nb_rx_bytes;
 
-  /* Battery voltage */
-  float battvoltage;
+  /* Number of bytes dropped because the receive ring buffer was full */
+  uint32_t nb_dropped_bytes;
 
-  /* I/O voltage */
-  float iovoltage;
+  /* Peak receive ring buffer fill and receive ring buffer size */
+  uint16_t peak_rx_ring_buf_fill;
+  uint16_t rx_ring_buf_size;
 
-  /* Receiver voltage */
-  float rxvoltage;
+  /* LRF frame decoder statistics */
+  LRFFrameDecoderStats dec;
 
-  /* Transmitter voltage */
-  float txvoltage;
+} LRFLinkStats;
 
-  /* Receiver temperature */
-  float rxtemp;
-
-  /* Status bytes */
-  uint8_t statusbyte1;
-  uint8_t statusbyte2;
-  uint8_t statusbyte3;
-
-  /* Pulse counter */
-  uint64_t pulsectr;
-
-  /* Serial error counter */
-  uint8_t rserrorctr;
-
-} LRFInfo;
 
 
+/** App structure **/
+struct _LRFSerialCommApp;
+typedef struct _LRFSerialCommApp LRFSerialCommApp;
 
-/** LRF boot information **/
-typedef struct {
 
-  /* Device ID */
-  char id[16];
 
-  /* Firmware version */
-  char fwversion[16];
+/*** Routines ***/
 
-  /* Rx timestamp */
-  uint32_t boot_string_rx_tstamp;
+/* The handlers are called in the UART receive thread with the list of
+   handlers locked. They must return quickly and must not add or remove
+   handlers, nor queue data or commands with the blocking send functions:
+   they should only pass what they receive on to another thread */
 
-} LRFBootInfo;
+/** Add a callback to handle raw data received from the LRF **/
+bool add_lrf_raw_data_handler(LRFSerialCommApp *,
+				void (*)(uint8_t *, uint16_t, void *), void *);
 
+/** Remove a callback that handles raw data received from the LRF **/
+void remove_lrf_raw_data_handler(LRFSerialCommApp *,
+				void (*)(uint8_t *, uint16_t, void *), void *);
 
+/** Add a callback to handle received LRF samples **/
+bool add_lrf_sample_handler(LRFSerialCommApp *,
+				void (*)(LRFSample *, void *), void *);
 
-/** LRF diagnostic data **/
-typedef struct {
+/** Remove a callback that handles received LRF samples **/
+void remove_lrf_sample_handler(LRFSerialCommApp *,
+				void (*)(LRFSample *, void *), void *);
 
-  /* Diagnostic data values */
-  uint16_t *vals;
+/** Add a callback to handle received LRF identification frames **/
+bool add_lrf_ident_handler(LRFSerialCommApp *,
+				void (*)(LRFIdent *, void *), void *);
 
-  /* Number of values currently read */
-  uint16_t nb_vals;
+/** Remove a callback that handles received LRF identification frames **/
+void remove_lrf_ident_handler(LRFSerialCommApp *,
+				void (*)(LRFIdent *, void *), void *);
 
-  /* Total number of values */
-  uint16_t total_vals;
+/** Add a callback to handle received LRF information frames **/
+bool add_lrf_info_handler(LRFSerialCommApp *,
+				void (*)(LRFInfo *, void *), void *);
 
-} LRFDiag;
+/** Remove a callback that handles received LRF information frames **/
+void remove_lrf_info_handler(LRFSerialCommApp *,
+				void (*)(LRFInfo *, void *), void *);
 
+/** Add a callback to handle LRF boot information **/
+bool add_lrf_boot_info_handler(LRFSerialCommApp *,
+				void (*)(LRFBootInfo *, void *), void *);
 
+/** Remove a callback that handles LRF boot information **/
+void remove_lrf_boot_info_handler(LRFSerialCommApp *,
+				void (*)(LRFBootInfo *, void *), void *);
 
-/** App structure **/
-struct _LRFSerialCommApp;
-typedef struct _LRFSerialCommApp LRFSerialCommApp;
+/** Add a callback to handle received diagnostic data **/
+bool add_diag_data_handler(LRFSerialCommApp *,
+				void (*)(LRFDiag *, void *), void *);
 
+/** Remove a callback that handles received diagnostic data **/
+void remove_diag_data_handler(LRFSerialCommApp *,
+				void (*)(LRFDiag *, void *), void *);
 
+/** Add a callback to handle received LRF statuses **/
+bool add_lrf_status_handler(LRFSerialCommApp *,
+				void (*)(LRFStatus *, void *), void *);
 
-/*** Routines ***/
+/** Remove a callback that handles received LRF statuses **/
+void remove_lrf_status_handler(LRFSerialCommApp *,
+				void (*)(LRFStatus *, void *), void *);
 
-/** Set the callback to handle raw data received from the LRF **/
-void set_lrf_raw_data_handler(LRFSerialCommApp *,
-				void (*)(uint8_t *, uint16_t, void *), void *);
+/** Add a callback to handle received LRF range windows **/
+bool add_lrf_range_win_handler(LRFSerialCommApp *,
+				void (*)(LRFRangeWindow *, void *), void *);
 
-/** Set the callback to handle one received LRF sample **/
-void set_lrf_sample_handler(LRFSerialCommApp *, void (*)(LRFSample *, void *),
-				void *);
+/** Remove a callback that handles received LRF range windows **/
+void remove_lrf_range_win_handler(LRFSerialCommApp *,
+				void (*)(LRFRangeWindow *, void *), void *);
 
-/** Set the callback to handle one received LRF identification frame **/
-void set_lrf_ident_handler(LRFSerialCommApp *, void (*)(LRFIdent *, void *),
-				void *);
+/** Add a callback to handle received LRF command acknowledgments **/
+bool add_lrf_ack_handler(LRFSerialCommApp *,
+				void (*)(LRFAck *, void *), void *);
 
-/** Set the callback to handle one received LRF information frame **/
-void set_lrf_info_handler(LRFSerialCommApp *, void (*)(LRFInfo *, void *),
-				void *);
+/** Remove a callback that handles received LRF command acknowledgments **/
+void remove_lrf_ack_handler(LRFSerialCommApp *,
+				void (*)(LRFAck *, void *), void *);
 
-/** Set the callback to handle LRF boot information **/
-void set_lrf_boot_info_handler(LRFSerialCommApp *, void (*)(LRFBootInfo *,
-				void *), void *);
+/** Get the serial link statistics **/
+void get_lrf_link_stats(LRFSerialCommApp *, LRFLinkStats *);
 
-/** Set the callback to handle received diagnostic data **/
-void set_diag_data_handler(LRFSerialCommApp *, void (*)(LRFDiag *, void *),
-				void *);
+/** Reset the serial link statistics **/
+void reset_lrf_link_stats(LRFSerialCommApp *);
 
 /** Enable or disable the use of the shared storage space as LRF frame decode
     buffer **/
 void enable_shared_storage_dec_buf(LRFSerialCommApp *, bool);
 
-/** UART send function **/
+/** UART send function
+    Sends the data right away and waits for the transmission to complete **/
 void uart_tx(LRFSerialCommApp *, uint8_t *, uint16_t);
 
-/** Send a command to the LRF **/
+/** Queue raw data to send to the LRF after the commands already queued **/
+void send_lrf_raw_data(LRFSerialCommApp *, uint8_t *, uint16_t);
+
+/** Queue a command to send to the LRF, and call a callback when the LRF has
+    responded to it or when the LRF didn't respond after all the retries.
+    The callback is called in the UART transmit thread **/
+void send_lrf_command_cb(LRFSerialCommApp *, LRFCommand,
+				void (*)(LRFCommand, bool, void *), void *);
+
+/** Queue a command to send to the LRF with a completion callback without
+    waiting for room in the queue, so it can be called from a completion
+    callback. Returns false if the queue is full **/
+bool try_send_lrf_command_cb(LRFSerialCommApp *, LRFCommand,
+				void (*)(LRFCommand, bool, void *), void *);
+
+/** Queue a prefix and a command to send to the LRF right after it as a
+    single request with a completion callback, without waiting for room in
+    the queue. Returns false if the queue is full **/
+bool try_send_lrf_prefixed_command_cb(LRFSerialCommApp *, uint8_t *,
+				uint16_t, LRFCommand,
+				void (*)(LRFCommand, bool, void *), void *);
+
+/** Get the time between the end of the transmission of the last command
+    and the arrival of its response in microseconds. Only valid in the
+    completion callback of a command that was responded to **/
+uint32_t get_lrf_command_resp_time_us(LRFSerialCommApp *);
+
+/** Queue a command to send to the LRF **/
 void send_lrf_command(LRFSerialCommApp *, LRFCommand);
 
+/** Wait until all the queued commands have been sent and responded to, or
+    have timed out **/
+void wait_lrf_commands_sent(LRFSerialCommApp *);
+
 /** Initialize the LRF serial communication app **/
-LRFSerialCommApp *lrf_serial_comm_app_init(uint16_t, uint16_t,
+LRFSerialCommApp *lrf_serial_comm_app_init(uint16_t, uint16_t, uint16_t,
+						uint16_t, uint16_t, uint8_t,
 						uint8_t *, uint16_t);
 
 /** Start the UART **/
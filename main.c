@@ -13,12 +13,14 @@
 #include "lrf_power_control.h"
 #include "config_view.h"
 #include "sample_view.h"
+#include "histogram_view.h"
 #include "lrf_info_view.h"
 #include "test_boot_time_view.h"
 #include "save_diag_view.h"
 #include "test_laser_view.h"
 #include "test_pointer_view.h"
 #include "passthru_view.h"
+#include "link_stats_view.h"
 #include "about_view.h"
 #include "submenu.h"
 
@@ -59,6 +61,9 @@ static App *noptel_lrf_sampler_app_init() {
   submenu_add_item(app->submenu, submenu_item_names[submenu_sample],
 			submenu_sample, submenu_callback, app);
 
+  submenu_add_item(app->submenu, submenu_item_names[submenu_histogram],
+			submenu_histogram, submenu_callback, app);
+
   submenu_add_item(app->submenu, submenu_item_names[submenu_pointeronoff],
 			submenu_pointeronoff, submenu_callback, app);
 
@@ -80,6 +85,9 @@ static App *noptel_lrf_sampler_app_init() {
   submenu_add_item(app->submenu, submenu_item_names[submenu_passthru],
 			submenu_passthru, submenu_callback, app);
 
+  submenu_add_item(app->submenu, submenu_item_names[submenu_linkstats],
+			submenu_linkstats, submenu_callback, app);
+
   submenu_add_item(app->submenu, submenu_item_names[submenu_about],
 			submenu_about, submenu_callback, app);
 
@@ -111,6 +119,18 @@ static App *noptel_lrf_sampler_app_init() {
 						nb_config_buf_values,
 						config_buf_change, app);
 
+  /* Add the statistic setting */
+  app->item_stat = variable_item_list_add(app->config_list,
+						config_stat_label,
+						nb_config_stat_values,
+						config_stat_change, app);
+
+  /* Add the targets setting */
+  app->item_targets = variable_item_list_add(app->config_list,
+						config_targets_label,
+						nb_config_targets_values,
+						config_targets_change, app);
+
   /* Add beep option list items */
   app->item_beep = variable_item_list_add(app->config_list,
 						config_beep_label,
@@ -165,18 +185,52 @@ static App *noptel_lrf_sampler_app_init() {
   view_allocate_model(app->sample_view, ViewModelTypeLockFree,
 			sizeof(SampleModel));
 
-  /* Point the LRF sample ring buffer to the shared storage area */
+  /* Initialize the sample queue and its statistics. The LRF sample ring
+     buffer is set up in the shared storage area when the view is entered */
   SampleModel *sample_model = view_get_model(app->sample_view);
-  sample_model->samples = (LRFSample *)app->shared_storage;
-  sample_model->max_samples = sizeof(app->shared_storage) / sizeof(LRFSample);
-  FURI_LOG_D(TAG, "Sampler ring buffer size: %d samples",
-		sample_model->max_samples);
+  sample_queue_reset(&sample_model->sample_queue);
+  sample_queue_reset_stats(&sample_model->sample_queue);
+
+  /* No burst SMM shots in the pipeline yet */
+  sample_model->nb_burst_shots_queued = 0;
+  sample_model->nb_burst_shots_done = 0;
 
   /* Add the sample view */
   view_dispatcher_add_view(app->view_dispatcher, view_sample, app->sample_view);
 
 
 
+  /* Setup the histogram view */
+
+  /* Allocate space for the histogram view */
+  app->histogram_view = view_alloc();
+
+  /* Setup the draw callback for the histogram view */
+  view_set_draw_callback(app->histogram_view, histogram_view_draw_callback);
+
+  /* Setup the input callback for the histogram view */
+  view_set_input_callback(app->histogram_view, histogram_view_input_callback);
+
+  /* Configure the "previous" callback for the histogram view */
+  view_set_previous_callback(app->histogram_view, return_to_submenu_callback);
+
+  /* Configure the enter and exit callbacks for the histogram view */
+  view_set_enter_callback(app->histogram_view, histogram_view_enter_callback);
+  view_set_exit_callback(app->histogram_view, histogram_view_exit_callback);
+
+  /* Set the context for the histogram view callbacks */
+  view_set_context(app->histogram_view, app);
+
+  /* Allocate space for the histogram view model */
+  view_allocate_model(app->histogram_view, ViewModelTypeLockFree,
+			sizeof(HistogramModel));
+
+  /* Add the histogram view */
+  view_dispatcher_add_view(app->view_dispatcher, view_histogram,
+				app->histogram_view);
+
+
+
   /* Setup the LRF info view */
 
   /* Allocate space for the LRF info view */
@@ -364,6 +418,36 @@ static App *noptel_lrf_sampler_app_init() {
 
 
 
+  /* Setup the link statistics view */
+
+  /* Allocate space for the link statistics view */
+  app->linkstats_view = view_alloc();
+
+  /* Setup the draw callback for the link statistics view */
+  view_set_draw_callback(app->linkstats_view, linkstats_view_draw_callback);
+
+  /* Setup the input callback for the link statistics view */
+  view_set_input_callback(app->linkstats_view, linkstats_view_input_callback);
+
+  /* Configure the "previous" callback for the link statistics view */
+  view_set_previous_callback(app->linkstats_view, return_to_submenu_callback);
+
+  /* Configure the enter callback for the link statistics view */
+  view_set_enter_callback(app->linkstats_view, linkstats_view_enter_callback);
+
+  /* Set the context for the link statistics view callbacks */
+  view_set_context(app->linkstats_view, app);
+
+  /* Allocate space for the link statistics view model */
+  view_allocate_model(app->linkstats_view, ViewModelTypeLockFree,
+			sizeof(LinkStatsModel));
+
+  /* Add the link statistics view */
+  view_dispatcher_add_view(app->view_dispatcher, view_linkstats,
+				app->linkstats_view);
+
+
+
   /* Setup the about view */
 
   /* Allocate space for the about view */
@@ -405,6 +489,10 @@ static App *noptel_lrf_sampler_app_init() {
   app->smm_pfx_config.config_smm_pfx_names[0][0] = 0;
   app->smm_pfx_config.config_smm_pfx_names[0][1] = 0;
 
+  /* Clear the configuration, so the padding bytes saved with it are zero
+     and not garbage a later version could mistake for a setting */
+  memset(&app->config, 0, sizeof(app->config));
+
   /* Set the default sampling mode setting */
   app->config.mode = config_mode_values[0];
   variable_item_set_current_value_index(app->item_mode, 0);
@@ -415,6 +503,17 @@ static App *noptel_lrf_sampler_app_init() {
   variable_item_set_current_value_index(app->item_buf, 0);
   variable_item_set_current_value_text(app->item_buf, config_buf_names[0]);
 
+  /* Set the default statistic setting */
+  app->config.stat = config_stat_values[0];
+  variable_item_set_current_value_index(app->item_stat, 0);
+  variable_item_set_current_value_text(app->item_stat, config_stat_names[0]);
+
+  /* Set the default targets setting */
+  app->config.targets = config_targets_values[0];
+  variable_item_set_current_value_index(app->item_targets, 0);
+  variable_item_set_current_value_text(app->item_targets,
+					config_targets_names[0]);
+
   /* Set the default beep option */
   app->config.beep = config_beep_values[0];
   variable_item_set_current_value_index(app->item_beep, 0);
@@ -459,6 +558,10 @@ static App *noptel_lrf_sampler_app_init() {
   app->lrf_serial_comm_app =
 		lrf_serial_comm_app_init(min_led_flash_duration,
 						uart_rx_timeout,
+						uart_rx_wakeup_threshold,
+						uart_rx_wakeup_timeout,
+						lrf_cmd_resp_timeout,
+						lrf_cmd_max_retries,
 						app->shared_storage,
 						sizeof(app->shared_storage));
 
@@ -488,6 +591,10 @@ static void noptel_lrf_sampler_app_free(App *app) {
   view_dispatcher_remove_view(app->view_dispatcher, view_about);
   view_free(app->about_view);
 
+  /* Remove the link statistics view */
+  view_dispatcher_remove_view(app->view_dispatcher, view_linkstats);
+  view_free(app->linkstats_view);
+
   /* Remove the USB serial passthrough view */
   view_dispatcher_remove_view(app->view_dispatcher, view_passthru);
   view_free(app->passthru_view);
@@ -512,6 +619,10 @@ static void noptel_lrf_sampler_app_free(App *app) {
   view_dispatcher_remove_view(app->view_dispatcher, view_testboottime);
   view_free(app->testboottime_view);
 
+  /* Remove the histogram view */
+  view_dispatcher_remove_view(app->view_dispatcher, view_histogram);
+  view_free(app->histogram_view);
+
   /* Remove the sample view */
   view_dispatcher_remove_view(app->view_dispatcher, view_sample);
   view_free(app->sample_view);
@@ -0,0 +1,307 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Order-statistic tree
+***/
+
+/*** Includes ***/
+#include <stdbool.h>
+
+#include "order_stat_tree.h"
+#include "endian_loaders.h"
+
+
+
+/*** Routines ***/
+
+/** Get the value of a node **/
+static inline uint32_t ost_value(OrderStatTree *tree, uint16_t n) {
+
+  return load_le_u24(tree->values + n * tree->stride);
+}
+
+
+
+/** Get the priority of a node
+    The priority is a hash of the node's index, so it doesn't need storing **/
+static inline uint32_t ost_priority(uint16_t n) {
+
+  uint32_t h = n;
+
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+
+  return h;
+}
+
+
+
+/** Return whether node a sorts before node b
+    Equal values are sorted by node index so all the keys are unique **/
+static inline bool ost_less(OrderStatTree *tree, uint16_t a, uint16_t b) {
+
+  uint32_t va = ost_value(tree, a);
+  uint32_t vb = ost_value(tree, b);
+
+  return va < vb || (va == vb && a < b);
+}
+
+
+
+/** Recalculate the size and sum of a subtree from its root's children **/
+static void ost_update(OrderStatTree *tree, uint16_t n) {
+
+  OSTNode *node = &tree->nodes[n];
+
+  node->size = 1;
+  tree->sums[n] = ost_value(tree, n);
+
+  if(node->left != OST_NIL) {
+    node->size += tree->nodes[node->left].size;
+    tree->sums[n] += tree->sums[node->left];
+  }
+
+  if(node->right != OST_NIL) {
+    node->size += tree->nodes[node->right].size;
+    tree->sums[n] += tree->sums[node->right];
+  }
+}
+
+
+
+/** Set up an empty tree
+    nodes and sums must hold as many entries as the value array **/
+void ost_init(OrderStatTree *tree, OSTNode *nodes, float *sums,
+		const uint8_t *values, size_t stride) {
+
+  tree->nodes = nodes;
+  tree->sums = sums;
+  tree->values = values;
+  tree->stride = stride;
+  tree->root = OST_NIL;
+}
+
+
+
+/** Empty the tree **/
+void ost_clear(OrderStatTree *tree) {
+
+  tree->root = OST_NIL;
+}
+
+
+
+/** Get the number of values in the tree **/
+uint16_t ost_size(OrderStatTree *tree) {
+
+  return tree->root == OST_NIL? 0 : tree->nodes[tree->root].size;
+}
+
+
+
+/** Add the value at index i in the value array to the tree
+    The value must not change while it is in the tree **/
+void ost_insert(OrderStatTree *tree, uint16_t i) {
+
+  OSTNode *nodes = tree->nodes;
+  uint16_t path[OST_MAX_DEPTH];
+  uint8_t depth = 0;
+  bool deep = false;
+  float value;
+  uint16_t *link;
+  uint16_t n, p, g;
+
+  /* Make the new node a leaf */
+  value = ost_value(tree, i);
+  nodes[i].left = OST_NIL;
+  nodes[i].right = OST_NIL;
+  nodes[i].size = 1;
+  tree->sums[i] = value;
+
+  /* Walk down to where the new leaf goes and remember its ancestors. Past the
+     maximum depth, update the ancestors on the way down instead */
+  link = &tree->root;
+  while((n = *link) != OST_NIL) {
+
+    if(depth < OST_MAX_DEPTH)
+      path[depth++] = n;
+    else {
+      nodes[n].size++;
+      tree->sums[n] += value;
+      deep = true;
+    }
+
+    link = ost_less(tree, i, n)? &nodes[n].left : &nodes[n].right;
+  }
+
+  /* Attach the new leaf */
+  *link = i;
+
+  /* Rotate the new node up as long as its priority is higher than its
+     parent's */
+  if(!deep)
+    while(depth && ost_priority(i) > ost_priority(path[depth - 1])) {
+
+      p = path[--depth];
+
+      if(nodes[p].left == i) {
+        nodes[p].left = nodes[i].right;
+        nodes[i].right = p;
+      }
+      else {
+        nodes[p].right = nodes[i].left;
+        nodes[i].left = p;
+      }
+
+      ost_update(tree, p);
+      ost_update(tree, i);
+
+      /* Attach the new node to its new parent */
+      if(depth) {
+        g = path[depth - 1];
+        if(nodes[g].left == p)
+          nodes[g].left = i;
+        else
+          nodes[g].right = i;
+      }
+      else
+        tree->root = i;
+    }
+
+  /* Update the remaining ancestors from the bottom up */
+  while(depth)
+    ost_update(tree, path[--depth]);
+}
+
+
+
+/** Remove the value at index i in the value array from the tree **/
+void ost_remove(OrderStatTree *tree, uint16_t i) {
+
+  OSTNode *nodes = tree->nodes;
+  uint16_t path[OST_MAX_DEPTH];
+  uint8_t depth = 0;
+  float value;
+  uint16_t *link;
+  uint16_t n, c;
+
+  value = ost_value(tree, i);
+
+  /* Walk down to the node and remember its ancestors. Past the maximum depth,
+     update the ancestors on the way down instead */
+  link = &tree->root;
+  while((n = *link) != i) {
+
+    /* Give up if the node isn't in the tree */
+    if(n == OST_NIL)
+      return;
+
+    if(depth < OST_MAX_DEPTH)
+      path[depth++] = n;
+    else {
+      nodes[n].size--;
+      tree->sums[n] -= value;
+    }
+
+    link = ost_less(tree, i, n)? &nodes[n].left : &nodes[n].right;
+  }
+
+  /* Rotate the node down until it has at most one child, moving its child with
+     the highest priority up each time */
+  while(nodes[i].left != OST_NIL && nodes[i].right != OST_NIL) {
+
+    if(ost_priority(nodes[i].left) > ost_priority(nodes[i].right)) {
+      c = nodes[i].left;
+      nodes[i].left = nodes[c].right;
+      nodes[c].right = i;
+      *link = c;
+      link = &nodes[c].right;
+    }
+    else {
+      c = nodes[i].right;
+      nodes[i].right = nodes[c].left;
+      nodes[c].left = i;
+      *link = c;
+      link = &nodes[c].left;
+    }
+
+    /* The child moved up is now an ancestor of the node */
+    if(depth < OST_MAX_DEPTH)
+      path[depth++] = c;
+    else {
+      ost_update(tree, i);
+      ost_update(tree, c);
+      nodes[c].size--;
+      tree->sums[c] -= value;
+    }
+  }
+
+  /* Replace the node with its only child, if any */
+  *link = nodes[i].left != OST_NIL? nodes[i].left : nodes[i].right;
+
+  /* Update the ancestors from the bottom up */
+  while(depth)
+    ost_update(tree, path[--depth]);
+}
+
+
+
+/** Get the value of rank k (0 is the smallest) in the tree **/
+uint32_t ost_select(OrderStatTree *tree, uint16_t k) {
+
+  OSTNode *nodes = tree->nodes;
+  uint16_t n = tree->root;
+  uint16_t left_size;
+
+  while(n != OST_NIL) {
+
+    left_size = nodes[n].left == OST_NIL? 0 : nodes[nodes[n].left].size;
+
+    if(k < left_size)
+      n = nodes[n].left;
+    else if(k == left_size)
+      return ost_value(tree, n);
+    else {
+      k -= left_size + 1;
+      n = nodes[n].right;
+    }
+  }
+
+  /* k is out of range */
+  return 0;
+}
+
+
+
+/** Get the sum of the k smallest values in the tree **/
+float ost_sum_smallest(OrderStatTree *tree, uint16_t k) {
+
+  OSTNode *nodes = tree->nodes;
+  uint16_t n = tree->root;
+  uint16_t left_size;
+  float sum = 0;
+
+  while(n != OST_NIL && k) {
+
+    left_size = nodes[n].left == OST_NIL? 0 : nodes[nodes[n].left].size;
+
+    /* All the k smallest values are in the left subtree */
+    if(k <= left_size)
+      n = nodes[n].left;
+
+    /* The whole left subtree and this node are among the k smallest values */
+    else {
+      if(left_size)
+        sum += tree->sums[nodes[n].left];
+      sum += ost_value(tree, n);
+      k -= left_size + 1;
+      n = nodes[n].right;
+    }
+  }
+
+  return sum;
+}
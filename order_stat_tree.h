@@ -0,0 +1,84 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Order-statistic tree
+ *
+ * Treap of 24-bit little-endian unsigned values kept in an external array,
+ * indexed by the position of the values in that array, with no dependency on
+ * the Flipper Zero firmware
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stddef.h>
+
+
+
+/*** Defines ***/
+#define OST_NIL 0xffff		/* No node */
+#define OST_MAX_DEPTH 64	/* Number of ancestors tracked when rebalancing */
+
+
+
+/*** Types ***/
+
+/** Tree node **/
+typedef struct {
+
+  /* Left and right children */
+  uint16_t left;
+  uint16_t right;
+
+  /* Number of nodes in the subtree rooted at this node */
+  uint16_t size;
+
+} OSTNode;
+
+
+
+/** Order-statistic tree **/
+typedef struct {
+
+  /* Nodes, and sums of the values in the subtrees rooted at the nodes.
+     There is one node per value in the value array */
+  OSTNode *nodes;
+  float *sums;
+
+  /* Value array: the value of node i is at values + i * stride */
+  const uint8_t *values;
+  size_t stride;
+
+  /* Root node */
+  uint16_t root;
+
+} OrderStatTree;
+
+
+
+/*** Routines ***/
+
+/** Set up an empty tree
+    nodes and sums must hold as many entries as the value array **/
+void ost_init(OrderStatTree *, OSTNode *, float *, const uint8_t *, size_t);
+
+/** Empty the tree **/
+void ost_clear(OrderStatTree *);
+
+/** Get the number of values in the tree **/
+uint16_t ost_size(OrderStatTree *);
+
+/** Add the value at index i in the value array to the tree
+    The value must not change while it is in the tree **/
+void ost_insert(OrderStatTree *, uint16_t);
+
+/** Remove the value at index i in the value array from the tree **/
+void ost_remove(OrderStatTree *, uint16_t);
+
+/** Get the value of rank k (0 is the smallest) in the tree **/
+uint32_t ost_select(OrderStatTree *, uint16_t);
+
+/** Get the sum of the k smallest values in the tree **/
+float ost_sum_smallest(OrderStatTree *, uint16_t);
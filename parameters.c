@@ -19,6 +19,7 @@ const char *config_file = STORAGE_APP_DATA_PATH_PREFIX "/" CONFIG_FILE;
 const char *smm_pfx_config_definition_file = STORAGE_APP_DATA_PATH_PREFIX "/"
 					SMM_PREFIX_CONFIG_DEFINITION_FILE;
 const char *dsp_files_dir = ANY_PATH("noptel_lrf_diag");
+const char *sample_log_files_dir = EXT_PATH("noptel_lrf_logs");
 
 /** Submenu item names **/
 const char *submenu_item_names[] = {"Configuration",
@@ -30,29 +31,50 @@ const char *submenu_item_names[] = {"Configuration",
 					"Test 905nm LRF laser",
 					"Test IR pointer",
 					"USB serial passthrough",
-					"About"};
+					"About",
+					"Link statistics",
+					"Histogram"};
 
 /** Sampling mode setting parameters **/
 const char *config_mode_label = "Sampling mode";
-const uint8_t config_mode_values[] = {smm, smm | AUTO_RESTART, cmm_1hz,
-					cmm_4hz, cmm_10hz, cmm_20hz,
-					cmm_100hz, cmm_200hz};
-const char *config_mode_names[] = {"SMM", "Auto SMM", "1 Hz", "4 Hz",
-					"10 Hz", "20 Hz", "100 Hz",
-					"200 Hz"};
+const uint8_t config_mode_values[] = {smm, smm | AUTO_RESTART,
+					smm | AUTO_RESTART | ADAPTIVE_COOLOFF,
+					quick_smm, cmm_1hz, cmm_4hz, cmm_10hz,
+					cmm_20hz, cmm_100hz, cmm_200hz};
+const char *config_mode_names[] = {"SMM", "Auto SMM", "Adapt SMM",
+					"Burst SMM", "1 Hz", "4 Hz", "10 Hz",
+					"20 Hz", "100 Hz", "200 Hz"};
 const uint8_t nb_config_mode_values = COUNT_OF(config_mode_values);
 
 /** Buffering setting parameters **/
 const char *config_buf_label = "Buffering";
 const int16_t config_buf_values[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
-					-5, -10, -100, -1000};
+					20, 30, 60,
+					-5, -10, -100, -1000, -2000, -3000,
+					BUF_TRACKING};
 const char *config_buf_names[] = {"None", "1 s", "2 s", "3 s",
 					"4 s", "5 s", "6 s", "7 s",
 					"8 s", "9 s", "10 s",
+					"20 s", "30 s", "60 s",
 					"5 spl", "10 spl", "100 spl",
-					"1000 spl"};
+					"1000 spl", "2000 spl", "3000 spl",
+					"Tracking"};
 const uint8_t nb_config_buf_values = COUNT_OF(config_buf_values);
 
+/** Statistic setting parameters **/
+const char *config_stat_label = "Statistic";
+const uint8_t config_stat_values[] = {stat_mean, stat_median,
+					stat_trimmed_mean, stat_mean_sd};
+const char *config_stat_names[] = {"Mean", "Median", "Trim 10%", "Mean+SD"};
+const char *config_stat_symbols[] = {"", "M", "T", "S"};
+const uint8_t nb_config_stat_values = COUNT_OF(config_stat_values);
+
+/** Targets setting parameters **/
+const char *config_targets_label = "Targets";
+const uint8_t config_targets_values[] = {targets_slots, targets_tracked};
+const char *config_targets_names[] = {"By slot", "Tracked"};
+const uint8_t nb_config_targets_values = COUNT_OF(config_targets_values);
+
 /** Beep setting parameters **/
 const char *config_beep_label = "Beep";
 const uint8_t config_beep_values[] = {0, 1};
@@ -80,6 +102,14 @@ const uint8_t nb_config_smm_pfx_values = COUNT_OF(config_smm_pfx_values);
 /** UART receive timeout **/
 const uint16_t uart_rx_timeout = 500; /*ms*/
 
+/** UART receive thread wakeup conditions **/
+const uint16_t uart_rx_wakeup_threshold = 64; /*bytes*/
+const uint16_t uart_rx_wakeup_timeout = 20; /*ms*/
+
+/** LRF command response timeout and retries **/
+const uint16_t lrf_cmd_resp_timeout = 200; /*ms*/
+const uint8_t lrf_cmd_max_retries = 2;
+
 /** Speaker parameters **/
 const uint16_t beep_frequency = 1000; /*Hz*/
 const uint16_t sample_received_beep_duration = 25; /*ms*/
@@ -87,9 +117,40 @@ const uint16_t sample_received_beep_duration = 25; /*ms*/
 /** LED parameters **/
 const uint16_t min_led_flash_duration = 15; /*ms*/
 
+/** Automatic SMM scheduler timings **/
+const uint16_t smm_cooloff = 200; /*ms*/
+const uint16_t smm_error_cooloff = 1000; /*ms*/
+const uint16_t smm_min_cooloff = 20; /*ms*/
+const uint16_t smm_cooloff_step = 10; /*ms, per measurement without error*/
+const uint16_t smm_resp_timeout = 2000; /*ms*/
+
+/** Burst SMM parameters **/
+const uint16_t burst_smm_nb_shots = 100;
+const uint8_t burst_smm_pipeline_depth = 2; /*shots queued ahead*/
+
 /** Sample view timings **/
 const uint16_t sample_view_update_every = 150; /*ms*/
 const uint8_t sample_view_smm_prefix_enabled_blink_every = 3; /*view updates*/
+const uint16_t sample_view_avg_recompute_every = 1000; /*samples*/
+
+/** Tracking filter parameters **/
+const float track_filter_accel_noise = 5; /*m/s^2, standard deviation*/
+const float track_filter_meas_noise = 0.1; /*m, standard deviation*/
+const float track_filter_gate = 4; /*innovation standard deviations*/
+const uint8_t track_filter_max_misses = 5; /*consecutive samples*/
+
+/** Target association parameters **/
+const float track_assoc_gate = 2; /*m*/
+const uint8_t track_assoc_max_misses = 10; /*consecutive samples*/
+
+/** Serial link load parameters **/
+const uint8_t lrf_cmm_frame_len = 22; /*bytes*/
+const uint8_t uart_bits_per_byte = 10; /*8N1: start + 8 data + stop bits*/
+
+/** Histogram view parameters **/
+const uint16_t histogram_view_update_every = 150; /*ms*/
+const uint32_t histogram_bin_widths_cm[] = {1, 2, 5, 10, 20, 50, 100};
+const uint8_t nb_histogram_bin_widths = COUNT_OF(histogram_bin_widths_cm);
 
 /** Test laser view timings **/
 const uint16_t test_laser_view_update_every = 150; /*ms*/
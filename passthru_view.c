@@ -121,7 +121,7 @@ static void mirror_vcp_on_uart(App *app, PassthruModel *passthru_model) {
 			passthru_model->vcp_config->dwDTERate);
 
       /* Setup the callback to receive raw LRF data */
-      set_lrf_raw_data_handler(app->lrf_serial_comm_app, lrf_raw_data_handler,
+      add_lrf_raw_data_handler(app->lrf_serial_comm_app, lrf_raw_data_handler,
 				app);
 
       /* Update the display */
@@ -154,8 +154,9 @@ static void mirror_vcp_on_uart(App *app, PassthruModel *passthru_model) {
     /* Is the UART started? */
     if(passthru_model->uart_baudrate) {
 
-      /* Unset the callback to receive raw LRF data */
-      set_lrf_raw_data_handler(app->lrf_serial_comm_app, NULL, app);
+      /* Remove the callback to receive raw LRF data */
+      remove_lrf_raw_data_handler(app->lrf_serial_comm_app,
+				lrf_raw_data_handler, app);
 
       /* Stop the UART */
       stop_uart(app->lrf_serial_comm_app);
@@ -626,7 +627,8 @@ void passthru_view_exit_callback(void *ctx) {
   /* If the UART is started, unset the callback to receive raw LRF data and
      stop the UART */
   if(passthru_model->uart_baudrate) {
-    set_lrf_raw_data_handler(app->lrf_serial_comm_app, NULL, app);
+    remove_lrf_raw_data_handler(app->lrf_serial_comm_app, lrf_raw_data_handler,
+				app);
     stop_uart(app->lrf_serial_comm_app);
   }
 
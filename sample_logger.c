@@ -0,0 +1,350 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Sample logger
+***/
+
+/*** Includes ***/
+#include <furi_hal.h>
+#include <storage/storage.h>
+
+#include "common.h"
+
+
+
+/*** Writer thread events ***/
+typedef enum {
+  stop = 1,
+  block_ready = 2
+} writer_thread_evts;
+
+
+
+/*** Routines ***/
+
+/** Sample log writer thread
+    Open the log file and write its header, write the blocks of samples to it
+    as they fill up, and write the index and close it when asked to stop **/
+static int32_t sample_log_writer_thread(void *ctx) {
+
+  SampleLogger *logger = (SampleLogger *)ctx;
+  Storage *storage;
+  File *file;
+  bool file_open = false;
+  uint8_t header[LRF_LOG_HEADER_SIZE];
+  LRFLogBlockInfo info;
+  uint32_t evts;
+  uint32_t start_ms, bytes_to_write, bytes_written;
+  uint8_t b;
+  bool full;
+
+  FURI_LOG_I(TAG, "Sample log writer thread started");
+
+  /* Open storage and allocate space for the file */
+  storage = furi_record_open(RECORD_STORAGE);
+  file = storage_file_alloc(storage);
+
+  /* Create the destination directory and the log file, and write the
+     header */
+  if(storage_simply_mkdir(storage, sample_log_files_dir) &&
+	storage_file_open(file, logger->fpath, FSAM_WRITE,
+				FSOM_CREATE_ALWAYS)) {
+    file_open = true;
+
+    lrf_log_encode_header(header, &logger->header);
+    bytes_written = storage_file_write(file, header, sizeof(header));
+    logger->stats.nb_bytes_written += bytes_written;
+
+    if(bytes_written != sizeof(header)) {
+      FURI_LOG_I(TAG, "Could not write the header of log file %s",
+			logger->fpath);
+      logger->stats.write_error = true;
+    }
+  }
+  else {
+    FURI_LOG_I(TAG, "Could not open log file %s for writing", logger->fpath);
+    logger->stats.write_error = true;
+  }
+
+  do {
+
+    /* Wait for events */
+    evts = furi_thread_flags_wait(stop | block_ready, FuriFlagWaitAny,
+					FuriWaitForever);
+
+    /* Check for errors */
+    furi_check((evts & FuriFlagError) == 0);
+
+    /* Write the full blocks in the order they filled up */
+    while(true) {
+
+      furi_check(furi_mutex_acquire(logger->mutex, FuriWaitForever) ==
+			FuriStatusOk);
+      b = logger->write_block;
+      full = logger->block_full[b];
+      furi_mutex_release(logger->mutex);
+
+      if(!full)
+        break;
+
+      /* Seal the block and write it if we can, and time how long writing
+         takes. The block isn't touched by anyone else while it's marked
+         full */
+      if(file_open && !logger->stats.write_error) {
+
+        lrf_log_seal_block(logger->blocks[b]);
+        lrf_log_get_block_info(logger->blocks[b], &info);
+
+        start_ms = furi_get_tick();
+        bytes_written = storage_file_write(file, logger->blocks[b],
+						LRF_LOG_BLOCK_SIZE);
+        logger->stats.write_time_ms += furi_get_tick() - start_ms;
+        logger->stats.nb_bytes_written += bytes_written;
+
+        /* If all the bytes couldn't be written, stop writing and report an
+           error */
+        if(bytes_written != LRF_LOG_BLOCK_SIZE) {
+          FURI_LOG_I(TAG, "Wrote %ld bytes to log file %s but %d expected",
+			bytes_written, logger->fpath, LRF_LOG_BLOCK_SIZE);
+          logger->stats.write_error = true;
+        }
+
+        /* Index the block */
+        else {
+          lrf_log_index_add(logger->index, logger->stats.nb_blocks_written,
+				info.first_tstamp_ms);
+          logger->stats.nb_blocks_written++;
+          logger->stats.nb_samples_written += info.nb_samples;
+        }
+      }
+
+      /* Hand the block back to the sample processing thread */
+      furi_check(furi_mutex_acquire(logger->mutex, FuriWaitForever) ==
+			FuriStatusOk);
+      logger->block_full[b] = false;
+      logger->write_block = b ^ 1;
+      furi_mutex_release(logger->mutex);
+    }
+
+  } while(!(evts & stop));
+
+  /* Write the index at the end of the log file. Both blocks have been
+     written and nobody adds samples anymore, so the first block is used to
+     encode it */
+  if(file_open && !logger->stats.write_error) {
+
+    bytes_to_write = lrf_log_encode_index(logger->blocks[0], logger->index);
+    bytes_written = storage_file_write(file, logger->blocks[0],
+					bytes_to_write);
+    logger->stats.nb_bytes_written += bytes_written;
+
+    if(bytes_written != bytes_to_write) {
+      FURI_LOG_I(TAG, "Could not write the index of log file %s",
+			logger->fpath);
+      logger->stats.write_error = true;
+    }
+  }
+
+  /* Close the log file */
+  if(file_open)
+    storage_file_close(file);
+
+  /* Free the file and close storage */
+  storage_file_free(file);
+  furi_record_close(RECORD_STORAGE);
+
+  FURI_LOG_I(TAG, "Sample log writer thread stopped: %ld samples saved in "
+			"file %s", logger->stats.nb_samples_written,
+			logger->fpath);
+
+  return 0;
+}
+
+
+
+/** Setup the sample logger **/
+void set_sample_logger(SampleLogger *logger) {
+
+  logger->mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+  logger->recording = false;
+  memset(&logger->stats, 0, sizeof(SampleLoggerStats));
+}
+
+
+
+/** Release the sample logger, stopping the recording if needed **/
+void release_sample_logger(SampleLogger *logger) {
+
+  stop_sample_logging(logger);
+  furi_mutex_free(logger->mutex);
+}
+
+
+
+/** Start recording samples into a new log file named after the LRF's serial
+    number and the current date and time
+    The date and time in the log file header are filled in **/
+void start_sample_logging(SampleLogger *logger, LRFLogHeader *header) {
+
+  DateTime datetime;
+
+  /* Don't start recording twice */
+  if(logger->recording)
+    return;
+
+  /* Complete the log file header with the current date / time */
+  furi_hal_rtc_get_datetime(&datetime);
+
+  memcpy(&logger->header, header, sizeof(LRFLogHeader));
+  logger->header.year = datetime.year;
+  logger->header.month = datetime.month;
+  logger->header.day = datetime.day;
+  logger->header.hour = datetime.hour;
+  logger->header.minute = datetime.minute;
+  logger->header.second = datetime.second;
+
+  /* Create the absolute path of the log file */
+  snprintf(logger->fpath, sizeof(logger->fpath),
+		"%s/%s-%04d.%02d.%02d-%02d.%02d.%02d.lrflog",
+		sample_log_files_dir,
+		header->ident.serial[0]? header->ident.serial : "unknown",
+		datetime.year, datetime.month, datetime.day,
+		datetime.hour, datetime.minute, datetime.second);
+
+  /* Allocate the blocks and the index. They're only needed while
+     recording, so they don't hold RAM the rest of the time */
+  logger->blocks[0] = malloc(LRF_LOG_BLOCK_SIZE);
+  logger->blocks[1] = malloc(LRF_LOG_BLOCK_SIZE);
+  logger->index = malloc(sizeof(LRFLogIndex));
+
+  /* Start encoding the first block, and reset the index and the
+     statistics */
+  logger->block_full[0] = false;
+  logger->block_full[1] = false;
+  logger->fill_block = 0;
+  logger->write_block = 0;
+  lrf_log_start_block(&logger->encoder, logger->blocks[0], 0);
+  logger->next_block_seq = 1;
+  lrf_log_index_init(logger->index);
+  memset(&logger->stats, 0, sizeof(SampleLoggerStats));
+
+  /* Allocate space for the writer thread */
+  logger->writer_thread = furi_thread_alloc();
+
+  /* Initialize the writer thread. It runs at low priority so writing to the
+     SD card never delays receiving or processing samples */
+  furi_thread_set_name(logger->writer_thread, "sample_log");
+  furi_thread_set_stack_size(logger->writer_thread, 2048);
+  furi_thread_set_priority(logger->writer_thread, FuriThreadPriorityLow);
+  furi_thread_set_context(logger->writer_thread, logger);
+  furi_thread_set_callback(logger->writer_thread, sample_log_writer_thread);
+
+  /* Start the writer thread */
+  furi_thread_start(logger->writer_thread);
+
+  /* Get the writer thread ID */
+  logger->writer_thread_id = furi_thread_get_id(logger->writer_thread);
+
+  /* Start accepting samples */
+  furi_check(furi_mutex_acquire(logger->mutex, FuriWaitForever) ==
+		FuriStatusOk);
+  logger->recording = true;
+  furi_mutex_release(logger->mutex);
+
+  FURI_LOG_I(TAG, "Recording samples into %s", logger->fpath);
+}
+
+
+
+/** Stop recording samples, write the samples left in the blocks and close
+    the log file **/
+void stop_sample_logging(SampleLogger *logger) {
+
+  if(!logger->recording)
+    return;
+
+  /* Stop accepting samples and hand the partly filled block to the writer
+     thread. If the other block is still waiting to be written, the writer
+     thread writes it first */
+  furi_check(furi_mutex_acquire(logger->mutex, FuriWaitForever) ==
+		FuriStatusOk);
+
+  logger->recording = false;
+
+  if(logger->encoder.nb_samples) {
+    logger->block_full[logger->fill_block] = true;
+    logger->fill_block ^= 1;
+  }
+
+  furi_mutex_release(logger->mutex);
+
+  /* Stop and free the writer thread once it has written all the full
+     blocks */
+  furi_thread_flags_set(logger->writer_thread_id, stop);
+  furi_thread_join(logger->writer_thread);
+  furi_thread_free(logger->writer_thread);
+
+  /* Free the blocks and the index */
+  free(logger->blocks[0]);
+  free(logger->blocks[1]);
+  free(logger->index);
+}
+
+
+
+/** Return whether samples are being recorded **/
+bool is_sample_logging(SampleLogger *logger) {
+
+  return logger->recording;
+}
+
+
+
+/** Log one LRF sample
+    Called by the sample processing thread **/
+void log_sample(SampleLogger *logger, LRFSample *sample) {
+
+  uint8_t b;
+
+  furi_check(furi_mutex_acquire(logger->mutex, FuriWaitForever) ==
+		FuriStatusOk);
+
+  /* Add the sample to the block being filled. If it doesn't fit, the block
+     is full */
+  if(logger->recording &&
+	!lrf_log_add_sample(&logger->encoder, sample)) {
+
+    b = logger->fill_block;
+
+    /* If the writer thread is still busy with the other block, the SD card
+       can't keep up: drop this block's samples and refill it. The dropped
+       block's sequence number is skipped so the gap shows in the file */
+    if(logger->block_full[b ^ 1])
+      logger->stats.nb_blocks_dropped++;
+
+    /* Otherwise hand the block to the writer thread and start filling the
+       other block. The thread is woken up while the mutex is held, so it
+       can't be stopped and freed in the meantime */
+    else {
+      logger->block_full[b] = true;
+      logger->fill_block = b ^ 1;
+      furi_thread_flags_set(logger->writer_thread_id, block_ready);
+    }
+
+    /* Add the sample to a new block */
+    lrf_log_start_block(&logger->encoder, logger->blocks[logger->fill_block],
+				logger->next_block_seq++);
+    lrf_log_add_sample(&logger->encoder, sample);
+  }
+
+  furi_mutex_release(logger->mutex);
+}
+
+
+
+/** Get the sample logger statistics **/
+void get_sample_logger_stats(SampleLogger *logger, SampleLoggerStats *stats) {
+
+  memcpy(stats, &logger->stats, sizeof(SampleLoggerStats));
+}
@@ -0,0 +1,115 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Sample logger
+ *
+ * Records the raw stream of LRF samples to a file on the SD card. Samples are
+ * encoded into one of two RAM blocks, and a low-priority writer thread
+ * flushes full blocks to the file, so SD card latency never holds up the
+ * threads that receive and process the samples
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <furi.h>
+#include <storage/storage.h>
+
+#include "lrf_frame_decoder.h"
+#include "lrf_sample_log.h"
+
+
+
+/*** Types ***/
+
+/** Sample logger statistics **/
+typedef struct {
+
+  /* Number of samples written to the file */
+  uint32_t nb_samples_written;
+
+  /* Number of blocks written to the file */
+  uint32_t nb_blocks_written;
+
+  /* Number of blocks dropped because the writer thread was still busy
+     writing the other block when they filled up */
+  uint32_t nb_blocks_dropped;
+
+  /* Number of bytes written to the file, and total time spent writing them */
+  uint32_t nb_bytes_written;
+  uint32_t write_time_ms;
+
+  /* Whether the file couldn't be opened or written */
+  bool write_error;
+
+} SampleLoggerStats;
+
+
+
+/** Sample logger **/
+typedef struct {
+
+  /* Blocks of samples, allocated while recording, and whether each block
+     is full and waiting to be written by the writer thread */
+  uint8_t *blocks[2];
+  bool block_full[2];
+
+  /* Block being filled with new samples, and next block to be written */
+  uint8_t fill_block;
+  uint8_t write_block;
+
+  /* Encoder of the block being filled, and sequence number of the next
+     block */
+  LRFLogBlockEncoder encoder;
+  uint32_t next_block_seq;
+
+  /* Mutex to access the block states above */
+  FuriMutex *mutex;
+
+  /* Whether samples are being recorded */
+  bool recording;
+
+  /* Log file header, path, and index of the blocks written to the file,
+     allocated while recording */
+  LRFLogHeader header;
+  char fpath[128];
+  LRFLogIndex *index;
+
+  /* Writer thread and its ID */
+  FuriThread *writer_thread;
+  FuriThreadId writer_thread_id;
+
+  /* Statistics */
+  SampleLoggerStats stats;
+
+} SampleLogger;
+
+
+
+/*** Routines ***/
+
+/** Setup the sample logger **/
+void set_sample_logger(SampleLogger *);
+
+/** Release the sample logger, stopping the recording if needed **/
+void release_sample_logger(SampleLogger *);
+
+/** Start recording samples into a new log file named after the LRF's serial
+    number and the current date and time
+    The date and time in the log file header are filled in **/
+void start_sample_logging(SampleLogger *, LRFLogHeader *);
+
+/** Stop recording samples, write the samples left in the blocks and close
+    the log file **/
+void stop_sample_logging(SampleLogger *);
+
+/** Return whether samples are being recorded **/
+bool is_sample_logging(SampleLogger *);
+
+/** Log one LRF sample
+    Called by the sample processing thread **/
+void log_sample(SampleLogger *, LRFSample *);
+
+/** Get the sample logger statistics **/
+void get_sample_logger_stats(SampleLogger *, SampleLoggerStats *);
@@ -0,0 +1,109 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF sample queue
+***/
+
+/*** Includes ***/
+#include <string.h>
+
+#include "sample_queue.h"
+
+
+
+/*** Routines ***/
+
+/** Empty the queue
+    Must only be called when neither the producer nor the consumer is running
+**/
+void sample_queue_reset(SampleQueue *queue) {
+
+  queue->head = 0;
+  queue->tail = 0;
+  queue->stats.size = SAMPLE_QUEUE_SIZE;
+}
+
+
+
+/** Push a sample into the queue - producer only
+    Returns false if the queue is full and the sample was dropped **/
+bool sample_queue_push(SampleQueue *queue, LRFSample *sample) {
+
+  uint16_t head, tail;
+  uint16_t fill;
+
+  /* Only the producer modifies the head of the queue */
+  head = queue->head;
+  tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+  queue->stats.nb_pushed++;
+
+  /* Is the queue full? */
+  fill = (head - tail) & (SAMPLE_QUEUE_SIZE * 2 - 1);
+  if(fill >= SAMPLE_QUEUE_SIZE) {
+    queue->stats.nb_overflows++;
+    return false;
+  }
+
+  /* Copy the sample into the queue */
+  memcpy(&queue->samples[head & (SAMPLE_QUEUE_SIZE - 1)], sample,
+		sizeof(LRFSample));
+
+  /* Update the high water mark */
+  if(fill + 1 > queue->stats.high_water_mark)
+    queue->stats.high_water_mark = fill + 1;
+
+  /* Publish the new sample to the consumer */
+  __atomic_store_n(&queue->head, (head + 1) & (SAMPLE_QUEUE_SIZE * 2 - 1),
+			__ATOMIC_RELEASE);
+
+  return true;
+}
+
+
+
+/** Pop a sample from the queue - consumer only
+    Returns false if the queue is empty **/
+bool sample_queue_pop(SampleQueue *queue, LRFSample *sample) {
+
+  uint16_t head, tail;
+
+  /* Only the consumer modifies the tail of the queue */
+  head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+  tail = queue->tail;
+
+  /* Is the queue empty? */
+  if(tail == head)
+    return false;
+
+  /* Copy the sample out of the queue */
+  memcpy(sample, &queue->samples[tail & (SAMPLE_QUEUE_SIZE - 1)],
+		sizeof(LRFSample));
+
+  /* Release the slot to the producer */
+  __atomic_store_n(&queue->tail, (tail + 1) & (SAMPLE_QUEUE_SIZE * 2 - 1),
+			__ATOMIC_RELEASE);
+
+  return true;
+}
+
+
+
+/** Get the queue statistics **/
+void sample_queue_get_stats(SampleQueue *queue, SampleQueueStats *stats) {
+
+  memcpy(stats, &queue->stats, sizeof(SampleQueueStats));
+  stats->size = SAMPLE_QUEUE_SIZE;
+}
+
+
+
+/** Reset the queue statistics **/
+void sample_queue_reset_stats(SampleQueue *queue) {
+
+  queue->stats.nb_pushed = 0;
+  queue->stats.nb_overflows = 0;
+  queue->stats.high_water_mark = 0;
+  queue->stats.size = SAMPLE_QUEUE_SIZE;
+}
@@ -0,0 +1,80 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF sample queue
+ *
+ * Lock-free single-producer / single-consumer queue of LRF samples, with no
+ * dependency on the Flipper Zero firmware
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include "lrf_frame_decoder.h"
+
+
+
+/*** Defines ***/
+#define SAMPLE_QUEUE_SIZE 64	/* Must be a power of 2 */
+
+
+
+/*** Types ***/
+
+/** Sample queue statistics **/
+typedef struct {
+
+  /* Number of samples pushed into the queue */
+  uint32_t nb_pushed;
+
+  /* Number of samples dropped because the queue was full */
+  uint32_t nb_overflows;
+
+  /* Highest number of samples held in the queue at once */
+  uint16_t high_water_mark;
+
+  /* Size of the queue */
+  uint16_t size;
+
+} SampleQueueStats;
+
+
+
+/** Sample queue **/
+typedef struct {
+
+  /* Sample ring buffer */
+  LRFSample samples[SAMPLE_QUEUE_SIZE];
+
+  /* Head (written by the producer) and tail (written by the consumer) */
+  uint16_t head;
+  uint16_t tail;
+
+  /* Statistics */
+  SampleQueueStats stats;
+
+} SampleQueue;
+
+
+
+/*** Routines ***/
+
+/** Empty the queue
+    Must only be called when neither the producer nor the consumer is running
+**/
+void sample_queue_reset(SampleQueue *);
+
+/** Push a sample into the queue - producer only
+    Returns false if the queue is full and the sample was dropped **/
+bool sample_queue_push(SampleQueue *, LRFSample *);
+
+/** Pop a sample from the queue - consumer only
+    Returns false if the queue is empty **/
+bool sample_queue_pop(SampleQueue *, LRFSample *);
+
+/** Get the queue statistics **/
+void sample_queue_get_stats(SampleQueue *, SampleQueueStats *);
+
+/** Reset the queue statistics **/
+void sample_queue_reset_stats(SampleQueue *);
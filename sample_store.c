@@ -0,0 +1,142 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Packed LRF sample storage
+***/
+
+/*** Includes ***/
+#include "sample_store.h"
+
+
+
+/*** Routines ***/
+
+/** Convert a distance in meters into a distance in centimeters that fits in
+    the store **/
+static uint32_t dist_to_cm(float dist) {
+
+  if(dist <= 0)
+    return 0;
+
+  if(dist >= MAX_PACKED_DIST_CM / 100.0f)
+    return MAX_PACKED_DIST_CM;
+
+  return (uint32_t)(dist * 100 + 0.5f);
+}
+
+
+
+/** Lay out a store for nb_samples samples in a storage area of at least
+    nb_samples * SAMPLE_STORE_BYTES_PER_SAMPLE bytes aligned on 2 bytes **/
+void sample_store_init(SampleStore *store, uint8_t *storage,
+			uint16_t nb_samples) {
+
+  uint8_t t;
+
+  /* The 16-bit arrays come first so they're aligned */
+  store->tstamp_delta_ms = (uint16_t *)storage;
+
+  for(t = 0; t < 3; t++)
+    store->ampl[t] = store->tstamp_delta_ms + (t + 1) * nb_samples;
+
+  for(t = 0; t < 3; t++)
+    store->dist_cm[t] = (uint8_t *)(store->ampl[2] + nb_samples) +
+				t * 3 * nb_samples;
+}
+
+
+
+/** Store an LRF sample at index i
+    prev_tstamp_us is the timestamp of the previously stored sample **/
+void sample_store_put(SampleStore *store, uint16_t i, LRFSample *sample,
+			uint64_t prev_tstamp_us) {
+
+  uint64_t tstamp_delta_ms;
+
+  store_le_u24(store->dist_cm[0] + 3 * i, dist_to_cm(sample->dist1));
+  store_le_u24(store->dist_cm[1] + 3 * i, dist_to_cm(sample->dist2));
+  store_le_u24(store->dist_cm[2] + 3 * i, dist_to_cm(sample->dist3));
+
+  store->ampl[0][i] = sample->ampl1;
+  store->ampl[1][i] = sample->ampl2;
+  store->ampl[2][i] = sample->ampl3;
+
+  /* Samples further apart than the maximum delta are stored as if they came
+     in at the maximum delta, and samples timestamped before the previous
+     sample as if they came in at the same time */
+  tstamp_delta_ms = sample->tstamp_us > prev_tstamp_us?
+			(sample->tstamp_us - prev_tstamp_us + 500) / 1000 : 0;
+  store->tstamp_delta_ms[i] = tstamp_delta_ms > MAX_PACKED_TSTAMP_DELTA_MS?
+				MAX_PACKED_TSTAMP_DELTA_MS : tstamp_delta_ms;
+}
+
+
+
+/** Get the LRF sample at index i
+    tstamp_us is the sample's timestamp, since it isn't stored in full **/
+void sample_store_get(SampleStore *store, uint16_t i, LRFSample *sample,
+			uint64_t tstamp_us) {
+
+  sample->dist1 = sample_store_dist_cm(store, 0, i) / 100.0f;
+  sample->dist2 = sample_store_dist_cm(store, 1, i) / 100.0f;
+  sample->dist3 = sample_store_dist_cm(store, 2, i) / 100.0f;
+
+  sample->ampl1 = store->ampl[0][i];
+  sample->ampl2 = store->ampl[1][i];
+  sample->ampl3 = store->ampl[2][i];
+
+  sample->tstamp_us = tstamp_us;
+}
+
+
+
+/** Add one target's valid distances in nb consecutive samples starting at
+    index i, without wrapping around, to sums cleared beforehand
+    Valid distances are longer than 50 cm. The sums are exact **/
+void sample_store_sum_dists(SampleStore *store, uint8_t target, uint16_t i,
+				uint16_t nb, SampleStoreSums *sums) {
+
+  const uint8_t *dist_cm = store->dist_cm[target] + 3 * i;
+  const uint16_t *ampl = store->ampl[target] + i;
+  uint32_t d;
+  int32_t dev;
+
+  for(; nb; nb--, dist_cm += 3, ampl++) {
+
+    d = load_le_u24(dist_cm);
+
+    if(d <= 50)
+      continue;
+
+    /* The first valid distance is the reference distance */
+    if(!sums->nb_valid)
+      sums->ref_dist_cm = d;
+
+    dev = (int32_t)(d - sums->ref_dist_cm);
+
+    sums->nb_valid++;
+    sums->sum_dist_cm += d;
+    sums->sum_ampl += *ampl;
+    sums->sum_dev_cm += dev;
+    sums->sum_sq_dev_cm += (int64_t)dev * dev;
+  }
+}
+
+
+
+/** Count the samples with any valid distance in nb consecutive samples
+    starting at index i, without wrapping around **/
+uint16_t sample_store_count_any_valid(SampleStore *store, uint16_t i,
+					uint16_t nb) {
+
+  uint16_t nb_valid = 0;
+
+  for(; nb; nb--, i++)
+    if(sample_store_dist_cm(store, 0, i) > 50 ||
+	sample_store_dist_cm(store, 1, i) > 50 ||
+	sample_store_dist_cm(store, 2, i) > 50)
+      nb_valid++;
+
+  return nb_valid;
+}
@@ -0,0 +1,103 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Packed LRF sample storage
+ *
+ * Compact structure-of-arrays storage of LRF samples for the sample ring
+ * buffer, with no dependency on the Flipper Zero firmware
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include "lrf_frame_decoder.h"
+#include "endian_loaders.h"
+
+
+
+/*** Defines ***/
+#define SAMPLE_STORE_BYTES_PER_SAMPLE 17
+#define MAX_PACKED_DIST_CM 0xffffff	/* About 167 km */
+#define MAX_PACKED_TSTAMP_DELTA_MS 0xffff
+
+
+
+/*** Types ***/
+
+/** Sample store
+    Each field of the samples is stored in its own array, so scanning one
+    field reads contiguous memory **/
+typedef struct {
+
+  /* Milliseconds elapsed since the previous sample, rounded to the
+     nearest */
+  uint16_t *tstamp_delta_ms;
+
+  /* Amplitudes of the 3 targets */
+  uint16_t *ampl[3];
+
+  /* Distances of the 3 targets in centimeters - 24-bit little-endian */
+  uint8_t *dist_cm[3];
+
+} SampleStore;
+
+
+
+/** Sums over one target's valid distances in a range of samples **/
+typedef struct {
+
+  /* Number of valid distances */
+  uint16_t nb_valid;
+
+  /* Sums of the valid distances and of their amplitudes */
+  uint64_t sum_dist_cm;
+  uint32_t sum_ampl;
+
+  /* Reference distance - the first valid distance - and sums of the
+     deviations of the valid distances from it and of their squares */
+  uint32_t ref_dist_cm;
+  int64_t sum_dev_cm;
+  uint64_t sum_sq_dev_cm;
+
+} SampleStoreSums;
+
+
+
+/*** Routines ***/
+
+/** Lay out a store for nb_samples samples in a storage area of at least
+    nb_samples * SAMPLE_STORE_BYTES_PER_SAMPLE bytes aligned on 2 bytes **/
+void sample_store_init(SampleStore *, uint8_t *, uint16_t);
+
+/** Store an LRF sample at index i
+    prev_tstamp_us is the timestamp of the previously stored sample **/
+void sample_store_put(SampleStore *, uint16_t, LRFSample *, uint64_t);
+
+/** Get the LRF sample at index i
+    tstamp_us is the sample's timestamp, since it isn't stored in full **/
+void sample_store_get(SampleStore *, uint16_t, LRFSample *, uint64_t);
+
+/** Add one target's valid distances in nb consecutive samples starting at
+    index i, without wrapping around, to sums cleared beforehand **/
+void sample_store_sum_dists(SampleStore *, uint8_t, uint16_t, uint16_t,
+				SampleStoreSums *);
+
+/** Count the samples with any valid distance in nb consecutive samples
+    starting at index i, without wrapping around **/
+uint16_t sample_store_count_any_valid(SampleStore *, uint16_t, uint16_t);
+
+/** Get the number of milliseconds elapsed between the sample at index i and
+    the previously stored sample **/
+static inline uint16_t sample_store_tstamp_delta(SampleStore *store,
+							uint16_t i) {
+
+  return store->tstamp_delta_ms[i];
+}
+
+/** Get a target's distance in centimeters in the sample at index i **/
+static inline uint32_t sample_store_dist_cm(SampleStore *store,
+						uint8_t target, uint16_t i) {
+
+  return load_le_u24(store->dist_cm[target] + 3 * i);
+}
@@ -0,0 +1,97 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Sample timing analysis
+***/
+
+/*** Includes ***/
+#include <string.h>
+
+#include "sample_timing.h"
+
+
+
+/*** Constants ***/
+
+/** Upper edges of the jitter bins in milliseconds, except the last bin's **/
+const uint16_t sample_timing_jitter_bin_edges_ms[] = {1, 2, 5, 10, 20, 50,
+							100};
+
+
+
+/*** Routines ***/
+
+/** Reset the sample timing statistics, with the nominal interval between
+    samples at the commanded sampling frequency, or 0 if there is none **/
+void sample_timing_reset(SampleTiming *timing, uint16_t nominal_interval_ms) {
+
+  memset(timing, 0, sizeof(SampleTiming));
+  timing->nominal_interval_ms = nominal_interval_ms;
+}
+
+
+
+/** Add the arrival time of a sample to the sample timing statistics **/
+void sample_timing_add(SampleTiming *timing, uint64_t tstamp_us) {
+
+  uint32_t interval_us, ref_interval_us, dev_us, nb_periods;
+  uint8_t b;
+
+  /* The first sample has no interval */
+  if(!timing->has_prev) {
+    timing->prev_tstamp_us = tstamp_us;
+    timing->has_prev = true;
+    return;
+  }
+
+  /* A sample timestamped before the previous one - which may happen if its
+     arrival time isn't known precisely - came in at the same time. Intervals
+     too long to count in microseconds are capped */
+  interval_us = tstamp_us <= timing->prev_tstamp_us? 0 :
+		tstamp_us - timing->prev_tstamp_us > UINT32_MAX? UINT32_MAX :
+		tstamp_us - timing->prev_tstamp_us;
+  timing->prev_tstamp_us = tstamp_us;
+
+  /* Update the smallest, largest and sum of the intervals */
+  if(!timing->nb_intervals || interval_us < timing->min_interval_us)
+    timing->min_interval_us = interval_us;
+  if(interval_us > timing->max_interval_us)
+    timing->max_interval_us = interval_us;
+  timing->sum_interval_us += interval_us;
+  timing->nb_intervals++;
+
+  /* Count the samples missing in the interval: one less than the number of
+     nominal intervals it spans, rounded to the nearest */
+  if(timing->nominal_interval_ms) {
+    ref_interval_us = timing->nominal_interval_ms * 1000;
+
+    nb_periods = (interval_us + ref_interval_us / 2) / ref_interval_us;
+    if(nb_periods > 1)
+      timing->nb_missing += nb_periods - 1;
+  }
+  else
+    ref_interval_us = timing->sum_interval_us / timing->nb_intervals;
+
+  /* Add the interval's deviation from the reference interval to the jitter
+     histogram */
+  dev_us = interval_us > ref_interval_us? interval_us - ref_interval_us :
+						ref_interval_us - interval_us;
+
+  for(b = 0; b < SAMPLE_TIMING_NB_JITTER_BINS - 1 &&
+		dev_us > sample_timing_jitter_bin_edges_ms[b] * 1000u; b++);
+
+  timing->jitter_bins[b]++;
+}
+
+
+
+/** Get the mean interval between samples
+    Returns 0 if there are no intervals yet **/
+float sample_timing_mean_interval_ms(SampleTiming *timing) {
+
+  if(!timing->nb_intervals)
+    return 0;
+
+  return timing->sum_interval_us / 1000.0f / timing->nb_intervals;
+}
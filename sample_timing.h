@@ -0,0 +1,75 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Sample timing analysis
+ *
+ * Statistics of the intervals between the arrival times of consecutive LRF
+ * samples, and count of the samples missing against the commanded sampling
+ * frequency, with no dependency on the Flipper Zero firmware
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+/*** Defines ***/
+#define SAMPLE_TIMING_NB_JITTER_BINS 8
+
+
+
+/*** Types ***/
+
+/** Sample timing statistics **/
+typedef struct {
+
+  /* Nominal interval between samples at the commanded sampling frequency,
+     0 if there is no commanded frequency */
+  uint16_t nominal_interval_ms;
+
+  /* Arrival time of the previous sample, and whether there is one */
+  uint64_t prev_tstamp_us;
+  bool has_prev;
+
+  /* Number of intervals, smallest, largest and sum of the intervals in
+     microseconds */
+  uint32_t nb_intervals;
+  uint32_t min_interval_us;
+  uint32_t max_interval_us;
+  uint64_t sum_interval_us;
+
+  /* Number of samples missing against the commanded sampling frequency */
+  uint32_t nb_missing;
+
+  /* Jitter histogram: number of intervals deviating from the nominal
+     interval - or from the mean interval if there is no nominal interval -
+     by up to each of the jitter bin edges, and by more in the last bin */
+  uint32_t jitter_bins[SAMPLE_TIMING_NB_JITTER_BINS];
+
+} SampleTiming;
+
+
+
+/*** Constants ***/
+
+/** Upper edges of the jitter bins in milliseconds, except the last bin's **/
+extern const uint16_t sample_timing_jitter_bin_edges_ms[];
+
+
+
+/*** Routines ***/
+
+/** Reset the sample timing statistics, with the nominal interval between
+    samples at the commanded sampling frequency, or 0 if there is none **/
+void sample_timing_reset(SampleTiming *, uint16_t);
+
+/** Add the arrival time of a sample to the sample timing statistics **/
+void sample_timing_add(SampleTiming *, uint64_t);
+
+/** Get the mean interval between samples
+    Returns 0 if there are no intervals yet **/
+float sample_timing_mean_interval_ms(SampleTiming *);
@@ -6,56 +6,726 @@
 ***/
 
 /*** Includes ***/
+#include <math.h>
+
 #include "common.h"
 #include "noptel_lrf_sampler_icons.h"	/* Generated from images in assets */
 
 
 
+/*** Sample processing thread events ***/
+typedef enum {
+  stop = 1,
+  sample_avail = 2,
+  graph_targets = 4,
+  smm_due = 8
+} sample_thread_evts;
+
+
+
+/*** Forward declarations ***/
+static void burst_shot_done(LRFCommand, bool, void *);
+
+
+
 /*** Routines ***/
 
-/** Time difference in seconds between system ticks in milliseconds, taking the
-    timestamp overflow into account **/
-static double ms_tick_time_diff(uint32_t tstamp1, uint32_t tstamp2) {
+/** Time difference in seconds between timestamps in microseconds, or 0 if
+    the first timestamp is earlier than the second **/
+static double us_time_diff(uint64_t tstamp1, uint64_t tstamp2) {
+
+  return tstamp1 > tstamp2? (tstamp1 - tstamp2) / 1000000.0 : 0;
+}
 
-  double timediff_s;
 
-  if(tstamp1 >= tstamp2)
-    timediff_s = (tstamp1 - tstamp2) / 1000.0;
 
-  else
-    timediff_s = (0xffffffff - tstamp2 + 1 + tstamp1) / 1000.0;
+/** Nominal interval in milliseconds between the samples of a sampling mode,
+    or 0 if the mode doesn't sample at a set frequency **/
+static uint16_t mode_sample_interval_ms(uint8_t mode) {
+
+  switch(mode) {
+
+    case cmm_1hz:
+      return 1000;
+
+    case cmm_4hz:
+      return 250;
+
+    case cmm_10hz:
+      return 100;
+
+    case cmm_20hz:
+      return 50;
+
+    case cmm_100hz:
+      return 10;
 
-  return(timediff_s);
+    case cmm_200hz:
+      return 5;
+
+    default:
+      return 0;
+  }
 }
 
 
 
-/** LRF sample handler
-    Called when a LRF sample is available from the LRF serial
-    communication app **/
-static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
+/** Add or subtract a sample's valid distances and amplitudes to or from the
+    averaging window's running sums **/
+static void update_avg_window_sums(SampleModel *sample_model, uint16_t i,
+					bool add) {
+
+  int8_t sign = add? 1 : -1;
+  bool one_dist_valid = false;
+  LRFSample stored_sample;
+  LRFSample *sample = &stored_sample;
+  float dev;
+
+  /* Get the sample from the store. Its timestamp isn't needed */
+  sample_store_get(&sample_model->sample_store, i, sample, 0);
+
+  if(sample->dist1 > 0.5) {
+    if(add && !sample_model->nb_valid_dist1)
+      sample_model->ref_dist1 = sample->dist1;
+    dev = sample->dist1 - sample_model->ref_dist1;
+    sample_model->sum_dev1 += sign * dev;
+    sample_model->sum_sq_dev1 += sign * dev * dev;
+    sample_model->sum_dist1 += sign * sample->dist1;
+    sample_model->sum_ampl1 += sign * sample->ampl1;
+    sample_model->nb_valid_dist1 += sign;
+    one_dist_valid = true;
+  }
+
+  if(sample->dist2 > 0.5) {
+    if(add && !sample_model->nb_valid_dist2)
+      sample_model->ref_dist2 = sample->dist2;
+    dev = sample->dist2 - sample_model->ref_dist2;
+    sample_model->sum_dev2 += sign * dev;
+    sample_model->sum_sq_dev2 += sign * dev * dev;
+    sample_model->sum_dist2 += sign * sample->dist2;
+    sample_model->sum_ampl2 += sign * sample->ampl2;
+    sample_model->nb_valid_dist2 += sign;
+    one_dist_valid = true;
+  }
+
+  if(sample->dist3 > 0.5) {
+    if(add && !sample_model->nb_valid_dist3)
+      sample_model->ref_dist3 = sample->dist3;
+    dev = sample->dist3 - sample_model->ref_dist3;
+    sample_model->sum_dev3 += sign * dev;
+    sample_model->sum_sq_dev3 += sign * dev * dev;
+    sample_model->sum_dist3 += sign * sample->dist3;
+    sample_model->sum_ampl3 += sign * sample->ampl3;
+    sample_model->nb_valid_dist3 += sign;
+    one_dist_valid = true;
+  }
+
+  if(one_dist_valid)
+    sample_model->nb_valid_any_dist += sign;
+
+  /* Clear the rounding errors left in the distance sums when they become
+     empty */
+  if(!sample_model->nb_valid_dist1) {
+    sample_model->sum_dist1 = 0;
+    sample_model->sum_dev1 = 0;
+    sample_model->sum_sq_dev1 = 0;
+  }
+  if(!sample_model->nb_valid_dist2) {
+    sample_model->sum_dist2 = 0;
+    sample_model->sum_dev2 = 0;
+    sample_model->sum_sq_dev2 = 0;
+  }
+  if(!sample_model->nb_valid_dist3) {
+    sample_model->sum_dist3 = 0;
+    sample_model->sum_dev3 = 0;
+    sample_model->sum_sq_dev3 = 0;
+  }
+}
+
+
+
+/** Add or remove a sample's valid distances to or from the order-statistic
+    trees. Valid distances are longer than 50 cm **/
+static void update_dist_trees(SampleModel *sample_model, uint16_t i,
+				bool add) {
+
+  if(sample_store_dist_cm(&sample_model->sample_store, 0, i) > 50) {
+    if(add)
+      ost_insert(&sample_model->dist1_tree, i);
+    else
+      ost_remove(&sample_model->dist1_tree, i);
+  }
+
+  if(sample_store_dist_cm(&sample_model->sample_store, 1, i) > 50) {
+    if(add)
+      ost_insert(&sample_model->dist2_tree, i);
+    else
+      ost_remove(&sample_model->dist2_tree, i);
+  }
+
+  if(sample_store_dist_cm(&sample_model->sample_store, 2, i) > 50) {
+    if(add)
+      ost_insert(&sample_model->dist3_tree, i);
+    else
+      ost_remove(&sample_model->dist3_tree, i);
+  }
+}
+
+
+
+/** Clear the averaging window's running sums **/
+static void clear_avg_window_sums(SampleModel *sample_model) {
+
+  sample_model->sum_dist1 = 0;
+  sample_model->sum_dist2 = 0;
+  sample_model->sum_dist3 = 0;
+  sample_model->sum_ampl1 = 0;
+  sample_model->sum_ampl2 = 0;
+  sample_model->sum_ampl3 = 0;
+  sample_model->sum_dev1 = 0;
+  sample_model->sum_dev2 = 0;
+  sample_model->sum_dev3 = 0;
+  sample_model->sum_sq_dev1 = 0;
+  sample_model->sum_sq_dev2 = 0;
+  sample_model->sum_sq_dev3 = 0;
+  sample_model->nb_valid_dist1 = 0;
+  sample_model->nb_valid_dist2 = 0;
+  sample_model->nb_valid_dist3 = 0;
+  sample_model->nb_valid_any_dist = 0;
+  sample_model->nb_samples_since_avg_recompute = 0;
+}
+
+
+
+/** Empty the averaging window **/
+static void reset_avg_window(SampleModel *sample_model) {
+
+  sample_model->avg_start_i = sample_model->samples_end_i;
+  sample_model->avg_start_tstamp_us = sample_model->newest_tstamp_us;
+  sample_model->nb_avg_samples = 0;
+  clear_avg_window_sums(sample_model);
+
+  if(sample_model->use_dist_trees) {
+    ost_clear(&sample_model->dist1_tree);
+    ost_clear(&sample_model->dist2_tree);
+    ost_clear(&sample_model->dist3_tree);
+  }
+}
+
+
+
+/** Set a target's running sums from exact sums calculated over the whole
+    averaging window **/
+static void set_avg_window_dist_sums(SampleStoreSums *sums, float *sum_dist,
+					uint32_t *sum_ampl, float *ref_dist,
+					float *sum_dev, float *sum_sq_dev,
+					uint16_t *nb_valid) {
+
+  *nb_valid = sums->nb_valid;
+
+  if(!sums->nb_valid)
+    return;
+
+  *sum_dist = sums->sum_dist_cm / 100.0f;
+  *sum_ampl = sums->sum_ampl;
+  *ref_dist = sums->ref_dist_cm / 100.0f;
+  *sum_dev = sums->sum_dev_cm / 100.0f;
+  *sum_sq_dev = sums->sum_sq_dev_cm / 10000.0f;
+}
+
+
+
+/** Recompute the averaging window's running sums from scratch
+    The order-statistic trees don't accumulate rounding errors, so they're left
+    alone **/
+static void recompute_avg_window_sums(SampleModel *sample_model) {
+
+  SampleStore *store = &sample_model->sample_store;
+  SampleStoreSums sums[3];
+  uint16_t nb_left, nb;
+  uint16_t i;
+  uint8_t t;
+
+  clear_avg_window_sums(sample_model);
+  memset(sums, 0, sizeof(sums));
+
+  /* The averaging window is at most two runs of consecutive samples in the
+     ring buffer: go through each run one target at a time */
+  i = sample_model->avg_start_i;
+  for(nb_left = sample_model->nb_avg_samples; nb_left; nb_left -= nb) {
+
+    nb = sample_model->max_samples - i;
+    if(nb > nb_left)
+      nb = nb_left;
+
+    for(t = 0; t < 3; t++)
+      sample_store_sum_dists(store, t, i, nb, &sums[t]);
+
+    sample_model->nb_valid_any_dist +=
+			sample_store_count_any_valid(store, i, nb);
+
+    i = 0;
+  }
+
+  set_avg_window_dist_sums(&sums[0], &sample_model->sum_dist1,
+				&sample_model->sum_ampl1,
+				&sample_model->ref_dist1,
+				&sample_model->sum_dev1,
+				&sample_model->sum_sq_dev1,
+				&sample_model->nb_valid_dist1);
+  set_avg_window_dist_sums(&sums[1], &sample_model->sum_dist2,
+				&sample_model->sum_ampl2,
+				&sample_model->ref_dist2,
+				&sample_model->sum_dev2,
+				&sample_model->sum_sq_dev2,
+				&sample_model->nb_valid_dist2);
+  set_avg_window_dist_sums(&sums[2], &sample_model->sum_dist3,
+				&sample_model->sum_ampl3,
+				&sample_model->ref_dist3,
+				&sample_model->sum_dev3,
+				&sample_model->sum_sq_dev3,
+				&sample_model->nb_valid_dist3);
+}
+
+
+
+/** Add the newest sample in the ring buffer to the averaging window **/
+static void add_newest_to_avg_window(SampleModel *sample_model) {
+
+  uint16_t i;
+
+  /* Find the newest sample */
+  i = sample_model->samples_end_i? sample_model->samples_end_i - 1 :
+					sample_model->max_samples - 1;
+
+  /* If the averaging window is empty, it starts with the newest sample */
+  if(!sample_model->nb_avg_samples) {
+    sample_model->avg_start_i = i;
+    sample_model->avg_start_tstamp_us = sample_model->newest_tstamp_us;
+  }
+
+  update_avg_window_sums(sample_model, i, true);
+  sample_model->nb_avg_samples++;
+
+  if(sample_model->use_dist_trees)
+    update_dist_trees(sample_model, i, true);
+}
+
+
+
+/** Remove the oldest sample from the averaging window **/
+static void remove_oldest_from_avg_window(SampleModel *sample_model) {
+
+  update_avg_window_sums(sample_model, sample_model->avg_start_i, false);
+  sample_model->nb_avg_samples--;
+
+  if(sample_model->use_dist_trees)
+    update_dist_trees(sample_model, sample_model->avg_start_i, false);
+
+  sample_model->avg_start_i++;
+  if(sample_model->avg_start_i >= sample_model->max_samples)
+    sample_model->avg_start_i = 0;
+
+  /* Work out the timestamp of the new oldest sample in the averaging window */
+  if(sample_model->nb_avg_samples)
+    sample_model->avg_start_tstamp_us += sample_store_tstamp_delta(
+				&sample_model->sample_store,
+				sample_model->avg_start_i) * 1000;
+}
+
+
+
+/** Calculate the interquartile range of a target's valid distances in the
+    averaging window **/
+static float dist_tree_iqr(OrderStatTree *tree, uint16_t nb_valid) {
+
+  return (ost_select(tree, (3 * (nb_valid - 1)) / 4) -
+		ost_select(tree, (nb_valid - 1) / 4)) / 100.0f;
+}
+
+
+
+/** Calculate the configured statistic of a target's valid distances in the
+    averaging window, and the spread of the distances **/
+static float calc_dist_statistic(SampleModel *sample_model,
+					OrderStatTree *tree, float sum_dist,
+					float sum_dev, float sum_sq_dev,
+					uint16_t nb_valid, float *spread) {
+
+  uint16_t nb_trimmed;
+  float mean_dev;
+  float var;
+
+  switch(sample_model->config->stat) {
+
+    /* Median, with the interquartile range as the spread */
+    case stat_median:
+      *spread = dist_tree_iqr(tree, nb_valid);
+
+      if(nb_valid & 1)
+        return ost_select(tree, nb_valid / 2) / 100.0f;
+
+      return (ost_select(tree, nb_valid / 2 - 1) +
+		ost_select(tree, nb_valid / 2)) / 200.0f;
+
+    /* Mean of the distances left after discarding the 10% smallest and the
+       10% largest, with the interquartile range as the spread */
+    case stat_trimmed_mean:
+      *spread = dist_tree_iqr(tree, nb_valid);
+
+      nb_trimmed = nb_valid / 10;
+      return (ost_sum_smallest(tree, nb_valid - nb_trimmed) -
+		ost_sum_smallest(tree, nb_trimmed)) /
+		(nb_valid - 2 * nb_trimmed) / 100.0f;
+
+    /* Mean, with the standard deviation as the spread */
+    case stat_mean_sd:
+      mean_dev = sum_dev / nb_valid;
+      var = sum_sq_dev / nb_valid - mean_dev * mean_dev;
+      *spread = var > 0? sqrtf(var) : 0;
+
+      return sum_dist / nb_valid;
+
+    /* Mean */
+    default:
+      *spread = 0;
+
+      return sum_dist / nb_valid;
+  }
+}
+
+
+
+/** Remove the oldest sample from the ring buffer, and from the averaging
+    window if it's in it **/
+static void evict_oldest_sample(SampleModel *sample_model) {
+
+  if(sample_model->nb_avg_samples &&
+	sample_model->avg_start_i == sample_model->samples_start_i)
+    remove_oldest_from_avg_window(sample_model);
+
+  sample_model->samples_start_i++;
+  if(sample_model->samples_start_i >= sample_model->max_samples)
+    sample_model->samples_start_i = 0;
+
+  sample_model->nb_samples--;
+
+  /* Work out the timestamp of the new oldest sample in the ring buffer */
+  if(sample_model->nb_samples)
+    sample_model->oldest_tstamp_us += sample_store_tstamp_delta(
+				&sample_model->sample_store,
+				sample_model->samples_start_i) * 1000;
+}
+
+
+
+/** Publish a display snapshot of the values to display for the draw
+    callback
+    The snapshot is written into the buffer that doesn't hold the latest
+    snapshot, then made the latest one by bumping the generation counter, so
+    the draw callback never sees a partly written snapshot and neither side
+    ever waits on the other **/
+static void publish_disp_snapshot(SampleModel *sample_model) {
+
+  uint32_t gen = sample_model->disp_gen + 1;
+  SampleDisp *disp = &sample_model->disp_snapshots[gen & 1];
+
+  /* Make sure the previous snapshot is published before the buffer it
+     replaces is overwritten */
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  memcpy(&disp->sample, &sample_model->disp_sample, sizeof(LRFSample));
+  disp->spread1 = sample_model->disp_spread1;
+  disp->spread2 = sample_model->disp_spread2;
+  disp->spread3 = sample_model->disp_spread3;
+  disp->vel1 = sample_model->disp_vel1;
+  disp->vel2 = sample_model->disp_vel2;
+  disp->vel3 = sample_model->disp_vel3;
+  disp->eff_freq = sample_model->eff_freq;
+  disp->return_rate = sample_model->return_rate;
+  disp->samples_time_span = sample_model->samples_time_span;
+  disp->nb_samples = sample_model->nb_samples;
+  memcpy(&disp->sample_timing, &sample_model->sample_timing,
+		sizeof(SampleTiming));
+  dist_graph_get_disp(&sample_model->dist_graph, &disp->graph);
+
+  __atomic_store_n(&sample_model->disp_gen, gen, __ATOMIC_RELEASE);
+}
+
+
+
+/** Get a consistent copy of the latest display snapshot
+    The sample processing thread only overwrites a snapshot after it has
+    published the next one, so if the generation counter didn't change while
+    we copied the snapshot, the copy is consistent. Otherwise copy the new
+    latest snapshot **/
+static void get_disp_snapshot(SampleModel *sample_model, SampleDisp *disp) {
+
+  uint32_t gen;
+
+  do {
+    gen = __atomic_load_n(&sample_model->disp_gen, __ATOMIC_ACQUIRE);
+    memcpy(disp, &sample_model->disp_snapshots[gen & 1], sizeof(SampleDisp));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while(__atomic_load_n(&sample_model->disp_gen, __ATOMIC_RELAXED) != gen);
+}
+
+
+
+/** Send the SMM prefix if it's enabled followed by the SMM command, and
+    expire the measurement if the LRF doesn't respond in time
+    Called by the sample processing thread when the automatic SMM
+    scheduler's timer runs out **/
+static void send_scheduled_smm(App *app, SampleModel *sample_model) {
+
+  /* Don't send anything if automatic single measurement was stopped */
+  if(!sample_model->continuous_meas_started)
+    return;
+
+  /* If the previous measurement is still outstanding, the LRF didn't
+     respond in time */
+  if(sample_model->smm_outstanding)
+    FURI_LOG_W(TAG, "SMM response timeout: SMM command resent");
+
+  /* Send the SMM prefix if it's enabled */
+  if(app->config.smm_pfx)
+    send_lrf_raw_data(app->lrf_serial_comm_app,
+			app->smm_pfx_config.smm_pfx_sequence,
+			sizeof(app->smm_pfx_config.smm_pfx_sequence));
+
+  /* Send the SMM command */
+  send_lrf_command(app->lrf_serial_comm_app, smm);
+
+  /* Resend the SMM command if the LRF doesn't respond in time */
+  sample_model->smm_outstanding = true;
+  furi_timer_start(sample_model->smm_timer,
+			furi_ms_to_ticks(smm_resp_timeout));
+}
+
+
+
+/** Schedule the next SMM command after the cool-off time following a
+    measurement. The cool-off time is longer after an error, to let the LRF
+    recover from hitting the eye safety limit. With adaptive cool-off, it
+    shortens after each measurement without error, and goes back to normal
+    after an error **/
+static void schedule_next_smm(App *app, SampleModel *sample_model,
+				bool sampling_error) {
+
+  uint16_t cooloff_ms = sample_model->smm_cooloff_ms;
+
+  sample_model->smm_outstanding = false;
+
+  if(sampling_error) {
+    cooloff_ms = smm_error_cooloff;
+    sample_model->smm_cooloff_ms = smm_cooloff;
+  }
+
+  else if(app->config.mode & ADAPTIVE_COOLOFF)
+    sample_model->smm_cooloff_ms =
+			sample_model->smm_cooloff_ms >=
+				smm_min_cooloff + smm_cooloff_step?
+			sample_model->smm_cooloff_ms - smm_cooloff_step :
+			smm_min_cooloff;
+
+  furi_timer_start(sample_model->smm_timer, furi_ms_to_ticks(cooloff_ms));
+}
+
+
+
+/** Start the automatic SMM scheduler: mark continuous measurement started
+    and have the sample processing thread send the first SMM command now **/
+static void start_smm_scheduler(SampleModel *sample_model) {
+
+  /* Stop the timer still pending from before automatic SMM was stopped, if
+     any, so it doesn't send a second SMM command after the first one */
+  furi_timer_stop(sample_model->smm_timer);
+
+  sample_model->smm_outstanding = false;
+  sample_model->smm_cooloff_ms = smm_cooloff;
+  sample_model->nb_smm_meas = 0;
+
+  sample_model->continuous_meas_started = true;
+  furi_thread_flags_set(sample_model->sample_thread_id, smm_due);
+}
+
+
+
+/** Automatic SMM scheduler timer callback
+    Wake up the sample processing thread to send the next SMM command **/
+static void smm_timer_callback(void *ctx) {
+
+  App *app = (App *)ctx;
+  SampleModel *sample_model = view_get_model(app->sample_view);
+
+  if(sample_model->continuous_meas_started)
+    furi_thread_flags_set(sample_model->sample_thread_id, smm_due);
+}
+
+
+
+/** Queue one quick SMM shot of a burst, preceded by the SMM prefix if it's
+    enabled, without waiting for room in the command queue since this is
+    called from the UART transmit thread. The prefix and the command are
+    queued as a single request, so the prefix is never left alone in the
+    queue. Returns false if the queue is full **/
+static bool queue_burst_shot(App *app, SampleModel *sample_model) {
+
+  __atomic_fetch_add(&sample_model->nb_burst_shots_queued, 1,
+			__ATOMIC_RELAXED);
+
+  if(try_send_lrf_prefixed_command_cb(app->lrf_serial_comm_app,
+			app->smm_pfx_config.smm_pfx_sequence,
+			app->config.smm_pfx?
+				sizeof(app->smm_pfx_config.smm_pfx_sequence) :
+				0,
+			quick_smm, burst_shot_done, app))
+    return true;
+
+  __atomic_fetch_sub(&sample_model->nb_burst_shots_queued, 1,
+			__ATOMIC_RELAXED);
+  return false;
+}
+
+
+
+/** Quick SMM shot completion callback
+    Called in the UART transmit thread when the LRF has responded to a shot
+    or didn't respond in time - shots aren't resent. Record the shot's
+    latency and queue the next shot to keep the command pipeline full until
+    the burst is done or stopped. The burst can be stopped by the GUI thread
+    and is started again by it once all the shots are done, so the shared
+    state is accessed atomically and the shot is counted as done last **/
+static void burst_shot_done(LRFCommand cmd, bool responded, void *ctx) {
 
   App *app = (App *)ctx;
   SampleModel *sample_model = view_get_model(app->sample_view);
+  uint32_t latency_us;
+  uint16_t nb_done, nb_failed;
+
+  UNUSED(cmd);
+
+  /* Only the UART transmit thread counts the shots done while a burst is
+     running */
+  nb_done = __atomic_load_n(&sample_model->nb_burst_shots_done,
+				__ATOMIC_RELAXED) + 1;
+
+  /* Record the shot's result, unless the burst was stopped: the shots still
+     in the pipeline are dropped */
+  if(__atomic_load_n(&sample_model->continuous_meas_started,
+			__ATOMIC_ACQUIRE)) {
+
+    if(!responded)
+      __atomic_add_fetch(&sample_model->nb_burst_shots_failed, 1,
+				__ATOMIC_RELAXED);
+
+    else {
+      latency_us = get_lrf_command_resp_time_us(app->lrf_serial_comm_app);
+      if(latency_us < sample_model->burst_min_latency_us)
+        sample_model->burst_min_latency_us = latency_us;
+      if(latency_us > sample_model->burst_max_latency_us)
+        sample_model->burst_max_latency_us = latency_us;
+      sample_model->burst_sum_latency_us += latency_us;
+    }
+
+    /* Is the burst done? */
+    if(nb_done >= burst_smm_nb_shots) {
+      nb_failed = __atomic_load_n(&sample_model->nb_burst_shots_failed,
+					__ATOMIC_RELAXED);
+      if(nb_failed < nb_done)
+        FURI_LOG_I(TAG, "Burst SMM done: %d shots, %d failed, latency "
+			"min %ld us, mean %ld us, max %ld us", nb_done,
+			nb_failed, sample_model->burst_min_latency_us,
+			(uint32_t)(sample_model->burst_sum_latency_us /
+					(nb_done - nb_failed)),
+			sample_model->burst_max_latency_us);
+      else
+        FURI_LOG_I(TAG, "Burst SMM done: %d shots, all failed", nb_done);
+      __atomic_store_n(&sample_model->continuous_meas_started, false,
+			__ATOMIC_RELAXED);
+    }
+
+    /* Queue the next shot if there are shots left to queue. Stop the burst
+       if the command queue is full rather than block the UART transmit
+       thread on its own queue */
+    else if(__atomic_load_n(&sample_model->nb_burst_shots_queued,
+				__ATOMIC_RELAXED) < burst_smm_nb_shots &&
+		!queue_burst_shot(app, sample_model)) {
+      __atomic_store_n(&sample_model->continuous_meas_started, false,
+			__ATOMIC_RELAXED);
+      FURI_LOG_W(TAG, "Burst SMM stopped after %d shots: command queue full",
+			nb_done);
+    }
+  }
+
+  /* Count the shot as done, so a new burst isn't started - and the burst's
+     statistics reset - until the shots of this one have all come in */
+  __atomic_store_n(&sample_model->nb_burst_shots_done, nb_done,
+			__ATOMIC_RELEASE);
+}
+
+
+
+/** Start a burst of quick SMM shots sent back to back: fill the command
+    pipeline, then each completed shot queues the next one. Refuse to start
+    while shots of the previous burst are still in the pipeline.
+    Returns false if the burst wasn't started **/
+static bool start_burst_smm(App *app, SampleModel *sample_model) {
+
+  uint8_t i;
+
+  if(__atomic_load_n(&sample_model->nb_burst_shots_done, __ATOMIC_ACQUIRE) !=
+	__atomic_load_n(&sample_model->nb_burst_shots_queued,
+			__ATOMIC_RELAXED)) {
+    FURI_LOG_W(TAG, "Burst SMM not started: previous shots still pending");
+    return false;
+  }
+
+  sample_model->nb_burst_shots_queued = 0;
+  sample_model->nb_burst_shots_done = 0;
+  sample_model->nb_burst_shots_failed = 0;
+  sample_model->burst_min_latency_us = UINT32_MAX;
+  sample_model->burst_max_latency_us = 0;
+  sample_model->burst_sum_latency_us = 0;
+
+  sample_model->flush_samples = true;
+  __atomic_store_n(&sample_model->continuous_meas_started, true,
+			__ATOMIC_RELEASE);
+
+  for(i = 0; i < burst_smm_pipeline_depth && i < burst_smm_nb_shots; i++)
+    if(!queue_burst_shot(app, sample_model))
+      break;
+
+  /* Give up if not even one shot could be queued */
+  if(!i) {
+    __atomic_store_n(&sample_model->continuous_meas_started, false,
+			__ATOMIC_RELAXED);
+    return false;
+  }
+
+  return true;
+}
+
+
+
+/** Process one LRF sample
+    Called by the sample processing thread for each LRF sample pulled out of
+    the sample queue **/
+static void process_lrf_sample(App *app, LRFSample *lrf_sample) {
+
+  SampleModel *sample_model = view_get_model(app->sample_view);
+  int16_t buf;
   uint16_t prev_samples_end_i;
-  uint16_t start_i_cfg_buf_only;
-  uint16_t nb_samples_cfg_buf_only;
-  float avg_dist1;
-  float avg_dist2;
-  float avg_dist3;
-  uint32_t avg_ampl1;
-  uint32_t avg_ampl2;
-  uint32_t avg_ampl3;
-  uint16_t nb_valid_samples_dist1;
-  uint16_t nb_valid_samples_dist2;
-  uint16_t nb_valid_samples_dist3;
-  uint16_t nb_valid_samples_any_dist;
   bool sampling_error;
-  bool one_dist_valid;
   float timediff;
   uint16_t i;
+  float vel;
+
 
 
+  /* The tracking mode keeps as many samples as without buffering, to
+     calculate the effective sampling frequency and the return rate */
+  buf = app->config.buf == BUF_TRACKING? 0 : app->config.buf;
 
   /* Determine if the rangefinder encountered an error or hit the eye safety
      limit */
@@ -65,40 +735,41 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
 
   /* A single mode measurement that didn't generate an error has turned off
      the pointer */
-  if((app->config.mode & (AUTO_RESTART - 1)) == smm && !sampling_error)
+  if((app->config.mode & LRF_COMMAND_MASK) == smm && !sampling_error)
     app->pointer_is_on = false;
 
   /* Do we do automatic single measurement? */
-  if(app->config.mode == (smm | AUTO_RESTART)) {
+  if(app->config.mode & AUTO_RESTART) {
 
     /* Is continuous measurement still enabled? */
     if(sample_model->continuous_meas_started) {
 
-      /* Wait a bit for the LRF to "cool off" before triggering another
-       measurement */
-      furi_delay_ms(sampling_error? 1000 : 200);
-
-      /* Send a new SMM command if continuous measurement wasn't stopped
-         during the wait */
-      if(sample_model->continuous_meas_started) {
-
-        /* Send the SMM prefix if it's enabled */
-        if(app->config.smm_pfx)
-          uart_tx(app->lrf_serial_comm_app,
-			app->smm_pfx_config.smm_pfx_sequence,
-			sizeof(app->smm_pfx_config.smm_pfx_sequence));
-
-        /* Send the SMM command */
-        send_lrf_command(app->lrf_serial_comm_app, smm);
-      }
+      /* Let the LRF "cool off" before the scheduler triggers another
+         measurement */
+      schedule_next_smm(app, sample_model, sampling_error);
 
       /* Discard the sample if the LRF encountered an error or hit the eye
          safety limit */
       if(sampling_error)
         return;
+
+      /* Count the measurement */
+      if(!sample_model->nb_smm_meas)
+        sample_model->first_smm_tstamp_us = lrf_sample->tstamp_us;
+      sample_model->nb_smm_meas++;
     }
   }
 
+  /* If we track the targets, drop their tracks if required, except if we do
+     single measurement: then they cover the successive measurements. Then
+     move the new sample's distances to the slots of the targets they belong
+     to */
+  if(app->config.targets == targets_tracked) {
+    if(sample_model->flush_samples && app->config.mode != smm)
+      track_assoc_reset(&sample_model->track_assoc);
+    track_assoc_assign(&sample_model->track_assoc, lrf_sample);
+  }
+
   /* If beeps are enabled and any distance in the new LRF sample is valid,
      play a beep */
   if(app->config.beep && (lrf_sample->dist1 > 0.5 ||
@@ -107,30 +778,67 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
     start_beep(&app->speaker_control, sample_received_beep_duration);
   }
 
-  /* Reset the ring buffer if required, or if we do single measurement */
+  /* Empty the distance graph, reset the sample timing statistics and drop
+     the tracks of the targets if required, except if we do single
+     measurement: then they cover the successive measurements */
+  if(sample_model->flush_samples && app->config.mode != smm) {
+    dist_graph_reset(&sample_model->dist_graph);
+    track_filter_reset(&sample_model->track_filter);
+    sample_timing_reset(&sample_model->sample_timing,
+				mode_sample_interval_ms(app->config.mode));
+  }
+
+  /* Add the sample's arrival time to the sample timing statistics */
+  sample_timing_add(&sample_model->sample_timing, lrf_sample->tstamp_us);
+
+  /* Reset the ring buffer and the averaging window if required, or if we do
+     single measurement */
   if(sample_model->flush_samples || app->config.mode == smm) {
     sample_model->samples_start_i = 0;
     sample_model->samples_end_i = 0;
     sample_model->nb_samples = 0;
+    reset_avg_window(sample_model);
     sample_model->flush_samples = false;
   }
 
-  /* Find the next spot in the samples ring buffer */
+  /* Add the new sample to the distance graph */
+  dist_graph_add_sample(&sample_model->dist_graph, lrf_sample);
+
+  /* If the ring buffer is full, make room for the new sample by removing the
+     oldest sample */
+  if(sample_model->nb_samples >= sample_model->max_samples - 1)
+    evict_oldest_sample(sample_model);
+
+  /* Store the new sample in the next spot in the samples ring buffer */
   prev_samples_end_i = sample_model->samples_end_i;
+  sample_store_put(&sample_model->sample_store, prev_samples_end_i,
+			lrf_sample, sample_model->newest_tstamp_us);
+
+  /* Work out the timestamp of the new sample from the stored time elapsed
+     since the previous sample, so the timestamps stay consistent with the
+     stored time deltas. If the ring buffer was empty, use the new sample's
+     timestamp as is */
+  if(sample_model->nb_samples)
+    sample_model->newest_tstamp_us += sample_store_tstamp_delta(
+				&sample_model->sample_store,
+				prev_samples_end_i) * 1000;
+  else {
+    sample_model->newest_tstamp_us = lrf_sample->tstamp_us;
+    sample_model->oldest_tstamp_us = lrf_sample->tstamp_us;
+  }
+
   i = prev_samples_end_i + 1;
   if(i >= sample_model->max_samples)
     i = 0;
+  sample_model->samples_end_i = i;
+  sample_model->nb_samples++;
 
-  /* If we have room in the ring buffer, insert the new sample */
-  if(i != sample_model->samples_start_i) {
-    memcpy(&(sample_model->samples[sample_model->samples_end_i]),
-		lrf_sample, sizeof(LRFSample));
-    sample_model->samples_end_i = i;
-    sample_model->nb_samples++;
-  }
+  /* Add the new sample to the averaging window if we buffer samples */
+  if(buf != 0)
+    add_newest_to_avg_window(sample_model);
 
   /* Do we buffer samples for a set amount of time? */
-  if(app->config.buf > 0) {
+  if(buf > 0) {
 
     /* Remove samples that are too old but try to keep at least 0.75 seconds
        worth of samples, or 2 samples, for more accurate effective frequency
@@ -139,12 +847,10 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
        samples that have come in a bit late */
     while(sample_model->samples_start_i != prev_samples_end_i &&
 
-		(sample_model->samples_time_span = ms_tick_time_diff(
-			sample_model->samples[prev_samples_end_i].tstamp_ms,
-			sample_model->samples[sample_model->samples_start_i].
-								tstamp_ms
-			)) > (double)(app->config.buf > 0.75?
-				app->config.buf + 0.2L : 0.75)) {
+		(sample_model->samples_time_span = us_time_diff(
+			sample_model->newest_tstamp_us,
+			sample_model->oldest_tstamp_us
+			)) > (double)(buf > 0.75? buf + 0.2L : 0.75)) {
 
       i = sample_model->samples_start_i + 1;
       if(i >= sample_model->max_samples)
@@ -153,8 +859,7 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
       if(i == prev_samples_end_i)
         break;
 
-      sample_model->nb_samples--;
-      sample_model->samples_start_i = i;
+      evict_oldest_sample(sample_model);
     }
   }
 
@@ -166,12 +871,11 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
        even if we don't do buffering at all. */
     while(sample_model->samples_start_i != prev_samples_end_i &&
 
-		sample_model->nb_samples > -app->config.buf &&
+		sample_model->nb_samples > -buf &&
 
-		(sample_model->samples_time_span = ms_tick_time_diff(
-			sample_model->samples[prev_samples_end_i].tstamp_ms,
-			sample_model->samples[sample_model->samples_start_i].
-								tstamp_ms
+		(sample_model->samples_time_span = us_time_diff(
+			sample_model->newest_tstamp_us,
+			sample_model->oldest_tstamp_us
 			)) > 0.75L) {
 
       i = sample_model->samples_start_i + 1;
@@ -181,8 +885,7 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
       if(i == prev_samples_end_i)
         break;
 
-      sample_model->samples_start_i = i;
-      sample_model->nb_samples--;
+      evict_oldest_sample(sample_model);
     }
   }
 
@@ -190,13 +893,18 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
   if(sample_model->nb_samples == 1) {
 
     /* Display that sample directly */
-    memcpy(&(sample_model->disp_sample),
-		&(sample_model->samples[prev_samples_end_i]),
-		sizeof(LRFSample));
+    sample_store_get(&sample_model->sample_store, prev_samples_end_i,
+			&sample_model->disp_sample,
+			sample_model->newest_tstamp_us);
 
     /* There is no time between the sample and itself */
     sample_model->samples_time_span = 0;
 
+    /* A single sample has no spread */
+    sample_model->disp_spread1 = 0;
+    sample_model->disp_spread2 = 0;
+    sample_model->disp_spread3 = 0;
+
     /* We can't calculate the effective frequency */
     sample_model->eff_freq = -1;
 
@@ -212,10 +920,9 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
 
     /* If we have at least 0.25 seconds between the oldest and the latest
        samples' timestamps, calculate the effective sampling frequency */
-    timediff = ms_tick_time_diff(
-			sample_model->samples[prev_samples_end_i].tstamp_ms,
-			sample_model->samples[sample_model->samples_start_i].
-				tstamp_ms);
+    timediff = us_time_diff(
+			sample_model->newest_tstamp_us,
+			sample_model->oldest_tstamp_us);
     if(timediff >= 0.25) {
       sample_model->eff_freq = (sample_model->nb_samples - 1) / timediff;
       FURI_LOG_T(TAG, "Effective frequency: %lf", sample_model->eff_freq);
@@ -224,144 +931,217 @@ static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
       sample_model->eff_freq = - 1;
 
     /* If we don't buffer samples, display the last sample directly */
-    if(app->config.buf == 0)
-      memcpy(&(sample_model->disp_sample),
-		&(sample_model->samples[prev_samples_end_i]),
-		sizeof(LRFSample));
+    if(buf == 0)
+      sample_store_get(&sample_model->sample_store, prev_samples_end_i,
+			&sample_model->disp_sample,
+			sample_model->newest_tstamp_us);
 
     /* We buffer samples */
     else {
 
-      start_i_cfg_buf_only = sample_model->samples_start_i;
-
       /* Do we buffer samples for a set amount of time? */
-      if(app->config.buf > 0) {
-
-        /* Just to calculate averages and return rate, disregard all samples
-           that are too old from the ring buffer without exceptions this time,
-           but still keep samples that are slightly older than we should to
-           avoid decimating samples that have come in a bit late */
-        nb_samples_cfg_buf_only = sample_model->nb_samples;
-
-        while(ms_tick_time_diff(
-			sample_model->samples[prev_samples_end_i].tstamp_ms,
-			sample_model->samples[start_i_cfg_buf_only].tstamp_ms
-		) > (double)app->config.buf + 0.2L) {
-
-          start_i_cfg_buf_only++;
-          if(i >= sample_model->max_samples)
-            start_i_cfg_buf_only = 0;
-
-          nb_samples_cfg_buf_only--;
-        }
+      if(buf > 0) {
+
+        /* Remove the samples that are too old from the averaging window
+           without exceptions this time, but still keep samples that are
+           slightly older than we should to avoid decimating samples that have
+           come in a bit late */
+        while(sample_model->nb_avg_samples > 1 &&
+		us_time_diff(
+			sample_model->newest_tstamp_us,
+			sample_model->avg_start_tstamp_us
+		) > (double)buf + 0.2L)
+          remove_oldest_from_avg_window(sample_model);
       }
 
       /* We buffer a set number of samples */
       else {
 
-        /* Just to calculate averages and return rate, disregard samples in
-           excess without exceptions this time */
-        nb_samples_cfg_buf_only = -app->config.buf;
+        /* Remove the samples in excess from the averaging window without
+           exceptions this time */
+        while(sample_model->nb_avg_samples > -buf)
+          remove_oldest_from_avg_window(sample_model);
 
-        if(sample_model->nb_samples > nb_samples_cfg_buf_only) {
+        sample_model->samples_time_span = us_time_diff(
+			sample_model->newest_tstamp_us,
+			sample_model->avg_start_tstamp_us);
+      }
 
-          start_i_cfg_buf_only += sample_model->nb_samples -
-					nb_samples_cfg_buf_only;
-          if(start_i_cfg_buf_only >= sample_model->max_samples)
-            start_i_cfg_buf_only -= sample_model->max_samples;
-        }
-        else
-          nb_samples_cfg_buf_only = sample_model->nb_samples;
+      /* Recompute the running sums exactly from time to time, so rounding
+         errors don't accumulate. Small windows are recomputed after as many
+         samples as they hold, which keeps the cost per sample constant and
+         the squared deviation sums accurate */
+      if(++sample_model->nb_samples_since_avg_recompute >=
+		sample_view_avg_recompute_every ||
+		sample_model->nb_samples_since_avg_recompute >=
+		sample_model->nb_avg_samples)
+        recompute_avg_window_sums(sample_model);
+
+      /* Calculate the average of the valid distances and amplitudes in the
+         averaging window, which holds the samples corresponding strictly to
+         the configured buffering setting */
+      if(sample_model->nb_valid_dist1 > 0) {
+        sample_model->disp_sample.dist1 = calc_dist_statistic(sample_model,
+						&sample_model->dist1_tree,
+						sample_model->sum_dist1,
+						sample_model->sum_dev1,
+						sample_model->sum_sq_dev1,
+						sample_model->nb_valid_dist1,
+						&sample_model->disp_spread1);
+        sample_model->disp_sample.ampl1 = sample_model->sum_ampl1 /
+						sample_model->nb_valid_dist1;
+      }
+      else
+        sample_model->disp_sample.dist1 = NO_AVERAGE;
 
-        sample_model->samples_time_span = ms_tick_time_diff(
-			sample_model->samples[prev_samples_end_i].tstamp_ms,
-			sample_model->samples[start_i_cfg_buf_only].tstamp_ms);
+      if(sample_model->nb_valid_dist2 > 0) {
+        sample_model->disp_sample.dist2 = calc_dist_statistic(sample_model,
+						&sample_model->dist2_tree,
+						sample_model->sum_dist2,
+						sample_model->sum_dev2,
+						sample_model->sum_sq_dev2,
+						sample_model->nb_valid_dist2,
+						&sample_model->disp_spread2);
+        sample_model->disp_sample.ampl2 = sample_model->sum_ampl2 /
+						sample_model->nb_valid_dist2;
       }
+      else
+        sample_model->disp_sample.dist2 = NO_AVERAGE;
 
-      /* Calculate the average of the valid distances and amplitudes in that
-         subset of samples in the ring buffer corresponding strictly to the
-         configured buffering setting */
-      avg_dist1 = 0;
-      avg_dist2 = 0;
-      avg_dist3 = 0;
-      avg_ampl1 = 0;
-      avg_ampl2 = 0;
-      avg_ampl3 = 0;
+      if(sample_model->nb_valid_dist3 > 0) {
+        sample_model->disp_sample.dist3 = calc_dist_statistic(sample_model,
+						&sample_model->dist3_tree,
+						sample_model->sum_dist3,
+						sample_model->sum_dev3,
+						sample_model->sum_sq_dev3,
+						sample_model->nb_valid_dist3,
+						&sample_model->disp_spread3);
+        sample_model->disp_sample.ampl3 = sample_model->sum_ampl3 /
+						sample_model->nb_valid_dist3;
+      }
+      else
+        sample_model->disp_sample.dist3 = NO_AVERAGE;
 
-      nb_valid_samples_dist1 = 0;
-      nb_valid_samples_dist2 = 0;
-      nb_valid_samples_dist3 = 0;
+      sample_model->return_rate = (double)sample_model->nb_valid_any_dist /
+						sample_model->nb_avg_samples;
+    }
+  }
 
-      nb_valid_samples_any_dist = 0;
+  /* If we do automatic single measurement, display the measurement rate
+     achieved since it started as the effective sampling frequency */
+  if((app->config.mode & AUTO_RESTART) && sample_model->nb_smm_meas > 1 &&
+	(timediff = us_time_diff(lrf_sample->tstamp_us,
+				sample_model->first_smm_tstamp_us)) > 0)
+    sample_model->eff_freq = (sample_model->nb_smm_meas - 1) / timediff;
+
+  /* In tracking mode, update the tracks of the targets with the new sample
+     and display the estimated distances and radial velocities of the
+     tracked targets instead of the last sample's distances */
+  if(app->config.buf == BUF_TRACKING) {
+
+    track_filter_add_sample(&sample_model->track_filter, lrf_sample);
+
+    if(track_filter_get(&sample_model->track_filter, 0,
+			&sample_model->disp_sample.dist1, &vel))
+      sample_model->disp_vel1 = vel;
+    if(track_filter_get(&sample_model->track_filter, 1,
+			&sample_model->disp_sample.dist2, &vel))
+      sample_model->disp_vel2 = vel;
+    if(track_filter_get(&sample_model->track_filter, 2,
+			&sample_model->disp_sample.dist3, &vel))
+      sample_model->disp_vel3 = vel;
+  }
 
-      i = start_i_cfg_buf_only;
-      while(i != sample_model->samples_end_i) {
+  /* Publish the updated values to display */
+  publish_disp_snapshot(sample_model);
+}
 
-        one_dist_valid = false;
 
-        if(sample_model->samples[i].dist1 > 0.5) {
-          avg_dist1 += sample_model->samples[i].dist1;
-          avg_ampl1 += sample_model->samples[i].ampl1;
-          one_dist_valid = true;
-          nb_valid_samples_dist1++;
-        }
 
-        if(sample_model->samples[i].dist2 > 0.5) {
-          avg_dist2 += sample_model->samples[i].dist2;
-          avg_ampl2 += sample_model->samples[i].ampl2;
-          one_dist_valid = true;
-          nb_valid_samples_dist2++;
-        }
+/** Sample processing thread
+    Pull LRF samples out of the sample queue and process them, so the UART
+    receive thread never waits on the sample view **/
+static int32_t sample_thread(void *ctx) {
 
-        if(sample_model->samples[i].dist3 > 0.5) {
-          avg_dist3 += sample_model->samples[i].dist3;
-          avg_ampl3 += sample_model->samples[i].ampl3;
-          one_dist_valid = true;
-          nb_valid_samples_dist3++;
-        }
+  App *app = (App *)ctx;
+  SampleModel *sample_model = view_get_model(app->sample_view);
+  LRFSample lrf_sample;
+  uint32_t evts;
 
-        if(one_dist_valid)
-          nb_valid_samples_any_dist++;
+  FURI_LOG_I(TAG, "Sample processing thread started");
 
-        i++;
-        if(i >= sample_model->max_samples)
-          i = 0;
-      }
+  while(true) {
 
-      if(nb_valid_samples_dist1 > 0) {
-        sample_model->disp_sample.dist1 = avg_dist1 / nb_valid_samples_dist1;
-        sample_model->disp_sample.ampl1 = avg_ampl1 / nb_valid_samples_dist1;
-      }
-      else
-        sample_model->disp_sample.dist1 = NO_AVERAGE;
+    /* Wait for events */
+    evts = furi_thread_flags_wait(stop | sample_avail | graph_targets |
+					smm_due, FuriFlagWaitAny,
+					FuriWaitForever);
 
-      if(nb_valid_samples_dist2 > 0) {
-        sample_model->disp_sample.dist2 = avg_dist2 / nb_valid_samples_dist2;
-        sample_model->disp_sample.ampl2 = avg_ampl2 / nb_valid_samples_dist2;
-      }
-      else
-        sample_model->disp_sample.dist2 = NO_AVERAGE;
+    /* Check for errors */
+    furi_check((evts & FuriFlagError) == 0);
 
-      if(nb_valid_samples_dist3 > 0) {
-        sample_model->disp_sample.dist3 = avg_dist3 / nb_valid_samples_dist3;
-        sample_model->disp_sample.ampl3 = avg_ampl3 / nb_valid_samples_dist3;
-      }
-      else
-        sample_model->disp_sample.dist3 = NO_AVERAGE;
+    /* Should we stop the thread? */
+    if(evts & stop)
+      break;
+
+    /* Should we change the number of targets displayed in the distance
+       graph? */
+    if(evts & graph_targets) {
+      dist_graph_set_targets(&sample_model->dist_graph,
+				sample_model->graph_nb_targets);
+      publish_disp_snapshot(sample_model);
+    }
 
-      sample_model->return_rate = (double)nb_valid_samples_any_dist /
-						nb_samples_cfg_buf_only;
+    /* Should we send the next SMM command? */
+    if(evts & smm_due)
+      send_scheduled_smm(app, sample_model);
+
+    /* Process all the samples in the queue, and record them raw if the
+       sample logger is recording */
+    while(sample_queue_pop(&sample_model->sample_queue, &lrf_sample)) {
+      log_sample(&sample_model->sample_logger, &lrf_sample);
+      process_lrf_sample(app, &lrf_sample);
     }
   }
 
-  /* Mark the samples as updated */
-  sample_model->samples_updated = true;
+  FURI_LOG_I(TAG, "Sample processing thread stopped");
 
-  /* Give the sample view update timer callback a chance to run if the LRF is
-     sending samples with no delay between each samples - i.e. maxxing out the
-     serial bandwidth by trying (and failing) to sample at 200 Hz and sending
-     the samples at 38400 bps */
-  furi_delay_ms(1);
+  return 0;
+}
+
+
+
+/** LRF identification handler
+    Called when a LRF identification frame is available from the LRF serial
+    communication app **/
+static void lrf_ident_handler(LRFIdent *lrf_ident, void *ctx) {
+
+  App *app = (App *)ctx;
+  SampleModel *sample_model = view_get_model(app->sample_view);
+
+  /* Copy the identification and mark it as valid */
+  memcpy(&(sample_model->ident), lrf_ident, sizeof(LRFIdent));
+  sample_model->has_ident = true;
+}
+
+
+
+/** LRF sample handler
+    Called in the UART receive thread when a LRF sample is available from the
+    LRF serial communication app: queue the sample and wake up the sample
+    processing thread **/
+static void lrf_sample_handler(LRFSample *lrf_sample, void *ctx) {
+
+  App *app = (App *)ctx;
+  SampleModel *sample_model = view_get_model(app->sample_view);
+
+  /* Queue the sample. If the queue is full, the sample is dropped and
+     counted as an overflow */
+  if(!sample_queue_push(&sample_model->sample_queue, lrf_sample))
+    FURI_LOG_W(TAG, "Sample queue overflow: LRF sample dropped");
+
+  /* Wake up the sample processing thread */
+  furi_thread_flags_set(sample_model->sample_thread_id, sample_avail);
 }
 
 
@@ -371,9 +1151,12 @@ static void sample_view_timer_callback(void *ctx) {
 
   App *app = (App *)ctx;
   SampleModel *sample_model = view_get_model(app->sample_view);
+  uint32_t gen = __atomic_load_n(&sample_model->disp_gen, __ATOMIC_ACQUIRE);
 
-  /* Were the samples updated or should make the OK button symbol blink? */
-  if(sample_model->samples_updated || !sample_model->symbol_blinking_ctr) {
+  /* Was a new display snapshot published since the last redraw or should
+     make the OK button symbol blink? */
+  if(gen != sample_model->drawn_disp_gen ||
+	!sample_model->symbol_blinking_ctr) {
 
     /* Reverse the symbol's colors and reset the blinker counter if needed  */
     if(!sample_model->symbol_blinking_ctr) {
@@ -386,7 +1169,7 @@ static void sample_view_timer_callback(void *ctx) {
     with_view_model(app->sample_view, SampleModel *_model,
 			{UNUSED(_model);}, true);
 
-    sample_model->samples_updated = false;
+    sample_model->drawn_disp_gen = gen;
   }
 
   /* Count down the blinking counter if it's not disabled */
@@ -402,32 +1185,102 @@ void sample_view_enter_callback(void *ctx) {
 
   App *app = (App *)ctx;
   uint32_t period = furi_ms_to_ticks(sample_view_update_every);
+  OSTNode *nodes;
+  float *sums;
 
   with_view_model(app->sample_view, SampleModel *sample_model,
 	{
 	  sample_model->config = &(app->config);
 
-	  /* Start the UART at the correct baudrate */
-	  start_uart(app->lrf_serial_comm_app, app->config.baudrate);
+	  /* Do we need order statistics of the buffered distances? */
+	  sample_model->use_dist_trees =
+			app->config.stat == stat_median ||
+			app->config.stat == stat_trimmed_mean;
+
+	  /* If we do, split the shared storage between the sums and nodes of
+	     the order-statistic trees of the distances and the ring buffer,
+	     with one node per sample and per target in each tree. The sums
+	     come first because they need aligning */
+	  if(sample_model->use_dist_trees) {
+	    sample_model->max_samples = sizeof(app->shared_storage) /
+					(SAMPLE_STORE_BYTES_PER_SAMPLE +
+					3 * (sizeof(float) + sizeof(OSTNode)));
+	    sums = (float *)app->shared_storage;
+	    nodes = (OSTNode *)(sums + 3 * sample_model->max_samples);
+	    sample_store_init(&sample_model->sample_store,
+				(uint8_t *)(nodes +
+					3 * sample_model->max_samples),
+				sample_model->max_samples);
+
+	    ost_init(&sample_model->dist1_tree, nodes, sums,
+			sample_model->sample_store.dist_cm[0], 3);
+	    ost_init(&sample_model->dist2_tree,
+			nodes + sample_model->max_samples,
+			sums + sample_model->max_samples,
+			sample_model->sample_store.dist_cm[1], 3);
+	    ost_init(&sample_model->dist3_tree,
+			nodes + 2 * sample_model->max_samples,
+			sums + 2 * sample_model->max_samples,
+			sample_model->sample_store.dist_cm[2], 3);
+	  }
 
-	  /* Setup the callback to receive decoded LRF samples */
-	  set_lrf_sample_handler(app->lrf_serial_comm_app, lrf_sample_handler,
-					app);
+	  /* Otherwise use all of the shared storage for the ring buffer */
+	  else {
+	    sample_model->max_samples = sizeof(app->shared_storage) /
+					SAMPLE_STORE_BYTES_PER_SAMPLE;
+	    sample_store_init(&sample_model->sample_store,
+				app->shared_storage,
+				sample_model->max_samples);
+	  }
 
-	  /* Set the backlight on all the time */
-	  set_backlight(&app->backlight_control, BL_ON);
+	  FURI_LOG_D(TAG, "Sampler ring buffer size: %d samples",
+			sample_model->max_samples);
 
-	  sample_model->samples_updated = false;
+	  /* Empty the sample queue */
+	  sample_queue_reset(&sample_model->sample_queue);
 
-	  /* Don't blink the OK button symbol by default */
-	  sample_model->symbol_reversed = false;
-	  sample_model->symbol_blinking_ctr = -1;
+	  /* Setup the distance graph to cover the buffering setting - or as
+	     without buffering in tracking mode - showing the first target
+	     only, and start at the distances screen */
+	  sample_model->graph_nb_targets = 1;
+	  dist_graph_init(&sample_model->dist_graph,
+				app->config.buf == BUF_TRACKING?
+					0 : app->config.buf,
+				sample_model->graph_nb_targets);
+	  sample_model->screen = sample_screen_dists;
+
+	  /* Reset the sample timing statistics */
+	  sample_timing_reset(&sample_model->sample_timing,
+				mode_sample_interval_ms(app->config.mode));
+
+	  /* Setup the target associator */
+	  track_assoc_init(&sample_model->track_assoc, track_assoc_gate,
+				track_assoc_max_misses);
+
+	  /* Setup the tracking filter */
+	  track_filter_init(&sample_model->track_filter,
+				track_filter_accel_noise,
+				track_filter_meas_noise,
+				track_filter_gate, track_filter_max_misses);
+
+	  /* Setup the sample logger */
+	  set_sample_logger(&sample_model->sample_logger);
 
 	  /* Initialize the displayed distances */
 	  sample_model->disp_sample.dist1 = NO_DISTANCE_DISPLAY;
 	  sample_model->disp_sample.dist2 = NO_DISTANCE_DISPLAY;
 	  sample_model->disp_sample.dist3 = NO_DISTANCE_DISPLAY;
 
+	  /* Initialize the displayed spreads */
+	  sample_model->disp_spread1 = 0;
+	  sample_model->disp_spread2 = 0;
+	  sample_model->disp_spread3 = 0;
+
+	  /* Initialize the displayed radial velocities */
+	  sample_model->disp_vel1 = 0;
+	  sample_model->disp_vel2 = 0;
+	  sample_model->disp_vel3 = 0;
+
 	  /* Reset the samples ring buffer and associated calculated values */
 	  sample_model->flush_samples = true;
 	  sample_model->nb_samples = 0;
@@ -437,32 +1290,90 @@ void sample_view_enter_callback(void *ctx) {
 	  /* Initialize the displayed effective sampling frequency */
 	  sample_model->eff_freq = -1;
 
-	  /* Are we doing single measurement (manual or automatic)? */
-	  if((app->config.mode & (AUTO_RESTART - 1)) == smm) {
+	  /* Publish the initial values to display before the sample processing
+	     thread starts publishing its own */
+	  publish_disp_snapshot(sample_model);
+	  sample_model->drawn_disp_gen = sample_model->disp_gen;
+
+	  /* Allocate the automatic SMM scheduler timer */
+	  sample_model->smm_timer = furi_timer_alloc(smm_timer_callback,
+						FuriTimerTypeOnce, ctx);
+
+	  /* Allocate space for the sample processing thread */
+	  sample_model->sample_thread = furi_thread_alloc();
+
+	  /* Initialize the sample processing thread */
+	  furi_thread_set_name(sample_model->sample_thread, "sample_proc");
+	  furi_thread_set_stack_size(sample_model->sample_thread, 2048);
+	  furi_thread_set_context(sample_model->sample_thread, app);
+	  furi_thread_set_callback(sample_model->sample_thread, sample_thread);
+
+	  /* Start the sample processing thread */
+	  furi_thread_start(sample_model->sample_thread);
+
+	  /* Get the sample processing thread ID */
+	  sample_model->sample_thread_id =
+			furi_thread_get_id(sample_model->sample_thread);
 
-	    /* Is the SMM prefix enabled? */
-	    if(app->config.smm_pfx) {
+	  /* Start the UART at the correct baudrate */
+	  start_uart(app->lrf_serial_comm_app, app->config.baudrate);
+
+	  /* Setup the callback to receive decoded LRF samples */
+	  add_lrf_sample_handler(app->lrf_serial_comm_app, lrf_sample_handler,
+					app);
+
+	  /* Setup the callback to receive decoded LRF identification frames */
+	  add_lrf_ident_handler(app->lrf_serial_comm_app, lrf_ident_handler,
+				app);
 
-	      /* Set up the OK button symbol for blinking */
-	      sample_model->symbol_blinking_ctr = 0;
+	  /* Set the backlight on all the time */
+	  set_backlight(&app->backlight_control, BL_ON);
 
-	      /* Send the SMM prefix */
-	      uart_tx(app->lrf_serial_comm_app,
+	  /* Don't blink the OK button symbol by default */
+	  sample_model->symbol_reversed = false;
+	  sample_model->symbol_blinking_ctr = -1;
+
+	  /* Invalidate the current identification - if any - and send a
+	     send-identification-frame command to get the serial number to
+	     name the log files after before starting measuring */
+	  sample_model->has_ident = false;
+	  send_lrf_command(app->lrf_serial_comm_app, send_ident);
+
+	  /* Set up the OK button symbol for blinking if we're doing single
+	     measurement (manual or automatic) with the SMM prefix enabled */
+	  if((app->config.mode & LRF_COMMAND_MASK) == smm &&
+		app->config.smm_pfx)
+	    sample_model->symbol_blinking_ctr = 0;
+
+	  /* Are we doing manual single measurement? */
+	  if(app->config.mode == smm) {
+
+	    /* Send the SMM prefix if it's enabled */
+	    if(app->config.smm_pfx)
+	      send_lrf_raw_data(app->lrf_serial_comm_app,
 				app->smm_pfx_config.smm_pfx_sequence,
 				sizeof(app->smm_pfx_config.smm_pfx_sequence));
-	    }
 
 	    /* Send the SMM command */
 	    send_lrf_command(app->lrf_serial_comm_app, smm);
+
+	    sample_model->continuous_meas_started = false;
 	  }
 
+	  /* Are we doing automatic single measurement? Start the scheduler,
+	     which sends the first SMM command */
+	  else if(app->config.mode & AUTO_RESTART)
+	    start_smm_scheduler(sample_model);
+
+	  /* Are we doing burst SMM? Start a burst */
+	  else if(app->config.mode == quick_smm)
+	    start_burst_smm(app, sample_model);
+
 	  /* Otherwise send the appropriate CMM command */
-	  else
+	  else {
 	    send_lrf_command(app->lrf_serial_comm_app, app->config.mode);
-
-	  /* Mark continuous measurement started as needed */
-	  sample_model->continuous_meas_started =
-				app->config.mode == smm? false : true;
+	    sample_model->continuous_meas_started = true;
+	  }
 	},
 	false);
 
@@ -481,20 +1392,24 @@ void sample_view_exit_callback(void *ctx) {
   App *app = (App *)ctx;
   SampleModel *sample_model = view_get_model(app->sample_view);
 
-  /* Stop continuous measurement unconditionally */
-  sample_model->continuous_meas_started = false;
+  /* Stop continuous measurement unconditionally - burst SMM shots still in
+     the command pipeline read it from the UART transmit thread */
+  __atomic_store_n(&sample_model->continuous_meas_started, false,
+			__ATOMIC_RELAXED);
 
-  /* Send a CMM-break command unconditionally - 3 times to be sure */
-  send_lrf_command(app->lrf_serial_comm_app, cmm_break);
-  send_lrf_command(app->lrf_serial_comm_app, cmm_break);
+  /* Send a CMM-break command unconditionally. It is resent if the LRF doesn't
+     acknowledge it */
   send_lrf_command(app->lrf_serial_comm_app, cmm_break);
   app->pointer_is_on = false;	/* A CMM break turns the pointer off */
 
   /* Set the backlight back to automatic */
   set_backlight(&app->backlight_control, BL_AUTO);
 
-  /* Unset the callback to receive decoded LRF samples */
-  set_lrf_sample_handler(app->lrf_serial_comm_app, NULL, app);
+  /* Remove the callback to receive decoded LRF samples */
+  remove_lrf_sample_handler(app->lrf_serial_comm_app, lrf_sample_handler, app);
+
+  /* Remove the callback to receive decoded LRF identification frames */
+  remove_lrf_ident_handler(app->lrf_serial_comm_app, lrf_ident_handler, app);
 
   /* Stop and free the view update timer */
   furi_timer_stop(app->sample_view_timer);
@@ -502,6 +1417,176 @@ void sample_view_exit_callback(void *ctx) {
 
   /* Stop the UART */
   stop_uart(app->lrf_serial_comm_app);
+
+  /* Stop and free the sample processing thread */
+  furi_thread_flags_set(sample_model->sample_thread_id, stop);
+  furi_thread_join(sample_model->sample_thread);
+  furi_thread_free(sample_model->sample_thread);
+
+  /* Stop and free the automatic SMM scheduler timer. The thread that
+     restarts it is stopped, and the timer callback does nothing now that
+     continuous measurement is stopped */
+  furi_timer_stop(sample_model->smm_timer);
+  furi_timer_free(sample_model->smm_timer);
+
+  /* Stop recording samples if needed and release the sample logger */
+  release_sample_logger(&sample_model->sample_logger);
+}
+
+
+
+/** Print a distance spread in 4 characters **/
+static void print_spread(char *str, size_t len, float spread) {
+
+  if(spread < 9.995f)
+    snprintf(str, len, "%4.2f", (double)spread);
+  else if(spread < 99.95f)
+    snprintf(str, len, "%4.1f", (double)spread);
+  else
+    snprintf(str, len, "%4.0f", (double)(spread < 9999? spread : 9999));
+}
+
+
+
+/** Print a radial velocity in meters per second with its sign in 4
+    characters **/
+static void print_velocity(char *str, size_t len, float vel) {
+
+  if(vel > -9.95f && vel < 9.95f)
+    snprintf(str, len, "%+4.1f", (double)vel);
+  else
+    snprintf(str, len, "%+4.0f", (double)(vel < -999? -999 :
+						vel > 999? 999 : vel));
+}
+
+
+
+/** Draw the distance graph above the bottom line, with the displayed range
+    of distances at the top and bottom left. The spans of pixels of the
+    columns are worked out as the samples come in and copied into the display
+    snapshot, so they're just drawn **/
+static void draw_dist_graph(Canvas *canvas, SampleModel *sample_model) {
+
+  DistGraphDisp *graph = &sample_model->disp.graph;
+  DistGraphSpan *span;
+  uint16_t w;
+  uint8_t x, t;
+
+  /* Draw the columns of the displayed targets */
+  for(x = 0; x < DIST_GRAPH_WIDTH; x++)
+    for(t = 0; t < graph->nb_targets; t++) {
+      span = &graph->spans[x][t];
+      if(span->top <= span->bottom)
+        canvas_draw_line(canvas, x, span->top, x, span->bottom);
+    }
+
+  /* Print the largest and smallest distances of the displayed range over
+     the graph, if it has anything to show */
+  if(!graph->has_dists)
+    return;
+
+  canvas_set_font(canvas, FontKeyboard);
+
+  snprintf(sample_model->spstr, sizeof(sample_model->spstr), "%.2f",
+		graph->range_max_cm / 100.0);
+  w = canvas_string_width(canvas, sample_model->spstr);
+  canvas_set_color(canvas, ColorWhite);
+  canvas_draw_box(canvas, 0, 0, w + 1, 8);
+  canvas_set_color(canvas, ColorBlack);
+  canvas_draw_str(canvas, 0, 7, sample_model->spstr);
+
+  snprintf(sample_model->spstr, sizeof(sample_model->spstr), "%.2f",
+		graph->range_min_cm / 100.0);
+  w = canvas_string_width(canvas, sample_model->spstr);
+  canvas_set_color(canvas, ColorWhite);
+  canvas_draw_box(canvas, 0, DIST_GRAPH_HEIGHT - 8, w + 1, 8);
+  canvas_set_color(canvas, ColorBlack);
+  canvas_draw_str(canvas, 0, DIST_GRAPH_HEIGHT - 1, sample_model->spstr);
+}
+
+
+
+/** Draw the sample timing statistics above the bottom line: the smallest,
+    mean and largest intervals between samples, the number of samples missing
+    against the commanded sampling frequency, the measured and commanded
+    serial link loads, and the jitter histogram **/
+static void draw_sample_timing(Canvas *canvas, SampleModel *sample_model) {
+
+  SampleTiming *timing = &sample_model->disp.sample_timing;
+  uint32_t link_bps = sample_model->config->baudrate;
+  uint32_t max_count = 0;
+  float mean_interval_ms;
+  uint8_t b, x, h;
+
+  canvas_set_font(canvas, FontKeyboard);
+
+  if(!timing->nb_intervals) {
+    canvas_draw_str_aligned(canvas, 64, 27, AlignCenter, AlignBottom,
+				"NO INTERVAL");
+    return;
+  }
+
+  /* Print the smallest, mean and largest intervals */
+  mean_interval_ms = sample_timing_mean_interval_ms(timing);
+  snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"Int %.1f/%.1f/%.1fms", timing->min_interval_us / 1000.0,
+		(double)mean_interval_ms, timing->max_interval_us / 1000.0);
+  canvas_draw_str(canvas, 0, 7, sample_model->spstr);
+
+  /* Print the number and proportion of missing samples if we sample at a
+     set frequency */
+  if(timing->nominal_interval_ms)
+    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"Missed %ld %.1f%%", timing->nb_missing,
+		100.0 * timing->nb_missing /
+			(timing->nb_intervals + timing->nb_missing));
+  else
+    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"Missed n/a");
+  canvas_draw_str(canvas, 0, 15, sample_model->spstr);
+
+  /* Print the load of the serial link at the measured sampling frequency,
+     and at the commanded sampling frequency if there is one */
+  if(timing->nominal_interval_ms)
+    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"Load %.0f%% cmd %.0f%%",
+		mean_interval_ms > 0?
+			100000.0 * lrf_cmm_frame_len * uart_bits_per_byte /
+			mean_interval_ms / link_bps : 0,
+		100000.0 * lrf_cmm_frame_len * uart_bits_per_byte /
+			timing->nominal_interval_ms / link_bps);
+  else
+    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"Load %.0f%%",
+		mean_interval_ms > 0?
+			100000.0 * lrf_cmm_frame_len * uart_bits_per_byte /
+			mean_interval_ms / link_bps : 0);
+  canvas_draw_str(canvas, 0, 23, sample_model->spstr);
+
+  /* Draw the jitter histogram as bars scaled to the fullest bin, non-empty
+     bins being at least one pixel high, with the upper edges of the bins
+     below */
+  for(b = 0; b < SAMPLE_TIMING_NB_JITTER_BINS; b++)
+    if(timing->jitter_bins[b] > max_count)
+      max_count = timing->jitter_bins[b];
+
+  for(b = 0; b < SAMPLE_TIMING_NB_JITTER_BINS; b++) {
+
+    x = b * 16 + 2;
+
+    if(timing->jitter_bins[b]) {
+      h = 1 + (uint64_t)timing->jitter_bins[b] * 10 / max_count;
+      canvas_draw_box(canvas, x, 38 - h, 12, h);
+    }
+
+    if(b < SAMPLE_TIMING_NB_JITTER_BINS - 1)
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr), "%d",
+		sample_timing_jitter_bin_edges_ms[b]);
+    else
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr), ">");
+    canvas_draw_str_aligned(canvas, x + 6, 47, AlignCenter, AlignBottom,
+				sample_model->spstr);
+  }
 }
 
 
@@ -510,45 +1595,61 @@ void sample_view_exit_callback(void *ctx) {
 void sample_view_draw_callback(Canvas *canvas, void *model) {
 
   SampleModel *sample_model = (SampleModel *)model;
+  SampleDisp *disp = &sample_model->disp;
+  bool recording = is_sample_logging(&sample_model->sample_logger);
   double buffer_fullness;
   uint8_t y;
 
+  /* Get a consistent copy of the latest values to display */
+  get_disp_snapshot(sample_model, disp);
+
+  /* Draw the distance graph or the sample timing statistics if either is
+     the displayed screen */
+  if(sample_model->screen == sample_screen_graph)
+    draw_dist_graph(canvas, sample_model);
+  else if(sample_model->screen == sample_screen_timing)
+    draw_sample_timing(canvas, sample_model);
+
   /* First print all the things we need to print in the FontBigNumber font */
   canvas_set_font(canvas, FontBigNumbers);
 
-  /* Print the measured distances if they're valid */
-  if(sample_model->disp_sample.dist1 > 0.5) {
-    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
-		"%8.2f", (double)sample_model->disp_sample.dist1);
-    canvas_draw_str(canvas, 0, 14, sample_model->spstr);
-  }
+  if(sample_model->screen == sample_screen_dists) {
 
-  if(sample_model->disp_sample.dist2 > 0.5) {
-    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
-		"%8.2f", (double)sample_model->disp_sample.dist2);
-    canvas_draw_str(canvas, 0, 30, sample_model->spstr);
-  }
+    /* Print the measured distances if they're valid */
+    if(disp->sample.dist1 > 0.5) {
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"%8.2f", (double)disp->sample.dist1);
+      canvas_draw_str(canvas, 0, 14, sample_model->spstr);
+    }
 
-  if(sample_model->disp_sample.dist3 > 0.5) {
-    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
-		"%8.2f", (double)sample_model->disp_sample.dist3);
-    canvas_draw_str(canvas, 0, 46, sample_model->spstr);
+    if(disp->sample.dist2 > 0.5) {
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"%8.2f", (double)disp->sample.dist2);
+      canvas_draw_str(canvas, 0, 30, sample_model->spstr);
+    }
+
+    if(disp->sample.dist3 > 0.5) {
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"%8.2f", (double)disp->sample.dist3);
+      canvas_draw_str(canvas, 0, 46, sample_model->spstr);
+    }
   }
 
-  /* If we have an effective sampling frequency, print it at the bottom */
-  if(sample_model->eff_freq >= 0) {
+  /* If we have an effective sampling frequency and we don't record samples,
+     print it at the bottom */
+  if(disp->eff_freq >= 0 && !recording) {
 
     /* If the frequency value is below 90 Hz, display it with one decimal */
-    if(sample_model->eff_freq < 90) {
+    if(disp->eff_freq < 90) {
       snprintf(sample_model->spstr, sizeof(sample_model->spstr),
-		"%4.1f", sample_model->eff_freq);
+		"%4.1f", disp->eff_freq);
       canvas_draw_str(canvas, 12, 64, sample_model->spstr);
     }
 
     /* Otherwise display it rounded to the nearest integer */
     else {
       snprintf(sample_model->spstr, sizeof(sample_model->spstr),
-		"%3.0f", sample_model->eff_freq);
+		"%3.0f", disp->eff_freq);
       canvas_draw_str(canvas, 18, 64, sample_model->spstr);
     }
   }
@@ -557,62 +1658,65 @@ void sample_view_draw_callback(Canvas *canvas, void *model) {
      (bold, proportional) */
   canvas_set_font(canvas, FontPrimary);
 
-  /* If any of the distances indicate an error or the eye safety limit was hit
-    display the error in the middle of the screen */
-  if(sample_model->disp_sample.dist1 == 0.5 ||
-	sample_model->disp_sample.dist1 == 0.5 ||
-	sample_model->disp_sample.dist3 == 0.5)
-  {
-    canvas_draw_str(canvas, 8, 27, "ERROR / EYE SAFETY");
-    canvas_draw_frame(canvas, 6, 17, 115, 12);
-  }
-
-  /* None of the distances indicate an error */
-  else {
+  if(sample_model->screen == sample_screen_dists) {
 
-    /* Add "m" right of the distance values or indicate no samples depending
-       on whether we have distances or not */
-    if(sample_model->disp_sample.dist1 > 0.5)
-      canvas_draw_str(canvas, 95, 14, "m");
-    else if(sample_model->disp_sample.dist1 >= 0 &&
-		sample_model->disp_sample.dist1 < 0.5) {
-      canvas_draw_str(canvas, 33, 11, "NO SAMPLE");
-      canvas_draw_frame(canvas, 31, 1, 66, 12);
-    }
-    else if(sample_model->disp_sample.dist1 == NO_AVERAGE) {
-      canvas_draw_str(canvas, 30, 11, "NO AVERAGE");
-      canvas_draw_frame(canvas, 28, 1, 73, 12);
+    /* If any of the distances indicate an error or the eye safety limit was
+      hit display the error in the middle of the screen */
+    if(disp->sample.dist1 == 0.5 ||
+	disp->sample.dist1 == 0.5 ||
+	disp->sample.dist3 == 0.5)
+    {
+      canvas_draw_str(canvas, 8, 27, "ERROR / EYE SAFETY");
+      canvas_draw_frame(canvas, 6, 17, 115, 12);
     }
 
-    if(sample_model->disp_sample.dist2 > 0.5)
-      canvas_draw_str(canvas, 95, 30, "m");
-    else if(sample_model->disp_sample.dist2 >= 0 &&
-		sample_model->disp_sample.dist2 < 0.5) {
-      canvas_draw_str(canvas, 33, 27, "NO SAMPLE");
-      canvas_draw_frame(canvas, 31, 17, 66, 12);
-    }
-    else if(sample_model->disp_sample.dist2 == NO_AVERAGE) {
-      canvas_draw_str(canvas, 30, 27, "NO AVERAGE");
-      canvas_draw_frame(canvas, 28, 17, 73, 12);
-    }
+    /* None of the distances indicate an error */
+    else {
 
-    if(sample_model->disp_sample.dist3 > 0.5)
-      canvas_draw_str(canvas, 95, 46, "m");
-    else if(sample_model->disp_sample.dist3 >= 0 &&
-		sample_model->disp_sample.dist3 < 0.5) {
-      canvas_draw_str(canvas, 33, 43, "NO SAMPLE");
-      canvas_draw_frame(canvas, 31, 33, 66, 12);
-    }
-    else if(sample_model->disp_sample.dist3 == NO_AVERAGE) {
-      canvas_draw_str(canvas, 30, 43, "NO AVERAGE");
-      canvas_draw_frame(canvas, 28, 33, 73, 12);
+      /* Add "m" right of the distance values or indicate no samples depending
+         on whether we have distances or not */
+      if(disp->sample.dist1 > 0.5)
+        canvas_draw_str(canvas, 95, 14, "m");
+      else if(disp->sample.dist1 >= 0 &&
+		disp->sample.dist1 < 0.5) {
+        canvas_draw_str(canvas, 33, 11, "NO SAMPLE");
+        canvas_draw_frame(canvas, 31, 1, 66, 12);
+      }
+      else if(disp->sample.dist1 == NO_AVERAGE) {
+        canvas_draw_str(canvas, 30, 11, "NO AVERAGE");
+        canvas_draw_frame(canvas, 28, 1, 73, 12);
+      }
+
+      if(disp->sample.dist2 > 0.5)
+        canvas_draw_str(canvas, 95, 30, "m");
+      else if(disp->sample.dist2 >= 0 &&
+		disp->sample.dist2 < 0.5) {
+        canvas_draw_str(canvas, 33, 27, "NO SAMPLE");
+        canvas_draw_frame(canvas, 31, 17, 66, 12);
+      }
+      else if(disp->sample.dist2 == NO_AVERAGE) {
+        canvas_draw_str(canvas, 30, 27, "NO AVERAGE");
+        canvas_draw_frame(canvas, 28, 17, 73, 12);
+      }
+
+      if(disp->sample.dist3 > 0.5)
+        canvas_draw_str(canvas, 95, 46, "m");
+      else if(disp->sample.dist3 >= 0 &&
+		disp->sample.dist3 < 0.5) {
+        canvas_draw_str(canvas, 33, 43, "NO SAMPLE");
+        canvas_draw_frame(canvas, 31, 33, 66, 12);
+      }
+      else if(disp->sample.dist3 == NO_AVERAGE) {
+        canvas_draw_str(canvas, 30, 43, "NO AVERAGE");
+        canvas_draw_frame(canvas, 28, 33, 73, 12);
+      }
     }
   }
 
-  /* If we have an effective sampling frequency, print "Hz" right of
-     the value */
-  if(sample_model->eff_freq >= 0)
-    canvas_draw_str(canvas, sample_model->eff_freq < 90 ? 59 : 53, 64, "Hz");
+  /* If we have an effective sampling frequency and we don't record samples,
+     print "Hz" right of the value */
+  if(disp->eff_freq >= 0 && !recording)
+    canvas_draw_str(canvas, disp->eff_freq < 90 ? 59 : 53, 64, "Hz");
 
   /* Print the OK button symbol followed by "Sample", "Start" or "Stop"
      in a frame at the right-hand side depending on whether we do single or
@@ -634,7 +1738,8 @@ void sample_view_draw_callback(Canvas *canvas, void *model) {
   if(sample_model->config->mode == smm)
     canvas_draw_str(canvas, 90, 62, "Sample");
   else
-    if(sample_model->continuous_meas_started)
+    if(__atomic_load_n(&sample_model->continuous_meas_started,
+			__ATOMIC_RELAXED))
       canvas_draw_str(canvas, 102, 62, "Stop");
     else
       canvas_draw_str(canvas, 102, 62, "Start");
@@ -643,39 +1748,127 @@ void sample_view_draw_callback(Canvas *canvas, void *model) {
      (thin, fixed) */
   canvas_set_font(canvas, FontKeyboard);
 
-  /* Print amplitude values when the corresponding distances are valid */
-  if(sample_model->disp_sample.dist1 > 0.5) {
-    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
-		"%4d", sample_model->disp_sample.ampl1);
-    canvas_draw_str(canvas, 105, 7, sample_model->spstr);
-  }
+  if(sample_model->screen == sample_screen_dists) {
 
-  if(sample_model->disp_sample.dist2 > 0.5) {
-    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
-		"%4d", sample_model->disp_sample.ampl2);
-    canvas_draw_str(canvas, 105, 23, sample_model->spstr);
+    /* Print amplitude values when the corresponding distances are valid */
+    if(disp->sample.dist1 > 0.5) {
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"%4d", disp->sample.ampl1);
+      canvas_draw_str(canvas, 105, 7, sample_model->spstr);
+    }
+
+    if(disp->sample.dist2 > 0.5) {
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"%4d", disp->sample.ampl2);
+      canvas_draw_str(canvas, 105, 23, sample_model->spstr);
+    }
+
+    if(disp->sample.dist3 > 0.5) {
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"%4d", disp->sample.ampl3);
+      canvas_draw_str(canvas, 105, 39, sample_model->spstr);
+    }
+
+    /* If we do continuous measurement, we buffer samples and we calculate
+       another statistic than the mean, print the symbol of the statistic above
+       the first distance's unit and the spreads of the valid distances below
+       their amplitudes */
+    if(sample_model->config->mode != smm && sample_model->config->buf != 0 &&
+	sample_model->config->buf != BUF_TRACKING &&
+	sample_model->config->stat != stat_mean) {
+
+      if(disp->sample.dist1 > 0.5) {
+        canvas_draw_str(canvas, 97, 7,
+			config_stat_symbols[sample_model->config->stat]);
+        print_spread(sample_model->spstr, sizeof(sample_model->spstr),
+			disp->spread1);
+        canvas_draw_str(canvas, 105, 15, sample_model->spstr);
+      }
+
+      if(disp->sample.dist2 > 0.5) {
+        print_spread(sample_model->spstr, sizeof(sample_model->spstr),
+			disp->spread2);
+        canvas_draw_str(canvas, 105, 31, sample_model->spstr);
+      }
+
+      if(disp->sample.dist3 > 0.5) {
+        print_spread(sample_model->spstr, sizeof(sample_model->spstr),
+			disp->spread3);
+        canvas_draw_str(canvas, 105, 47, sample_model->spstr);
+      }
+    }
+
+    /* If we track the targets, print the tracking symbol above the first
+       distance's unit and the radial velocities of the valid distances
+       below their amplitudes */
+    else if(sample_model->config->buf == BUF_TRACKING) {
+
+      if(disp->sample.dist1 > 0.5) {
+        canvas_draw_str(canvas, 97, 7, "V");
+        print_velocity(sample_model->spstr, sizeof(sample_model->spstr),
+			disp->vel1);
+        canvas_draw_str(canvas, 105, 15, sample_model->spstr);
+      }
+
+      if(disp->sample.dist2 > 0.5) {
+        print_velocity(sample_model->spstr, sizeof(sample_model->spstr),
+			disp->vel2);
+        canvas_draw_str(canvas, 105, 31, sample_model->spstr);
+      }
+
+      if(disp->sample.dist3 > 0.5) {
+        print_velocity(sample_model->spstr, sizeof(sample_model->spstr),
+			disp->vel3);
+        canvas_draw_str(canvas, 105, 47, sample_model->spstr);
+      }
+    }
   }
 
-  if(sample_model->disp_sample.dist3 > 0.5) {
-    snprintf(sample_model->spstr, sizeof(sample_model->spstr),
-		"%4d", sample_model->disp_sample.ampl3);
-    canvas_draw_str(canvas, 105, 39, sample_model->spstr);
+  /* If we record samples, print a recording dot followed by the SD card
+     write throughput reached, and the number of dropped blocks or the write
+     error below, at the bottom instead of the effective sampling frequency */
+  if(recording) {
+
+    get_sample_logger_stats(&sample_model->sample_logger,
+				&sample_model->log_stats);
+
+    canvas_draw_disc(canvas, 11, 52, 2);
+
+    if(sample_model->log_stats.write_time_ms) {
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"%4.0fkB/s",
+		(double)sample_model->log_stats.nb_bytes_written /
+		sample_model->log_stats.write_time_ms);
+      canvas_draw_str(canvas, 16, 56, sample_model->spstr);
+    }
+    else
+      canvas_draw_str(canvas, 16, 56, "REC");
+
+    if(sample_model->log_stats.write_error)
+      canvas_draw_str(canvas, 16, 64, "SD error");
+    else {
+      snprintf(sample_model->spstr, sizeof(sample_model->spstr),
+		"Drop %ld", sample_model->log_stats.nb_blocks_dropped);
+      canvas_draw_str(canvas, 16, 64, sample_model->spstr);
+    }
   }
 
   /* If we do continuous measurement and we buffer samples, display how much
      of the configured buffering time or samples we hold in the ring buffer
      as a small bar at the lower left, and display the return rate as a
-     second small bar at the right of it */
-  if(sample_model->config->mode != smm && sample_model->config->buf != 0) {
+     second small bar at the right of it. The tracking mode doesn't buffer
+     samples */
+  if(sample_model->config->mode != smm && sample_model->config->buf != 0 &&
+	sample_model->config->buf != BUF_TRACKING) {
 
     /* Do we buffer samples for a set amount of time? */
     if(sample_model->config->buf > 0)
-      buffer_fullness = sample_model->samples_time_span
+      buffer_fullness = disp->samples_time_span
 				/ sample_model->config->buf ;
 
     /* We buffer a set number of samples */
     else
-      buffer_fullness = (double)sample_model->nb_samples
+      buffer_fullness = (double)disp->nb_samples
 				/ -sample_model->config->buf;
 
     buffer_fullness = buffer_fullness > 1.0L? 1.0L : buffer_fullness;
@@ -688,7 +1881,7 @@ void sample_view_draw_callback(Canvas *canvas, void *model) {
     canvas_draw_line(canvas, 2, 63, 2, y);
 
     /* Display the return rate as a bar */
-    y = 63 - 14 * sample_model->return_rate;
+    y = 63 - 14 * disp->return_rate;
     canvas_draw_line(canvas, 4, 63, 4, y);
     canvas_draw_line(canvas, 5, 63, 5, y);
     canvas_draw_line(canvas, 6, 63, 6, y);
@@ -706,6 +1899,7 @@ bool sample_view_input_callback(InputEvent *evt, void *ctx) {
 
   App *app = (App *)ctx;
   SampleModel *sample_model = view_get_model(app->sample_view);
+  LRFLogHeader log_header;
 
   /* If the user pressed the OK button, tell the LRF to grab a single
      measurement or start/stop continuous measurement */
@@ -714,7 +1908,7 @@ bool sample_view_input_callback(InputEvent *evt, void *ctx) {
     FURI_LOG_D(TAG, "OK button pressed");
 
     /* Are we doing single measurement (manual or automatic)? */
-    if((app->config.mode & (AUTO_RESTART - 1)) == smm) {
+    if((app->config.mode & LRF_COMMAND_MASK) == smm) {
 
       /* Is continuous measurement stopped? */
       if(!sample_model->continuous_meas_started) {
@@ -722,20 +1916,42 @@ bool sample_view_input_callback(InputEvent *evt, void *ctx) {
         /* Reset the samples ring buffer */
         sample_model->flush_samples = true;
 
-        /* Send the SMM prefix if it's enabled */
-        if(app->config.smm_pfx)
-          uart_tx(app->lrf_serial_comm_app,
+        /* If we do automatic single measurement, start the scheduler, which
+           sends the first SMM command */
+        if(app->config.mode & AUTO_RESTART)
+          start_smm_scheduler(sample_model);
+
+        /* Otherwise send the SMM prefix if it's enabled and the SMM
+           command */
+        else {
+          if(app->config.smm_pfx)
+            send_lrf_raw_data(app->lrf_serial_comm_app,
 			app->smm_pfx_config.smm_pfx_sequence,
 			sizeof(app->smm_pfx_config.smm_pfx_sequence));
 
-        /* Send the SMM command */
-        send_lrf_command(app->lrf_serial_comm_app, smm);
+          send_lrf_command(app->lrf_serial_comm_app, smm);
+        }
       }
 
-      /* If we do automatic single measurement, flip the started flag */
-      if(app->config.mode != smm)
-        sample_model->continuous_meas_started =
-				!sample_model->continuous_meas_started;
+      /* If we do automatic single measurement, stop it. The scheduler stops
+         triggering measurements */
+      else
+        sample_model->continuous_meas_started = false;
+    }
+
+    /* Are we doing burst SMM? */
+    else if(app->config.mode == quick_smm) {
+
+      /* Stop the burst if it's running. The shots left in the command
+         pipeline still come in */
+      if(__atomic_load_n(&sample_model->continuous_meas_started,
+				__ATOMIC_RELAXED))
+        __atomic_store_n(&sample_model->continuous_meas_started, false,
+				__ATOMIC_RELAXED);
+
+      /* Otherwise reset the samples ring buffer and start a new burst */
+      else
+        start_burst_smm(app, sample_model);
     }
 
     /* We're doing continuous measurement */
@@ -744,9 +1960,8 @@ bool sample_view_input_callback(InputEvent *evt, void *ctx) {
       /* Is continuous measurement already started? */
       if(sample_model->continuous_meas_started) {
 
-        /* Send a CMM-break command - 3 times to be sure */
-        send_lrf_command(app->lrf_serial_comm_app, cmm_break);
-        send_lrf_command(app->lrf_serial_comm_app, cmm_break);
+        /* Send a CMM-break command. It is resent if the LRF doesn't
+           acknowledge it */
         send_lrf_command(app->lrf_serial_comm_app, cmm_break);
         app->pointer_is_on = false;	/* A CMM break turns the pointer off */
 
@@ -769,6 +1984,74 @@ bool sample_view_input_callback(InputEvent *evt, void *ctx) {
     return true;
   }
 
+  /* If the user pressed the up button, start or stop recording the raw
+     samples to the SD card */
+  if(evt->type == InputTypePress && evt->key == InputKeyUp) {
+
+    FURI_LOG_D(TAG, "Up button pressed");
+
+    if(is_sample_logging(&sample_model->sample_logger))
+      stop_sample_logging(&sample_model->sample_logger);
+
+    /* Start recording with the LRF identification - blank if we don't have
+       it - and the sampling configuration in the log file header */
+    else {
+      memset(&log_header, 0, sizeof(log_header));
+
+      if(sample_model->has_ident)
+        memcpy(&log_header.ident, &sample_model->ident, sizeof(LRFIdent));
+
+      log_header.mode = app->config.mode;
+      log_header.buf = app->config.buf;
+      log_header.stat = app->config.stat;
+      log_header.baudrate = app->config.baudrate;
+
+      start_sample_logging(&sample_model->sample_logger, &log_header);
+    }
+
+    /* Trigger a sample view redraw */
+    with_view_model(app->sample_view, SampleModel *_model,
+			{UNUSED(_model);}, true);
+
+    return true;
+  }
+
+  /* If the user pressed the left or right button, switch to the previous or
+     next screen among the distances, the distance graph and the sample
+     timing statistics */
+  if(evt->type == InputTypePress &&
+	(evt->key == InputKeyLeft || evt->key == InputKeyRight)) {
+
+    FURI_LOG_D(TAG, "%s button pressed",
+		evt->key == InputKeyLeft? "Left" : "Right");
+
+    with_view_model(app->sample_view, SampleModel *_model,
+			{
+			  _model->screen = (_model->screen +
+					(evt->key == InputKeyRight? 1 :
+						total_sample_screens - 1)) %
+					total_sample_screens;
+			},
+			true);
+
+    return true;
+  }
+
+  /* If the user pressed the down button while the distance graph is
+     displayed, show the first target only or all 3 targets in it. The
+     sample processing thread redraws the graph */
+  if(evt->type == InputTypePress && evt->key == InputKeyDown &&
+	sample_model->screen == sample_screen_graph) {
+
+    FURI_LOG_D(TAG, "Down button pressed");
+
+    sample_model->graph_nb_targets = sample_model->graph_nb_targets == 1?
+									3 : 1;
+    furi_thread_flags_set(sample_model->sample_thread_id, graph_targets);
+
+    return true;
+  }
+
   /* We haven't handled this event */
   return false;
 }
@@ -299,11 +299,11 @@ void savediag_view_enter_callback(void *ctx) {
 	  start_uart(app->lrf_serial_comm_app, app->config.baudrate);
 
 	  /* Setup the callback to receive decoded LRF identification frames */
-	  set_lrf_ident_handler(app->lrf_serial_comm_app, lrf_ident_handler,
+	  add_lrf_ident_handler(app->lrf_serial_comm_app, lrf_ident_handler,
 				app);
 
 	  /* Setup the callback to receive diagnostic data */
-	  set_diag_data_handler(app->lrf_serial_comm_app, diag_data_handler,
+	  add_diag_data_handler(app->lrf_serial_comm_app, diag_data_handler,
 				app);
 
 	  /* Let the LRF serial communication thread use the larger shared
@@ -343,11 +343,11 @@ void savediag_view_exit_callback(void *ctx) {
      space anymore */
   enable_shared_storage_dec_buf(app->lrf_serial_comm_app, false);
 
-  /* Unset the callback to receive diagnostic data */
-  set_diag_data_handler(app->lrf_serial_comm_app, NULL, app);
+  /* Remove the callback to receive diagnostic data */
+  remove_diag_data_handler(app->lrf_serial_comm_app, diag_data_handler, app);
 
-  /* Unset the callback to receive decoded LRF identification frames */
-  set_lrf_ident_handler(app->lrf_serial_comm_app, NULL, app);
+  /* Remove the callback to receive decoded LRF identification frames */
+  remove_lrf_ident_handler(app->lrf_serial_comm_app, lrf_ident_handler, app);
 
   /* Stop the UART */
   stop_uart(app->lrf_serial_comm_app);
@@ -34,6 +34,13 @@ void submenu_callback(void *ctx, uint32_t idx) {
       FURI_LOG_D(TAG, "Switch to sample view");
       break;
 
+    /* Switch to the histogram view */
+    case submenu_histogram:
+      view_dispatcher_switch_to_view(app->view_dispatcher, view_histogram);
+      app->config.sitem = submenu_histogram;
+      FURI_LOG_D(TAG, "Switch to histogram view");
+      break;
+
     /* Turn the pointer on and off */
     case submenu_pointeronoff:
 
@@ -95,6 +102,13 @@ void submenu_callback(void *ctx, uint32_t idx) {
       FURI_LOG_D(TAG, "Switch to USB serial passthrough view");
       break;
 
+    /* Switch to the link statistics view */
+    case submenu_linkstats:
+      view_dispatcher_switch_to_view(app->view_dispatcher, view_linkstats);
+      app->config.sitem = submenu_linkstats;
+      FURI_LOG_D(TAG, "Switch to link statistics view");
+      break;
+
     /* Switch to the about view */
     case submenu_about:
       view_dispatcher_switch_to_view(app->view_dispatcher, view_about);
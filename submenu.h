@@ -17,6 +17,9 @@ typedef enum {
   /* Sample view */
   view_sample,
 
+  /* Histogram view */
+  view_histogram,
+
   /* LRF info view */
   view_lrfinfo,
 
@@ -35,6 +38,9 @@ typedef enum {
   /* USB serial passthrough view */
   view_passthru,
 
+  /* Link statistics view */
+  view_linkstats,
+
   /* About view */
   view_about,
 
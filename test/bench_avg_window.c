@@ -0,0 +1,367 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Averaging window benchmark. Runs on Linux - not part of the Flipper Zero
+ * app
+ *
+ * Build: make -C test
+ *
+ * Feeds a 200 Hz stream of samples into an averaging window kept in the
+ * sample store for every buffering setting, and compares the CPU time per
+ * sample of recomputing the sums over the whole window on every sample with
+ * that of keeping running sums updated when samples enter and leave the
+ * window and recomputed exactly from time to time, as the sample view does.
+ * Fails if the averages of the running sums drift more than 1 mm away from
+ * the exact averages
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../sample_store.h"
+#include "lrf_test_frames.h"
+
+
+
+/*** Defines ***/
+#define RATE_HZ 200
+#define NB_SAMPLES (RATE_HZ * 30)
+#define SHARED_STORAGE_SIZE 60000	/* As in common.h */
+#define MAX_SAMPLES (SHARED_STORAGE_SIZE / SAMPLE_STORE_BYTES_PER_SAMPLE)
+#define AVG_RECOMPUTE_EVERY 1000	/* samples, as in parameters.c */
+#define MAX_DRIFT 0.001			/* m */
+#define BUF_TRACKING INT16_MIN		/* As in common.h */
+
+
+
+/*** Types ***/
+
+/** Averaging window over the samples of a sample store ring buffer **/
+typedef struct {
+
+  SampleStore store;
+
+  /* Buffering setting */
+  int16_t buf;
+
+  /* Window in the ring buffer, and timestamps of its oldest and newest
+     samples */
+  uint16_t start_i;
+  uint16_t nb;
+  uint64_t start_tstamp_us;
+  uint64_t newest_tstamp_us;
+
+  /* Running sums of the valid distances, of their amplitudes and of their
+     deviations from a reference distance, per target */
+  float sum_dist[3];
+  uint32_t sum_ampl[3];
+  float ref_dist[3];
+  float sum_dev[3];
+  float sum_sq_dev[3];
+  uint16_t nb_valid[3];
+  uint16_t nb_valid_any;
+  uint16_t nb_since_recompute;
+
+  /* Sum of the window sizes after each sample, to report the average size */
+  uint64_t sum_sizes;
+
+} AvgWindow;
+
+
+
+/*** Global variables ***/
+
+/* Buffering settings, as in parameters.c */
+static const int16_t config_buf_values[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+						20, 30, 60,
+						-5, -10, -100, -1000, -2000,
+						-3000, BUF_TRACKING};
+static const char *config_buf_names[] = {"None", "1 s", "2 s", "3 s",
+						"4 s", "5 s", "6 s", "7 s",
+						"8 s", "9 s", "10 s",
+						"20 s", "30 s", "60 s",
+						"5 spl", "10 spl", "100 spl",
+						"1000 spl", "2000 spl",
+						"3000 spl", "Tracking"};
+
+
+
+/*** Routines ***/
+
+/** Monotonic time in nanoseconds **/
+static uint64_t now_ns(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+/** Exact sums over the whole window **/
+static void sum_window(AvgWindow *win, SampleStoreSums *sums,
+			uint16_t *nb_valid_any) {
+
+  uint16_t nb_left, nb, i;
+  uint8_t t;
+
+  memset(sums, 0, 3 * sizeof(SampleStoreSums));
+  *nb_valid_any = 0;
+
+  /* The window is at most two runs of consecutive samples */
+  i = win->start_i;
+  for(nb_left = win->nb; nb_left; nb_left -= nb) {
+
+    nb = MAX_SAMPLES - i;
+    if(nb > nb_left)
+      nb = nb_left;
+
+    for(t = 0; t < 3; t++)
+      sample_store_sum_dists(&win->store, t, i, nb, &sums[t]);
+    *nb_valid_any += sample_store_count_any_valid(&win->store, i, nb);
+
+    i = 0;
+  }
+}
+
+
+
+/** Recompute the running sums exactly **/
+static void recompute_sums(AvgWindow *win) {
+
+  SampleStoreSums sums[3];
+  uint8_t t;
+
+  sum_window(win, sums, &win->nb_valid_any);
+
+  for(t = 0; t < 3; t++) {
+    win->nb_valid[t] = sums[t].nb_valid;
+    win->sum_dist[t] = sums[t].sum_dist_cm / 100.0f;
+    win->sum_ampl[t] = sums[t].sum_ampl;
+    win->ref_dist[t] = sums[t].ref_dist_cm / 100.0f;
+    win->sum_dev[t] = sums[t].sum_dev_cm / 100.0f;
+    win->sum_sq_dev[t] = sums[t].sum_sq_dev_cm / 10000.0f;
+  }
+
+  win->nb_since_recompute = 0;
+}
+
+
+
+/** Add or subtract a sample's valid distances to or from the running sums,
+    as update_avg_window_sums() does in the sample view **/
+static void update_sums(AvgWindow *win, uint16_t i, bool add) {
+
+  int8_t sign = add? 1 : -1;
+  bool one_dist_valid = false;
+  LRFSample sample;
+  float dist[3], dev;
+  uint16_t ampl[3];
+  uint8_t t;
+
+  sample_store_get(&win->store, i, &sample, 0);
+  dist[0] = sample.dist1;
+  dist[1] = sample.dist2;
+  dist[2] = sample.dist3;
+  ampl[0] = sample.ampl1;
+  ampl[1] = sample.ampl2;
+  ampl[2] = sample.ampl3;
+
+  for(t = 0; t < 3; t++) {
+
+    if(dist[t] <= 0.5)
+      continue;
+
+    if(add && !win->nb_valid[t])
+      win->ref_dist[t] = dist[t];
+    dev = dist[t] - win->ref_dist[t];
+    win->sum_dev[t] += sign * dev;
+    win->sum_sq_dev[t] += sign * dev * dev;
+    win->sum_dist[t] += sign * dist[t];
+    win->sum_ampl[t] += sign * ampl[t];
+    win->nb_valid[t] += sign;
+    one_dist_valid = true;
+
+    if(!win->nb_valid[t]) {
+      win->sum_dist[t] = 0;
+      win->sum_dev[t] = 0;
+      win->sum_sq_dev[t] = 0;
+    }
+  }
+
+  if(one_dist_valid)
+    win->nb_valid_any += sign;
+}
+
+
+
+/** Remove the oldest sample from the window **/
+static void evict_oldest(AvgWindow *win, bool running_sums) {
+
+  if(running_sums)
+    update_sums(win, win->start_i, false);
+
+  win->nb--;
+  win->start_i++;
+  if(win->start_i >= MAX_SAMPLES)
+    win->start_i = 0;
+
+  if(win->nb)
+    win->start_tstamp_us += sample_store_tstamp_delta(&win->store,
+							win->start_i) * 1000;
+}
+
+
+
+/** Add a sample to the window, evict the samples that fall out of it and
+    calculate the average of the first target's valid distances, with
+    running sums or by recomputing the sums over the whole window **/
+static float add_sample(AvgWindow *win, LRFSample *sample,
+			bool running_sums) {
+
+  SampleStoreSums sums[3];
+  uint16_t i, nb_valid_any;
+
+  /* Make room in the ring buffer */
+  if(win->nb >= MAX_SAMPLES - 1)
+    evict_oldest(win, running_sums);
+
+  /* Store the sample after the newest one */
+  i = (win->start_i + win->nb) % MAX_SAMPLES;
+  sample_store_put(&win->store, i, sample, win->newest_tstamp_us);
+  if(win->nb)
+    win->newest_tstamp_us += sample_store_tstamp_delta(&win->store, i) *
+									1000;
+  else
+    win->newest_tstamp_us = win->start_tstamp_us = sample->tstamp_us;
+  win->nb++;
+
+  if(running_sums)
+    update_sums(win, i, true);
+
+  /* Evict the samples that fall out of the window */
+  if(win->buf > 0)
+    while(win->nb > 1 && (win->newest_tstamp_us - win->start_tstamp_us) /
+					1e6 > win->buf + 0.2)
+      evict_oldest(win, running_sums);
+  else
+    while(win->nb > -win->buf)
+      evict_oldest(win, running_sums);
+
+  win->sum_sizes += win->nb;
+
+  /* Recompute the running sums from time to time, or the sums over the
+     whole window every time */
+  if(running_sums) {
+    if(++win->nb_since_recompute >= AVG_RECOMPUTE_EVERY ||
+		win->nb_since_recompute >= win->nb)
+      recompute_sums(win);
+  }
+  else {
+    sum_window(win, sums, &nb_valid_any);
+    return sums[0].nb_valid? sums[0].sum_dist_cm / 100.0 /
+					sums[0].nb_valid : 0;
+  }
+
+  return win->nb_valid[0]? win->sum_dist[0] / win->nb_valid[0] : 0;
+}
+
+
+
+/** Feed the stream into a window. Returns the CPU time per sample in
+    nanoseconds, and the averages in avgs **/
+static double run_window(int16_t buf, LRFSample *samples, bool running_sums,
+				float *avgs, double *avg_size) {
+
+  static uint8_t storage[SHARED_STORAGE_SIZE];
+  AvgWindow win;
+  uint64_t start_ns;
+  uint32_t i;
+
+  memset(&win, 0, sizeof(win));
+  sample_store_init(&win.store, storage, MAX_SAMPLES);
+  win.buf = buf;
+
+  start_ns = now_ns();
+
+  for(i = 0; i < NB_SAMPLES; i++)
+    avgs[i] = add_sample(&win, &samples[i], running_sums);
+
+  *avg_size = (double)win.sum_sizes / NB_SAMPLES;
+
+  return (double)(now_ns() - start_ns) / NB_SAMPLES;
+}
+
+
+
+/** Main routine **/
+int main(void) {
+
+  static LRFSample samples[NB_SAMPLES];
+  static float rescan_avgs[NB_SAMPLES], running_avgs[NB_SAMPLES];
+  double rescan_ns, running_ns, avg_size, drift, max_drift;
+  float dist = 100;
+  uint32_t seed = 1;
+  uint32_t i;
+  uint8_t j;
+  bool failed = false;
+
+  /* Build a 200 Hz stream with a first target drifting around 100 m, a
+     second target 20 m further away returning 70% of the time and no third
+     target */
+  for(i = 0; i < NB_SAMPLES; i++) {
+    dist += ((int32_t)(lrf_test_rand(&seed) % 201) - 100) / 1000.0f;
+    samples[i].dist1 = dist;
+    samples[i].ampl1 = 1000 + lrf_test_rand(&seed) % 100;
+    samples[i].dist2 = lrf_test_rand(&seed) % 10 < 7? dist + 20 : 0;
+    samples[i].ampl2 = samples[i].dist2 > 0? 500 : 0;
+    samples[i].dist3 = 0;
+    samples[i].ampl3 = 0;
+    samples[i].tstamp_us = (uint64_t)i * 1000000 / RATE_HZ;
+  }
+
+  printf("Buffering  Window | Rescan ns/spl  Running ns/spl  Speedup  "
+		"Max drift\n");
+
+  for(j = 0; j < sizeof(config_buf_values) / sizeof(config_buf_values[0]);
+		j++) {
+
+    /* Without buffering - and in tracking mode - nothing is averaged */
+    if(!config_buf_values[j] || config_buf_values[j] == BUF_TRACKING) {
+      printf("%-9s       - |             -               -        -  "
+		"        -\n", config_buf_names[j]);
+      continue;
+    }
+
+    rescan_ns = run_window(config_buf_values[j], samples, false,
+				rescan_avgs, &avg_size);
+    running_ns = run_window(config_buf_values[j], samples, true,
+				running_avgs, &avg_size);
+
+    max_drift = 0;
+    for(i = 0; i < NB_SAMPLES; i++) {
+      drift = fabs(running_avgs[i] - rescan_avgs[i]);
+      if(drift > max_drift)
+        max_drift = drift;
+    }
+
+    printf("%-9s %7.0f | %13.0f %15.0f %7.1fx %8.3fmm\n",
+		config_buf_names[j], avg_size, rescan_ns, running_ns,
+		rescan_ns / running_ns, max_drift * 1000);
+
+    if(max_drift > MAX_DRIFT) {
+      printf("FAILED: the running sums drifted more than %.0f mm\n",
+		MAX_DRIFT * 1000);
+      failed = true;
+    }
+  }
+
+  return failed? 1 : 0;
+}
@@ -0,0 +1,428 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF frame field loader micro-benchmark. Runs on Linux - not part of the
+ * Flipper Zero app
+ *
+ * Build: make -C test
+ *
+ * Decodes the multi-byte fields of range measurement (0xcc), information
+ * (0xc2) and identification (0xc0) frames the way the UART receive thread
+ * used to - testing the endianness at runtime and copying the bytes one at a
+ * time through unions - and with the compile-time little-endian loaders of
+ * endian_loaders.h, and reports the cost of decoding one frame each way.
+ * The text fields of the identification frame are copied the same way
+ * before and after, so only its binary fields are decoded. Fails if the two
+ * ways don't decode the same values
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../lrf_frame_decoder.h"
+#include "../endian_loaders.h"
+#include "lrf_test_frames.h"
+
+
+
+/*** Defines ***/
+#define NB_FRAMES 256		/* Different frames of each type */
+#define MIN_BENCH_NS 200000000	/* Decode each frame type for at least 0.2 s */
+
+
+
+/*** Types ***/
+
+/** Binary fields of an identification frame **/
+typedef struct {
+
+  uint8_t fw_major;
+  uint8_t fw_minor;
+  uint8_t fw_micro;
+  uint8_t fw_build;
+  uint8_t electronics;
+  bool is_fw_newer_than_x4;
+
+} IdentFields;
+
+/** Frame decoding routine **/
+typedef void (*DecodeFrame)(uint8_t *, void *);
+
+
+
+/*** Global variables ***/
+
+/* Result of the runtime endianness test, as the receive thread did it */
+static bool is_little_endian;
+
+
+
+/*** Routines ***/
+
+/** Monotonic time in nanoseconds **/
+static uint64_t now_ns(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+/** CPU cycle counter, or 0 if we don't know how to read it **/
+static uint64_t now_cycles(void) {
+
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+
+/** Unions and macros of the old receive thread **/
+#define BEFORE_UNIONS \
+  union { \
+    uint8_t bytes[4]; \
+    float val; \
+  } float_union; \
+  union { \
+    uint8_t bytes[2]; \
+    uint16_t unsigned_val; \
+    int16_t signed_val; \
+  } int16_union; \
+  (void)float_union; \
+  (void)int16_union;
+
+#define LE2LE_FLOAT_AT_OFFSET(offset) \
+	float_union.bytes[0] = dec_buf[offset]; \
+	float_union.bytes[1] = dec_buf[offset + 1]; \
+	float_union.bytes[2] = dec_buf[offset + 2]; \
+	float_union.bytes[3] = dec_buf[offset + 3];
+
+#define LE2BE_FLOAT_AT_OFFSET(offset) \
+	float_union.bytes[3] = dec_buf[offset]; \
+	float_union.bytes[2] = dec_buf[offset + 1]; \
+	float_union.bytes[1] = dec_buf[offset + 2]; \
+	float_union.bytes[0] = dec_buf[offset + 3];
+
+#define LE2LE_INT16_AT_OFFSET(offset) \
+	int16_union.bytes[0] = dec_buf[offset]; \
+	int16_union.bytes[1] = dec_buf[offset + 1];
+
+#define LE2BE_INT16_AT_OFFSET(offset) \
+	int16_union.bytes[1] = dec_buf[offset]; \
+	int16_union.bytes[0] = dec_buf[offset + 1];
+
+#define INT16_AT_OFFSET(offset) \
+	if(is_little_endian) { \
+	  LE2LE_INT16_AT_OFFSET(offset) \
+	} \
+	else { \
+	  LE2BE_INT16_AT_OFFSET(offset) \
+	}
+
+
+
+/** Decode a range measurement frame the old way **/
+static __attribute__((noinline)) void before_range_meas(uint8_t *dec_buf,
+							void *out) {
+
+  LRFSample *sample = (LRFSample *)out;
+  BEFORE_UNIONS
+
+  if(is_little_endian) {
+    LE2LE_FLOAT_AT_OFFSET(2)
+    sample->dist1 = float_union.val;
+    LE2LE_INT16_AT_OFFSET(6);
+    sample->ampl1 = int16_union.unsigned_val;
+    LE2LE_FLOAT_AT_OFFSET(8)
+    sample->dist2 = float_union.val;
+    LE2LE_INT16_AT_OFFSET(12);
+    sample->ampl2 = int16_union.unsigned_val;
+    LE2LE_FLOAT_AT_OFFSET(14)
+    sample->dist3 = float_union.val;
+    LE2LE_INT16_AT_OFFSET(18);
+    sample->ampl3 = int16_union.unsigned_val;
+  }
+
+  else {
+    LE2BE_FLOAT_AT_OFFSET(2)
+    sample->dist1 = float_union.val;
+    LE2BE_INT16_AT_OFFSET(6);
+    sample->ampl1 = int16_union.unsigned_val;
+    LE2BE_FLOAT_AT_OFFSET(8)
+    sample->dist2 = float_union.val;
+    LE2BE_INT16_AT_OFFSET(12);
+    sample->ampl2 = int16_union.unsigned_val;
+    LE2BE_FLOAT_AT_OFFSET(14)
+    sample->dist3 = float_union.val;
+    LE2BE_INT16_AT_OFFSET(18);
+    sample->ampl3 = int16_union.unsigned_val;
+  }
+}
+
+
+
+/** Decode a range measurement frame with the little-endian loaders **/
+static __attribute__((noinline)) void after_range_meas(uint8_t *dec_buf,
+							void *out) {
+
+  LRFSample *sample = (LRFSample *)out;
+
+  sample->dist1 = load_le_float(dec_buf + 2);
+  sample->ampl1 = load_le_u16(dec_buf + 6);
+  sample->dist2 = load_le_float(dec_buf + 8);
+  sample->ampl2 = load_le_u16(dec_buf + 12);
+  sample->dist3 = load_le_float(dec_buf + 14);
+  sample->ampl3 = load_le_u16(dec_buf + 18);
+}
+
+
+
+/** Decode an information frame the old way **/
+static __attribute__((noinline)) void before_info(uint8_t *dec_buf,
+							void *out) {
+
+  LRFInfo *info = (LRFInfo *)out;
+  BEFORE_UNIONS
+
+  info->txretries = dec_buf[2];
+  INT16_AT_OFFSET(3)
+  info->txpumptime = int16_union.unsigned_val;
+  INT16_AT_OFFSET(5)
+  info->pulsesused = int16_union.unsigned_val;
+  info->txtemp = dec_buf[7];
+  info->apdatfirstburst = dec_buf[8];
+  INT16_AT_OFFSET(10)
+  info->targetdist1 = int16_union.unsigned_val;
+  INT16_AT_OFFSET(12)
+  info->targetdist2 = int16_union.unsigned_val;
+  INT16_AT_OFFSET(14)
+  info->targetdist3 = int16_union.unsigned_val;
+  info->targetmagnitude1 = dec_buf[16];
+  info->targetmagnitude2 = dec_buf[17];
+  info->targetmagnitude3 = dec_buf[18];
+  INT16_AT_OFFSET(20)
+  info->battvoltage = (float)int16_union.unsigned_val * 0.001;
+  INT16_AT_OFFSET(24)
+  info->iovoltage = (float)(int16_union.unsigned_val - 3300) * 0.001;
+  INT16_AT_OFFSET(26)
+  info->rxvoltage = (float)int16_union.unsigned_val * 0.01;
+  INT16_AT_OFFSET(28)
+  info->txvoltage = (float)int16_union.unsigned_val * 0.001;
+  INT16_AT_OFFSET(30)
+  info->rxtemp = (float)int16_union.signed_val * 0.01;
+  info->statusbyte1 = dec_buf[32];
+  info->statusbyte2 = dec_buf[33];
+  info->statusbyte3 = dec_buf[34];
+  INT16_AT_OFFSET(35)
+  info->pulsectr = (int16_union.unsigned_val + (dec_buf[37] << 16)) * 1e6;
+  info->rserrorctr = dec_buf[38];
+}
+
+
+
+/** Decode an information frame with the little-endian loaders **/
+static __attribute__((noinline)) void after_info(uint8_t *dec_buf,
+							void *out) {
+
+  LRFInfo *info = (LRFInfo *)out;
+
+  info->txretries = dec_buf[2];
+  info->txpumptime = load_le_u16(dec_buf + 3);
+  info->pulsesused = load_le_u16(dec_buf + 5);
+  info->txtemp = dec_buf[7];
+  info->apdatfirstburst = dec_buf[8];
+  info->targetdist1 = load_le_u16(dec_buf + 10);
+  info->targetdist2 = load_le_u16(dec_buf + 12);
+  info->targetdist3 = load_le_u16(dec_buf + 14);
+  info->targetmagnitude1 = dec_buf[16];
+  info->targetmagnitude2 = dec_buf[17];
+  info->targetmagnitude3 = dec_buf[18];
+  info->battvoltage = (float)load_le_u16(dec_buf + 20) * 0.001;
+  info->iovoltage = (float)(load_le_u16(dec_buf + 24) - 3300) * 0.001;
+  info->rxvoltage = (float)load_le_u16(dec_buf + 26) * 0.01;
+  info->txvoltage = (float)load_le_u16(dec_buf + 28) * 0.001;
+  info->rxtemp = (float)load_le_i16(dec_buf + 30) * 0.01;
+  info->statusbyte1 = dec_buf[32];
+  info->statusbyte2 = dec_buf[33];
+  info->statusbyte3 = dec_buf[34];
+  info->pulsectr = load_le_u24(dec_buf + 35) * 1e6;
+  info->rserrorctr = dec_buf[38];
+}
+
+
+
+/** Interpret the firmware version and electronics type of an
+    identification frame **/
+static inline void interpret_fw_version(uint16_t fw_version,
+					uint8_t electronics,
+					IdentFields *ident) {
+
+  ident->fw_major = fw_version >> 12;
+  ident->fw_minor = (fw_version & 0xf00) >> 8;
+  ident->fw_micro = fw_version & 0xff;
+  ident->is_fw_newer_than_x4 = ident->fw_minor > 4 ||
+				(ident->fw_minor == 4 && ident->fw_micro > 0);
+
+  if(ident->is_fw_newer_than_x4) {
+    ident->fw_build = electronics;
+    ident->electronics = 0;
+  }
+  else {
+    ident->fw_build = electronics & 0x0f;
+    ident->electronics = electronics >> 4;
+  }
+}
+
+
+
+/** Decode the binary fields of an identification frame the old way **/
+static __attribute__((noinline)) void before_ident(uint8_t *dec_buf,
+							void *out) {
+
+  BEFORE_UNIONS
+
+  INT16_AT_OFFSET(48)
+  interpret_fw_version(int16_union.unsigned_val, dec_buf[50],
+			(IdentFields *)out);
+}
+
+
+
+/** Decode the binary fields of an identification frame with the
+    little-endian loaders **/
+static __attribute__((noinline)) void after_ident(uint8_t *dec_buf,
+							void *out) {
+
+  interpret_fw_version(load_le_u16(dec_buf + 48), dec_buf[50],
+			(IdentFields *)out);
+}
+
+
+
+/** Decode frames repeatedly for long enough to time it. Returns the cost of
+    decoding one frame in nanoseconds, and in cycles if we can count them **/
+static double bench_decode(DecodeFrame decode, uint8_t *frames,
+				uint32_t frame_len, void *out,
+				uint32_t out_size, double *cycles_per_frame) {
+
+  uint64_t start_ns, elapsed_ns, start_cycles, cycles;
+  uint64_t nb_frames = 0;
+  uint32_t i;
+
+  start_ns = now_ns();
+  start_cycles = now_cycles();
+
+  do {
+    for(i = 0; i < NB_FRAMES; i++)
+      decode(frames + i * frame_len, (uint8_t *)out + i * out_size);
+    nb_frames += NB_FRAMES;
+    elapsed_ns = now_ns() - start_ns;
+  } while(elapsed_ns < MIN_BENCH_NS);
+
+  cycles = now_cycles() - start_cycles;
+  *cycles_per_frame = (double)cycles / nb_frames;
+
+  return (double)elapsed_ns / nb_frames;
+}
+
+
+
+/** Benchmark decoding one type of frame before and after and check that
+    both decode the same values. Returns false if they don't **/
+static bool bench_frame_type(char *desc, DecodeFrame before,
+				DecodeFrame after, uint8_t *frames,
+				uint32_t frame_len, uint32_t out_size) {
+
+  static uint8_t before_out[NB_FRAMES * sizeof(LRFInfo)];
+  static uint8_t after_out[NB_FRAMES * sizeof(LRFInfo)];
+  double before_ns, after_ns, before_cycles, after_cycles;
+
+  memset(before_out, 0, sizeof(before_out));
+  memset(after_out, 0, sizeof(after_out));
+
+  before_ns = bench_decode(before, frames, frame_len, before_out, out_size,
+				&before_cycles);
+  after_ns = bench_decode(after, frames, frame_len, after_out, out_size,
+				&after_cycles);
+
+  printf("%-12s %7.2f ns/frame %7.2f ns/frame  x%.2f", desc, before_ns,
+		after_ns, before_ns / after_ns);
+  if(before_cycles && after_cycles)
+    printf("  %6.1f -> %6.1f cycles/frame", before_cycles, after_cycles);
+  printf("\n");
+
+  if(memcmp(before_out, after_out, NB_FRAMES * out_size)) {
+    printf("FAILED: %s fields decoded differently\n", desc);
+    return false;
+  }
+
+  return true;
+}
+
+
+
+/** Main routine **/
+int main(void) {
+
+  static uint8_t range_meas_frames[NB_FRAMES * LRF_TEST_RANGE_MEAS_LEN];
+  static uint8_t info_frames[NB_FRAMES * LRF_TEST_INFO_LEN];
+  static uint8_t ident_frames[NB_FRAMES * LRF_TEST_IDENT_LEN];
+  union {
+    uint8_t bytes[4];
+    float val;
+  } float_union = {.bytes = {0x00, 0x40, 0x9a, 0x44}};
+  uint32_t seed = 1;
+  uint8_t *frame;
+  uint32_t i, j;
+  bool failed = false;
+
+  /* Test endianness as the receive thread did */
+  is_little_endian = float_union.val == 1234.0;
+
+  /* Build different frames of each type, so the decoding isn't always the
+     same. The padding of the decoded structures is zeroed beforehand on
+     both sides, so they can be compared whole */
+  lrf_test_cmm_stream(range_meas_frames, NB_FRAMES, seed);
+
+  for(i = 0; i < NB_FRAMES; i++) {
+
+    frame = info_frames + i * LRF_TEST_INFO_LEN;
+    lrf_test_info_frame(frame);
+    for(j = 2; j < LRF_TEST_INFO_LEN - 1; j++)
+      frame[j] = lrf_test_rand(&seed);
+    lrf_test_seal_frame(frame, LRF_TEST_INFO_LEN);
+
+    frame = ident_frames + i * LRF_TEST_IDENT_LEN;
+    lrf_test_ident_frame(frame);
+    store_le_u16(frame + 48, lrf_test_rand(&seed));
+    frame[50] = lrf_test_rand(&seed);
+    lrf_test_seal_frame(frame, LRF_TEST_IDENT_LEN);
+  }
+
+  printf("%-12s %16s %16s  Speedup\n", "Frame type", "Before", "After");
+
+  failed |= !bench_frame_type("0xcc range", before_range_meas,
+				after_range_meas, range_meas_frames,
+				LRF_TEST_RANGE_MEAS_LEN, sizeof(LRFSample));
+  failed |= !bench_frame_type("0xc2 info", before_info, after_info,
+				info_frames, LRF_TEST_INFO_LEN,
+				sizeof(LRFInfo));
+  failed |= !bench_frame_type("0xc0 ident", before_ident, after_ident,
+				ident_frames, LRF_TEST_IDENT_LEN,
+				sizeof(IdentFields));
+
+  return failed? 1 : 0;
+}
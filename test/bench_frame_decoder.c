@@ -0,0 +1,200 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF frame decoder throughput benchmark. Runs on Linux - not part of the
+ * Flipper Zero app
+ *
+ * Build: make -C test
+ *
+ * Usage:
+ *
+ * bench_frame_decoder [-m <minimum frames/s>] [<capture file>]
+ *
+ * Decodes 100 Hz and 200 Hz continuous measurement streams - or the raw
+ * bytes captured from a LRF in a file - and reports the decoding throughput
+ * in bytes/s and frames/s, and the cost of decoding one frame. Fails if the
+ * throughput falls below the minimum number of frames per second, so a
+ * change that slows the decoder down is caught
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../lrf_frame_decoder.h"
+#include "lrf_test_frames.h"
+
+
+
+/*** Defines ***/
+#define STREAM_SECS 60		/* Length of the synthetic streams */
+#define CAPTURE_CHUNK 64	/* bytes fed at once when decoding a capture */
+#define MIN_BENCH_NS 200000000	/* Decode each stream for at least 0.2 s */
+
+/* Default minimum throughput: about a fifth of what a recent x86-64 host
+   decodes, so only a real regression - not a busy host - trips it */
+#define DEFAULT_MIN_FRAMES_PER_SEC 2000000
+
+
+
+/*** Routines ***/
+
+/** Monotonic time in nanoseconds **/
+static uint64_t now_ns(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+/** CPU cycle counter, or 0 if we don't know how to read it **/
+static uint64_t now_cycles(void) {
+
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+
+/** Decoder event handler: count the decoded frames **/
+static void evt_handler(LRFFrameDecoder *dec, LRFFrameEvent evt, void *ctx) {
+
+  (void)dec;
+  (void)evt;
+
+  (*(uint32_t *)ctx)++;
+}
+
+
+
+/** Decode a stream repeatedly for long enough to time it, feeding it in
+    chunks timestamped as they would be received, and print the results.
+    Returns the number of frames decoded per second **/
+static double bench_stream(char *desc, uint8_t *stream, uint32_t len,
+				uint32_t chunk, uint32_t chunk_us) {
+
+  static uint8_t dec_buf[128];
+  LRFFrameDecoder dec;
+  uint32_t nb_frames = 0;
+  uint64_t tstamp_us = 0;
+  uint64_t start_ns, elapsed_ns, start_cycles, cycles;
+  uint64_t nb_bytes = 0;
+  uint32_t i, n;
+
+  lrf_frame_decoder_init(&dec, dec_buf, sizeof(dec_buf), 100, evt_handler,
+			&nb_frames);
+
+  start_ns = now_ns();
+  start_cycles = now_cycles();
+
+  do {
+    for(i = 0; i < len; i += n) {
+      n = len - i < chunk? len - i : chunk;
+      lrf_frame_decoder_feed(&dec, stream + i, n, tstamp_us, tstamp_us);
+      tstamp_us += chunk_us;
+    }
+    nb_bytes += len;
+    elapsed_ns = now_ns() - start_ns;
+  } while(elapsed_ns < MIN_BENCH_NS);
+
+  cycles = now_cycles() - start_cycles;
+
+  printf("%-12s %10.0f bytes/s %9.0f frames/s %7.1f ns/frame",
+		desc, nb_bytes * 1e9 / elapsed_ns,
+		nb_frames * 1e9 / elapsed_ns,
+		nb_frames? (double)elapsed_ns / nb_frames : 0);
+  if(cycles && nb_frames)
+    printf(" %7.1f cycles/frame", (double)cycles / nb_frames);
+  printf("\n");
+
+  return nb_frames * 1e9 / elapsed_ns;
+}
+
+
+
+/** Check the throughput against the minimum. Returns false if it's too
+    low **/
+static bool check_throughput(char *desc, double frames_per_sec,
+				double min_frames_per_sec) {
+
+  if(frames_per_sec >= min_frames_per_sec)
+    return true;
+
+  printf("FAILED: %s decoded at %.0f frames/s, below the minimum of %.0f "
+		"frames/s\n", desc, frames_per_sec, min_frames_per_sec);
+
+  return false;
+}
+
+
+
+/** Main routine **/
+int main(int argc, char **argv) {
+
+  double min_frames_per_sec = DEFAULT_MIN_FRAMES_PER_SEC;
+  uint8_t *stream;
+  uint32_t len;
+  FILE *f;
+  long fsize;
+  bool ok;
+
+  /* Get the minimum throughput if we got one */
+  if(argc > 2 && !strcmp(argv[1], "-m")) {
+    min_frames_per_sec = atof(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+
+  /* Decode a capture if we got one */
+  if(argc > 1) {
+
+    if(!(f = fopen(argv[1], "rb")) || fseek(f, 0, SEEK_END) ||
+		(fsize = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) ||
+		!(stream = malloc(fsize)) ||
+		fread(stream, 1, fsize, f) != (size_t)fsize) {
+      fprintf(stderr, "Could not read %s\n", argv[1]);
+      return 1;
+    }
+    fclose(f);
+
+    ok = check_throughput(argv[1],
+			bench_stream(argv[1], stream, fsize, CAPTURE_CHUNK,
+					1000), min_frames_per_sec);
+    free(stream);
+
+    return ok? 0 : 1;
+  }
+
+  /* Otherwise decode synthetic 100 Hz and 200 Hz CMM streams, one frame
+     per receive chunk */
+  stream = malloc(200 * STREAM_SECS * LRF_TEST_RANGE_MEAS_LEN);
+
+  len = lrf_test_cmm_stream(stream, 100 * STREAM_SECS, 1);
+  ok = check_throughput("CMM 100 Hz",
+			bench_stream("CMM 100 Hz", stream, len,
+					LRF_TEST_RANGE_MEAS_LEN, 10000),
+			min_frames_per_sec);
+
+  len = lrf_test_cmm_stream(stream, 200 * STREAM_SECS, 2);
+  ok &= check_throughput("CMM 200 Hz",
+			bench_stream("CMM 200 Hz", stream, len,
+					LRF_TEST_RANGE_MEAS_LEN, 5000),
+			min_frames_per_sec);
+
+  free(stream);
+
+  return ok? 0 : 1;
+}
@@ -0,0 +1,359 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Sample history layout benchmark. Runs on Linux - not part of the Flipper
+ * Zero app
+ *
+ * Build: make -C test
+ *
+ * Keeps a 2500-sample window of a 200 Hz stream in three layouts:
+ *
+ * - An array of LRFSample structures, as the sample ring buffer used to be
+ *
+ * - Separate arrays of timestamps, distances and amplitudes
+ *
+ * - The packed sample store, with 16-bit timestamp deltas and 24-bit
+ *   distances in centimeters in separate arrays
+ *
+ * and reports the cost of adding a sample, evicting the samples that fall
+ * out of the window by scanning their timestamps, and reducing the valid
+ * distances and amplitudes of the 3 targets over the whole window. The
+ * packed store is reduced with sample_store_sum_dists(), which also sums the
+ * deviations from a reference distance and their squares for the standard
+ * deviation. Fails if the layouts don't reduce to the same sums
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../sample_store.h"
+#include "lrf_test_frames.h"
+
+
+
+/*** Defines ***/
+#define RATE_HZ 200
+#define WINDOW_SAMPLES 2500
+#define WINDOW_US ((uint64_t)WINDOW_SAMPLES * 1000000 / RATE_HZ)
+#define RING_SAMPLES (WINDOW_SAMPLES + 1)
+#define NB_SAMPLES (WINDOW_SAMPLES * 4)
+
+
+
+/*** Types ***/
+
+/** Sums over one target's valid distances in the window **/
+typedef struct {
+
+  uint32_t nb_valid;
+  double sum_dist;
+  uint64_t sum_ampl;
+
+} TargetSums;
+
+/** Sample history as an array of structures **/
+typedef struct {
+
+  LRFSample samples[RING_SAMPLES];
+  uint16_t start_i;
+  uint16_t nb;
+
+} AoSHistory;
+
+/** Sample history as a structure of arrays **/
+typedef struct {
+
+  uint64_t tstamp_us[RING_SAMPLES];
+  float dist[3][RING_SAMPLES];
+  uint16_t ampl[3][RING_SAMPLES];
+  uint16_t start_i;
+  uint16_t nb;
+
+} SoAHistory;
+
+/** Sample history in the packed sample store **/
+typedef struct {
+
+  SampleStore store;
+  uint8_t storage[RING_SAMPLES * SAMPLE_STORE_BYTES_PER_SAMPLE];
+  uint64_t oldest_tstamp_us;
+  uint64_t newest_tstamp_us;
+  uint16_t start_i;
+  uint16_t nb;
+
+} PackedHistory;
+
+
+
+/*** Routines ***/
+
+/** Monotonic time in nanoseconds **/
+static uint64_t now_ns(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+/** Add a sample to the array of structures, evict the samples that fall out
+    of the window and reduce the window **/
+static void aos_add(AoSHistory *hist, LRFSample *sample, TargetSums *sums) {
+
+  uint16_t i, nb_left, nb;
+  LRFSample *s;
+
+  hist->samples[(hist->start_i + hist->nb) % RING_SAMPLES] = *sample;
+  hist->nb++;
+
+  /* Evict the samples that are too old */
+  while(sample->tstamp_us - hist->samples[hist->start_i].tstamp_us >=
+		WINDOW_US) {
+    hist->start_i = (hist->start_i + 1) % RING_SAMPLES;
+    hist->nb--;
+  }
+
+  /* Reduce the window, in at most two runs of consecutive samples */
+  memset(sums, 0, 3 * sizeof(TargetSums));
+  i = hist->start_i;
+  for(nb_left = hist->nb; nb_left; nb_left -= nb) {
+
+    nb = RING_SAMPLES - i;
+    if(nb > nb_left)
+      nb = nb_left;
+
+    for(s = hist->samples + i; s < hist->samples + i + nb; s++) {
+      if(s->dist1 > 0.5) {
+        sums[0].nb_valid++;
+        sums[0].sum_dist += s->dist1;
+        sums[0].sum_ampl += s->ampl1;
+      }
+      if(s->dist2 > 0.5) {
+        sums[1].nb_valid++;
+        sums[1].sum_dist += s->dist2;
+        sums[1].sum_ampl += s->ampl2;
+      }
+      if(s->dist3 > 0.5) {
+        sums[2].nb_valid++;
+        sums[2].sum_dist += s->dist3;
+        sums[2].sum_ampl += s->ampl3;
+      }
+    }
+
+    i = 0;
+  }
+}
+
+
+
+/** Add a sample to the structure of arrays, evict the samples that fall out
+    of the window and reduce the window **/
+static void soa_add(SoAHistory *hist, LRFSample *sample, TargetSums *sums) {
+
+  uint16_t i, j, nb_left, nb;
+
+  i = (hist->start_i + hist->nb) % RING_SAMPLES;
+  hist->tstamp_us[i] = sample->tstamp_us;
+  hist->dist[0][i] = sample->dist1;
+  hist->dist[1][i] = sample->dist2;
+  hist->dist[2][i] = sample->dist3;
+  hist->ampl[0][i] = sample->ampl1;
+  hist->ampl[1][i] = sample->ampl2;
+  hist->ampl[2][i] = sample->ampl3;
+  hist->nb++;
+
+  /* Evict the samples that are too old, reading the timestamps only */
+  while(sample->tstamp_us - hist->tstamp_us[hist->start_i] >= WINDOW_US) {
+    hist->start_i = (hist->start_i + 1) % RING_SAMPLES;
+    hist->nb--;
+  }
+
+  /* Reduce the window, in at most two runs of consecutive samples */
+  memset(sums, 0, 3 * sizeof(TargetSums));
+  i = hist->start_i;
+  for(nb_left = hist->nb; nb_left; nb_left -= nb) {
+
+    nb = RING_SAMPLES - i;
+    if(nb > nb_left)
+      nb = nb_left;
+
+    /* Same reduction as with the array of structures, so only the layout
+       differs */
+    for(j = i; j < i + nb; j++) {
+      if(hist->dist[0][j] > 0.5) {
+        sums[0].nb_valid++;
+        sums[0].sum_dist += hist->dist[0][j];
+        sums[0].sum_ampl += hist->ampl[0][j];
+      }
+      if(hist->dist[1][j] > 0.5) {
+        sums[1].nb_valid++;
+        sums[1].sum_dist += hist->dist[1][j];
+        sums[1].sum_ampl += hist->ampl[1][j];
+      }
+      if(hist->dist[2][j] > 0.5) {
+        sums[2].nb_valid++;
+        sums[2].sum_dist += hist->dist[2][j];
+        sums[2].sum_ampl += hist->ampl[2][j];
+      }
+    }
+
+    i = 0;
+  }
+}
+
+
+
+/** Add a sample to the packed sample store, evict the samples that fall out
+    of the window and reduce the window **/
+static void packed_add(PackedHistory *hist, LRFSample *sample,
+			TargetSums *sums) {
+
+  SampleStoreSums store_sums;
+  uint16_t i, nb_left, nb;
+  uint8_t t;
+
+  i = (hist->start_i + hist->nb) % RING_SAMPLES;
+  sample_store_put(&hist->store, i, sample, hist->newest_tstamp_us);
+  if(hist->nb)
+    hist->newest_tstamp_us += sample_store_tstamp_delta(&hist->store, i) *
+									1000;
+  else
+    hist->newest_tstamp_us = hist->oldest_tstamp_us = sample->tstamp_us;
+  hist->nb++;
+
+  /* Evict the samples that are too old, reading the timestamp deltas
+     only */
+  while(hist->newest_tstamp_us - hist->oldest_tstamp_us >= WINDOW_US) {
+    hist->start_i = (hist->start_i + 1) % RING_SAMPLES;
+    hist->nb--;
+    hist->oldest_tstamp_us += sample_store_tstamp_delta(&hist->store,
+							hist->start_i) * 1000;
+  }
+
+  /* Reduce the window one target at a time, in at most two runs of
+     consecutive samples */
+  memset(sums, 0, 3 * sizeof(TargetSums));
+  for(t = 0; t < 3; t++) {
+
+    memset(&store_sums, 0, sizeof(store_sums));
+    i = hist->start_i;
+    for(nb_left = hist->nb; nb_left; nb_left -= nb) {
+
+      nb = RING_SAMPLES - i;
+      if(nb > nb_left)
+        nb = nb_left;
+
+      sample_store_sum_dists(&hist->store, t, i, nb, &store_sums);
+
+      i = 0;
+    }
+
+    sums[t].nb_valid = store_sums.nb_valid;
+    sums[t].sum_dist = store_sums.sum_dist_cm / 100.0;
+    sums[t].sum_ampl = store_sums.sum_ampl;
+  }
+}
+
+
+
+/** Check that two layouts reduced to the same sums - the packed store keeps
+    distances to the nearest centimeter **/
+static bool same_sums(TargetSums *sums1, TargetSums *sums2) {
+
+  uint8_t t;
+
+  for(t = 0; t < 3; t++)
+    if(sums1[t].nb_valid != sums2[t].nb_valid ||
+	sums1[t].sum_ampl != sums2[t].sum_ampl ||
+	fabs(sums1[t].sum_dist - sums2[t].sum_dist) >
+					0.005 * sums1[t].nb_valid + 1e-6)
+      return false;
+
+  return true;
+}
+
+
+
+/** Main routine **/
+int main(void) {
+
+  static LRFSample samples[NB_SAMPLES];
+  static AoSHistory aos;
+  static SoAHistory soa;
+  static PackedHistory packed;
+  TargetSums aos_sums[3], soa_sums[3], packed_sums[3];
+  uint64_t aos_ns = 0, soa_ns = 0, packed_ns = 0, start_ns;
+  uint32_t nb_timed = 0, nb_mismatches = 0;
+  float dist = 100;
+  uint32_t seed = 1;
+  uint32_t i;
+
+  /* Build a 200 Hz stream with a first target drifting around 100 m, a
+     second target 20 m further away returning 70% of the time and a third
+     target returning 10% of the time */
+  for(i = 0; i < NB_SAMPLES; i++) {
+    dist += ((int32_t)(lrf_test_rand(&seed) % 201) - 100) / 1000.0f;
+    samples[i].dist1 = dist;
+    samples[i].ampl1 = 1000 + lrf_test_rand(&seed) % 100;
+    samples[i].dist2 = lrf_test_rand(&seed) % 10 < 7? dist + 20 : 0;
+    samples[i].ampl2 = samples[i].dist2 > 0? 500 : 0;
+    samples[i].dist3 = lrf_test_rand(&seed) % 10 < 1? dist + 50 : 0;
+    samples[i].ampl3 = samples[i].dist3 > 0? 100 : 0;
+    samples[i].tstamp_us = (uint64_t)i * 1000000 / RATE_HZ;
+  }
+
+  sample_store_init(&packed.store, packed.storage, RING_SAMPLES);
+
+  /* Add the samples to each layout in turn, timing them once the window is
+     full */
+  for(i = 0; i < NB_SAMPLES; i++) {
+
+    start_ns = now_ns();
+    aos_add(&aos, &samples[i], aos_sums);
+    if(i >= WINDOW_SAMPLES)
+      aos_ns += now_ns() - start_ns;
+
+    start_ns = now_ns();
+    soa_add(&soa, &samples[i], soa_sums);
+    if(i >= WINDOW_SAMPLES)
+      soa_ns += now_ns() - start_ns;
+
+    start_ns = now_ns();
+    packed_add(&packed, &samples[i], packed_sums);
+    if(i >= WINDOW_SAMPLES)
+      packed_ns += now_ns() - start_ns;
+
+    if(i >= WINDOW_SAMPLES)
+      nb_timed++;
+
+    if(!same_sums(aos_sums, soa_sums) || !same_sums(aos_sums, packed_sums))
+      nb_mismatches++;
+  }
+
+  printf("Layout              Bytes/sample  Window  ns/sample\n");
+  printf("Array of structures %12d %7d %10.0f\n", (int)sizeof(LRFSample),
+		aos.nb, (double)aos_ns / nb_timed);
+  printf("Structure of arrays %12d %7d %10.0f\n",
+		(int)(sizeof(uint64_t) + 3 * sizeof(float) +
+			3 * sizeof(uint16_t)),
+		soa.nb, (double)soa_ns / nb_timed);
+  printf("Packed store        %12d %7d %10.0f\n",
+		SAMPLE_STORE_BYTES_PER_SAMPLE, packed.nb,
+		(double)packed_ns / nb_timed);
+
+  if(nb_mismatches) {
+    printf("FAILED: the layouts reduced to different sums %d times\n",
+		nb_mismatches);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF frame decoder fuzzing harness. Runs on Linux - not part of the Flipper
+ * Zero app
+ *
+ * Build: make -C test			(corpus replay / AFL)
+ *        make -C test fuzz_frame_decoder_libfuzzer	(libFuzzer, clang)
+ *
+ * Usage:
+ *
+ * fuzz_frame_decoder [<input file> ...]
+ * fuzz_frame_decoder_libfuzzer [<libFuzzer options>] [corpus]
+ *
+ * Each input is a flags byte and a chunk size byte followed by the bytes
+ * fed into the decoder in chunks of that size. The flags select the 60000
+ * byte shared storage as the decode buffer instead of the 128 byte default
+ * decode buffer - as when downloading diagnostic data - the boot string
+ * mode, and a gap longer than the receive timeout between chunks.
+ *
+ * The decode buffer is followed by guard bytes, and the harness aborts if
+ * the decoder writes into them, or if an event reports lengths, pointers or
+ * strings that don't fit in the decode buffer or the decoded structures.
+ *
+ * Without arguments, the standalone harness runs one input read from stdin,
+ * which is what AFL expects
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lrf_frame_decoder.h"
+#include "fuzz_frame_decoder.h"
+
+
+
+/*** Defines ***/
+#define DEFAULT_DEC_BUF_SIZE 128	/* As in lrf_serial_comm.c */
+#define SHARED_STORAGE_SIZE 60000	/* As in common.h */
+#define RX_TIMEOUT 500			/* ms, as in parameters.c */
+#define GUARD_SIZE 256
+#define GUARD_BYTE 0xa5
+#define MAX_INPUT_SIZE (1024 * 1024)
+
+
+
+/*** Routines ***/
+
+/** Abort with a message, so the fuzzer records the input as a crash **/
+static void fail(char *msg) {
+
+  fprintf(stderr, "LRF frame decoder check failed: %s\n", msg);
+  abort();
+}
+
+
+
+/** Check that a string is terminated within its array **/
+#define CHECK_STR(str) \
+	if(!memchr(str, 0, sizeof(str))) \
+	  fail("unterminated " #str)
+
+
+
+/** Decoder event handler: check what the event reports **/
+static void evt_handler(LRFFrameDecoder *dec, LRFFrameEvent evt, void *ctx) {
+
+  uint8_t *dec_buf = (uint8_t *)ctx;
+  uint8_t *vals;
+
+  if(dec->nb_dec_buf > dec->dec_buf_size)
+    fail("decode buffer overrun");
+
+  switch(evt) {
+
+    case lrf_evt_ident:
+      CHECK_STR(dec->ident.id);
+      CHECK_STR(dec->ident.addinfo);
+      CHECK_STR(dec->ident.serial);
+      CHECK_STR(dec->ident.fwversion);
+      CHECK_STR(dec->ident.electronics);
+      CHECK_STR(dec->ident.optics);
+      CHECK_STR(dec->ident.builddate);
+      break;
+
+    case lrf_evt_boot_info:
+      CHECK_STR(dec->boot_info.id);
+      CHECK_STR(dec->boot_info.fwversion);
+      break;
+
+    /* The diagnostic values must fit in the decode buffer, and only point
+       into it once they're all received */
+    case lrf_evt_diag:
+      if(dec->diag.nb_vals > dec->diag.total_vals)
+        fail("more diagnostic values received than expected");
+      if(2 + dec->diag.total_vals * 2u + 1 > dec->dec_buf_size)
+        fail("diagnostic values larger than the decode buffer");
+      if(dec->diag.vals) {
+        vals = (uint8_t *)dec->diag.vals;
+        if(dec->diag.nb_vals != dec->diag.total_vals)
+          fail("incomplete diagnostic values reported");
+        if(vals < dec_buf || vals + dec->diag.total_vals * 2 >
+				dec_buf + dec->dec_buf_size)
+          fail("diagnostic values outside the decode buffer");
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+
+/** Run one input through the decoder **/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+
+  static uint8_t buf[SHARED_STORAGE_SIZE + GUARD_SIZE];
+  LRFFrameDecoder dec;
+  uint16_t dec_buf_size;
+  uint8_t flags;
+  uint32_t chunk_size, n, i;
+  uint64_t now_us = 0;
+
+  if(size < 2)
+    return 0;
+
+  flags = data[0];
+  chunk_size = data[1]? data[1] : 256;
+  data += 2;
+  size -= 2;
+
+  /* Set up the decode buffer followed by its guard bytes */
+  dec_buf_size = flags & FUZZ_FLAG_SHARED_STORAGE?
+			SHARED_STORAGE_SIZE : DEFAULT_DEC_BUF_SIZE;
+  memset(buf, GUARD_BYTE, dec_buf_size + GUARD_SIZE);
+
+  lrf_frame_decoder_init(&dec, buf, dec_buf_size, RX_TIMEOUT, evt_handler,
+			buf);
+  lrf_frame_decoder_set_boot_string_mode(&dec,
+					flags & FUZZ_FLAG_BOOT_STRING_MODE);
+
+  /* Feed the data in chunks */
+  for(i = 0; i < size; i += n) {
+
+    n = size - i < chunk_size? size - i : chunk_size;
+
+    now_us += flags & FUZZ_FLAG_RX_TIMEOUTS?
+			(RX_TIMEOUT + 100) * 1000 : n * 100;
+    lrf_frame_decoder_feed(&dec, (uint8_t *)data + i, n, now_us, now_us);
+
+    if(dec.nb_dec_buf > dec_buf_size)
+      fail("decode buffer overrun");
+  }
+
+  /* Check the guard bytes */
+  for(i = dec_buf_size; i < dec_buf_size + (uint32_t)GUARD_SIZE; i++)
+    if(buf[i] != GUARD_BYTE)
+      fail("write past the end of the decode buffer");
+
+  return 0;
+}
+
+
+
+#ifndef FUZZ_LIBFUZZER
+/** Read a whole file - or stdin if the path is NULL. Returns the number of
+    bytes read, or -1 on error **/
+static long read_input(char *path, uint8_t *data, long max_size) {
+
+  FILE *f = path? fopen(path, "rb") : stdin;
+  long size;
+
+  if(!f)
+    return -1;
+
+  size = fread(data, 1, max_size, f);
+  if(ferror(f))
+    size = -1;
+
+  if(path)
+    fclose(f);
+
+  return size;
+}
+
+
+
+/** Main routine: run the inputs given as arguments, or stdin **/
+int main(int argc, char **argv) {
+
+  static uint8_t data[MAX_INPUT_SIZE];
+  long size;
+  int i;
+
+  if(argc < 2) {
+    if((size = read_input(NULL, data, sizeof(data))) < 0) {
+      fprintf(stderr, "Could not read stdin\n");
+      return 1;
+    }
+    LLVMFuzzerTestOneInput(data, size);
+    return 0;
+  }
+
+  for(i = 1; i < argc; i++) {
+    if((size = read_input(argv[i], data, sizeof(data))) < 0) {
+      fprintf(stderr, "Could not read %s\n", argv[i]);
+      return 1;
+    }
+    LLVMFuzzerTestOneInput(data, size);
+  }
+
+  printf("%d input%s decoded without error\n", argc - 1,
+		argc > 2? "s" : "");
+
+  return 0;
+}
+#endif
@@ -0,0 +1,24 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF frame decoder fuzzing harness input format
+ *
+ * Each input is a flags byte, a chunk size byte - 0 meaning 256 - and the
+ * bytes fed into the decoder in chunks of that size. Runs on Linux - not
+ * part of the Flipper Zero app
+***/
+
+#pragma once
+
+/*** Defines ***/
+
+/* Decode into the 60000 byte shared storage instead of the default decode
+   buffer, as when downloading diagnostic data */
+#define FUZZ_FLAG_SHARED_STORAGE 0x01
+
+/* Decode LRF boot strings only */
+#define FUZZ_FLAG_BOOT_STRING_MODE 0x02
+
+/* Leave a gap longer than the receive timeout between chunks */
+#define FUZZ_FLAG_RX_TIMEOUTS 0x04
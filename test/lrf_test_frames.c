@@ -0,0 +1,161 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF test frames
+***/
+
+/*** Includes ***/
+#include <string.h>
+
+#include "lrf_test_frames.h"
+#include "../endian_loaders.h"
+
+
+
+/*** Routines ***/
+
+/** Deterministic pseudo-random number generator, so the streams are the same
+    on every run and every host **/
+uint32_t lrf_test_rand(uint32_t *seed) {
+
+  /* xorshift32 */
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+
+  return *seed;
+}
+
+
+
+/** Set the checkbyte at the end of a frame of a given total length **/
+void lrf_test_seal_frame(uint8_t *frame, uint32_t len) {
+
+  uint8_t checksum = 0;
+  uint32_t i;
+
+  for(i = 0; i < len - 1; i++)
+    checksum += frame[i];
+
+  frame[len - 1] = checksum ^ 0x50;
+}
+
+
+
+/** Store a little-endian float **/
+static void store_le_float(uint8_t *p, float v) {
+
+  uint32_t u;
+
+  memcpy(&u, &v, sizeof(u));
+  store_le_u32(p, u);
+}
+
+
+
+/** Build a range measurement frame with 3 distances in meters and their
+    amplitudes. Returns the length of the frame **/
+uint32_t lrf_test_range_meas_frame(uint8_t *frame, float dist1,
+					uint16_t ampl1, float dist2,
+					uint16_t ampl2, float dist3,
+					uint16_t ampl3) {
+
+  frame[0] = 0x59;
+  frame[1] = 0xcc;
+  store_le_float(frame + 2, dist1);
+  store_le_u16(frame + 6, ampl1);
+  store_le_float(frame + 8, dist2);
+  store_le_u16(frame + 12, ampl2);
+  store_le_float(frame + 14, dist3);
+  store_le_u16(frame + 18, ampl3);
+  frame[20] = 0;
+  lrf_test_seal_frame(frame, LRF_TEST_RANGE_MEAS_LEN);
+
+  return LRF_TEST_RANGE_MEAS_LEN;
+}
+
+
+
+/** Build an identification frame. Returns the length of the frame **/
+uint32_t lrf_test_ident_frame(uint8_t *frame) {
+
+  memset(frame, ' ', LRF_TEST_IDENT_LEN);
+
+  frame[0] = 0x59;
+  frame[1] = 0xc0;
+  memcpy(frame + 2, "LRF1234", 7);
+  memcpy(frame + 17, "\r\n", 2);
+  memcpy(frame + 19, "TEST", 4);
+  memcpy(frame + 34, "\r\n", 2);
+  memcpy(frame + 36, "123456", 6);
+  memcpy(frame + 46, "\r\n", 2);
+  store_le_u16(frame + 48, 0x1501);
+  frame[50] = 3;
+  frame[51] = 2;
+  memcpy(frame + 52, "24.01.31\r\n12:00:00", 18);
+  frame[70] = 0;
+  frame[71] = 0;
+  lrf_test_seal_frame(frame, LRF_TEST_IDENT_LEN);
+
+  return LRF_TEST_IDENT_LEN;
+}
+
+
+
+/** Build an information frame. Returns the length of the frame **/
+uint32_t lrf_test_info_frame(uint8_t *frame) {
+
+  uint8_t i;
+
+  frame[0] = 0x59;
+  frame[1] = 0xc2;
+  for(i = 2; i < LRF_TEST_INFO_LEN - 1; i++)
+    frame[i] = i * 7;
+  lrf_test_seal_frame(frame, LRF_TEST_INFO_LEN);
+
+  return LRF_TEST_INFO_LEN;
+}
+
+
+
+/** Build a read diagnostic data frame with a given data count and histogram
+    length. Returns the length of the frame **/
+uint32_t lrf_test_diag_frame(uint8_t *frame, uint16_t data_count,
+				uint16_t histogram_len) {
+
+  uint32_t len = 6 + (data_count - 1) * 2 + histogram_len * 2 + 1;
+  uint32_t i;
+
+  frame[0] = 0x59;
+  frame[1] = 0xdc;
+  store_le_u16(frame + 2, data_count);
+  store_le_u16(frame + 4, histogram_len);
+  for(i = 6; i < len - 1; i++)
+    frame[i] = i;
+  lrf_test_seal_frame(frame, len);
+
+  return len;
+}
+
+
+
+/** Build a stream of consecutive range measurement frames with distances
+    drifting randomly, as sent by the LRF in continuous measurement mode.
+    Returns the length of the stream **/
+uint32_t lrf_test_cmm_stream(uint8_t *stream, uint32_t nb_frames,
+				uint32_t seed) {
+
+  float dist = 100;
+  uint32_t len = 0;
+  uint32_t i;
+
+  for(i = 0; i < nb_frames; i++) {
+    dist += ((int32_t)(lrf_test_rand(&seed) % 201) - 100) / 1000.0f;
+    len += lrf_test_range_meas_frame(stream + len, dist,
+					1000 + lrf_test_rand(&seed) % 100,
+					dist + 20, 500, 0, 0);
+  }
+
+  return len;
+}
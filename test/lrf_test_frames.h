@@ -0,0 +1,53 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF test frames
+ *
+ * Builds valid LRF response frames and deterministic byte streams for the
+ * host tests and benchmarks. Runs on Linux - not part of the Flipper Zero app
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+/*** Defines ***/
+#define LRF_TEST_RANGE_MEAS_LEN 22	/* bytes */
+#define LRF_TEST_IDENT_LEN 73		/* bytes */
+#define LRF_TEST_INFO_LEN 40		/* bytes */
+
+
+
+/*** Routines ***/
+
+/** Deterministic pseudo-random number generator, so the streams are the same
+    on every run and every host **/
+uint32_t lrf_test_rand(uint32_t *);
+
+/** Set the checkbyte at the end of a frame of a given total length **/
+void lrf_test_seal_frame(uint8_t *, uint32_t);
+
+/** Build a range measurement frame with 3 distances in meters and their
+    amplitudes. Returns the length of the frame **/
+uint32_t lrf_test_range_meas_frame(uint8_t *, float, uint16_t, float,
+					uint16_t, float, uint16_t);
+
+/** Build an identification frame. Returns the length of the frame **/
+uint32_t lrf_test_ident_frame(uint8_t *);
+
+/** Build an information frame. Returns the length of the frame **/
+uint32_t lrf_test_info_frame(uint8_t *);
+
+/** Build a read diagnostic data frame with a given data count and histogram
+    length. Returns the length of the frame **/
+uint32_t lrf_test_diag_frame(uint8_t *, uint16_t, uint16_t);
+
+/** Build a stream of consecutive range measurement frames with distances
+    drifting randomly, as sent by the LRF in continuous measurement mode.
+    Returns the length of the stream **/
+uint32_t lrf_test_cmm_stream(uint8_t *, uint32_t, uint32_t);
@@ -0,0 +1,203 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF frame decoder fuzzing corpus generator. Runs on Linux - not part of
+ * the Flipper Zero app
+ *
+ * Build: make -C test
+ *
+ * Usage:
+ *
+ * make_fuzz_corpus <corpus directory>
+ *
+ * Writes the seed inputs of the fuzzing harness: continuous measurement
+ * streams, identification and information frames, diagnostic data frames
+ * filling the shared storage or too long for it, boot strings in boot
+ * garbage, receive timeouts and bit errors. The inputs are the same on every
+ * run, so the corpus committed in test/corpus can be regenerated with
+ * make -C test corpus
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lrf_test_frames.h"
+#include "fuzz_frame_decoder.h"
+
+
+
+/*** Defines ***/
+#define MAX_INPUT_SIZE 65536
+#define BOOT_STRING "\n\rLRF1234 V1.5.1\r\n"
+
+
+
+/*** Global variables ***/
+static uint8_t input[MAX_INPUT_SIZE];
+static uint32_t input_len;
+static uint32_t seed = 1;
+
+
+
+/*** Routines ***/
+
+/** Start an input with its flags and chunk size **/
+static void start_input(uint8_t flags, uint8_t chunk_size) {
+
+  input[0] = flags;
+  input[1] = chunk_size;
+  input_len = 2;
+}
+
+
+
+/** Append continuous measurement frames to the input **/
+static void add_cmm(uint32_t nb_frames) {
+
+  input_len += lrf_test_cmm_stream(input + input_len, nb_frames,
+					lrf_test_rand(&seed));
+}
+
+
+
+/** Append random bytes to the input **/
+static void add_garbage(uint32_t len) {
+
+  uint32_t i;
+
+  for(i = 0; i < len; i++)
+    input[input_len++] = lrf_test_rand(&seed);
+}
+
+
+
+/** Append a string to the input **/
+static void add_string(char *str) {
+
+  memcpy(input + input_len, str, strlen(str));
+  input_len += strlen(str);
+}
+
+
+
+/** Flip random bits in the input after the flags and chunk size **/
+static void add_bit_errors(uint32_t nb_bit_errors) {
+
+  uint32_t i;
+
+  for(i = 0; i < nb_bit_errors; i++)
+    input[2 + lrf_test_rand(&seed) % (input_len - 2)] ^=
+					1 << lrf_test_rand(&seed) % 8;
+}
+
+
+
+/** Write the input to a file in the corpus directory. Returns false if it
+    couldn't be written **/
+static bool write_input(char *dir, char *name) {
+
+  char path[256];
+  FILE *f;
+  bool ok;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+  if(!(f = fopen(path, "wb")))
+    return false;
+  ok = fwrite(input, 1, input_len, f) == input_len;
+
+  return !fclose(f) && ok;
+}
+
+
+
+/** Main routine **/
+int main(int argc, char **argv) {
+
+  char *dir;
+  bool ok = true;
+
+  if(argc != 2) {
+    fprintf(stderr, "Usage: %s <corpus directory>\n", argv[0]);
+    return 1;
+  }
+  dir = argv[1];
+
+  /* Continuous measurement, one frame per chunk and frames split across
+     chunks */
+  start_input(0, LRF_TEST_RANGE_MEAS_LEN);
+  add_cmm(100);
+  ok &= write_input(dir, "cmm_frame_chunks");
+
+  start_input(0, 5);
+  add_cmm(100);
+  ok &= write_input(dir, "cmm_split_chunks");
+
+  /* Identification and information frames between samples */
+  start_input(0, 16);
+  add_cmm(2);
+  input_len += lrf_test_ident_frame(input + input_len);
+  add_cmm(2);
+  input_len += lrf_test_info_frame(input + input_len);
+  add_cmm(2);
+  ok &= write_input(dir, "ident_info");
+
+  /* Diagnostic data filling most of the shared storage */
+  start_input(FUZZ_FLAG_SHARED_STORAGE, 0);
+  input_len += lrf_test_diag_frame(input + input_len, 1000, 28000);
+  add_cmm(2);
+  ok &= write_input(dir, "diag_large");
+
+  /* Diagnostic data 9 bytes too long for the shared storage */
+  start_input(FUZZ_FLAG_SHARED_STORAGE, 0);
+  input_len += lrf_test_diag_frame(input + input_len, 2, 30000);
+  add_cmm(2);
+  ok &= write_input(dir, "diag_too_large");
+
+  /* Diagnostic data too long for the default decode buffer */
+  start_input(0, 32);
+  input_len += lrf_test_diag_frame(input + input_len, 10, 100);
+  add_cmm(2);
+  ok &= write_input(dir, "diag_default_buf");
+
+  /* Boot strings in boot garbage, decoded in boot string mode and as frames
+     as happens before the app knows the LRF is booting */
+  start_input(FUZZ_FLAG_BOOT_STRING_MODE, 7);
+  add_garbage(2000);
+  add_string(BOOT_STRING);
+  add_garbage(500);
+  add_string(BOOT_STRING);
+  ok &= write_input(dir, "boot_garbage");
+
+  input[0] = 0;
+  add_cmm(10);
+  ok &= write_input(dir, "boot_garbage_frames");
+
+  /* Frames cut short by receive timeouts */
+  start_input(FUZZ_FLAG_RX_TIMEOUTS, 10);
+  add_cmm(20);
+  input_len += lrf_test_ident_frame(input + input_len);
+  ok &= write_input(dir, "rx_timeouts");
+
+  /* Mixed frames with bit errors */
+  start_input(0, 16);
+  add_cmm(50);
+  input_len += lrf_test_info_frame(input + input_len);
+  add_cmm(50);
+  input_len += lrf_test_ident_frame(input + input_len);
+  add_cmm(50);
+  input_len += lrf_test_diag_frame(input + input_len, 5, 20);
+  add_cmm(50);
+  add_bit_errors(40);
+  ok &= write_input(dir, "bit_errors");
+
+  if(!ok) {
+    fprintf(stderr, "Could not write the corpus in %s\n", dir);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,230 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Simulation of the handoff of the received bytes from the UART IRQ callback
+ * to the UART receive thread. Runs on Linux - not part of the Flipper Zero
+ * app
+ *
+ * Build: make -C test
+ *
+ * Usage:
+ *
+ * sim_uart_rx_wakeup [<wakeup threshold in bytes> [<wakeup timeout in ms>]]
+ *
+ * Simulates the LRF sending 100 Hz and 200 Hz continuous measurement frames
+ * - or back-to-back frames if the baudrate is too low - at each baudrate,
+ * and compares waking up the receive thread on every byte with waking it up
+ * on idle line, when the wakeup threshold is reached or when the wakeup
+ * timeout expires, as on_uart_irq_callback() and uart_rx_thread() do.
+ * Reports the thread wakeups per second and the latency between the end of
+ * a frame and the wakeup that hands it over to the thread, excluding the
+ * scheduling delays
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lrf_test_frames.h"
+
+
+
+/*** Defines ***/
+#define SIM_SECS 10
+#define DEFAULT_WAKEUP_THRESHOLD 64	/* bytes, as in parameters.c */
+#define DEFAULT_WAKEUP_TIMEOUT 20	/* ms, as in parameters.c */
+
+
+
+/*** Types ***/
+
+/** Simulation results **/
+typedef struct {
+
+  /* Number of bytes and frames received */
+  uint32_t nb_bytes;
+  uint32_t nb_frames;
+
+  /* Number of receive thread wakeups */
+  uint32_t nb_wakeups;
+
+  /* Sum and maximum of the latencies between the end of the frames and the
+     wakeups that handed them over to the thread, in microseconds */
+  double sum_latency_us;
+  double max_latency_us;
+
+} SimResults;
+
+/** Simulation state **/
+typedef struct {
+
+  /* Wakeup threshold in bytes and wakeup timeout in microseconds */
+  uint32_t threshold;
+  double timeout_us;
+
+  /* Bytes received by the IRQ callback since it last woke up the thread */
+  uint32_t nb_rx_since_wakeup;
+
+  /* Time of the last wakeup */
+  double last_wakeup_us;
+
+  /* Time between the start of the frames, and time from the start of a
+     frame to the arrival of its last byte */
+  double period_us;
+  double frame_us;
+
+  /* Frames handed over to the thread so far */
+  uint32_t nb_frames_handed_over;
+
+  SimResults res;
+
+} SimState;
+
+
+
+/*** Routines ***/
+
+/** Wake up the receive thread: it pulls all the bytes received so far **/
+static void wakeup(SimState *sim, double t_us) {
+
+  double latency_us;
+
+  sim->res.nb_wakeups++;
+  sim->last_wakeup_us = t_us;
+
+  /* Hand over the frames received completely so far */
+  for(; sim->nb_frames_handed_over < sim->res.nb_frames;
+	sim->nb_frames_handed_over++) {
+    latency_us = t_us - (sim->nb_frames_handed_over * sim->period_us +
+				sim->frame_us);
+    sim->res.sum_latency_us += latency_us;
+    if(latency_us > sim->res.max_latency_us)
+      sim->res.max_latency_us = latency_us;
+  }
+}
+
+
+
+/** Wake up the receive thread every time the wakeup timeout expires before
+    a given time without any other wakeup **/
+static void timeout_wakeups(SimState *sim, double t_us) {
+
+  while(sim->last_wakeup_us + sim->timeout_us <= t_us)
+    wakeup(sim, sim->last_wakeup_us + sim->timeout_us);
+}
+
+
+
+/** Simulate receiving frames at a given rate and baudrate, with a wakeup
+    threshold and timeout - or waking up the thread on every byte if the
+    threshold is 0 **/
+static void simulate(uint32_t baudrate, uint32_t rate_hz, uint32_t threshold,
+			uint32_t timeout_ms, SimResults *res) {
+
+  SimState sim = {0};
+  double char_us = 10e6 / baudrate;	/* 8N1: 10 bits per byte */
+  double period_us = 1e6 / rate_hz;
+  double frame_start_us, t_us, next_t_us;
+  uint32_t nb_frames, f, b;
+
+  /* The LRF can't send frames faster than the baudrate allows */
+  if(period_us < LRF_TEST_RANGE_MEAS_LEN * char_us)
+    period_us = LRF_TEST_RANGE_MEAS_LEN * char_us;
+
+  nb_frames = SIM_SECS * 1e6 / period_us;
+
+  sim.threshold = threshold;
+  sim.timeout_us = timeout_ms * 1000.0;
+  sim.period_us = period_us;
+  sim.frame_us = LRF_TEST_RANGE_MEAS_LEN * char_us;
+
+  for(f = 0; f < nb_frames; f++) {
+
+    frame_start_us = f * period_us;
+
+    for(b = 0; b < LRF_TEST_RANGE_MEAS_LEN; b++) {
+
+      /* The byte is received at the end of its stop bit */
+      t_us = frame_start_us + (b + 1) * char_us;
+
+      if(threshold)
+        timeout_wakeups(&sim, t_us);
+
+      sim.res.nb_bytes++;
+      sim.nb_rx_since_wakeup++;
+
+      if(b == LRF_TEST_RANGE_MEAS_LEN - 1)
+        sim.res.nb_frames++;
+
+      /* Wake up the thread on every byte without a threshold, or when
+         the threshold is reached */
+      if(!threshold || sim.nb_rx_since_wakeup >= threshold) {
+        sim.nb_rx_since_wakeup = 0;
+        wakeup(&sim, t_us);
+        continue;
+      }
+
+      /* The UART signals an idle line when no byte starts during one
+         character time after a byte */
+      next_t_us = b < LRF_TEST_RANGE_MEAS_LEN - 1? t_us + char_us :
+				frame_start_us + period_us + char_us;
+      if(next_t_us > t_us + 2 * char_us) {
+        timeout_wakeups(&sim, t_us + char_us);
+        if(sim.nb_rx_since_wakeup) {
+          sim.nb_rx_since_wakeup = 0;
+          wakeup(&sim, t_us + char_us);
+        }
+      }
+    }
+  }
+
+  *res = sim.res;
+}
+
+
+
+/** Main routine **/
+int main(int argc, char **argv) {
+
+  static const uint32_t baudrates[] = {9600, 19200, 38400, 57600, 115200};
+  static const uint32_t rates_hz[] = {100, 200};
+  uint32_t threshold = DEFAULT_WAKEUP_THRESHOLD;
+  uint32_t timeout_ms = DEFAULT_WAKEUP_TIMEOUT;
+  SimResults per_byte, batched;
+  uint8_t i, j;
+
+  if(argc > 1)
+    threshold = atoi(argv[1]);
+  if(argc > 2)
+    timeout_ms = atoi(argv[2]);
+
+  if(!threshold || !timeout_ms) {
+    fprintf(stderr, "The wakeup threshold and timeout must not be 0\n");
+    return 1;
+  }
+
+  printf("Wakeup threshold %d bytes, wakeup timeout %d ms\n\n", threshold,
+		timeout_ms);
+  printf("  Baud   Rate  Frames/s | Per byte: wakeups/s | "
+		"Batched: wakeups/s  lat avg  lat max\n");
+
+  for(i = 0; i < sizeof(baudrates) / sizeof(baudrates[0]); i++)
+    for(j = 0; j < sizeof(rates_hz) / sizeof(rates_hz[0]); j++) {
+
+      simulate(baudrates[i], rates_hz[j], 0, timeout_ms, &per_byte);
+      simulate(baudrates[i], rates_hz[j], threshold, timeout_ms, &batched);
+
+      printf("%6d %4d Hz %9.1f | %19.0f | %18.0f %6.2fms %6.2fms\n",
+		baudrates[i], rates_hz[j],
+		(double)batched.nb_frames / SIM_SECS,
+		(double)per_byte.nb_wakeups / SIM_SECS,
+		(double)batched.nb_wakeups / SIM_SECS,
+		batched.sum_latency_us / batched.nb_frames / 1000,
+		batched.max_latency_us / 1000);
+    }
+
+  return 0;
+}
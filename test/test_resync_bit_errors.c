@@ -0,0 +1,182 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF frame decoder resynchronization test. Runs on Linux - not part of the
+ * Flipper Zero app
+ *
+ * Build: make -C test
+ *
+ * Usage:
+ *
+ * test_resync_bit_errors [<capture file>]
+ *
+ * Injects random bit errors at increasing bit error rates into a 200 Hz
+ * continuous measurement stream - or into the raw bytes captured from a LRF
+ * in a file - and compares the samples lost by the decoder when it discards
+ * invalid frames and when it resynchronizes after them. Samples hit by a bit
+ * error - only counted in the built stream - are lost either way. Fails if
+ * resynchronizing loses more samples than discarding, or if it recovers no
+ * sample at all
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lrf_frame_decoder.h"
+#include "lrf_test_frames.h"
+
+
+
+/*** Defines ***/
+#define NB_FRAMES 20000
+#define FEED_CHUNK 16	/* bytes fed at once */
+
+
+
+/*** Prototypes ***/
+
+/* The decoder built without resynchronization, with its routines renamed */
+void noresync_lrf_frame_decoder_init(LRFFrameDecoder *, uint8_t *, uint16_t,
+				uint16_t, void (*)(LRFFrameDecoder *,
+						LRFFrameEvent, void *), void *);
+void noresync_lrf_frame_decoder_feed(LRFFrameDecoder *, uint8_t *, uint16_t,
+				uint64_t, uint64_t);
+
+
+
+/*** Routines ***/
+
+/** Decoder event handler: count the decoded samples **/
+static void evt_handler(LRFFrameDecoder *dec, LRFFrameEvent evt, void *ctx) {
+
+  (void)dec;
+
+  if(evt == lrf_evt_sample)
+    (*(uint32_t *)ctx)++;
+}
+
+
+
+/** Decode a stream in chunks with or without resynchronization. Returns the
+    number of samples decoded **/
+static uint32_t decode_stream(uint8_t *stream, uint32_t len, bool resync,
+				uint32_t *nb_recovered) {
+
+  static uint8_t dec_buf[128];
+  LRFFrameDecoder dec;
+  uint32_t nb_samples = 0;
+  uint32_t i, n;
+
+  if(resync)
+    lrf_frame_decoder_init(&dec, dec_buf, sizeof(dec_buf), 100,
+				evt_handler, &nb_samples);
+  else
+    noresync_lrf_frame_decoder_init(&dec, dec_buf, sizeof(dec_buf), 100,
+					evt_handler, &nb_samples);
+
+  for(i = 0; i < len; i += n) {
+    n = len - i < FEED_CHUNK? len - i : FEED_CHUNK;
+    if(resync)
+      lrf_frame_decoder_feed(&dec, stream + i, n, i, i);
+    else
+      noresync_lrf_frame_decoder_feed(&dec, stream + i, n, i, i);
+  }
+
+  if(nb_recovered)
+    *nb_recovered = dec.stats.nb_frames_recovered;
+
+  return nb_samples;
+}
+
+
+
+/** Main routine **/
+int main(int argc, char **argv) {
+
+  static const double bers[] = {1e-5, 1e-4, 3e-4, 1e-3, 3e-3};
+  uint8_t *stream, *corrupted;
+  uint32_t len, nb_samples, nb_clean, nb_discard, nb_resync, nb_recovered;
+  uint32_t nb_bit_errors, nb_hit, nb_recovered_total = 0;
+  uint32_t threshold, seed, i;
+  FILE *f;
+  long fsize;
+  uint8_t j, bit;
+  bool failed = false;
+
+  /* Read the capture if we got one, otherwise build the stream */
+  if(argc > 1) {
+
+    if(!(f = fopen(argv[1], "rb")) || fseek(f, 0, SEEK_END) ||
+		(fsize = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) ||
+		!(stream = malloc(fsize)) ||
+		fread(stream, 1, fsize, f) != (size_t)fsize) {
+      fprintf(stderr, "Could not read %s\n", argv[1]);
+      return 1;
+    }
+    fclose(f);
+    len = fsize;
+  }
+
+  else {
+    stream = malloc(NB_FRAMES * LRF_TEST_RANGE_MEAS_LEN);
+    len = lrf_test_cmm_stream(stream, NB_FRAMES, 1);
+  }
+
+  corrupted = malloc(len);
+
+  /* Count the samples in the clean stream */
+  nb_clean = decode_stream(stream, len, true, NULL);
+
+  printf("%d samples in the clean stream\n\n", nb_clean);
+  printf("     BER  Bit errors  Hit samples | Lost discarding  "
+		"Lost resyncing  Recovered\n");
+
+  for(j = 0; j < sizeof(bers) / sizeof(bers[0]); j++) {
+
+    /* Flip random bits */
+    memcpy(corrupted, stream, len);
+    threshold = bers[j] * 4294967296.0;
+    seed = 12345 + j;
+    nb_bit_errors = 0;
+    for(i = 0; i < len; i++)
+      for(bit = 0; bit < 8; bit++)
+        if(lrf_test_rand(&seed) < threshold) {
+          corrupted[i] ^= 1 << bit;
+          nb_bit_errors++;
+        }
+
+    /* Count the samples hit by a bit error if we know where the frames are */
+    nb_hit = 0;
+    if(argc <= 1)
+      for(i = 0; i < len; i += LRF_TEST_RANGE_MEAS_LEN)
+        nb_hit += memcmp(corrupted + i, stream + i,
+				LRF_TEST_RANGE_MEAS_LEN) != 0;
+
+    nb_discard = nb_clean - decode_stream(corrupted, len, false, NULL);
+    nb_samples = decode_stream(corrupted, len, true, &nb_recovered);
+    nb_resync = nb_clean > nb_samples? nb_clean - nb_samples : 0;
+
+    printf("%8.0e %11d %12d | %15d %15d %10d\n", bers[j], nb_bit_errors,
+		nb_hit, nb_discard, nb_resync, nb_recovered);
+
+    if(nb_resync > nb_discard) {
+      printf("FAILED: resynchronizing lost more samples than discarding\n");
+      failed = true;
+    }
+
+    nb_recovered_total += nb_recovered;
+  }
+
+  if(!nb_recovered_total) {
+    printf("FAILED: no sample recovered by resynchronizing\n");
+    failed = true;
+  }
+
+  free(corrupted);
+  free(stream);
+
+  return failed? 1 : 0;
+}
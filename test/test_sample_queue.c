@@ -0,0 +1,245 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * LRF sample queue stress test. Runs on Linux - not part of the Flipper Zero
+ * app
+ *
+ * Build: make -C test
+ *
+ * A producer thread standing in for the UART receive thread pushes samples
+ * into the queue while a consumer thread standing in for the sample
+ * processing thread pops them:
+ *
+ * - At 200 Hz for 2 seconds, with the consumer stalling for 250 ms halfway
+ *   through as it may when the display or the SD card holds it up. Fails if
+ *   a single sample is lost, reordered or corrupted
+ *
+ * - As fast as possible for 2 million samples, the producer pushing each
+ *   sample again until the queue has room for it. Fails if a single sample
+ *   is lost, reordered or corrupted, or if the pushes and the overflows
+ *   don't add up
+ *
+ * The threads yield the CPU when the queue is full or empty, so the test
+ * also runs on a single CPU
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "../sample_queue.h"
+
+
+
+/*** Defines ***/
+#define PACED_RATE_HZ 200
+#define PACED_NB_SAMPLES (PACED_RATE_HZ * 2)
+#define PACED_STALL_MS 250
+#define FAST_NB_SAMPLES 2000000
+
+
+
+/*** Types ***/
+
+/** Test state shared by the producer and the consumer **/
+typedef struct {
+
+  SampleQueue queue;
+
+  /* Number of samples to push, and interval between them in nanoseconds -
+     0 to push as fast as possible, pushing each sample again until the
+     queue has room for it */
+  uint32_t nb_samples;
+  uint32_t interval_ns;
+
+  /* Sample after which the consumer stalls, and for how long */
+  uint32_t stall_after;
+  uint32_t stall_ms;
+
+  /* Whether the producer is done pushing */
+  bool producer_done;
+
+  /* Number of samples popped, and number of samples popped out of order or
+     corrupted */
+  uint32_t nb_popped;
+  uint32_t nb_bad;
+
+} QueueTest;
+
+
+
+/*** Routines ***/
+
+/** Sleep for a number of nanoseconds **/
+static void sleep_ns(uint64_t ns) {
+
+  struct timespec ts = {ns / 1000000000, ns % 1000000000};
+
+  nanosleep(&ts, NULL);
+}
+
+
+
+/** Fill a sample with values all derived from its sequence number, so a
+    corrupted sample can be detected **/
+static void make_sample(LRFSample *sample, uint32_t seq) {
+
+  sample->dist1 = seq;
+  sample->dist2 = seq * 2.0f;
+  sample->dist3 = seq * 3.0f;
+  sample->ampl1 = seq;
+  sample->ampl2 = seq >> 16;
+  sample->ampl3 = ~seq;
+  sample->tstamp_us = (uint64_t)seq << 32 | seq;
+}
+
+
+
+/** Check that a sample was made from a sequence number **/
+static bool check_sample(LRFSample *sample, uint32_t seq) {
+
+  LRFSample expected;
+
+  make_sample(&expected, seq);
+
+  return sample->dist1 == expected.dist1 && sample->dist2 == expected.dist2 &&
+		sample->dist3 == expected.dist3 &&
+		sample->ampl1 == expected.ampl1 &&
+		sample->ampl2 == expected.ampl2 &&
+		sample->ampl3 == expected.ampl3 &&
+		sample->tstamp_us == expected.tstamp_us;
+}
+
+
+
+/** Producer thread **/
+static void *producer(void *ctx) {
+
+  QueueTest *test = (QueueTest *)ctx;
+  LRFSample sample;
+  uint32_t seq;
+
+  for(seq = 0; seq < test->nb_samples; seq++) {
+    make_sample(&sample, seq);
+    if(test->interval_ns) {
+      sample_queue_push(&test->queue, &sample);
+      sleep_ns(test->interval_ns);
+    }
+    else
+      while(!sample_queue_push(&test->queue, &sample))
+        sched_yield();
+  }
+
+  __atomic_store_n(&test->producer_done, true, __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+
+
+/** Consumer thread: check that the samples come out in order and intact **/
+static void *consumer(void *ctx) {
+
+  QueueTest *test = (QueueTest *)ctx;
+  LRFSample sample;
+  uint32_t next_seq = 0, seq;
+  bool done;
+
+  while(true) {
+
+    done = __atomic_load_n(&test->producer_done, __ATOMIC_ACQUIRE);
+
+    while(sample_queue_pop(&test->queue, &sample)) {
+
+      seq = sample.ampl1 | (uint32_t)sample.ampl2 << 16;
+      if(seq != next_seq || !check_sample(&sample, seq))
+        test->nb_bad++;
+      else
+        next_seq = seq + 1;
+
+      if(++test->nb_popped == test->stall_after)
+        sleep_ns(test->stall_ms * 1000000ULL);
+    }
+
+    /* Stop once the producer is done and the queue is drained */
+    if(done)
+      break;
+
+    /* Wait for more samples */
+    if(test->interval_ns)
+      sleep_ns(100000);
+    else
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+
+
+/** Run the producer and the consumer. Returns true if all the samples were
+    popped intact and in order, and the pushes and overflows add up **/
+static bool run_test(char *desc, QueueTest *test) {
+
+  pthread_t producer_thread, consumer_thread;
+  SampleQueueStats stats;
+
+  sample_queue_reset(&test->queue);
+  sample_queue_reset_stats(&test->queue);
+  test->producer_done = false;
+  test->nb_popped = 0;
+  test->nb_bad = 0;
+
+  pthread_create(&consumer_thread, NULL, consumer, test);
+  pthread_create(&producer_thread, NULL, producer, test);
+  pthread_join(producer_thread, NULL);
+  pthread_join(consumer_thread, NULL);
+
+  sample_queue_get_stats(&test->queue, &stats);
+
+  printf("%-22s pushed %9d popped %8d overflows %9d bad %d high water "
+		"mark %d/%d\n", desc, stats.nb_pushed, test->nb_popped,
+		stats.nb_overflows, test->nb_bad, stats.high_water_mark,
+		stats.size);
+
+  return test->nb_popped == test->nb_samples &&
+		test->nb_popped + stats.nb_overflows == stats.nb_pushed &&
+		!test->nb_bad;
+}
+
+
+
+/** Main routine **/
+int main(void) {
+
+  static QueueTest test;
+  bool failed = false;
+
+  /* 200 Hz with a consumer stall: no sample may be lost */
+  test.nb_samples = PACED_NB_SAMPLES;
+  test.interval_ns = 1000000000 / PACED_RATE_HZ;
+  test.stall_after = PACED_NB_SAMPLES / 2;
+  test.stall_ms = PACED_STALL_MS;
+
+  if(!run_test("200 Hz, 250 ms stall", &test)) {
+    printf("FAILED: samples lost or bad at 200 Hz\n");
+    failed = true;
+  }
+
+  /* Full speed, with the queue full most of the time */
+  test.nb_samples = FAST_NB_SAMPLES;
+  test.interval_ns = 0;
+  test.stall_after = 0;
+  test.stall_ms = 0;
+
+  if(!run_test("Full speed", &test)) {
+    printf("FAILED: samples lost or bad at full speed\n");
+    failed = true;
+  }
+
+  return failed? 1 : 0;
+}
@@ -0,0 +1,266 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Tracking filter replay test. Runs on Linux - not part of the Flipper Zero
+ * app
+ *
+ * Build: make -C test
+ *
+ * Replays synthetic trajectories of a target - standing still, approaching,
+ * receding, braking to a stop and turning around - sampled at 10 Hz and
+ * 100 Hz with measurement noise, missed measurements and outliers, through
+ * the tracking filter, and compares the error of its distance estimates with
+ * that of averaging the distances over the last second, as the sample view
+ * does with 1 second of buffering, and with that of the raw distances. The
+ * outliers are left out of the average and of the raw distances, so their
+ * errors are only the lag and the measurement noise. Also reports the error
+ * of the radial velocity estimates.
+ *
+ * Fails if the filter's distance estimates are worse than the averaged
+ * distances on a moving target, worse than the raw distances on a target
+ * that doesn't accelerate - the constant-velocity filter lags behind an
+ * accelerating target - if its velocity estimates are off by more than
+ * 1 m/s RMS, or if it loses the target
+***/
+
+/*** Includes ***/
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "../track_filter.h"
+#include "lrf_test_frames.h"
+
+
+
+/*** Defines ***/
+#define DURATION_S 20
+#define WARMUP_S 2
+#define AVG_WINDOW_US 1000000
+#define MAX_WINDOW_SAMPLES (100 * AVG_WINDOW_US / 1000000 + 1)
+#define MEAS_NOISE 0.05			/* m, standard deviation */
+#define MISS_PERCENT 5
+#define OUTLIER_PERCENT 1
+#define MAX_VEL_RMS_ERROR 1		/* m/s */
+
+/* As in parameters.c */
+#define TRACK_FILTER_ACCEL_NOISE 5	/* m/s^2, standard deviation */
+#define TRACK_FILTER_MEAS_NOISE 0.1	/* m, standard deviation */
+#define TRACK_FILTER_GATE 4		/* innovation standard deviations */
+#define TRACK_FILTER_MAX_MISSES 5	/* consecutive samples */
+
+
+
+/*** Types ***/
+
+/** Synthetic trajectory: initial distance, velocity and acceleration of the
+    target **/
+typedef struct {
+
+  char *name;
+  double dist;
+  double vel;
+  double accel;
+
+} Trajectory;
+
+/** Errors of one estimator over a replay **/
+typedef struct {
+
+  double sum_sq_err;
+  double sum_err;
+  uint32_t nb;
+
+} Errors;
+
+
+
+/*** Global variables ***/
+
+static const Trajectory trajectories[] = {
+  {"Still", 150, 0, 0},
+  {"Approach", 300, -10, 0},
+  {"Recede", 50, 10, 0},
+  {"Brake", 400, -20, 1},
+  {"Turn", 300, -20, 2},
+};
+
+static const uint16_t rates_hz[] = {10, 100};
+
+
+
+/*** Routines ***/
+
+/** Gaussian pseudo-random number with a null mean and a unit standard
+    deviation, with the Box-Muller transform **/
+static double gauss_rand(uint32_t *seed) {
+
+  double u1 = (lrf_test_rand(seed) + 1.0) / 4294967297.0;
+  double u2 = lrf_test_rand(seed) / 4294967296.0;
+
+  return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+
+
+/** Add an estimate's error to the errors of an estimator **/
+static void add_error(Errors *errs, double err) {
+
+  errs->sum_sq_err += err * err;
+  errs->sum_err += err;
+  errs->nb++;
+}
+
+
+
+/** RMS error of an estimator **/
+static double rms_error(Errors *errs) {
+
+  return errs->nb? sqrt(errs->sum_sq_err / errs->nb) : INFINITY;
+}
+
+
+
+/** Mean error of an estimator - the lag of the distance estimates on a
+    moving target **/
+static double mean_error(Errors *errs) {
+
+  return errs->nb? errs->sum_err / errs->nb : 0;
+}
+
+
+
+/** Replay a trajectory sampled at a given rate. Returns false if the test
+    fails **/
+static bool replay(const Trajectory *traj, uint16_t rate_hz) {
+
+  static float window_dists[MAX_WINDOW_SAMPLES];
+  static uint64_t window_tstamps_us[MAX_WINDOW_SAMPLES];
+  TrackFilter filter;
+  LRFSample sample;
+  Errors filter_errs, avg_errs, raw_errs, vel_errs;
+  uint32_t nb_samples = DURATION_S * rate_hz;
+  uint32_t nb_lost = 0, nb_window = 0, seed = 1;
+  uint32_t i, j, r;
+  double t, true_dist, true_vel, sum_window;
+  float dist, vel;
+  bool outlier, ok = true;
+
+  memset(&filter_errs, 0, sizeof(Errors));
+  memset(&avg_errs, 0, sizeof(Errors));
+  memset(&raw_errs, 0, sizeof(Errors));
+  memset(&vel_errs, 0, sizeof(Errors));
+  memset(&sample, 0, sizeof(sample));
+
+  track_filter_init(&filter, TRACK_FILTER_ACCEL_NOISE,
+			TRACK_FILTER_MEAS_NOISE, TRACK_FILTER_GATE,
+			TRACK_FILTER_MAX_MISSES);
+
+  for(i = 0; i < nb_samples; i++) {
+
+    /* Sample the trajectory with a little timing jitter */
+    sample.tstamp_us = (uint64_t)i * 1000000 / rate_hz +
+				lrf_test_rand(&seed) % 1000;
+    t = sample.tstamp_us / 1e6;
+    true_dist = traj->dist + traj->vel * t + traj->accel * t * t / 2;
+    true_vel = traj->vel + traj->accel * t;
+
+    /* Miss some measurements and return outliers from time to time */
+    r = lrf_test_rand(&seed) % 100;
+    outlier = r >= MISS_PERCENT && r < MISS_PERCENT + OUTLIER_PERCENT;
+    if(r < MISS_PERCENT)
+      sample.dist1 = 0;
+    else if(outlier)
+      sample.dist1 = 1 + lrf_test_rand(&seed) % 500;
+    else
+      sample.dist1 = true_dist + MEAS_NOISE * gauss_rand(&seed);
+
+    track_filter_add_sample(&filter, &sample);
+
+    /* Average the valid distances over the last second */
+    if(sample.dist1 > 0.5 && !outlier) {
+      window_dists[nb_window % MAX_WINDOW_SAMPLES] = sample.dist1;
+      window_tstamps_us[nb_window % MAX_WINDOW_SAMPLES] = sample.tstamp_us;
+      nb_window++;
+    }
+    sum_window = 0;
+    for(j = 0; j < nb_window && j < MAX_WINDOW_SAMPLES; j++) {
+      r = (nb_window - 1 - j) % MAX_WINDOW_SAMPLES;
+      if(sample.tstamp_us - window_tstamps_us[r] >= AVG_WINDOW_US)
+        break;
+      sum_window += window_dists[r];
+    }
+
+    if(t < WARMUP_S)
+      continue;
+
+    /* Compare the estimates with the true distance and velocity */
+    if(track_filter_get(&filter, 0, &dist, &vel)) {
+      add_error(&filter_errs, dist - true_dist);
+      add_error(&vel_errs, vel - true_vel);
+    }
+    else
+      nb_lost++;
+
+    if(j)
+      add_error(&avg_errs, sum_window / j - true_dist);
+
+    if(sample.dist1 > 0.5 && !outlier)
+      add_error(&raw_errs, sample.dist1 - true_dist);
+  }
+
+  printf("%-8s %3d Hz | %8.3f %8.3f | %8.3f %8.3f | %8.3f | %8.3f | %4d\n",
+		traj->name, rate_hz, rms_error(&filter_errs),
+		mean_error(&filter_errs), rms_error(&avg_errs),
+		mean_error(&avg_errs), rms_error(&raw_errs),
+		rms_error(&vel_errs), nb_lost);
+
+  if(!traj->accel &&
+	rms_error(&filter_errs) >= rms_error(&raw_errs)) {
+    printf("FAILED: the filtered distances are worse than the raw "
+		"distances\n");
+    ok = false;
+  }
+
+  if((traj->vel || traj->accel) &&
+	rms_error(&filter_errs) >= rms_error(&avg_errs)) {
+    printf("FAILED: the filtered distances are worse than the averaged "
+		"distances on a moving target\n");
+    ok = false;
+  }
+
+  if(rms_error(&vel_errs) > MAX_VEL_RMS_ERROR) {
+    printf("FAILED: the velocities are off by more than %d m/s RMS\n",
+		MAX_VEL_RMS_ERROR);
+    ok = false;
+  }
+
+  if(nb_lost) {
+    printf("FAILED: the filter lost the target %d times\n", nb_lost);
+    ok = false;
+  }
+
+  return ok;
+}
+
+
+
+/** Main routine **/
+int main(void) {
+
+  bool failed = false;
+  uint8_t i, j;
+
+  printf("                | Filter dist (m)   | 1 s average (m)   |  Raw (m) "
+		"| Vel (m/s)|\n");
+  printf("Target     Rate |      RMS      Lag |      RMS      Lag |      RMS "
+		"|      RMS | Lost\n");
+
+  for(i = 0; i < sizeof(trajectories) / sizeof(trajectories[0]); i++)
+    for(j = 0; j < sizeof(rates_hz) / sizeof(rates_hz[0]); j++)
+      failed |= !replay(&trajectories[i], rates_hz[j]);
+
+  return failed? 1 : 0;
+}
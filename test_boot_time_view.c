@@ -14,15 +14,11 @@
 
 /*** Routines ***/
 
-/** Time difference in milliseconds between system ticks in milliseconds,
-    taking the timestamp overflow into account **/
-static uint32_t ms_tick_time_diff_ms(uint32_t tstamp1, uint32_t tstamp2) {
+/** Time difference in milliseconds between timestamps in microseconds, or 0
+    if the first timestamp is earlier than the second **/
+static uint32_t us_time_diff_ms(uint64_t tstamp1, uint64_t tstamp2) {
 
-  if(tstamp1 >= tstamp2)
-    return tstamp1 - tstamp2;
-
-  else
-    return 0xffffffff - tstamp2 + 1 + tstamp1;
+  return tstamp1 > tstamp2? (tstamp1 - tstamp2) / 1000 : 0;
 }
 
 
@@ -43,9 +39,9 @@ static void lrf_boot_info_handler(LRFBootInfo *lrf_boot_info, void *ctx) {
   if(testboottime_model->await_boot_info) {
 
     /* Calculate the boot time */
-    testboottime_model->boot_time_ms = ms_tick_time_diff_ms(
-			testboottime_model->boot_info.boot_string_rx_tstamp,
-			testboottime_model->power_on_tstamp);
+    testboottime_model->boot_time_ms = us_time_diff_ms(
+			testboottime_model->boot_info.boot_string_rx_tstamp_us,
+			testboottime_model->power_on_tstamp_us);
 
     /* We're not waiting for a boot string anymore */
     testboottime_model->await_boot_info = false;
@@ -81,7 +77,7 @@ void testboottime_view_enter_callback(void *ctx) {
           testboottime_model->boot_time_ms = 0;
 
 	  /* Setup the callback to receive decoded LRF boot information */
-	  set_lrf_boot_info_handler(app->lrf_serial_comm_app, lrf_boot_info_handler,
+	  add_lrf_boot_info_handler(app->lrf_serial_comm_app, lrf_boot_info_handler,
 				app);
 
           /* Turn off the LRF */
@@ -96,7 +92,7 @@ void testboottime_view_enter_callback(void *ctx) {
 
           /* Turn the LRF back on and mark the power-on timestamp */
           FURI_LOG_I(TAG, "LRF power on");
-          power_lrf(true, &testboottime_model->power_on_tstamp);
+          power_lrf(true, &testboottime_model->power_on_tstamp_us);
 	},
 	false);
 }
@@ -108,8 +104,9 @@ void testboottime_view_exit_callback(void *ctx) {
 
   App *app = (App *)ctx;
 
-  /* Unset the callback to receive decoded LRF boot information */
-  set_lrf_boot_info_handler(app->lrf_serial_comm_app, NULL, app);
+  /* Remove the callback to receive decoded LRF boot information */
+  remove_lrf_boot_info_handler(app->lrf_serial_comm_app, lrf_boot_info_handler,
+				app);
 
   /* Stop the UART */
   stop_uart(app->lrf_serial_comm_app);
@@ -219,7 +216,7 @@ bool testboottime_view_input_callback(InputEvent *evt, void *ctx) {
 
     /* Turn the LRF back on and mark the power-on timestamp */
     FURI_LOG_I(TAG, "LRF power on");
-    power_lrf(true, &testboottime_model->power_on_tstamp);
+    power_lrf(true, &testboottime_model->power_on_tstamp_us);
 
     return true;
   }
@@ -129,7 +129,7 @@ void testlaser_view_enter_callback(void *ctx) {
   furi_hal_infrared_async_rx_set_timeout(test_laser_view_update_every * 1000);
 
   /* Setup the callback to receive decoded LRF samples */
-  set_lrf_sample_handler(app->lrf_serial_comm_app, lrf_sample_handler, app);
+  add_lrf_sample_handler(app->lrf_serial_comm_app, lrf_sample_handler, app);
 
   /* Start CMM rightaway */
   send_lrf_command(app->lrf_serial_comm_app, cmm_10hz);
@@ -173,14 +173,13 @@ void testlaser_view_exit_callback(void *ctx) {
   furi_timer_stop(app->test_laser_restart_cmm_timer);
   furi_timer_free(app->test_laser_restart_cmm_timer);
 
-  /* Send a CMM-break command unconditionally - 3 times to be sure */
-  send_lrf_command(app->lrf_serial_comm_app, cmm_break);
-  send_lrf_command(app->lrf_serial_comm_app, cmm_break);
+  /* Send a CMM-break command unconditionally. It is resent if the LRF doesn't
+     acknowledge it */
   send_lrf_command(app->lrf_serial_comm_app, cmm_break);
   app->pointer_is_on = false;	/* A CMM break turns the pointer off */
 
-  /* Unset the callback to receive decoded LRF samples */
-  set_lrf_sample_handler(app->lrf_serial_comm_app, NULL, app);
+  /* Remove the callback to receive decoded LRF samples */
+  remove_lrf_sample_handler(app->lrf_serial_comm_app, lrf_sample_handler, app);
 
   /* Stop the UART */
   stop_uart(app->lrf_serial_comm_app);
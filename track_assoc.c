@@ -0,0 +1,125 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Target association
+***/
+
+/*** Includes ***/
+#include <string.h>
+
+#include "track_assoc.h"
+
+
+
+/*** Constants ***/
+
+/** All the ways of assigning the 3 distance slots of a sample to the 3
+    tracks, the first one keeping the distances in their slots **/
+static const uint8_t assignments[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2},
+					{1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+
+
+
+/*** Routines ***/
+
+/** Cost of associating a distance with a track: the difference with the
+    track's last distance if it's within the gate, a gate's worth to start a
+    new track, and twice that to take over a track whose target is too far **/
+static float assoc_cost(TrackAssoc *assoc, AssocTrack *track, float dist) {
+
+  float diff;
+
+  if(!track->active)
+    return assoc->gate;
+
+  diff = dist > track->dist? dist - track->dist : track->dist - dist;
+
+  return diff <= assoc->gate? diff : 2 * assoc->gate;
+}
+
+
+
+/** Setup a target associator with its gate and miss parameters **/
+void track_assoc_init(TrackAssoc *assoc, float gate, uint8_t max_misses) {
+
+  assoc->gate = gate;
+  assoc->max_misses = max_misses;
+
+  track_assoc_reset(assoc);
+}
+
+
+
+/** Release all the tracks **/
+void track_assoc_reset(TrackAssoc *assoc) {
+
+  memset(assoc->tracks, 0, sizeof(assoc->tracks));
+}
+
+
+
+/** Move the distances and amplitudes of a LRF sample to the slots of the
+    tracks they're associated with, and update the tracks. Samples flagging
+    an error are left untouched **/
+void track_assoc_assign(TrackAssoc *assoc, LRFSample *lrf_sample) {
+
+  float dists[3] = {lrf_sample->dist1, lrf_sample->dist2, lrf_sample->dist3};
+  uint16_t ampls[3] = {lrf_sample->ampl1, lrf_sample->ampl2,
+			lrf_sample->ampl3};
+  float track_dists[3] = {0, 0, 0};
+  uint16_t track_ampls[3] = {0, 0, 0};
+  float cost, best_cost = 0;
+  uint8_t a, best_a = 0;
+  uint8_t i, t;
+  AssocTrack *track;
+
+  /* Leave samples flagging an error untouched */
+  if(dists[0] == 0.5f || dists[1] == 0.5f || dists[2] == 0.5f)
+    return;
+
+  /* Find the cheapest assignment of the valid distances to the tracks */
+  for(a = 0; a < 6; a++) {
+
+    cost = 0;
+    for(i = 0; i < 3; i++)
+      if(dists[i] > 0.5f)
+        cost += assoc_cost(assoc, &assoc->tracks[assignments[a][i]],
+				dists[i]);
+
+    if(!a || cost < best_cost) {
+      best_cost = cost;
+      best_a = a;
+    }
+  }
+
+  /* Update the tracks with the distances assigned to them */
+  for(i = 0; i < 3; i++)
+    if(dists[i] > 0.5f) {
+      t = assignments[best_a][i];
+      track = &assoc->tracks[t];
+
+      track->active = true;
+      track->dist = dists[i];
+      track->nb_misses = 0;
+
+      track_dists[t] = dists[i];
+      track_ampls[t] = ampls[i];
+    }
+
+  /* Release the tracks that went without a distance for too long */
+  for(t = 0; t < 3; t++) {
+    track = &assoc->tracks[t];
+    if(track->active && track_dists[t] == 0 &&
+		++track->nb_misses > assoc->max_misses)
+      track->active = false;
+  }
+
+  /* Put the distances and amplitudes in the slots of their tracks */
+  lrf_sample->dist1 = track_dists[0];
+  lrf_sample->dist2 = track_dists[1];
+  lrf_sample->dist3 = track_dists[2];
+  lrf_sample->ampl1 = track_ampls[0];
+  lrf_sample->ampl2 = track_ampls[1];
+  lrf_sample->ampl3 = track_ampls[2];
+}
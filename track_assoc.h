@@ -0,0 +1,69 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Target association
+ *
+ * Nearest-neighbour association of the distances returned by the LRF with
+ * persistent target tracks, with no dependency on the Flipper Zero firmware.
+ * The LRF returns up to 3 distances per sample in the order it finds them,
+ * so a target appearing or disappearing shifts the other targets to other
+ * distance slots. The association puts each distance back in the slot of
+ * the track of the target it belongs to, at a constant cost per sample
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lrf_frame_decoder.h"
+
+
+
+/*** Types ***/
+
+/** Target track **/
+typedef struct {
+
+  /* Whether the track is in use */
+  bool active;
+
+  /* Last distance associated with the track in meters */
+  float dist;
+
+  /* Number of consecutive samples without a distance for the track */
+  uint8_t nb_misses;
+
+} AssocTrack;
+
+/** Target associator **/
+typedef struct {
+
+  /* Largest difference in meters between a distance and the last distance
+     of a track for the distance to belong to the track's target */
+  float gate;
+
+  /* A track is released after this many consecutive misses */
+  uint8_t max_misses;
+
+  /* Tracks of the targets, in the order of the distance slots */
+  AssocTrack tracks[3];
+
+} TrackAssoc;
+
+
+
+/*** Routines ***/
+
+/** Setup a target associator with its gate and miss parameters **/
+void track_assoc_init(TrackAssoc *, float, uint8_t);
+
+/** Release all the tracks **/
+void track_assoc_reset(TrackAssoc *);
+
+/** Move the distances and amplitudes of a LRF sample to the slots of the
+    tracks they're associated with, and update the tracks. Samples flagging
+    an error are left untouched **/
+void track_assoc_assign(TrackAssoc *, LRFSample *);
@@ -0,0 +1,151 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Tracking filter
+***/
+
+/*** Includes ***/
+#include <string.h>
+#include <math.h>
+
+#include "track_filter.h"
+
+
+
+/*** Routines ***/
+
+/** Update the track of one target with a distance in meters measured at a
+    given time. Invalid distances only move the estimates forward in time **/
+static void update_track(TrackFilter *filter, Track *track, float dist,
+				uint64_t tstamp_us) {
+
+  bool valid = dist > 0.5f;
+  float dt, lambda, r, alpha, beta, innov;
+
+  /* Without a track, start one at the distance if it's valid */
+  if(track->state == track_none) {
+    if(valid) {
+      track->state = track_started;
+      track->dist = dist;
+      track->vel = 0;
+      track->tstamp_us = tstamp_us;
+      track->nb_misses = 0;
+    }
+    return;
+  }
+
+  /* Time elapsed since the previous estimate in seconds. A sample
+     timestamped before the previous estimate came in at the same time */
+  dt = tstamp_us > track->tstamp_us?
+		(tstamp_us - track->tstamp_us) / 1000000.0f : 0;
+  dt = dt < 0.000001f? 0.000001f : dt;
+  track->tstamp_us = tstamp_us > track->tstamp_us? tstamp_us :
+							track->tstamp_us;
+
+  /* A track with a distance estimate only gets its velocity estimate from
+     the second valid distance */
+  if(track->state == track_started) {
+    if(valid) {
+      track->vel = (dist - track->dist) / dt;
+      track->dist = dist;
+      track->state = track_locked;
+      track->nb_misses = 0;
+    }
+    else if(++track->nb_misses > filter->max_misses)
+      track->state = track_none;
+    return;
+  }
+
+  /* Predict the distance at the time of the sample */
+  track->dist += track->vel * dt;
+
+  /* Drop the track if the target has been missing for too long */
+  if(!valid) {
+    if(++track->nb_misses > filter->max_misses)
+      track->state = track_none;
+    return;
+  }
+
+  /* Work out the steady-state gains of the filter for the time step from
+     the tracking index - the ratio of the target's motion uncertainty to the
+     measurement uncertainty */
+  lambda = filter->accel_noise * dt * dt / filter->meas_noise;
+  r = (4 + lambda - sqrtf(8 * lambda + lambda * lambda)) / 4;
+  alpha = 1 - r * r;
+  beta = 2 * (2 - alpha) - 4 * sqrtf(1 - alpha);
+
+  /* Reject the distance as an outlier if the innovation is too large for
+     the innovation variance, which is meas_noise^2 / (1 - alpha) in the
+     steady state. If we keep rejecting distances, the target has moved
+     unexpectedly, so restart the track at the new distance */
+  innov = dist - track->dist;
+  if(innov * innov * r * r > filter->gate * filter->gate *
+				filter->meas_noise * filter->meas_noise) {
+    if(++track->nb_misses > filter->max_misses) {
+      track->state = track_started;
+      track->dist = dist;
+      track->vel = 0;
+      track->nb_misses = 0;
+    }
+    return;
+  }
+
+  /* Correct the estimates with the innovation */
+  track->dist += alpha * innov;
+  track->vel += beta / dt * innov;
+  track->nb_misses = 0;
+}
+
+
+
+/** Setup a tracking filter with its noise, gate and miss parameters **/
+void track_filter_init(TrackFilter *filter, float accel_noise,
+			float meas_noise, float gate, uint8_t max_misses) {
+
+  filter->accel_noise = accel_noise;
+  filter->meas_noise = meas_noise;
+  filter->gate = gate;
+  filter->max_misses = max_misses;
+
+  track_filter_reset(filter);
+}
+
+
+
+/** Drop the tracks of all the targets **/
+void track_filter_reset(TrackFilter *filter) {
+
+  memset(filter->tracks, 0, sizeof(filter->tracks));
+}
+
+
+
+/** Update the tracks of the targets with a new LRF sample **/
+void track_filter_add_sample(TrackFilter *filter, LRFSample *lrf_sample) {
+
+  update_track(filter, &filter->tracks[0], lrf_sample->dist1,
+		lrf_sample->tstamp_us);
+  update_track(filter, &filter->tracks[1], lrf_sample->dist2,
+		lrf_sample->tstamp_us);
+  update_track(filter, &filter->tracks[2], lrf_sample->dist3,
+		lrf_sample->tstamp_us);
+}
+
+
+
+/** Get the estimated distance and radial velocity of a target
+    Returns false if the target isn't tracked **/
+bool track_filter_get(TrackFilter *filter, uint8_t target, float *dist,
+			float *vel) {
+
+  Track *track = &filter->tracks[target];
+
+  if(track->state == track_none)
+    return false;
+
+  *dist = track->dist;
+  *vel = track->vel;
+
+  return true;
+}
@@ -0,0 +1,87 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Tracking filter
+ *
+ * Constant-velocity alpha-beta filter estimating the distance and radial
+ * velocity of each target from the successive LRF samples, with no
+ * dependency on the Flipper Zero firmware. The filter gains are worked out
+ * for each sample from the time elapsed since the previous estimate, so
+ * irregular sampling is handled, and distances too far from the predicted
+ * distance are rejected as outliers
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lrf_frame_decoder.h"
+
+
+
+/*** Types ***/
+
+/** Track states **/
+typedef enum {
+  track_none = 0,	/* No estimate */
+  track_started = 1,	/* Distance estimate only */
+  track_locked = 2,	/* Distance and velocity estimates */
+} TrackState;
+
+/** Track of one target **/
+typedef struct {
+
+  /* State of the track */
+  TrackState state;
+
+  /* Estimated distance in meters and radial velocity in meters per second -
+     positive when the target moves away - and time of the estimate */
+  float dist;
+  float vel;
+  uint64_t tstamp_us;
+
+  /* Number of consecutive samples without a valid distance for the target,
+     or with a distance rejected as an outlier */
+  uint8_t nb_misses;
+
+} Track;
+
+/** Tracking filter **/
+typedef struct {
+
+  /* Standard deviation of the targets' acceleration in meters per second
+     squared and of the LRF's distance measurement error in meters */
+  float accel_noise;
+  float meas_noise;
+
+  /* Distances are outliers if their innovation exceeds this many standard
+     deviations */
+  float gate;
+
+  /* The track of a target is dropped after this many consecutive misses */
+  uint8_t max_misses;
+
+  /* Tracks of the targets */
+  Track tracks[3];
+
+} TrackFilter;
+
+
+
+/*** Routines ***/
+
+/** Setup a tracking filter with its noise, gate and miss parameters **/
+void track_filter_init(TrackFilter *, float, float, float, uint8_t);
+
+/** Drop the tracks of all the targets **/
+void track_filter_reset(TrackFilter *);
+
+/** Update the tracks of the targets with a new LRF sample **/
+void track_filter_add_sample(TrackFilter *, LRFSample *);
+
+/** Get the estimated distance and radial velocity of a target
+    Returns false if the target isn't tracked **/
+bool track_filter_get(TrackFilter *, uint8_t, float *, float *);
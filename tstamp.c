@@ -0,0 +1,71 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Microsecond timestamps
+***/
+
+/*** Includes ***/
+#include <furi_hal.h>
+
+#include "tstamp.h"
+
+
+
+/*** Routines ***/
+
+/** Get the current time in microseconds as a monotonic 64-bit timestamp that
+    doesn't wrap around. May be called from an IRQ callback
+    The time is counted in CPU cycles by the DWT cycle counter, which the
+    firmware keeps running. The 32-bit cycle counter wraps around every 67
+    seconds at 64 MHz, so it's extended to 64 bits here, using the tick
+    counter to work out how many times it wrapped around if we weren't
+    called for that long **/
+uint64_t tstamp_us(void) {
+
+  static bool started = false;
+  static uint32_t prev_cyccnt;
+  static uint32_t prev_tick_ms;
+  static uint64_t nb_cycles;
+
+  uint32_t cycles_per_us = furi_hal_cortex_instructions_per_microsecond();
+  uint32_t cyccnt, tick_ms, delta_cycles;
+  uint64_t expected_cycles, us;
+
+  FURI_CRITICAL_ENTER();
+
+  cyccnt = DWT->CYCCNT;
+  tick_ms = furi_get_tick();
+
+  /* The first call starts the count at the uptime given by the tick
+     counter */
+  if(!started) {
+    nb_cycles = (uint64_t)tick_ms * 1000 * cycles_per_us;
+    started = true;
+  }
+
+  else {
+
+    /* Number of cycles elapsed since the previous call, modulo 2^32 */
+    delta_cycles = cyccnt - prev_cyccnt;
+
+    /* Add the wraparounds we missed: the tick counter tells us roughly how
+       many cycles actually elapsed, and the difference with the counted
+       cycles rounded to the nearest multiple of 2^32 is what we missed */
+    expected_cycles = (uint64_t)(tick_ms - prev_tick_ms) * 1000 *
+				cycles_per_us;
+    if(expected_cycles > delta_cycles)
+      nb_cycles += (expected_cycles - delta_cycles + 0x80000000) &
+			~(uint64_t)0xffffffff;
+
+    nb_cycles += delta_cycles;
+  }
+
+  prev_cyccnt = cyccnt;
+  prev_tick_ms = tick_ms;
+  us = nb_cycles / cycles_per_us;
+
+  FURI_CRITICAL_EXIT();
+
+  return us;
+}
@@ -0,0 +1,19 @@
+/***
+ * Noptel LRF rangefinder sampler for the Flipper Zero
+ * Version: 2.4
+ *
+ * Microsecond timestamps
+***/
+
+#pragma once
+
+/*** Includes ***/
+#include <stdint.h>
+
+
+
+/*** Routines ***/
+
+/** Get the current time in microseconds as a monotonic 64-bit timestamp that
+    doesn't wrap around. May be called from an IRQ callback **/
+uint64_t tstamp_us(void);